@@ -0,0 +1,76 @@
+/*********************************************************************
+ * FileName:        AppConfig.c
+ * Dependencies:    TCPIP.h
+ * Processor:       PIC18F67J60, x86/x86-64 Linux host
+ * Complier:        HI-TECH PICC-18 9.50PL3 or higher, gcc
+ *
+ * Default network configuration, shared by Principal.c and the host
+ * build's HostMain.c.  Both include this file after AppConfig.
+ ********************************************************************/
+static void FormatNetBIOSName(unsigned char Name[]);
+
+/*********************************************************************
+ * Function:        void InitAppConfig(void)
+ * PreCondition:    MPFSInit() is already called.
+ * Input:           None
+ * Output:          Write/Read non-volatile config variables.
+ * Side Effects:    None
+ * Overview:        None
+ * Note:            None
+ ********************************************************************/
+static const unsigned char SerializedMACAddress[6] =
+	{ MY_DEFAULT_MAC_BYTE1, MY_DEFAULT_MAC_BYTE2, MY_DEFAULT_MAC_BYTE3,
+	MY_DEFAULT_MAC_BYTE4, MY_DEFAULT_MAC_BYTE5, MY_DEFAULT_MAC_BYTE6
+};
+
+static void InitAppConfig(void)
+{
+	AppConfig.Flags.bIsDHCPEnabled = TRUE;
+	AppConfig.Flags.bInConfigMode = TRUE;
+	memcpypgm2ram((void *) &AppConfig.MyMACAddr,(const void *) SerializedMACAddress,sizeof(AppConfig.MyMACAddr));
+	AppConfig.MyIPAddr.Val =
+		MY_DEFAULT_IP_ADDR_BYTE1 | MY_DEFAULT_IP_ADDR_BYTE2 << 8ul |
+		MY_DEFAULT_IP_ADDR_BYTE3 << 16ul | MY_DEFAULT_IP_ADDR_BYTE4 <<
+		24ul;
+	AppConfig.DefaultIPAddr.Val = AppConfig.MyIPAddr.Val;
+	AppConfig.MyMask.Val =
+		MY_DEFAULT_MASK_BYTE1 | MY_DEFAULT_MASK_BYTE2 << 8ul |
+		MY_DEFAULT_MASK_BYTE3 << 16ul | MY_DEFAULT_MASK_BYTE4 << 24ul;
+	AppConfig.DefaultMask.Val = AppConfig.MyMask.Val;
+	AppConfig.MyGateway.Val =
+		MY_DEFAULT_GATE_BYTE1 | MY_DEFAULT_GATE_BYTE2 << 8ul |
+		MY_DEFAULT_GATE_BYTE3 << 16ul | MY_DEFAULT_GATE_BYTE4 << 24ul;
+	AppConfig.PrimaryDNSServer.Val =
+		MY_DEFAULT_PRIMARY_DNS_BYTE1 | MY_DEFAULT_PRIMARY_DNS_BYTE2 << 8ul
+		| MY_DEFAULT_PRIMARY_DNS_BYTE3 << 16ul |
+		MY_DEFAULT_PRIMARY_DNS_BYTE4 << 24ul;
+	AppConfig.SecondaryDNSServer.Val =
+		MY_DEFAULT_SECONDARY_DNS_BYTE1 | MY_DEFAULT_SECONDARY_DNS_BYTE2 <<
+		8ul | MY_DEFAULT_SECONDARY_DNS_BYTE3 << 16ul |
+		MY_DEFAULT_SECONDARY_DNS_BYTE4 << 24ul;
+	// Load the default NetBIOS Host Name
+	strncpypgm2ram((char *) AppConfig.NetBIOSName, MY_DEFAULT_HOST_NAME, 16);
+	FormatNetBIOSName(AppConfig.NetBIOSName);
+	return;
+}
+
+// NOTE: Name[] must be at least 16 characters long.
+// It should be exactly 16 characters, as defined by NetBIOS spec.
+static void FormatNetBIOSName(unsigned char Name[])
+{
+	unsigned char i;
+	Name[15] = '\0';
+	strupr((char *) Name);
+	i = 0;
+	while(i<15u)
+	{
+		if(Name[i]=='\0')
+		{
+			while(i<15u)
+				Name[i++]=' ';
+			break;
+		}
+		i++;
+	}
+	return;
+}
@@ -26,6 +26,37 @@ extern HTTP_CONN curHTTP;
 extern HTTP_STUB httpStubs[MAX_HTTP_CONNECTIONS];
 extern unsigned char curHTTPID;
 
+// Sample printed by the data.json and poll.json callbacks.  HTTPExecuteGet() copies 
+// it from the cache of Mod_Med_HT.c into curHTTP.data, so a response 
+// never waits for the sensor and all its fields come from one sample.
+typedef struct _HTTP_READING {
+	unsigned char vValid;		// TRUE if a sample exists and the sensor answered
+	unsigned char vHaveSample;	// TRUE if a sample exists at all
+	WORD wHumidityRaw;			// SHT1x readings as in Ultima_Medicion
+	WORD wTemperatureRaw;
+	SHORT sHumidity;			// Compensated %RH, in hundredths
+	SHORT sTemperature;			// Degrees C, in hundredths
+	DWORD dwAge;				// Seconds since the sample was taken
+	DWORD dwSequence;			// Cant_Mediciones when it was taken
+	DWORD dwFailures;			// Cant_Fallas
+} HTTP_READING;
+#define HTTPReading		(*(HTTP_READING *) curHTTP.data)
+
+// Seconds a poll.json request waits for a new sample before it answers 
+// with the current one.  Kept under the 30s idle limit of most proxies.
+#define HTTP_POLL_TIMEOUT	(25u)
+
+// State of a parked poll.json request, kept in curHTTP.data until 
+// HTTPLoadReading() replaces it with the sample.
+typedef struct _HTTP_POLL {
+	DWORD dwSequence;			// Last sample the client has seen
+	DWORD dwDeadline;			// Tick at which it gets an answer anyway
+} HTTP_POLL;
+#define HTTPPoll		(*(HTTP_POLL *) curHTTP.data)
+
+static void HTTPLoadReading(void);
+static void HTTPPrintFixed(LONG Value, unsigned char Decimals, BOOL Valid);
+
 /*********************************************************************
  * Function:        unsigned char HTTPAuthenticate(unsigned char *user, unsigned char *pass, unsigned char *filename)
  *
@@ -109,18 +140,21 @@ HTTPAuthenticate(unsigned char *user, unsigned char *pass,
  *
  * Side Effects:    None
  *
- * Overview:        This function is called if data was read from the
- *					HTTP request from either the GET arguments, or
- *					any cookies sent.  curHTTP.data contains
- *					sequential pairs of strings representing the
- *					data received.  Any required authentication has 
- *					already been validated.
+ * Overview:        This function is called for every GET of a file, 
+ *					and for other requests if data was read from 
+ *					either the GET arguments, or any cookies sent.  
+ *					curHTTP.data contains sequential pairs of strings 
+ *					representing the data received, or is empty.  
+ *					Any required authentication has already been 
+ *					validated.
  *
  * Note:            In this simple example, HTTPGetROMArg is used to 
  *					search for values associated with argument names.
  *					At this point, the application may overwrite/modify
  *					curHTTP.data if additional storage associated with
- *					a connection is needed.  Cookies may be set; see
+ *					a connection is needed.  curHTTP.callbackPos is 
+ *					zero on the first call and is kept across calls 
+ *					that return HTTP_IO_WAITING.  Cookies may be set; see
  *					HTTPExecutePostCookies for an example.  For 
  *					redirect functionality, set curHTTP.data to the 
  *					destination and change curHTTP.httpStatus to
@@ -134,26 +168,8 @@ HTTP_IO_RESULT HTTPExecuteGet(void)
 	// Make sure unsigned char filename[] above is large enough for your
 	// longest name
 	MPFSGetFilename(curHTTP.file, filename, 20);
-	// If its the forms.htm page
-	if (!memcmppgm2ram(filename, "forms.htm", 9)) {
-		// Seek out each of the four LED strings, and if it exists set the 
-		// 
-		// LED states
-		ptr = HTTPGetROMArg(curHTTP.data, (const unsigned char *) "led4");
-		if (ptr)
-			LED4_IO = (*ptr == '1');
-		ptr = HTTPGetROMArg(curHTTP.data, (const unsigned char *) "led3");
-		if (ptr)
-			LED3_IO = (*ptr == '1');
-		ptr = HTTPGetROMArg(curHTTP.data, (const unsigned char *) "led2");
-		if (ptr)
-			LED2_IO = (*ptr == '1');
-		ptr = HTTPGetROMArg(curHTTP.data, (const unsigned char *) "led1");
-		if (ptr)
-			LED1_IO = (*ptr == '1');
-	}
-	// If it's the LED updater file
-	else if (!memcmppgm2ram(filename, "cookies.htm", 11)) {
+	// If it's the cookie demo, store its name as a cookie
+	if (!memcmppgm2ram(filename, "cookies.htm", 11)) {
 		// This is very simple.  The names and values we want are already
 		// in
 		// the data array.  We just set the hasArgs value to indicate how
@@ -163,40 +179,71 @@ HTTP_IO_RESULT HTTPExecuteGet(void)
 		// remember to also add a dynamic variable callback to control the 
 		// 
 		// printout.
-		curHTTP.hasArgs = 0x01;
+		// This runs for every GET now, so without the name argument
+		// curHTTP.data holds no pair and no cookie is set.
+		if (HTTPGetROMArg(curHTTP.data, (const unsigned char *) "name") != NULL)
+			curHTTP.hasArgs = 0x01;
 	}
-	// If it's the LED updater file
-	else if (!memcmppgm2ram(filename, "leds.cgi", 8)) {
-		// Determine which LED to toggle
-		ptr = HTTPGetROMArg(curHTTP.data, (const unsigned char *) "led");
-		// Toggle the specified LED
-		switch (*ptr) {
-		case '1':
-			LED1_IO ^= 1;
-			break;
-		case '2':
-			LED2_IO ^= 1;
-			break;
-		case '3':
-			LED3_IO ^= 1;
-			break;
-		case '4':
-			LED4_IO ^= 1;
-			break;
-		case '5':
-			LED5_IO ^= 1;
-			break;
-		case '6':
-			LED6_IO ^= 1;
-			break;
-		case '7':
-			LED7_IO ^= 1;
-			break;
+	// If it's the measurement data, take the sample it prints
+	else if (!memcmppgm2ram(filename, "data.json", 9)) {
+		HTTPLoadReading();
+	}
+	// If it's the long poll, park the request until a sample the client 
+	// hasn't seen is taken.  Any other sequence number counts, so a 
+	// client also learns at once that the board has restarted.
+	else if (!memcmppgm2ram(filename, "poll.json", 9)) {
+		if (curHTTP.callbackPos == 0) {
+			ptr = HTTPGetROMArg(curHTTP.data, (const unsigned char *) "seq");
+			if (ptr == NULL) {
+				HTTPLoadReading();
+				return HTTP_IO_DONE;
+			}
+			HTTPPoll.dwSequence = (DWORD) atol((char *) ptr);
+			HTTPPoll.dwDeadline = TickGet() + HTTP_POLL_TIMEOUT * TICK_SECOND;
+			curHTTP.callbackPos = 1;
 		}
+		if (Cant_Mediciones == HTTPPoll.dwSequence
+			&& TickGet() <= HTTPPoll.dwDeadline)
+			return HTTP_IO_WAITING;
+		HTTPLoadReading();
 	}
 	return HTTP_IO_DONE;
 }
 
+/*********************************************************************
+ * Function:        static void HTTPLoadReading(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          HTTPReading holds the latest sample
+ *
+ * Side Effects:    Overwrites curHTTP.data, including any GET args
+ *
+ * Overview:        Copies the last reading of Medicion_HT() and its 
+ *					derived values into curHTTP.data for the 
+ *					HTTPPrint_ht_* callbacks.
+ *
+ * Note:            Never measures: Medicion_Periodica() keeps the 
+ *					cache fresh and takes tens of milliseconds.
+ ********************************************************************/
+static void HTTPLoadReading(void)
+{
+	HTTPReading.vHaveSample = Hay_Medicion;
+	HTTPReading.wHumidityRaw =
+		((WORD) Ultima_Medicion[0] << 8) | Ultima_Medicion[1];
+	HTTPReading.wTemperatureRaw =
+		((WORD) Ultima_Medicion[2] << 8) | Ultima_Medicion[3];
+	HTTPReading.vValid = Medicion_Valida();
+	HTTPReading.sTemperature = Temperatura_Centesimas();
+	HTTPReading.sHumidity = Humedad_Centesimas();
+	HTTPReading.dwAge = (TickGetDiv256() - Tick_Ultima_Medicion)
+		/ (DWORD) (TICKS_PER_SECOND / 256ull);
+	HTTPReading.dwSequence = Cant_Mediciones;
+	HTTPReading.dwFailures = Cant_Fallas;
+}
+
 #if defined(HTTP_USE_POST)
 /*********************************************************************
  * Function:        HTTP_IO_RESULT HTTPExecutePost(void)
@@ -631,175 +678,22 @@ static HTTP_IO_RESULT HTTPPostMD5(void)
  *					next call.
  ********************************************************************/
 
-const unsigned char HTML_UP_ARROW[] = "up";
-const unsigned char HTML_DOWN_ARROW[] = "dn";
-
-void HTTPPrint_btn0(void)
-{
-	TCPPutROMArray(sktHTTP, (BUTTON0_IO ? HTML_UP_ARROW : HTML_DOWN_ARROW),
-				   2);
-	return;
-}
-
-void HTTPPrint_btn1(void)
-{
-	TCPPutROMArray(sktHTTP, (BUTTON1_IO ? HTML_UP_ARROW : HTML_DOWN_ARROW),
-				   2);
-	return;
-}
-
-void HTTPPrint_btn2(void)
-{
-	TCPPutROMArray(sktHTTP, (BUTTON2_IO ? HTML_UP_ARROW : HTML_DOWN_ARROW),
-				   2);
-	return;
-}
-
-void HTTPPrint_btn3(void)
-{
-	TCPPutROMArray(sktHTTP, (BUTTON3_IO ? HTML_UP_ARROW : HTML_DOWN_ARROW),
-				   2);
-	return;
-}
-
-void HTTPPrint_led1(void)
-{
-	TCPPut(sktHTTP, (LED1_IO ? '1' : '0'));
-	return;
-}
-
-void HTTPPrint_led2(void)
-{
-	TCPPut(sktHTTP, (LED2_IO ? '1' : '0'));
-	return;
-}
-
-void HTTPPrint_led3(void)
-{
-	TCPPut(sktHTTP, (LED3_IO ? '1' : '0'));
-	return;
-}
-
-void HTTPPrint_led4(void)
-{
-	TCPPut(sktHTTP, (LED4_IO ? '1' : '0'));
-	return;
-}
-
-void HTTPPrint_led5(void)
-{
-	TCPPut(sktHTTP, (LED5_IO ? '1' : '0'));
-	return;
-}
-
-void HTTPPrint_led6(void)
-{
-	TCPPut(sktHTTP, (LED6_IO ? '1' : '0'));
-	return;
-}
-
-void HTTPPrint_led7(void)
-{
-	TCPPut(sktHTTP, (LED7_IO ? '1' : '0'));
-	return;
-}
-
-const unsigned char HTML_SELECTED[] = "selected";
-void HTTPPrint_led4selected(void)
-{
-	if (LED4_IO)
-		TCPPutROMArray(sktHTTP, HTML_SELECTED, 8);
-	return;
-}
-
-void HTTPPrint_led4notselected(void)
-{
-	if (!LED4_IO)
-		TCPPutROMArray(sktHTTP, HTML_SELECTED, 8);
-	return;
-}
-
-void HTTPPrint_led3selected(void)
-{
-	if (LED3_IO)
-		TCPPutROMArray(sktHTTP, HTML_SELECTED, 8);
-	return;
-}
-
-void HTTPPrint_led3notselected(void)
-{
-	if (!LED3_IO)
-		TCPPutROMArray(sktHTTP, HTML_SELECTED, 8);
-	return;
-}
-
-void HTTPPrint_led2selected(void)
-{
-	if (LED2_IO)
-		TCPPutROMArray(sktHTTP, HTML_SELECTED, 8);
-	return;
-}
-
-void HTTPPrint_led2notselected(void)
-{
-	if (!LED2_IO)
-		TCPPutROMArray(sktHTTP, HTML_SELECTED, 8);
-	return;
-}
-
-void HTTPPrint_led1selected(void)
-{
-	if (LED1_IO)
-		TCPPutROMArray(sktHTTP, HTML_SELECTED, 8);
-	return;
-}
-
-void HTTPPrint_led1notselected(void)
-{
-	if (!LED1_IO)
-		TCPPutROMArray(sktHTTP, HTML_SELECTED, 8);
-	return;
-}
-
-void HTTPPrint_pot0(void)
-{
-	char AN0String[8];
-	unsigned short int ADval;
-#if __C30__
-	ADval = (unsigned short int) ADC1BUF0;
-	// ADval *= (unsigned short int)10;
-	// ADval /= (unsigned short int)102;
-	uitoa(ADval, (unsigned char *) AN0String);
-#else
-	// Wait until A/D conversion is done
-	ADCON0bits.GO = 1;
-	while (ADCON0bits.GO);
-
-	// Convert 10-bit value into ASCII string
-	ADval = (unsigned short int) ADRES;
-	// ADval *= (unsigned short int)10;
-	// ADval /= (unsigned short int)102;
-	uitoa(ADval, AN0String);
-#endif
-	TCPPutArray(sktHTTP, (void *) AN0String, strlen((char *) AN0String));
-}
-
 void HTTPPrint_version(void)
 {
 	TCPPutROMArray(sktHTTP, (const void *) VERSION,
 				   strlenpgm((const char *) VERSION));
 }
 
-void HTTPPrint_hiddenLED0(void)
-{
-	TCPPut(sktHTTP, (LED0_IO ? '1' : '0'));
-	return;
-}
-
 void HTTPPrint_builddate(void)
 {
+	// 20 bytes, more than HTTP_MIN_CALLBACK_FREE guarantees
+	if (TCPIsPutReady(sktHTTP) < strlenpgm((const char *) __DATE__ " " __TIME__)) {
+		curHTTP.callbackPos = 0x01;
+		return;
+	}
 	TCPPutROMArray(sktHTTP, (const void *) __DATE__ " " __TIME__,
 				   strlenpgm((const char *) __DATE__ " " __TIME__));
+	curHTTP.callbackPos = 0x00;
 }
 
 void HTTPPrint_lcdtext(void)
@@ -982,4 +876,52 @@ void HTTPPrint_rebootaddr(void)
 	TCPPutArray(sktHTTP, curHTTP.data, strlen((char *) curHTTP.data));
 }
 
+// Writes a fixed-point value, or a JSON null for missing data
+static void HTTPPrintFixed(LONG Value, unsigned char Decimals, BOOL Valid)
+{
+	unsigned char digits[13];
+
+	if (!Valid) {
+		TCPPutROMArray(sktHTTP, (const unsigned char *) "null", 4);
+		return;
+	}
+	fixtoa(Value, Decimals, digits);
+	TCPPutArray(sktHTTP, digits, strlen((char *) digits));
+}
+
+void HTTPPrint_ht_seq(void)
+{
+	HTTPPrintFixed((LONG) HTTPReading.dwSequence, 0, TRUE);
+}
+
+void HTTPPrint_ht_age(void)
+{
+	HTTPPrintFixed((LONG) HTTPReading.dwAge, 0, HTTPReading.vHaveSample);
+}
+
+void HTTPPrint_ht_temp(void)
+{
+	HTTPPrintFixed(HTTPReading.sTemperature, 2, HTTPReading.vValid);
+}
+
+void HTTPPrint_ht_hum(void)
+{
+	HTTPPrintFixed(HTTPReading.sHumidity, 2, HTTPReading.vValid);
+}
+
+void HTTPPrint_ht_rhraw(void)
+{
+	HTTPPrintFixed(HTTPReading.wHumidityRaw, 0, HTTPReading.vValid);
+}
+
+void HTTPPrint_ht_traw(void)
+{
+	HTTPPrintFixed(HTTPReading.wTemperatureRaw, 0, HTTPReading.vValid);
+}
+
+void HTTPPrint_ht_fail(void)
+{
+	HTTPPrintFixed((LONG) HTTPReading.dwFailures, 0, TRUE);
+}
+
 #endif
@@ -30,6 +30,13 @@ void HTTPPrint_config_gw(void);
 void HTTPPrint_config_subnet(void);
 void HTTPPrint_config_dns1(void);
 void HTTPPrint_config_dns2(void);
+void HTTPPrint_ht_seq(void);
+void HTTPPrint_ht_age(void);
+void HTTPPrint_ht_temp(void);
+void HTTPPrint_ht_hum(void);
+void HTTPPrint_ht_rhraw(void);
+void HTTPPrint_ht_traw(void);
+void HTTPPrint_ht_fail(void);
 
 void HTTPPrint(DWORD callbackID)
 {
@@ -74,6 +81,27 @@ void HTTPPrint(DWORD callbackID)
 		case 0x00000027:
 			HTTPPrint_config_dns2();
 			break;
+		case 0x00000028:
+			HTTPPrint_ht_seq();
+			break;
+		case 0x00000029:
+			HTTPPrint_ht_age();
+			break;
+		case 0x0000002a:
+			HTTPPrint_ht_temp();
+			break;
+		case 0x0000002b:
+			HTTPPrint_ht_hum();
+			break;
+		case 0x0000002c:
+			HTTPPrint_ht_rhraw();
+			break;
+		case 0x0000002d:
+			HTTPPrint_ht_traw();
+			break;
+		case 0x0000002e:
+			HTTPPrint_ht_fail();
+			break;
 		default:
 			// Output notification for undefined values
 			TCPPutROMArray(sktHTTP, (ROM BYTE*)"!DEF", 4);
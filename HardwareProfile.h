@@ -110,10 +110,30 @@ typedef struct {
 	unsigned char HLVDIF:1;
 	unsigned char BCLIF:1;
 	unsigned char EEIF:1;
-	unsigned char:1;
+	unsigned char ETHIF:1;
 	unsigned char CMIF:1;
 	unsigned char OSCFIF:1;
 } PIR2bits;
+typedef struct {
+	unsigned char CCP2IE:1;
+	unsigned char TMR3IE:1;
+	unsigned char HLVDIE:1;
+	unsigned char BCLIE:1;
+	unsigned char EEIE:1;
+	unsigned char ETHIE:1;
+	unsigned char CMIE:1;
+	unsigned char OSCFIE:1;
+} PIE2bits;
+typedef struct {
+	unsigned char CCP2IP:1;
+	unsigned char TMR3IP:1;
+	unsigned char HLVDIP:1;
+	unsigned char BCLIP:1;
+	unsigned char EEIP:1;
+	unsigned char ETHIP:1;
+	unsigned char CMIP:1;
+	unsigned char OSCFIP:1;
+} IPR2bits;
 typedef struct {
 	unsigned char TMR1IE:1;
 	unsigned char TMR2IE:1;
@@ -214,6 +234,15 @@ typedef struct {
 	unsigned DMAIF:1;
 	unsigned PKTIF:1;
 } EIRbits;
+typedef struct {
+	unsigned RXERIE:1;
+	unsigned TXERIE:1;
+	unsigned:1;
+	unsigned TXIE:1;
+	unsigned LINKIE:1;
+	unsigned DMAIE:1;
+	unsigned PKTIE:1;
+} EIEbits;
 typedef struct {
 	unsigned BUSY:1;
 	unsigned SCAN:1;
@@ -240,6 +269,8 @@ typedef struct {
 #define ADCON2bits			(*((ADCON2bits*)&ADCON2))
 #define PIR1bits			(*((PIR1bits*)&PIR1))
 #define PIR2bits			(*((PIR2bits*)&PIR2))
+#define PIE2bits			(*((PIE2bits*)&PIE2))
+#define IPR2bits			(*((IPR2bits*)&IPR2))
 #define PIE1bits			(*((PIE1bits*)&PIE1))
 #define IPR1bits			(*((IPR1bits*)&IPR1))
 #define T0CONbits			(*((T0CONbits*)&T0CON))
@@ -253,6 +284,7 @@ typedef struct {
 #define ESTATbits			(*((ESTATbits*)&ESTAT))
 #define ECON2bits			(*((ECON2bits*)&ECON2))
 #define EIRbits				(*((EIRbits*)&EIR))
+#define EIEbits				(*((EIEbits*)&EIE))
 #define MISTATbits			(*((MISTATbits*)&MISTAT))
 #define BAUDCONbits			(*((BAUDCONbits*)&BAUDCON1))
 
@@ -0,0 +1,72 @@
+/*********************************************************************
+ *
+ *                  Linux host port definitions
+ *
+ *********************************************************************
+ * FileName:        Host.h
+ * Dependencies:    GenericTypeDefs.h
+ * Processor:       x86/x86-64 Linux host
+ * Compiler:        gcc/g++ (built with -DHOST_BUILD, see Makefile)
+ ********************************************************************/
+#ifndef __HOST_H
+#define __HOST_H
+
+#include "GenericTypeDefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// HostTick.c: Tick and Delay10us() against the host clock.
+// With bHostRealTime set, delays wait on the wall clock like the PIC would.
+// Otherwise they only advance the simulated clock, so a run is limited by
+// the CPU instead of by the sensor and the Tick still sees the delays.
+extern BOOL bHostRealTime;
+QWORD HostGetMicroseconds(void);
+QWORD HostGetNanoseconds(void);
+void HostAdvanceNanoseconds(DWORD dwNanoseconds);
+
+// HostMAC.c: Ethernet controller emulation.  Frames come from a TAP
+// interface and/or a pcap file and can be captured to a pcap file.
+BOOL HostMACOpenTap(const char *szName);
+BOOL HostMACOpenSocket(int fd);
+BOOL HostMACOpenReplay(const char *szFile);
+BOOL HostMACOpenCapture(const char *szFile);
+BOOL HostMACIsReplayDone(void);
+BOOL HostMACPoll(DWORD dwWaitMicroseconds);
+void HostMACClose(void);
+
+typedef struct _HOST_MAC_STATS {
+	DWORD dwRxFrames;			// Frames accepted into the RX buffer
+	DWORD dwRxDropped;			// Frames lost because the RX buffer was full
+	DWORD dwRxIgnored;			// Frames the address filter did not pass
+	DWORD dwTxFrames;
+} HOST_MAC_STATS;
+extern HOST_MAC_STATS HostMACStats;
+
+// HostSensor.cpp/HostSHT1x.cpp: SHT1x model behind the SCK/DATA pins of
+// Mod_Med_HT.c
+#define HOST_SENSOR_FAULT_NONE			0
+#define HOST_SENSOR_FAULT_NO_ACK		1	// Command not acknowledged
+#define HOST_SENSOR_FAULT_STUCK_LOW		2	// DATA held low after the command
+#define HOST_SENSOR_FAULT_STUCK_HIGH	3	// Conversion never signals ready
+#define HOST_SENSOR_FAULT_BAD_CRC		4
+
+typedef struct _HOST_SENSOR_STATS {
+	DWORD dwTransfers;			// Commands received
+	DWORD dwConversions;		// Results that became ready
+	DWORD dwCRCRead;			// Transfers read up to and including the CRC
+	DWORD dwFaults;				// Transfers a fault was injected into
+	DWORD dwTimingErrors;		// Pulse width, setup or early read violations
+	QWORD qwTransferNs;			// Time from transmission start to release
+} HOST_SENSOR_STATS;
+
+void HostSensorSetClimate(double dTemperature, double dHumidity);
+void HostSensorSetConversionPercent(unsigned char vPercent);
+void HostSensorSetFault(unsigned char vFault, DWORD dwEvery);
+void HostSensorGetStats(HOST_SENSOR_STATS *pStats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
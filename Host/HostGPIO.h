@@ -0,0 +1,136 @@
+/*********************************************************************
+ *
+ *  Simulated GPIO pins for the Linux host port
+ *
+ *********************************************************************
+ * FileName:        HostGPIO.h
+ * Dependencies:    Host.h
+ * Processor:       x86/x86-64 Linux host
+ * Compiler:        g++
+ *
+ * Stand-ins for the PIC's port and TRIS bit variables (RC3, TRISC4,
+ * ...), so that bit-banged drivers compile unchanged: assigning to a
+ * HostPortBit writes the output latch, reading it returns the level
+ * on the wire.  Every pin has a pull-up; devices attached to it can
+ * only pull it low (open drain), like the SHT1x DATA line.
+ ********************************************************************/
+#ifndef __HOST_GPIO_H
+#define __HOST_GPIO_H
+
+#include "Host.h"
+
+#define HOST_GPIO_MAX_DEVICES	4
+
+// Simulated time per port access: a bit instruction plus the code around
+// it, about 4 instruction cycles at 10.4 MIPS.  Without it a virtual run
+// samples a pin within nanoseconds of changing another one, faster than
+// the PIC can and faster than devices settle.
+#define HOST_GPIO_ACCESS_NS		400u
+
+class HostGPIO;
+
+// A chip on the other end of one or more pins
+class HostGPIODevice
+{
+public:
+	virtual ~HostGPIODevice() {}
+	// Some attached pin changed its latch or direction
+	virtual void PinChanged(QWORD qwNow) = 0;
+	// The firmware reads the pin (PORTx)
+	virtual void PinSampled(const HostGPIO *pPin, QWORD qwNow) {}
+	virtual bool PullsLow(const HostGPIO *pPin, QWORD qwNow) = 0;
+};
+
+class HostGPIO
+{
+public:
+	explicit HostGPIO(bool bInput = true) : bLatch(false), bInput(bInput), vDevices(0) {}
+
+	void Attach(HostGPIODevice *pDevice)
+	{
+		if (vDevices < HOST_GPIO_MAX_DEVICES)
+			Devices[vDevices++] = pDevice;
+	}
+	void SetLatch(bool b)
+	{
+		bLatch = b;
+		Changed();
+	}
+	void SetInput(bool b)
+	{
+		bInput = b;
+		Changed();
+	}
+	bool IsInput() const { return bInput; }
+	bool Latch() const { return bLatch; }
+
+	// Level on the wire at time qwNow (HostGetNanoseconds())
+	bool Level(QWORD qwNow) const
+	{
+		unsigned char i;
+		if (!bInput && !bLatch)
+			return false;
+		for (i = 0; i < vDevices; i++)
+			if (Devices[i]->PullsLow(this, qwNow))
+				return false;
+		return true;
+	}
+	bool Read()
+	{
+		QWORD qwNow;
+		unsigned char i;
+		HostAdvanceNanoseconds(HOST_GPIO_ACCESS_NS);
+		qwNow = HostGetNanoseconds();
+		for (i = 0; i < vDevices; i++)
+			Devices[i]->PinSampled(this, qwNow);
+		return Level(qwNow);
+	}
+
+private:
+	bool bLatch;
+	bool bInput;
+	unsigned char vDevices;
+	HostGPIODevice *Devices[HOST_GPIO_MAX_DEVICES];
+
+	void Changed()
+	{
+		QWORD qwNow;
+		unsigned char i;
+		HostAdvanceNanoseconds(HOST_GPIO_ACCESS_NS);
+		qwNow = HostGetNanoseconds();
+		for (i = 0; i < vDevices; i++)
+			Devices[i]->PinChanged(qwNow);
+	}
+};
+
+// PORTx/LATx bit: RC3 = 1; if (RC4) ...
+class HostPortBit
+{
+public:
+	explicit HostPortBit(HostGPIO &Pin) : Pin(Pin) {}
+	HostPortBit & operator=(int v)
+	{
+		Pin.SetLatch(v != 0);
+		return *this;
+	}
+	operator unsigned char() const { return Pin.Read() ? 1u : 0u; }
+private:
+	HostGPIO &Pin;
+};
+
+// TRISx bit: 1 = input, 0 = output
+class HostTrisBit
+{
+public:
+	explicit HostTrisBit(HostGPIO &Pin) : Pin(Pin) {}
+	HostTrisBit & operator=(int v)
+	{
+		Pin.SetInput(v != 0);
+		return *this;
+	}
+	operator unsigned char() const { return Pin.IsInput() ? 1u : 0u; }
+private:
+	HostGPIO &Pin;
+};
+
+#endif
@@ -0,0 +1,760 @@
+/*********************************************************************
+ *
+ *  Ethernet controller emulation for the Linux host port
+ *
+ *********************************************************************
+ * FileName:        HostMAC.c
+ * Dependencies:    MAC.h, Host.h
+ * Processor:       x86/x86-64 Linux host
+ * Compiler:        gcc
+ *
+ * Replaces ETH67J60.c.  The 8KB Ethernet buffer RAM is emulated with
+ * the same RX/TX/TCP layout as on the PIC (see MAC.h), so TCP.c keeps
+ * its sockets in "Ethernet RAM" and copies them with MACMemCopyAsync().
+ * Frames are exchanged with a TAP interface or an inherited socket
+ * and/or read from a pcap file; everything seen on the wire can be
+ * captured to a pcap file.
+ *
+ * Received frames are written into the RX ring on arrival with the
+ * same next packet pointer and status vector as the hardware, so frames
+ * held by MACHoldRx(), MACGetFreeRxSize() and ring overflows (RXERIF)
+ * behave as on the PIC.
+ *
+ * Differences from the hardware:
+ *  - Copies and transmissions complete before the call returns.
+ *  - Multicast frames are not received.
+ ********************************************************************/
+#define __HOSTMAC_C
+#define _GNU_SOURCE				// ppoll()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include "TCPIP Stack/TCPIP.h"
+#include "Host.h"
+
+#define ETHER_IP	(0x00u)
+#define ETHER_ARP	(0x06u)
+
+// Next packet pointer and status vector in front of every frame
+#define RX_PREAMBLE			(6u)
+// Bytes a frame occupies in the RX ring: preamble, the frame, its CRC,
+// rounded up to an even address
+#define RX_RING_SPACE(len)	((WORD) (((len) + RX_PREAMBLE + 4u + 1u) & ~1u))
+
+#define PCAP_MAGIC			0xA1B2C3D4ul
+#define PCAP_MAGIC_NS		0xA1B23C4Dul
+#define PCAP_LINKTYPE_ETHERNET	1ul
+
+typedef struct _PCAP_FILE_HEADER {
+	DWORD dwMagic;
+	WORD wVersionMajor;
+	WORD wVersionMinor;
+	LONG lThisZone;
+	DWORD dwSigFigs;
+	DWORD dwSnapLen;
+	DWORD dwLinkType;
+} PCAP_FILE_HEADER;
+
+typedef struct _PCAP_RECORD_HEADER {
+	DWORD dwSeconds;
+	DWORD dwFraction;			// Microseconds, or nanoseconds for PCAP_MAGIC_NS
+	DWORD dwCapturedLen;
+	DWORD dwOriginalLen;
+} PCAP_RECORD_HEADER;
+
+typedef struct _HOST_FRAME {
+	WORD wLen;
+	unsigned char Data[1514];
+} HOST_FRAME;
+
+// Emulated Ethernet buffer RAM and its pointers
+static unsigned char EthRAM[RAMSIZE];
+static WORD wReadPtr;			// ERDPT
+static WORD wWritePtr;			// EWRPT
+static WORD wTxEnd;				// ETXND of the frame being built
+WORD wMACTxBase;
+
+// Receive ring, as in ETH67J60.c
+static WORD wRxWritePtr;		// ERXWRPT
+static WORD wRxReadPtr;			// ERXRDPT
+static unsigned char vPktCnt;	// EPKTCNT
+static WORD NextPacketLocation;
+static WORD CurrentPacketLocation;
+static BOOL WasDiscarded;
+typedef struct _MAC_RX_HELD {
+	WORD wLocation;
+	BOOL bReleased;
+} MAC_RX_HELD;
+static MAC_RX_HELD HeldRx[MAC_RX_HOLD_SLOTS];
+static unsigned char vHeldRx;
+static BOOL PktIE;				// EIE.PKTIE
+static BOOL RxErIF;				// EIR.RXERIF
+static WORD wRxStamp;
+static BOOL RxStampValid;
+
+volatile MAC_EVENTS MACEvents;
+MAC_RX_STATS MACRxStats;
+HOST_MAC_STATS HostMACStats;
+
+// Backends
+static int TapFD = -1;
+static FILE *ReplayFile;
+static FILE *CaptureFile;
+static BOOL ReplayNanoseconds;
+static HOST_FRAME ReplayFrame;	// Next frame from the replay file
+static BOOL ReplayFrameValid;
+static QWORD qwReplayDue;		// HostGetMicroseconds() at which it is due
+static QWORD qwReplayFirst;		// Capture time of the first replayed frame
+static QWORD qwReplayStart;		// HostGetMicroseconds() when replay started
+static BOOL ReplayStarted;
+
+static void FreeRxSpace(void);
+
+/*********************************************************************
+ * Backends
+ ********************************************************************/
+BOOL HostMACOpenTap(const char *szName)
+{
+	struct ifreq ifr;
+	TapFD = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+	if (TapFD < 0) {
+		perror("/dev/net/tun");
+		return FALSE;
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	strncpy(ifr.ifr_name, szName, IFNAMSIZ - 1);
+	if (ioctl(TapFD, TUNSETIFF, &ifr) < 0) {
+		perror(szName);
+		close(TapFD);
+		TapFD = -1;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Any descriptor that carries one frame per read and write, such as one 
+// end of a SOCK_SEQPACKET socketpair() (see WebTest.c), stands in for 
+// the TAP interface
+BOOL HostMACOpenSocket(int fd)
+{
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+		perror("socket");
+		return FALSE;
+	}
+	TapFD = fd;
+	return TRUE;
+}
+
+BOOL HostMACOpenReplay(const char *szFile)
+{
+	PCAP_FILE_HEADER hdr;
+	ReplayFile = fopen(szFile, "rb");
+	if (ReplayFile == NULL) {
+		perror(szFile);
+		return FALSE;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, ReplayFile) != 1
+		|| (hdr.dwMagic != PCAP_MAGIC && hdr.dwMagic != PCAP_MAGIC_NS)
+		|| hdr.dwLinkType != PCAP_LINKTYPE_ETHERNET) {
+		fprintf(stderr, "%s: not a little endian Ethernet pcap file\n",
+				szFile);
+		fclose(ReplayFile);
+		ReplayFile = NULL;
+		return FALSE;
+	}
+	ReplayNanoseconds = (hdr.dwMagic == PCAP_MAGIC_NS);
+	return TRUE;
+}
+
+BOOL HostMACOpenCapture(const char *szFile)
+{
+	PCAP_FILE_HEADER hdr;
+	CaptureFile = fopen(szFile, "wb");
+	if (CaptureFile == NULL) {
+		perror(szFile);
+		return FALSE;
+	}
+	hdr.dwMagic = PCAP_MAGIC;
+	hdr.wVersionMajor = 2;
+	hdr.wVersionMinor = 4;
+	hdr.lThisZone = 0;
+	hdr.dwSigFigs = 0;
+	hdr.dwSnapLen = 65535ul;
+	hdr.dwLinkType = PCAP_LINKTYPE_ETHERNET;
+	fwrite(&hdr, sizeof(hdr), 1, CaptureFile);
+	return TRUE;
+}
+
+void HostMACClose(void)
+{
+	if (TapFD >= 0)
+		close(TapFD);
+	TapFD = -1;
+	if (ReplayFile)
+		fclose(ReplayFile);
+	ReplayFile = NULL;
+	if (CaptureFile)
+		fclose(CaptureFile);
+	CaptureFile = NULL;
+}
+
+BOOL HostMACIsReplayDone(void)
+{
+	return ReplayFile == NULL && !ReplayFrameValid;
+}
+
+static void CaptureFrame(const unsigned char *frame, WORD len)
+{
+	PCAP_RECORD_HEADER rec;
+	QWORD now;
+	if (CaptureFile == NULL)
+		return;
+	now = HostGetMicroseconds();
+	rec.dwSeconds = (DWORD) (now / 1000000ull);
+	rec.dwFraction = (DWORD) (now % 1000000ull);
+	rec.dwCapturedLen = len;
+	rec.dwOriginalLen = len;
+	fwrite(&rec, sizeof(rec), 1, CaptureFile);
+	fwrite(frame, len, 1, CaptureFile);
+}
+
+static void RingWrite(const unsigned char *data, WORD len)
+{
+	while (len--) {
+		EthRAM[wRxWritePtr] = *data++;
+		if (wRxWritePtr == RXSTOP)
+			wRxWritePtr = RXSTART;
+		else
+			wRxWritePtr++;
+	}
+}
+
+/*********************************************************************
+ * Function:        static void ReceiveFrame(const unsigned char *frame,
+ *											 WORD len)
+ * PreCondition:    None
+ * Input:           frame, len - a frame as seen on the wire, without CRC
+ * Output:          None
+ * Side Effects:    None
+ * Overview:        Applies the address filter (unicast to us and
+ *					broadcasts) and writes the frame into the RX ring, or
+ *					flags an RX error if the ring has no room for it.
+ * Note:            None
+ ********************************************************************/
+static void ReceiveFrame(const unsigned char *frame, WORD len)
+{
+	static const unsigned char crc[4] = { 0, 0, 0, 0 };
+	unsigned char preamble[RX_PREAMBLE];
+	WORD next;
+	CaptureFrame(frame, len);
+	if (len < sizeof(ETHER_HEADER) || len > sizeof(ReplayFrame.Data)) {
+		HostMACStats.dwRxIgnored++;
+		return;
+	}
+	if (memcmp(frame, &AppConfig.MyMACAddr, sizeof(MAC_ADDR))
+		&& (frame[0] & frame[1] & frame[2] & frame[3] & frame[4] & frame[5])
+		!= 0xFFu) {
+		HostMACStats.dwRxIgnored++;
+		return;
+	}
+	// Our own transmissions looped back by a capture or bridge
+	if (!memcmp(frame + 6, &AppConfig.MyMACAddr, sizeof(MAC_ADDR))) {
+		HostMACStats.dwRxIgnored++;
+		return;
+	}
+	if (RX_RING_SPACE(len) > MACGetFreeRxSize() || vPktCnt == 0xFFu) {
+		HostMACStats.dwRxDropped++;
+		RxErIF = TRUE;
+		return;
+	}
+	next = wRxWritePtr + RX_RING_SPACE(len);
+	if (next > RXSTOP)
+		next -= RXSIZE;
+	// Next packet pointer, byte count including the CRC, Received Ok
+	preamble[0] = (unsigned char) next;
+	preamble[1] = (unsigned char) (next >> 8);
+	preamble[2] = (unsigned char) (len + 4u);
+	preamble[3] = (unsigned char) ((len + 4u) >> 8);
+	preamble[4] = 0x80;
+	preamble[5] = 0x00;
+	RingWrite(preamble, sizeof(preamble));
+	RingWrite(frame, len);
+	RingWrite(crc, sizeof(crc));
+	wRxWritePtr = next;
+	vPktCnt++;
+	HostMACStats.dwRxFrames++;
+}
+
+static void ReadReplayFrame(void)
+{
+	PCAP_RECORD_HEADER rec;
+	QWORD t;
+	while (ReplayFile) {
+		if (fread(&rec, sizeof(rec), 1, ReplayFile) != 1) {
+			fclose(ReplayFile);
+			ReplayFile = NULL;
+			break;
+		}
+		if (rec.dwCapturedLen > sizeof(ReplayFrame.Data)) {
+			fseek(ReplayFile, rec.dwCapturedLen, SEEK_CUR);
+			continue;
+		}
+		if (fread(ReplayFrame.Data, 1, rec.dwCapturedLen, ReplayFile)
+			!= rec.dwCapturedLen) {
+			fclose(ReplayFile);
+			ReplayFile = NULL;
+			break;
+		}
+		ReplayFrame.wLen = (WORD) rec.dwCapturedLen;
+		t = (QWORD) rec.dwSeconds * 1000000ull +
+			(ReplayNanoseconds ? rec.dwFraction / 1000ul : rec.dwFraction);
+		if (!ReplayStarted) {
+			ReplayStarted = TRUE;
+			qwReplayFirst = t;
+			qwReplayStart = HostGetMicroseconds();
+		}
+		// Frames keep their spacing from the capture
+		qwReplayDue = qwReplayStart + (t > qwReplayFirst ? t - qwReplayFirst : 0);
+		ReplayFrameValid = TRUE;
+		return;
+	}
+	ReplayFrameValid = FALSE;
+}
+
+static void ReplayService(void)
+{
+	while (1) {
+		if (!ReplayFrameValid)
+			ReadReplayFrame();
+		if (!ReplayFrameValid || qwReplayDue > HostGetMicroseconds())
+			return;
+		ReplayFrameValid = FALSE;
+		ReceiveFrame(ReplayFrame.Data, ReplayFrame.wLen);
+	}
+}
+
+/*********************************************************************
+ * Function:        BOOL HostMACPoll(DWORD dwWaitMicroseconds)
+ * PreCondition:    None
+ * Input:           dwWaitMicroseconds - how long to wait for traffic
+ *										 when no interrupt is pending
+ * Output:          TRUE if the Ethernet interrupt is pending, in which
+ *					case the caller must call MACISR()
+ * Side Effects:    None
+ * Overview:        Plays the part of the hardware: moves frames from the
+ *					backends into the RX ring and raises the interrupt.
+ * Note:            None
+ ********************************************************************/
+BOOL HostMACPoll(DWORD dwWaitMicroseconds)
+{
+	unsigned char frame[2048];
+	struct pollfd pfd;
+	struct timespec ts;
+	ssize_t n;
+
+	ReplayService();
+	if (dwWaitMicroseconds && !((vPktCnt && PktIE) || RxErIF)) {
+		if (ReplayFrameValid && qwReplayDue < HostGetMicroseconds() + dwWaitMicroseconds)
+			dwWaitMicroseconds = (DWORD) (qwReplayDue - HostGetMicroseconds());
+		ts.tv_sec = dwWaitMicroseconds / 1000000ul;
+		ts.tv_nsec = (long) (dwWaitMicroseconds % 1000000ul) * 1000l;
+		if (TapFD >= 0) {
+			pfd.fd = TapFD;
+			pfd.events = POLLIN;
+			ppoll(&pfd, 1, &ts, NULL);
+		} else {
+			nanosleep(&ts, NULL);
+		}
+		ReplayService();
+	}
+	if (TapFD >= 0) {
+		while ((n = read(TapFD, frame, sizeof(frame))) > 0)
+			ReceiveFrame(frame, (WORD) n);
+	}
+	return (vPktCnt && PktIE) || RxErIF;
+}
+
+/*********************************************************************
+ * MAC.h interface
+ ********************************************************************/
+void MACInit(void)
+{
+	WasDiscarded = TRUE;
+	vHeldRx = 0;
+	vPktCnt = 0;
+	NextPacketLocation = RXSTART;
+	wRxWritePtr = RXSTART;
+	wRxReadPtr = RXSTOP;
+	wMACTxBase = TXSTART + 1;
+	EthRAM[TXSTART] = 0x00;		// Per packet control byte
+	PktIE = TRUE;
+	RxErIF = FALSE;
+	MACEvents.Val = 0;
+}
+
+void MACISR(void)
+{
+	if (PktIE && vPktCnt) {
+		PktIE = FALSE;
+		wRxStamp = (WORD) TickGet();
+		RxStampValid = TRUE;
+		MACRxStats.dwInterrupts++;
+		MACEvents.bits.bRxPacket = 1;
+	}
+	if (RxErIF) {
+		RxErIF = FALSE;
+		MACRxStats.dwRxErrors++;
+		MACEvents.bits.bRxError = 1;
+	}
+}
+
+BOOL MACIsRxPending(void)
+{
+	return MACEvents.Val || !WasDiscarded;
+}
+
+void MACUpdateRxFilter(void)
+{
+	// The profile is applied per frame in MACGetHeader()
+}
+
+BOOL MACIsLinked(void)
+{
+	return TRUE;
+}
+
+BOOL MACIsTxReady(void)
+{
+	return TRUE;
+}
+
+void MACDiscardRx(void)
+{
+	if (WasDiscarded)
+		return;
+	WasDiscarded = TRUE;
+	vPktCnt--;
+	FreeRxSpace();
+}
+
+// ERXRDPT goes up to the oldest frame still in use
+static void FreeRxSpace(void)
+{
+	WORD w;
+	if (vHeldRx)
+		w = HeldRx[0].wLocation;
+	else if (!WasDiscarded)
+		w = CurrentPacketLocation;
+	else
+		w = NextPacketLocation;
+	wRxReadPtr = (w == RXSTART) ? RXSTOP : w - 1u;
+}
+
+MAC_RX_HANDLE MACHoldRx(void)
+{
+	if (WasDiscarded || vHeldRx >= MAC_RX_HOLD_SLOTS)
+		return MAC_RX_INVALID_HANDLE;
+	HeldRx[vHeldRx].wLocation = CurrentPacketLocation;
+	HeldRx[vHeldRx].bReleased = FALSE;
+	vHeldRx++;
+	WasDiscarded = TRUE;
+	vPktCnt--;
+	return CurrentPacketLocation;
+}
+
+void MACReleaseRx(MAC_RX_HANDLE h)
+{
+	unsigned char i;
+	for (i = 0; i < vHeldRx; i++) {
+		if (HeldRx[i].wLocation == h) {
+			HeldRx[i].bReleased = TRUE;
+			break;
+		}
+	}
+	i = 0;
+	while (i < vHeldRx && HeldRx[i].bReleased)
+		i++;
+	if (i == 0u)
+		return;
+	vHeldRx -= i;
+	memmove(HeldRx, &HeldRx[i], vHeldRx * sizeof(HeldRx[0]));
+	FreeRxSpace();
+}
+
+MAC_RX_HANDLE MACGetOldestHeldRx(void)
+{
+	if (vHeldRx == 0u)
+		return MAC_RX_INVALID_HANDLE;
+	return HeldRx[0].wLocation;
+}
+
+WORD MACGetFreeRxSize(void)
+{
+	if (wRxWritePtr > wRxReadPtr)
+		return (RXSTOP - RXSTART) - (wRxWritePtr - wRxReadPtr);
+	else if (wRxWritePtr == wRxReadPtr)
+		return RXSIZE - 1;
+	else
+		return wRxReadPtr - wRxWritePtr - 1;
+}
+
+BOOL MACGetHeader(MAC_ADDR * remote, unsigned char *type)
+{
+	unsigned char preamble[RX_PREAMBLE];
+	ETHER_HEADER header;
+	WORD w;
+	while (1) {
+		if (vPktCnt == 0u) {
+			MACEvents.bits.bRxError = 0;
+			MACEvents.bits.bRxPacket = 0;
+			PktIE = TRUE;
+			return FALSE;
+		}
+		// Make absolutely certain that any previous packet was discarded
+		if (WasDiscarded == FALSE) {
+			MACDiscardRx();
+			return FALSE;
+		}
+		CurrentPacketLocation = NextPacketLocation;
+		wReadPtr = CurrentPacketLocation;
+		MACGetArray(preamble, sizeof(preamble));
+		MACGetArray((unsigned char *) &header, sizeof(header));
+		NextPacketLocation = preamble[0] | ((WORD) preamble[1] << 8);
+		memcpy((void *) remote->v, (void *) header.SourceMACAddr.v,
+			   sizeof(*remote));
+		*type = MAC_UNKNOWN;
+		if ((header.Type.v[0] == 0x08u) &&
+			((header.Type.v[1] == ETHER_IP)
+			 || (header.Type.v[1] == ETHER_ARP))) {
+			*type = header.Type.v[1];
+		}
+		if (RxStampValid) {
+			RxStampValid = FALSE;
+			w = (WORD) TickGet() - wRxStamp;
+			MACRxStats.wLastLatency = w;
+			if (w > MACRxStats.wMaxLatency)
+				MACRxStats.wMaxLatency = w;
+		}
+		WasDiscarded = FALSE;
+#if MAC_RX_FILTER_PROFILE != MAC_RX_FILTER_OPEN
+		if ((header.DestMACAddr.v[0] & header.DestMACAddr.v[1] &
+			 header.DestMACAddr.v[2] & header.DestMACAddr.v[3] &
+			 header.DestMACAddr.v[4] & header.DestMACAddr.v[5]) == 0xFFu
+			&& !StackIsWantedBroadcast(*type)) {
+			MACRxStats.dwFiltered++;
+			MACDiscardRx();
+			continue;
+		}
+#endif
+		MACSetReadPtrInRx(0);
+		return TRUE;
+	}
+}
+
+
+void MACPutHeader(MAC_ADDR * remote, unsigned char type, WORD dataLen)
+{
+	wWritePtr = wMACTxBase;
+	wTxEnd = dataLen + (WORD) sizeof(ETHER_HEADER) + wMACTxBase - 1;
+	MACPutArray((unsigned char *) remote, sizeof(*remote));
+	MACPutArray((unsigned char *) &AppConfig.MyMACAddr,
+				sizeof(AppConfig.MyMACAddr));
+	MACPut(0x08);
+	MACPut((type == MAC_IP) ? ETHER_IP : ETHER_ARP);
+}
+
+void MACFlush(void)
+{
+	unsigned char frame[1514];
+	WORD len;
+	len = wTxEnd - wMACTxBase + 1;
+	if (len > sizeof(frame))
+		Reset();
+	memcpy(frame, &EthRAM[wMACTxBase], len);
+	// The MAC pads short frames (MACON3.PADCFG0)
+	if (len < 60u) {
+		memset(&frame[len], 0x00, 60u - len);
+		len = 60u;
+	}
+	if (TapFD >= 0 && write(TapFD, frame, len) < 0 && errno != EAGAIN)
+		perror("tap write");
+	CaptureFrame(frame, len);
+	HostMACStats.dwTxFrames++;
+}
+
+void MACSetReadPtrInRx(WORD offset)
+{
+	MACSetReadPtrInHeldRx(CurrentPacketLocation, sizeof(ETHER_HEADER) + offset);
+}
+
+void MACSetReadPtrInHeldRx(MAC_RX_HANDLE h, WORD offset)
+{
+	WORD w;
+	w = h + RX_PREAMBLE + offset;
+	if (w > RXSTOP)
+		w -= RXSIZE;
+	wReadPtr = w;
+}
+
+WORD MACSetWritePtr(WORD address)
+{
+	WORD oldVal;
+	oldVal = wWritePtr;
+	wWritePtr = address;
+	return oldVal;
+}
+
+WORD MACSetReadPtr(WORD address)
+{
+	WORD oldVal;
+	oldVal = wReadPtr;
+	wReadPtr = address;
+	return oldVal;
+}
+
+WORD MACCalcRxChecksum(WORD offset, WORD len)
+{
+	WORD temp;
+	WORD RDSave;
+	temp = CurrentPacketLocation + RX_PREAMBLE + sizeof(ETHER_HEADER) + offset;
+	if (temp > RXSTOP)
+		temp -= RXSIZE;
+	RDSave = wReadPtr;
+	wReadPtr = temp;
+	temp = CalcIPBufferChecksum(len);
+	wReadPtr = RDSave;
+	return temp;
+}
+
+WORD CalcIPBufferChecksum(WORD len)
+{
+	WORD Start;
+	DWORD_VAL Checksum = { 0x00000000ul };
+	WORD ChunkLen;
+	unsigned char DataBuffer[20];	// Must be an even size
+	WORD *DataPtr;
+	Start = wReadPtr;
+	while (len) {
+		ChunkLen = len > sizeof(DataBuffer) ? sizeof(DataBuffer) : len;
+		MACGetArray(DataBuffer, ChunkLen);
+		len -= ChunkLen;
+		if (((WORD_VAL *) & ChunkLen)->bits.b0) {
+			DataBuffer[ChunkLen] = 0x00;
+			ChunkLen++;
+		}
+		DataPtr = (WORD *) & DataBuffer[0];
+		while (ChunkLen) {
+			Checksum.Val += *DataPtr++;
+			ChunkLen -= 2;
+		}
+	}
+	wReadPtr = Start;
+	Checksum.Val = (DWORD) Checksum.w[0] + (DWORD) Checksum.w[1];
+	Checksum.w[0] += Checksum.w[1];
+	return ~Checksum.w[0];
+}
+
+// ERDPT follows the receive ring wrap, EWRPT only the end of the RAM
+static unsigned char ReadByte(void)
+{
+	unsigned char b;
+	b = EthRAM[wReadPtr];
+	if (wReadPtr == RXSTOP)
+		wReadPtr = RXSTART;
+	else
+		wReadPtr = (wReadPtr + 1u) & (RAMSIZE - 1u);
+	return b;
+}
+
+static void WriteByte(unsigned char b)
+{
+	EthRAM[wWritePtr] = b;
+	wWritePtr = (wWritePtr + 1u) & (RAMSIZE - 1u);
+}
+
+void MACMemCopyAsync(WORD destAddr, WORD sourceAddr, WORD len)
+{
+	WORD ReadSave, WriteSave;
+	BOOL UpdateWritePointer = FALSE;
+	BOOL UpdateReadPointer = FALSE;
+	if (((WORD_VAL *) & destAddr)->bits.b15) {
+		UpdateWritePointer = TRUE;
+		destAddr = wWritePtr;
+	}
+	if (((WORD_VAL *) & sourceAddr)->bits.b15) {
+		UpdateReadPointer = TRUE;
+		sourceAddr = wReadPtr;
+	}
+	ReadSave = wReadPtr;
+	WriteSave = wWritePtr;
+	wReadPtr = sourceAddr;
+	wWritePtr = destAddr;
+	while (len--)
+		WriteByte(ReadByte());
+	if (!UpdateReadPointer)
+		wReadPtr = ReadSave;
+	if (!UpdateWritePointer)
+		wWritePtr = WriteSave;
+}
+
+BOOL MACIsMemCopyDone(void)
+{
+	return TRUE;
+}
+
+unsigned char MACGet()
+{
+	return ReadByte();
+}
+
+WORD MACGetArray(unsigned char *val, WORD len)
+{
+	WORD w;
+	w = len;
+	if (val) {
+		while (w--)
+			*val++ = ReadByte();
+	} else {
+		while (w--)
+			ReadByte();
+	}
+	return len;
+}
+
+void MACPut(unsigned char val)
+{
+	WriteByte(val);
+}
+
+void MACPutArray(unsigned char *val, WORD len)
+{
+	while (len--)
+		WriteByte(*val++);
+}
+
+void MACPutROMArray(const unsigned char *val, WORD len)
+{
+	while (len--)
+		WriteByte(*val++);
+}
+
+void MACPowerDown(void)
+{
+}
+
+void MACPowerUp(void)
+{
+}
+
+void SetRXHashTableEntry(MAC_ADDR DestMACAddr)
+{
+	// Multicast reception is not emulated
+}
@@ -0,0 +1,200 @@
+/*********************************************************************
+ * FileName:        HostMain.c
+ * Dependencies:    TCPIP.h, Host.h
+ * Processor:       x86/x86-64 Linux host
+ * Complier:        gcc
+ *
+ * Host counterpart of Principal.c: same configuration, same main loop.
+ * The Ethernet interrupt is polled between passes of the loop.
+ *
+ * Usage: FullEthernet [-i tap | -s fd] [-r in.pcap] [-w out.pcap] [-a ip]
+ *					   [-t celsius] [-h rh%] [-c percent] [-f fault[:n]] [-v]
+ *   -i  Exchange frames with an existing TAP interface, e.g.
+ *       ip tuntap add tap0 mode tap user $USER
+ *       ip addr add 192.168.2.1/24 dev tap0 && ip link set tap0 up
+ *   -s  Exchange frames over an inherited descriptor, one frame per
+ *       read and write (make check runs WebTest this way)
+ *   -r  Feed the frames of a pcap file, keeping their spacing.  Without
+ *       -i the program exits one second after the last frame.
+ *   -w  Capture every frame received and sent to a pcap file
+ *   -a  IP address (default MY_DEFAULT_IP_ADDR_BYTEx from TCPIPConfig.h)
+ *   -t, -h  Climate reported by the simulated SHT1x
+ *   -c  SHT1x conversion time in percent of the datasheet maximum (40)
+ *   -f  Inject a sensor fault into every n-th command (default 1):
+ *       noack, stucklow, stuckhigh or crc
+ *   -v  Virtual delays: Delay10us() advances the Tick without waiting
+ ********************************************************************/
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+#include "TCPIP Stack/TCPIP.h"
+#include "Host.h"
+
+// Same time between main loop passes as on the PIC when idle.
+// TCPServer() counts passes to time out silent clients.
+#define HOST_IDLE_WAIT_US		(100ul)
+
+unsigned int desbordador;
+APP_CONFIG AppConfig;
+unsigned char myDHCPBindCount = 0xFF;
+
+#include "AppConfig.c"
+
+static volatile sig_atomic_t bQuit;
+
+// Indexed by HOST_SENSOR_FAULT_*
+static const char *szFaults[] = { "none", "noack", "stucklow", "stuckhigh", "crc" };
+
+static void PrintStats(void);
+
+static void OnSignal(int sig)
+{
+	bQuit = 1;
+}
+
+void HostReset(void)
+{
+	fprintf(stderr, "Reset() called: stack consistency check failed\n");
+	PrintStats();
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *szTap = NULL;
+	const char *szReplay = NULL;
+	const char *szCapture = NULL;
+	const char *szAddress = NULL;
+	int iSocket = -1;
+	double dTemperature = 22.0, dHumidity = 45.0;
+	struct in_addr addr;
+	QWORD qwReplayEnd = 0;
+	char *p;
+	int c;
+
+	while ((c = getopt(argc, argv, "i:s:r:w:a:t:h:c:f:v")) != -1) {
+		switch (c) {
+		case 'i':
+			szTap = optarg;
+			break;
+		case 's':
+			iSocket = atoi(optarg);
+			break;
+		case 'r':
+			szReplay = optarg;
+			break;
+		case 'w':
+			szCapture = optarg;
+			break;
+		case 'a':
+			szAddress = optarg;
+			break;
+		case 't':
+			dTemperature = atof(optarg);
+			break;
+		case 'h':
+			dHumidity = atof(optarg);
+			break;
+		case 'c':
+			HostSensorSetConversionPercent((unsigned char) atoi(optarg));
+			break;
+		case 'f':
+			p = strchr(optarg, ':');
+			if (p)
+				*p++ = '\0';
+			for (c = 0; c < (int) (sizeof(szFaults) / sizeof(szFaults[0])); c++)
+				if (!strcmp(optarg, szFaults[c]))
+					break;
+			if (c == (int) (sizeof(szFaults) / sizeof(szFaults[0]))) {
+				fprintf(stderr, "%s: unknown fault %s\n", argv[0], optarg);
+				return 1;
+			}
+			HostSensorSetFault((unsigned char) c, p ? strtoul(p, NULL, 0) : 1ul);
+			break;
+		case 'v':
+			bHostRealTime = FALSE;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-i tap | -s fd] [-r in.pcap] [-w out.pcap] "
+					"[-a ip] [-t celsius] [-h rh%%] [-c percent] [-f fault[:n]] [-v]\n",
+					argv[0]);
+			return 1;
+		}
+	}
+	if (szTap == NULL && iSocket < 0 && szReplay == NULL) {
+		fprintf(stderr, "%s: need a TAP interface (-i), a socket (-s) or a pcap file (-r)\n",
+				argv[0]);
+		return 1;
+	}
+	if ((szTap && !HostMACOpenTap(szTap))
+		|| (iSocket >= 0 && !HostMACOpenSocket(iSocket))
+		|| (szReplay && !HostMACOpenReplay(szReplay))
+		|| (szCapture && !HostMACOpenCapture(szCapture)))
+		return 1;
+	HostSensorSetClimate(dTemperature, dHumidity);
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+
+	TickInit();
+	InitAppConfig();
+	if (szAddress) {
+		if (!inet_aton(szAddress, &addr)) {
+			fprintf(stderr, "%s: bad address %s\n", argv[0], szAddress);
+			return 1;
+		}
+		AppConfig.MyIPAddr.Val = addr.s_addr;
+		AppConfig.DefaultIPAddr.Val = addr.s_addr;
+	}
+	StackInit();
+	while (!bQuit) {
+		// High priority interrupt
+		if (HostMACPoll(MACIsRxPending() ? 0ul : HOST_IDLE_WAIT_US))
+			MACISR();
+		StackTask();
+		DiscoveryTask();
+		NBNSTask();
+		TCPServer(4321);
+#if defined(STACK_USE_HTTP2_SERVER)
+		HTTPServer();
+#endif
+#if defined(STACK_USE_TCP_PERFORMANCE_TEST)
+		TCPPerformanceTask();
+#endif
+		Medicion_Periodica();
+		if (szTap == NULL && iSocket < 0 && HostMACIsReplayDone()) {
+			if (qwReplayEnd == 0)
+				qwReplayEnd = HostGetMicroseconds() + 1000000ull;
+			else if (HostGetMicroseconds() > qwReplayEnd)
+				break;
+		}
+	}
+	PrintStats();
+	HostMACClose();
+	return 0;
+}
+
+static void PrintStats(void)
+{
+	HOST_SENSOR_STATS sensor;
+	fprintf(stderr, "rx %u frames, %u dropped, %u ignored, %u filtered; "
+			"tx %u frames\n",
+			HostMACStats.dwRxFrames, HostMACStats.dwRxDropped,
+			HostMACStats.dwRxIgnored, MACRxStats.dwFiltered,
+			HostMACStats.dwTxFrames);
+	fprintf(stderr, "rx interrupts %u, errors %u, latency last %u max %u ticks\n",
+			MACRxStats.dwInterrupts, MACRxStats.dwRxErrors,
+			MACRxStats.wLastLatency, MACRxStats.wMaxLatency);
+	fprintf(stderr, "stack arp %u, icmp %u, tcp %u, udp %u, other %u; "
+			"budget stops %u, drains %u, udp dropped %u\n",
+			StackRxStats.dwARP, StackRxStats.dwICMP, StackRxStats.dwTCP,
+			StackRxStats.dwUDP, StackRxStats.dwOther,
+			StackRxStats.dwBudgetStops, StackRxStats.dwDrains,
+			StackRxStats.dwUDPDropped);
+	HostSensorGetStats(&sensor);
+	fprintf(stderr, "sensor %u commands, %u conversions, %u CRCs read, "
+			"%u faults, %u timing errors, %.3f s on the bus\n",
+			sensor.dwTransfers, sensor.dwConversions, sensor.dwCRCRead,
+			sensor.dwFaults, sensor.dwTimingErrors,
+			(double) sensor.qwTransferNs / 1e9);
+}
@@ -0,0 +1,358 @@
+/*********************************************************************
+ *
+ *  SHT1x humidity and temperature sensor model
+ *
+ *********************************************************************
+ * FileName:        HostSHT1x.cpp
+ * Dependencies:    HostSHT1x.h
+ * Processor:       x86/x86-64 Linux host
+ * Compiler:        g++
+ *
+ * Follows the SHT1x datasheet at the level of single SCK edges, timed
+ * with HostGetNanoseconds():
+ *  - transmission start and the 9-clock connection reset sequence
+ *  - measure T/RH, read/write status register and soft reset commands
+ *  - conversion time by resolution (status register bit 0), scaled to
+ *    a percentage of the datasheet maximum
+ *  - ACK, result bytes and the CRC-8, with DATA changing SHT_T_V after
+ *    the falling SCK edge
+ *  - SCK pulse width, DATA setup and early read violations are counted
+ *    as timing errors
+ *  - injected faults: missing ACK, DATA stuck low, conversion never
+ *    ready (DATA stuck high) and corrupted CRC
+ ********************************************************************/
+#include <math.h>
+#include <string.h>
+#include "HostSHT1x.h"
+
+// Conversion formulas from the datasheet (VDD = 3.3V), high/low resolution
+static const double SHT_D1 = -39.66;
+static const double SHT_D2[2] = { 0.01, 0.04 };
+static const double SHT_C1[2] = { -2.0468, -2.0468 };
+static const double SHT_C2[2] = { 0.0367, 0.5872 };
+static const double SHT_C3[2] = { -1.5955E-6, -4.0845E-4 };
+static const WORD SHT_T_MAX[2] = { 0x3FFFu, 0x0FFFu };
+static const WORD SHT_RH_MAX[2] = { 0x0FFFu, 0x00FFu };
+
+HostSHT1x::HostSHT1x(HostGPIO &SCK, HostGPIO &DATA) : SCK(SCK), DATA(DATA)
+{
+	State = SM_IDLE;
+	bLastSCK = false;
+	bLastDrive = true;
+	qwSCKEdge = qwDataEdge = qwStart = 0;
+	bDrivesLow = bDrovePrevious = false;
+	qwValid = 0;
+	vCommand = vShift = vBits = vHighClocks = 0;
+	bAck = false;
+	memset(vOut, 0, sizeof(vOut));
+	vOutLen = vOutIndex = 0;
+	vStatus = 0;
+	qwReady = 0;
+	vConversionPercent = 40;
+	vFault = vActiveFault = HOST_SENSOR_FAULT_NONE;
+	dwFaultEvery = 0;
+	memset(&Stat, 0, sizeof(Stat));
+	SetClimate(22.0, 45.0);
+	SCK.Attach(this);
+	DATA.Attach(this);
+}
+
+void HostSHT1x::SetClimate(double dTemperature, double dHumidity)
+{
+	double so, disc;
+	unsigned char r;
+	for (r = 0; r < 2u; r++) {
+		so = (dTemperature - SHT_D1) / SHT_D2[r] + 0.5;
+		wRawTemperature[r] = so < 0.0 ? 0u : so > SHT_T_MAX[r] ? SHT_T_MAX[r] : (WORD) so;
+		// Smaller root of RHlinear = C1 + C2*SO + C3*SO^2
+		disc = SHT_C2[r] * SHT_C2[r] - 4.0 * SHT_C3[r] * (SHT_C1[r] - dHumidity);
+		so = disc < 0.0 ? SHT_RH_MAX[r] :
+			(-SHT_C2[r] + sqrt(disc)) / (2.0 * SHT_C3[r]) + 0.5;
+		wRawHumidity[r] = so < 0.0 ? 0u : so > SHT_RH_MAX[r] ? SHT_RH_MAX[r] : (WORD) so;
+	}
+}
+
+// vFault is injected into every dwEvery-th command (1 = all, 0 = never)
+void HostSHT1x::SetFault(unsigned char vNewFault, DWORD dwEvery)
+{
+	vFault = vNewFault;
+	dwFaultEvery = dwEvery;
+}
+
+// CRC-8 (x^8 + x^5 + x^4 + 1) over command and data, seeded with the
+// reversed low nibble of the status register and sent bit reversed
+unsigned char HostSHT1x::CRC(const unsigned char *pData, unsigned char vLen) const
+{
+	unsigned char crc, b, i, r;
+	crc = 0;
+	for (i = 0; i < 4u; i++)
+		if (vStatus & (1u << i))
+			crc |= 0x80u >> i;
+	while (vLen--) {
+		b = *pData++;
+		for (i = 0; i < 8u; i++) {
+			if ((crc ^ b) & 0x80u)
+				crc = (unsigned char) ((crc << 1) ^ 0x31u);
+			else
+				crc <<= 1;
+			b <<= 1;
+		}
+	}
+	r = 0;
+	for (i = 0; i < 8u; i++)
+		if (crc & (1u << i))
+			r |= 0x80u >> i;
+	return r;
+}
+
+void HostSHT1x::Drive(bool bLow, QWORD qwNow)
+{
+	if (bLow == bDrivesLow)
+		return;
+	bDrovePrevious = bDrivesLow;
+	bDrivesLow = bLow;
+	qwValid = qwNow + SHT_T_V;
+}
+
+void HostSHT1x::OutputBit(QWORD qwNow)
+{
+	Drive(!(vShift & 0x80u), qwNow);
+}
+
+// vLen data bytes of wValue, MSB first, followed by the CRC
+void HostSHT1x::LoadOutput(WORD wValue, unsigned char vLen)
+{
+	unsigned char crcdata[3];
+	vOutLen = 0;
+	if (vLen == 2u)
+		vOut[vOutLen++] = (unsigned char) (wValue >> 8);
+	vOut[vOutLen++] = (unsigned char) wValue;
+	crcdata[0] = vCommand;
+	memcpy(&crcdata[1], vOut, vOutLen);
+	vOut[vOutLen] = CRC(crcdata, vOutLen + 1u);
+	if (vActiveFault == HOST_SENSOR_FAULT_BAD_CRC)
+		vOut[vOutLen] ^= 0xFFu;
+	vOutLen++;
+	vOutIndex = 0;
+}
+
+void HostSHT1x::EndTransfer(QWORD qwNow)
+{
+	State = SM_IDLE;
+	Drive(false, qwNow);
+	vActiveFault = HOST_SENSOR_FAULT_NONE;
+	Stat.qwTransferNs += qwNow - qwStart;
+}
+
+// Background completion of a conversion or soft reset
+void HostSHT1x::Advance(QWORD qwNow)
+{
+	if (State != SM_BUSY || qwNow < qwReady)
+		return;
+	if (vCommand == SHT_SOFT_RESET) {
+		EndTransfer(qwReady);
+		return;
+	}
+	// The first result bit is always 0: pulling DATA low signals "ready"
+	Stat.dwConversions++;
+	State = SM_OUTPUT;
+	vBits = 0;
+	vShift = vOut[0];
+	Drive(!(vShift & 0x80u), qwReady);
+	qwValid = qwReady;
+}
+
+// Called on the 8th falling SCK edge of a command
+void HostSHT1x::Command(QWORD qwNow)
+{
+	vCommand = vShift;
+	if (vCommand != SHT_MEASURE_TEMP && vCommand != SHT_MEASURE_HUMI
+		&& vCommand != SHT_READ_STATUS && vCommand != SHT_WRITE_STATUS
+		&& vCommand != SHT_SOFT_RESET) {
+		State = SM_IDLE;
+		return;
+	}
+	Stat.dwTransfers++;
+	vActiveFault = HOST_SENSOR_FAULT_NONE;
+	if (vFault != HOST_SENSOR_FAULT_NONE && dwFaultEvery
+		&& Stat.dwTransfers % dwFaultEvery == 0u) {
+		vActiveFault = vFault;
+		Stat.dwFaults++;
+	}
+	if (vActiveFault == HOST_SENSOR_FAULT_NO_ACK) {
+		EndTransfer(qwNow);
+		return;
+	}
+	State = SM_COMMAND_ACK;
+	Drive(true, qwNow);
+}
+
+bool HostSHT1x::PullsLow(const HostGPIO *pPin, QWORD qwNow)
+{
+	if (pPin != &DATA)
+		return false;
+	Advance(qwNow);
+	if (vActiveFault == HOST_SENSOR_FAULT_STUCK_LOW
+		&& (State == SM_BUSY || State == SM_OUTPUT || State == SM_OUTPUT_ACK))
+		return true;
+	return qwNow < qwValid ? bDrovePrevious : bDrivesLow;
+}
+
+void HostSHT1x::PinSampled(const HostGPIO *pPin, QWORD qwNow)
+{
+	// Read before the new bit settled after the falling edge
+	if (pPin == &DATA && State == SM_OUTPUT && qwNow < qwValid)
+		Stat.dwTimingErrors++;
+}
+
+void HostSHT1x::PinChanged(QWORD qwNow)
+{
+	bool sck, drive, data, rise, fall;
+	unsigned char r;
+	QWORD t;
+
+	sck = SCK.Level(qwNow);
+	drive = DATA.IsInput() || DATA.Latch();
+	data = DATA.Level(qwNow);
+	rise = sck && !bLastSCK;
+	fall = !sck && bLastSCK;
+	if (rise || fall) {
+		if (qwSCKEdge && qwNow - qwSCKEdge < SHT_T_SCK_MIN)
+			Stat.dwTimingErrors++;
+		qwSCKEdge = qwNow;
+	}
+	if (drive != bLastDrive)
+		qwDataEdge = qwNow;
+
+	// Connection reset: 9 or more clocks with DATA high
+	if (rise) {
+		if (data && ++vHighClocks >= 9u && State != SM_IDLE) {
+			EndTransfer(qwNow);
+		} else if (!data) {
+			vHighClocks = 0;
+		}
+	}
+	// Transmission start: DATA falls while SCK is high, SCK pulses low,
+	// DATA rises while SCK is high.  Aborts whatever was going on.
+	if (sck && bLastSCK && drive != bLastDrive) {
+		if (!drive) {
+			if (State != SM_IDLE && State != SM_START_LOW && State != SM_START_CLOCK)
+				EndTransfer(qwNow);
+			State = SM_START_LOW;
+			qwStart = qwNow;
+		} else if (State == SM_START_CLOCK) {
+			State = SM_COMMAND;
+			vBits = 0;
+			vShift = 0;
+		}
+	}
+	// Master driven bits must be stable before SCK rises
+	if (rise && (State == SM_COMMAND || State == SM_WRITE || State == SM_OUTPUT_ACK)
+		&& qwNow - qwDataEdge < SHT_T_SU)
+		Stat.dwTimingErrors++;
+
+	switch (State) {
+	case SM_START_LOW:
+		if (rise)
+			State = SM_START_CLOCK;
+		break;
+	case SM_COMMAND:
+		if (rise) {
+			vShift = (unsigned char) ((vShift << 1) | (data ? 1u : 0u));
+			vBits++;
+		} else if (fall && vBits == 8u) {
+			Command(qwNow);
+		}
+		break;
+	case SM_COMMAND_ACK:
+		if (!fall)
+			break;
+		Drive(false, qwNow);
+		r = (vStatus & SHT_STATUS_LOW_RES) ? 1u : 0u;
+		switch (vCommand) {
+		case SHT_MEASURE_TEMP:
+		case SHT_MEASURE_HUMI:
+			if (vCommand == SHT_MEASURE_TEMP) {
+				LoadOutput(wRawTemperature[r], 2);
+				t = r ? SHT_T_CONV_12BIT : SHT_T_CONV_14BIT;
+			} else {
+				LoadOutput(wRawHumidity[r], 2);
+				t = r ? SHT_T_CONV_8BIT : SHT_T_CONV_12BIT;
+			}
+			if (vActiveFault == HOST_SENSOR_FAULT_STUCK_LOW)
+				t = 0;
+			else if (vActiveFault == HOST_SENSOR_FAULT_STUCK_HIGH)
+				t = ~0ull - qwNow;
+			else
+				t = t * vConversionPercent / 100u;
+			qwReady = qwNow + t;
+			State = SM_BUSY;
+			break;
+		case SHT_READ_STATUS:
+			LoadOutput(vStatus, 1);
+			State = SM_OUTPUT;
+			vBits = 0;
+			vShift = vOut[0];
+			OutputBit(qwNow);
+			break;
+		case SHT_WRITE_STATUS:
+			State = SM_WRITE;
+			vBits = 0;
+			vShift = 0;
+			break;
+		case SHT_SOFT_RESET:
+			vStatus = 0;
+			qwReady = qwNow + SHT_T_SOFT_RESET;
+			State = SM_BUSY;
+			break;
+		}
+		break;
+	case SM_WRITE:
+		if (rise) {
+			vShift = (unsigned char) ((vShift << 1) | (data ? 1u : 0u));
+			vBits++;
+		} else if (fall && vBits == 8u) {
+			vStatus = vShift & SHT_STATUS_WRITABLE;
+			State = SM_WRITE_ACK;
+			Drive(true, qwNow);
+		}
+		break;
+	case SM_WRITE_ACK:
+		if (fall)
+			EndTransfer(qwNow);
+		break;
+	case SM_OUTPUT:
+		if (fall) {
+			vShift <<= 1;
+			if (++vBits == 8u) {
+				// Release DATA for the master's acknowledge
+				Drive(false, qwNow);
+				State = SM_OUTPUT_ACK;
+			} else {
+				OutputBit(qwNow);
+			}
+		}
+		break;
+	case SM_OUTPUT_ACK:
+		if (rise) {
+			bAck = !data;
+		} else if (fall) {
+			if (++vOutIndex == vOutLen)
+				Stat.dwCRCRead++;
+			// A NACK skips the rest; after the CRC the sensor is done
+			if (!bAck || vOutIndex == vOutLen) {
+				EndTransfer(qwNow);
+			} else {
+				vBits = 0;
+				vShift = vOut[vOutIndex];
+				State = SM_OUTPUT;
+				OutputBit(qwNow);
+			}
+		}
+		break;
+	default:
+		break;
+	}
+	bLastSCK = sck;
+	bLastDrive = drive;
+}
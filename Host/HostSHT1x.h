@@ -0,0 +1,108 @@
+/*********************************************************************
+ *
+ *  SHT1x humidity and temperature sensor model
+ *
+ *********************************************************************
+ * FileName:        HostSHT1x.h
+ * Dependencies:    HostGPIO.h
+ * Processor:       x86/x86-64 Linux host
+ * Compiler:        g++
+ ********************************************************************/
+#ifndef __HOST_SHT1X_H
+#define __HOST_SHT1X_H
+
+#include "HostGPIO.h"
+
+// Commands (address 000 plus the command bits)
+#define SHT_MEASURE_TEMP		0x03u
+#define SHT_MEASURE_HUMI		0x05u
+#define SHT_READ_STATUS			0x07u
+#define SHT_WRITE_STATUS		0x06u
+#define SHT_SOFT_RESET			0x1Eu
+
+// Status register bits
+#define SHT_STATUS_LOW_RES		0x01u	// 12 bit T / 8 bit RH instead of 14 / 12
+#define SHT_STATUS_NO_RELOAD	0x02u
+#define SHT_STATUS_HEATER		0x04u
+#define SHT_STATUS_WRITABLE		0x07u
+
+// Interface timing limits and the sensor's own delays, in ns
+#define SHT_T_SCK_MIN			100ull		// SCK high or low time
+#define SHT_T_SU				100ull		// DATA setup before SCK rises
+#define SHT_T_V					250ull		// DATA valid after SCK falls
+#define SHT_T_SOFT_RESET		11000000ull
+// Datasheet maximum conversion times for 8, 12 and 14 bit results
+#define SHT_T_CONV_8BIT			20000000ull
+#define SHT_T_CONV_12BIT		80000000ull
+#define SHT_T_CONV_14BIT		320000000ull
+
+class HostSHT1x : public HostGPIODevice
+{
+public:
+	HostSHT1x(HostGPIO &SCK, HostGPIO &DATA);
+
+	void SetClimate(double dTemperature, double dHumidity);
+	void SetConversionPercent(unsigned char vPercent) { vConversionPercent = vPercent; }
+	void SetFault(unsigned char vFault, DWORD dwEvery);
+	const HOST_SENSOR_STATS & Stats() const { return Stat; }
+
+	virtual void PinChanged(QWORD qwNow);
+	virtual void PinSampled(const HostGPIO *pPin, QWORD qwNow);
+	virtual bool PullsLow(const HostGPIO *pPin, QWORD qwNow);
+
+private:
+	enum STATE {
+		SM_IDLE = 0,		// Waiting for a transmission start
+		SM_START_LOW,		// DATA fell while SCK was high
+		SM_START_CLOCK,		// ... and SCK pulsed low once
+		SM_COMMAND,			// Clocking in the command byte
+		SM_COMMAND_ACK,		// Pulling DATA low for the 9th clock
+		SM_BUSY,			// Converting or resetting, DATA released
+		SM_WRITE,			// Clocking in the status register value
+		SM_WRITE_ACK,
+		SM_OUTPUT,			// Shifting out a byte
+		SM_OUTPUT_ACK		// Master acknowledges on the 9th clock
+	} State;
+
+	HostGPIO &SCK;
+	HostGPIO &DATA;
+	bool bLastSCK;
+	bool bLastDrive;		// DATA as driven by the master (or the pull-up)
+	QWORD qwSCKEdge;		// Time of the last SCK edge
+	QWORD qwDataEdge;		// Time the master last changed DATA
+	QWORD qwStart;			// Time of the transmission start
+
+	// Output: bDrivesLow takes effect SHT_T_V after the SCK edge
+	bool bDrivesLow;
+	bool bDrovePrevious;
+	QWORD qwValid;
+
+	unsigned char vCommand;
+	unsigned char vShift;
+	unsigned char vBits;
+	unsigned char vHighClocks;		// SCK pulses with DATA high, for the reset sequence
+	bool bAck;						// Master pulled DATA low on the 9th clock
+	unsigned char vOut[3];			// Bytes to send: result/status and CRC
+	unsigned char vOutLen;
+	unsigned char vOutIndex;
+	unsigned char vStatus;
+	QWORD qwReady;					// End of SM_BUSY
+
+	WORD wRawTemperature[2];		// High and low resolution
+	WORD wRawHumidity[2];
+	unsigned char vConversionPercent;
+	unsigned char vFault;
+	unsigned char vActiveFault;		// Fault applied to the current transfer
+	DWORD dwFaultEvery;
+	HOST_SENSOR_STATS Stat;
+
+	void Drive(bool bLow, QWORD qwNow);
+	void Advance(QWORD qwNow);
+	void Command(QWORD qwNow);
+	void LoadOutput(WORD wValue, unsigned char vLen);
+	void OutputBit(QWORD qwNow);
+	void EndTransfer(QWORD qwNow);
+	unsigned char CRC(const unsigned char *pData, unsigned char vLen) const;
+};
+
+#endif
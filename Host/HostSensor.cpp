@@ -0,0 +1,56 @@
+/*********************************************************************
+ *
+ *  Simulated SHT1x sensor for the Linux host port
+ *
+ *********************************************************************
+ * FileName:        HostSensor.cpp
+ * Dependencies:    Mod_Med_HT.c, HostSHT1x.h
+ * Processor:       x86/x86-64 Linux host
+ * Compiler:        g++
+ *
+ * Compiles the measurement module unchanged.  As in Principal.c, the
+ * SCK, DATA and C_DATA pins are macros defined before Mod_Med_HT.c is
+ * included; here they name simulated RC3/RC4/TRISC4 bits wired to an
+ * SHT1x model.
+ ********************************************************************/
+extern "C" {
+#include "TCPIP Stack/TCPIP.h"
+}
+#include "HostSHT1x.h"
+
+// Outputs, as set up by InitializeBoard() in Principal.c
+static HostGPIO PinRC3(false);
+static HostGPIO PinRC4(false);
+static HostSHT1x Sensor(PinRC3, PinRC4);
+
+static HostPortBit HostRC3(PinRC3);
+static HostPortBit HostRC4(PinRC4);
+static HostTrisBit HostTRISC4(PinRC4);
+
+#define SCK			HostRC3
+#define DATA		HostRC4
+#define C_DATA		HostTRISC4
+
+extern "C" {
+#include "Mod_Med_HT.c"
+
+void HostSensorSetClimate(double dTemperature, double dHumidity)
+{
+	Sensor.SetClimate(dTemperature, dHumidity);
+}
+
+void HostSensorSetConversionPercent(unsigned char vPercent)
+{
+	Sensor.SetConversionPercent(vPercent);
+}
+
+void HostSensorSetFault(unsigned char vFault, DWORD dwEvery)
+{
+	Sensor.SetFault(vFault, dwEvery);
+}
+
+void HostSensorGetStats(HOST_SENSOR_STATS *pStats)
+{
+	*pStats = Sensor.Stats();
+}
+}
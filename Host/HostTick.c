@@ -0,0 +1,112 @@
+/*********************************************************************
+ *
+ *                  Tick Manager for the Linux host port
+ *
+ *********************************************************************
+ * FileName:        HostTick.c
+ * Dependencies:    Tick.h, Host.h
+ * Processor:       x86/x86-64 Linux host
+ * Compiler:        gcc
+ *
+ * Replaces Tick.c.  Ticks run at the same TICKS_PER_SECOND as Timer0
+ * on the PIC, so every timeout in the stack keeps its real length.
+ ********************************************************************/
+#define __TICK_C
+
+#include <time.h>
+#include "TCPIP Stack/TCPIP.h"
+#include "Host.h"
+
+BOOL bHostRealTime = TRUE;
+
+static QWORD qwStart;			// Monotonic clock at TickInit(), in ns
+static QWORD qwSkipped;			// Time added by delays not waited for, in ns
+
+static QWORD ClockNow(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (QWORD) ts.tv_sec * 1000000000ull + (QWORD) ts.tv_nsec;
+}
+
+QWORD HostGetNanoseconds(void)
+{
+	return ClockNow() - qwStart + qwSkipped;
+}
+
+QWORD HostGetMicroseconds(void)
+{
+	return HostGetNanoseconds() / 1000ull;
+}
+
+// Charges simulated time for work that takes far longer on the PIC than
+// here.  Only the virtual clock moves; real-time mode already pays it.
+void HostAdvanceNanoseconds(DWORD dwNanoseconds)
+{
+	if (!bHostRealTime)
+		qwSkipped += dwNanoseconds;
+}
+
+void TickInit(void)
+{
+	qwStart = ClockNow();
+	qwSkipped = 0;
+}
+
+static QWORD TickGet64(void)
+{
+	return HostGetMicroseconds() * TICKS_PER_SECOND / 1000000ull;
+}
+
+DWORD TickGet(void)
+{
+	return (DWORD) TickGet64();
+}
+
+DWORD TickGetDiv256(void)
+{
+	return (DWORD) (TickGet64() >> 8);
+}
+
+DWORD TickGetDiv64K(void)
+{
+	return (DWORD) (TickGet64() >> 16);
+}
+
+DWORD TickConvertToMilliseconds(DWORD dwTickValue)
+{
+	return (DWORD) (((QWORD) dwTickValue * 1000ull + TICKS_PER_SECOND / 2ull) / TICKS_PER_SECOND);
+}
+
+void TickUpdate(void)
+{
+}
+
+/*********************************************************************
+ * Function:        void HostDelay10us(unsigned long x)
+ * PreCondition:    TickInit() is already called.
+ * Input:           x - delay in units of 10us
+ * Output:          None
+ * Side Effects:    None
+ * Overview:        Backs the Delay10us() macro.  Short delays spin on
+ *					the clock because nanosleep() overshoots them by tens
+ *					of microseconds.
+ * Note:            None
+ ********************************************************************/
+void HostDelay10us(unsigned long x)
+{
+	QWORD qwEnd;
+	struct timespec ts;
+
+	if (!bHostRealTime) {
+		qwSkipped += (QWORD) x * 10000ull;
+		return;
+	}
+	qwEnd = ClockNow() + (QWORD) x * 10000ull;
+	if (x > 20ul) {
+		ts.tv_sec = (time_t) ((x - 10ul) / 100000ul);
+		ts.tv_nsec = (long) ((x - 10ul) % 100000ul) * 10000l;
+		nanosleep(&ts, NULL);
+	}
+	while (ClockNow() < qwEnd);
+}
@@ -0,0 +1,352 @@
+/*********************************************************************
+ * FileName:        MPFSTest.c
+ * Dependencies:    MPFS2.c built with MPFS_USE_EEPROM
+ * Processor:       x86/x86-64 Linux host
+ * Complier:        gcc
+ *
+ * Checks of the MPFS2 upload writer against a simulated 25LC1024.
+ * The EEPROM here keeps a write cycle busy for a few XEEIsBusy()
+ * polls, flags page crossings and can flip one bit as it is
+ * programmed.  Small images are built on the fly and fit a slot;
+ * MPFSImg2.bin does not and is refused, or written over the whole
+ * area when built with MPFS_WRITE_WHOLE_AREA (MPFSTestWhole).
+ *
+ * Usage: MPFSTest [path to MPFSImg2.bin]   (make check)
+ *        MPFSTestWhole [path to MPFSImg2.bin]
+ * Prints one line per check and exits with 1 if any failed.
+ ********************************************************************/
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TCPIP Stack/TCPIP.h"
+
+#define BUSY_POLLS		(3)			// XEEIsBusy() TRUE this often per write
+
+static unsigned char EEPROM[MPFS_EEPROM_SIZE];
+static DWORD dwReadAddr;
+static int iBusy;
+static DWORD dwCorrupt;				// Flip a bit here when programmed, 0 for none
+static int bPageCrossed;
+static int iFailures;
+
+/*********************************************************************
+ * Simulated EEPROM
+ ********************************************************************/
+void XEEInit(void)
+{
+}
+
+BOOL XEEIsBusy(void)
+{
+	if (iBusy) {
+		iBusy--;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+// Like SendWrite(), waits for the last cycle before starting another
+XEE_RESULT XEEWritePage(DWORD address, unsigned char *buffer, WORD length)
+{
+	iBusy = 0;
+	if (address / MPFS_WRITE_PAGE_SIZE != (address + length - 1) / MPFS_WRITE_PAGE_SIZE
+		|| address + length > sizeof(EEPROM))
+		bPageCrossed = 1;
+	else
+		memcpy(EEPROM + address, buffer, length);
+	if (dwCorrupt && dwCorrupt >= address && dwCorrupt < address + length)
+		EEPROM[dwCorrupt] ^= 0x10;
+	iBusy = BUSY_POLLS;
+	return XEE_SUCCESS;
+}
+
+XEE_RESULT XEEReadArray(DWORD address, unsigned char *buffer, unsigned char length)
+{
+	iBusy = 0;
+	while (length--)
+		*buffer++ = EEPROM[address++ % sizeof(EEPROM)];
+	return XEE_SUCCESS;
+}
+
+XEE_RESULT XEEBeginRead(DWORD address)
+{
+	iBusy = 0;
+	dwReadAddr = address;
+	return XEE_SUCCESS;
+}
+
+unsigned char XEERead(void)
+{
+	return EEPROM[dwReadAddr++ % sizeof(EEPROM)];
+}
+
+XEE_RESULT XEEEndRead(void)
+{
+	return XEE_SUCCESS;
+}
+
+/*********************************************************************
+ * Helpers
+ ********************************************************************/
+static void Check(int bOK, const char *szFormat, ...)
+{
+	va_list ap;
+
+	printf("%s: ", bOK ? "ok  " : "FAIL");
+	va_start(ap, szFormat);
+	vprintf(szFormat, ap);
+	va_end(ap);
+	printf("\n");
+	fflush(stdout);
+	if (!bOK)
+		iFailures++;
+}
+
+static void PutLE32(unsigned char *p, DWORD v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+// Builds a 2.0 image holding one file, padded to dwSize bytes
+static DWORD MakeImage(unsigned char *img, const char *szName,
+					   const char *szData, DWORD dwSize)
+{
+	DWORD dwName = 8 + 24, dwData = dwName + strlen(szName) + 1;
+	const char *p;
+	WORD wHash = 0;
+
+	memset(img, 0, dwSize);
+	memcpy(img, "MPFS\x02\x00\x01\x00", 8);
+	for (p = szName; *p; p++)
+		wHash += (unsigned char) *p;
+	img[8] = wHash;
+	img[9] = wHash >> 8;
+	PutLE32(img + 12, dwName);
+	PutLE32(img + 16, dwData);
+	PutLE32(img + 20, strlen(szData));
+	strcpy((char *) img + dwName, szName);
+	memcpy(img + dwData, szData, strlen(szData));
+	return dwData + strlen(szData) > dwSize ? dwData + strlen(szData) : dwSize;
+}
+
+// Reads a whole file into buf, -1 if it does not open
+static long ReadFile(const char *szName, unsigned char *buf, long lMax)
+{
+	MPFS_HANDLE h;
+	long lLen = 0;
+	WORD w;
+
+	h = MPFSOpen((unsigned char *) szName);
+	if (h == MPFS_INVALID_HANDLE)
+		return -1;
+	while (lLen < lMax && (w = MPFSGetArray(h, buf + lLen, 64)) != 0)
+		lLen += w;
+	MPFSClose(h);
+	return lLen;
+}
+
+// True if the file opens and holds szData
+static int FileIs(const char *szName, const char *szData)
+{
+	unsigned char buf[256];
+	long lLen = ReadFile(szName, buf, sizeof(buf));
+
+	return lLen == (long) strlen(szData) && !memcmp(buf, szData, lLen);
+}
+
+/*********************************************************************
+ * Function:        static int Upload(const unsigned char *img,
+ *									  DWORD dwLen, DWORD dwSize,
+ *									  int *pMidway)
+ *
+ * Input:           img, dwLen: bytes to write, as HTTPMPFSUpload()
+ *						does, 16 at a time
+ *					dwSize: size given to MPFSFormat()
+ *					pMidway: set to 1 if a.txt opened halfway through
+ *
+ * Output:          MPFSPutEnd(), or -1 if MPFSFormat() failed
+ ********************************************************************/
+static int Upload(const unsigned char *img, DWORD dwLen, DWORD dwSize,
+				  int *pMidway)
+{
+	MPFS_HANDLE h;
+	DWORD i = 0;
+	WORD w;
+	unsigned char buf[256];
+
+	h = MPFSFormat(dwSize);
+	if (h == MPFS_INVALID_HANDLE)
+		return -1;
+	while (i < dwLen) {
+		w = MPFSIsPutReady(h);
+		if (w > 16)
+			w = 16;
+		if (w > dwLen - i)
+			w = dwLen - i;
+		i += MPFSPutArray(h, (unsigned char *) img + i, w);
+		if (pMidway && i >= dwLen / 2) {
+			*pMidway = ReadFile("a.txt", buf, sizeof(buf)) >= 0;
+			pMidway = NULL;
+		}
+	}
+	return MPFSPutEnd();
+}
+
+/*********************************************************************
+ * The checks
+ ********************************************************************/
+static unsigned char imgA[4096], imgB[4096], imgBig[200000];
+
+static void TestSlots(void)
+{
+	DWORD dwA, dwB;
+	int bMidway = 0;
+
+	dwA = MakeImage(imgA, "a.txt", "first image", 3000);
+	dwB = MakeImage(imgB, "a.txt", "second image", 2000);
+
+	Check(FileIs("a.txt", "first image") == 0, "a blank EEPROM has no files");
+	Check(Upload(imgA, dwA, dwA, NULL) == 1 && EEPROM[MPFS_SLOT_FLAG] == MPFS_SLOT_SECOND &&
+		FileIs("a.txt", "first image"), "the first upload goes to the second slot");
+	Check(Upload(imgB, dwB, dwB, &bMidway) == 1 && bMidway &&
+		EEPROM[MPFS_SLOT_FLAG] == MPFS_SLOT_FIRST && FileIs("a.txt", "second image"),
+		"the next one swaps back, the old image readable during the upload");
+	MPFSInit();
+	Check(FileIs("a.txt", "second image"), "the flag byte selects the slot after a restart");
+
+	dwCorrupt = MPFS_SLOT_BASE + MPFS_SLOT_SIZE + 100;
+	Check(Upload(imgA, dwA, dwA, NULL) == 0 && EEPROM[MPFS_SLOT_FLAG] == MPFS_SLOT_FIRST &&
+		FileIs("a.txt", "second image"), "a page corrupted while programmed is rejected");
+	dwCorrupt = 0;
+	Check(Upload(imgA, 20, dwA, NULL) == 0 && FileIs("a.txt", "second image"),
+		"a truncated upload is rejected");
+	imgA[0] = 'X';
+	Check(Upload(imgA, dwA, dwA, NULL) == 0 && FileIs("a.txt", "second image"),
+		"an image with a bad header is rejected");
+	imgA[0] = 'M';
+	memcpy(imgBig, imgA, dwA);
+	Check(Upload(imgBig, MPFS_SLOT_SIZE + 100, MPFS_SLOT_SIZE, NULL) == 0 &&
+		FileIs("a.txt", "second image"),
+		"more bytes than MPFSFormat() was told are rejected");
+	Check(Upload(imgA, dwA, dwA, NULL) == 1 && FileIs("a.txt", "first image"),
+		"a good upload after the rejected ones is used");
+}
+
+// Reads szImage into imgBig, 0 unless it is larger than a slot
+static DWORD LoadBig(const char *szImage)
+{
+	DWORD dwBig;
+	FILE *f;
+
+	f = fopen(szImage, "rb");
+	dwBig = f ? fread(imgBig, 1, sizeof(imgBig), f) : 0;
+	if (f)
+		fclose(f);
+	if (dwBig <= MPFS_SLOT_SIZE) {
+		Check(0, "%s is larger than a %lu byte slot", szImage,
+			(unsigned long) MPFS_SLOT_SIZE);
+		return 0;
+	}
+	return dwBig;
+}
+
+#if !defined(MPFS_WRITE_WHOLE_AREA)
+static void TestTooLarge(const char *szImage)
+{
+	DWORD dwBig, dwA;
+	unsigned char vFlag;
+
+	if ((dwBig = LoadBig(szImage)) == 0)
+		return;
+	dwA = MakeImage(imgA, "a.txt", "small image", 3000);
+	Upload(imgA, dwA, dwA, NULL);
+	vFlag = EEPROM[MPFS_SLOT_FLAG];
+
+	Check(Upload(imgBig, dwBig, dwBig, NULL) == -1 && EEPROM[MPFS_SLOT_FLAG] == vFlag &&
+		FileIs("a.txt", "small image"),
+		"%lu byte image is refused before writing, the old one kept",
+		(unsigned long) dwBig);
+	Check(Upload(imgA, dwA, MPFS_SLOT_SIZE + 1, NULL) == -1,
+		"so is an upload one byte larger than a slot");
+	Check(Upload(imgA, dwA, MPFS_SLOT_SIZE, NULL) == 1 && EEPROM[MPFS_SLOT_FLAG] != vFlag &&
+		FileIs("a.txt", "small image"), "one that fits a slot still swaps");
+	MPFSInit();
+	Check(FileIs("a.txt", "small image"), "and is used after a restart");
+	Check(!bPageCrossed, "no write crossed a page");
+}
+#else
+static void TestWhole(const char *szImage)
+{
+	unsigned char buf[65536], c[8];
+	DWORD dwBig, dwA, dwStart = 0, dwLen = 0;
+	MPFS_HANDLE h;
+	long lLen;
+	int bMidway = 1;
+
+	if ((dwBig = LoadBig(szImage)) == 0)
+		return;
+	dwA = MakeImage(imgA, "a.txt", "small image", 3000);
+
+	Check(Upload(imgBig, dwBig, dwBig, &bMidway) == 1 && !bMidway &&
+		EEPROM[MPFS_SLOT_FLAG] == MPFS_SLOT_WHOLE,
+		"%lu byte image is written over the whole area, no files open meanwhile",
+		(unsigned long) dwBig);
+	h = MPFSOpen((unsigned char *) "index.htm");
+	if (h != MPFS_INVALID_HANDLE) {
+		dwStart = MPFSGetStartAddr(h);
+		dwLen = MPFSGetSize(h);
+		MPFSClose(h);
+	}
+	lLen = ReadFile("index.htm", buf, sizeof(buf));
+	Check(h != MPFS_INVALID_HANDLE && lLen > 0 && lLen == (long) dwLen &&
+		dwStart + dwLen <= dwBig && !memcmp(buf, imgBig + dwStart, lLen),
+		"index.htm reads back from it");
+	MPFSInit();
+	Check(ReadFile("index.htm", buf, sizeof(buf)) > 0, "and is used after a restart");
+
+	// The image in use spans both slots, so even a small one replaces it
+	Check(Upload(imgA, dwA, dwA, NULL) == 1 && EEPROM[MPFS_SLOT_FLAG] == MPFS_SLOT_FIRST &&
+		FileIs("a.txt", "small image") && ReadFile("index.htm", buf, sizeof(buf)) < 0,
+		"a small image after it is written over it");
+
+	dwCorrupt = MPFS_SLOT_BASE + 40000;
+	Check(Upload(imgBig, dwBig, dwBig, NULL) == 0 && EEPROM[MPFS_SLOT_FLAG] == MPFS_SLOT_NONE &&
+		ReadFile("a.txt", buf, sizeof(buf)) < 0 && ReadFile("index.htm", buf, sizeof(buf)) < 0,
+		"a rejected upload over the whole area leaves no files");
+	dwCorrupt = 0;
+	MPFSInit();
+	Check(ReadFile("index.htm", buf, sizeof(buf)) < 0, "not even after a restart");
+	Check(Upload(imgA, dwA, dwA, NULL) == 1 && FileIs("a.txt", "small image"),
+		"a good upload brings the files back");
+
+	Check(Upload(imgBig, dwBig, MPFS_EEPROM_SIZE, NULL) == -1 && FileIs("a.txt", "small image"),
+		"an upload larger than the EEPROM is refused before writing");
+
+	// Back to two slots once a small image is in the first one
+	Check(Upload(imgA, dwA, dwA, NULL) == 1 && EEPROM[MPFS_SLOT_FLAG] == MPFS_SLOT_SECOND,
+		"small images are double buffered again");
+	XEEReadArray(MPFS_SLOT_BASE + MPFS_SLOT_SIZE, c, 4);
+	Check(!bPageCrossed && !memcmp(c, "MPFS", 4), "no write crossed a page");
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	memset(EEPROM, 0xFF, sizeof(EEPROM));
+	MPFSInit();
+
+	TestSlots();
+#if defined(MPFS_WRITE_WHOLE_AREA)
+	TestWhole(argc > 1 ? argv[1] : "../MPFSImg2.bin");
+#else
+	TestTooLarge(argc > 1 ? argv[1] : "../MPFSImg2.bin");
+#endif
+
+	printf("%d check(s) failed\n", iFailures);
+	return iFailures ? 1 : 0;
+}
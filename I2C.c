@@ -7,7 +7,7 @@
 /*				Fecha de modificacin:	05/03/2011								*/
 /*				Autor:					Mariano Ariel Deville					*/
 /********************************************************************************/
-#include "i2c.h"
+#include "I2C.h"
 /********************************************************************************/
 /*				CONFIGURACION E INICIALIZACION DEL MODULO						*/
 /********************************************************************************/
@@ -7,17 +7,29 @@
 #ifndef __COMPILER_H
 #define __COMPILER_H
 
+#if defined(HOST_BUILD)
+// Linux host build (see Host/Makefile).  The PIC18 specific ROM function 
+// variants are not needed, so __18CXX stays undefined.
+#include "HardwareProfile.h"
+#else
 #define __18CXX					// lo define para toda la linea 18 de hitech.
 #include <htc.h>
 #include "HardwareProfile.h"
+#endif
 #define INSTR_FREQ			((CLOCK_FREQ+2ul)/4ul)
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Base RAM pointer type for given architecture
+// Base RAM pointer type for given architecture.  On the host it must hold 
+// a full pointer, since TCP keeps PIC RAM socket buffers as PTR_BASE.
+#if defined(HOST_BUILD)
+#include <stdint.h>
+#define PTR_BASE	uintptr_t
+#else
 #define PTR_BASE	WORD
+#endif
 
 // Definitions that apply to all compilers
 #define memcmppgm2ram(a,b,c)	memcmp(a,b,c)
@@ -30,11 +42,23 @@
 #define strchrpgm(a,b)			strchr(a,b)
 #define strcatpgm2ram(a,b)		strcat(a,b)
 
-#define	__attribute__(a)
 #define ROM                 	const
 #define rom
+
+#if defined(HOST_BUILD)
+void HostReset(void) __attribute__ ((noreturn));
+#define Nop()
+#define ClrWdt()
+#define CLRWDT()
+#define Reset()					HostReset()
+// PIC only variable attributes (section placement, not cleared at reset)
+#define far
+#define persistent
+#else
+#define	__attribute__(a)
 #define Nop()               	asm("NOP");
 #define ClrWdt()				asm("CLRWDT");
 #define Reset()					asm("RESET");
+#endif
 
 #endif
@@ -16,11 +16,19 @@ typedef enum _BOOL { FALSE = 0, TRUE } BOOL;	// Undefined size
 
 typedef unsigned char BYTE;		// 8-bit unsigned
 typedef unsigned short int WORD;	// 16-bit unsigned
+#if defined(HOST_BUILD)
+typedef unsigned int DWORD;		// 32-bit unsigned (long is 64-bit on LP64 hosts)
+#else
 typedef unsigned long DWORD;	// 32-bit unsigned
+#endif
 typedef unsigned long long QWORD;	// 64-bit unsigned
 typedef signed char CHAR;		// 8-bit signed
 typedef signed short int SHORT;	// 16-bit signed
+#if defined(HOST_BUILD)
+typedef signed int LONG;		// 32-bit signed
+#else
 typedef signed long LONG;		// 32-bit signed
+#endif
 typedef signed long long LONGLONG;	// 64-bit signed
 
 typedef union _BYTE_VAL {
@@ -10,6 +10,26 @@
  ********************************************************************/
 #ifndef __ANNONCE_H
 #define __ANNONCE_H
+#define ANNOUNCE_PORT	30303
+
+// A discovery request is a datagram to ANNOUNCE_PORT starting with 'D'.
+// The reply is "<NetBIOS name>\r\n<MAC as XX-XX-XX-XX-XX-XX>\r\n", sent
+// after a delay of MAC[5]/256 of a window (ANNOUNCE_JITTER_MS) so a
+// broadcast does not make every board answer at once.
+//
+// Request "DM[w]": same reply, followed by the binary trailer below.
+// The optional byte w replaces ANNOUNCE_JITTER_MS, in ms (0 = no delay).
+// Multi-byte fields are big-endian.
+//	 0	'M'
+//	 1	Length of what follows (ANNOUNCE_READING_LENGTH)
+//	 2	Flags (ANNOUNCE_READING_VALID: the sensor answered both parts)
+//	 3	RH MSB, RH LSB, T MSB, T LSB, as sent by TCPServer()
+//	 7	Age of the reading, s (0xFFFF: none or older)
+//	 9	Uptime, s
+//	13	FIRMWARE_VERSION
+#define ANNOUNCE_OPCODE_READING		'M'
+#define ANNOUNCE_READING_LENGTH		(13u)
+#define ANNOUNCE_READING_VALID		(0x01u)
 
 void AnnounceIP(void);
 void DiscoveryTask(void);
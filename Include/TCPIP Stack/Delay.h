@@ -17,12 +17,18 @@
 #error INSTR_FREQ must be defined.
 #endif
 
+#if defined(HOST_BUILD)
+// Timed against the simulated Tick clock in Host/HostTick.c
+void HostDelay10us(unsigned long x);
+#define Delay10us(x)			HostDelay10us(x)
+#else
 #define Delay10us(x)			\
 {								\
 	unsigned long _dcnt;		\
 	_dcnt=x*((unsigned long)(0.00001/(1.0/INSTR_FREQ)/6));	\
 	while(_dcnt--);				\
 }
+#endif
 void DelayMs(unsigned char ms);
 void DelayS(unsigned char s);
 
@@ -24,12 +24,20 @@
 #define HTTP_MIN_CALLBACK_FREE	(16u)	// Min bytes free in TX FIFO before callbacks execute
 #define HTTP_CACHE_LEN			("600")	// Max lifetime (sec) of static responses as string
 #define HTTP_TIMEOUT			(45u)	// Max time (sec) to await more data before
+#define HTTP_KEEP_ALIVE_TIMEOUT	(5u)	// Max time (sec) a persistent connection waits for its next request
+#define HTTP_MIN_HEADER_FREE	(200u)	// Min bytes free in TX FIFO before a pipelined response starts
 
 	// Authentication requires Base64 decoding
 #if defined(HTTP_USE_AUTHENTICATION)
 #ifndef STACK_USE_BASE64_DECODE
 #define STACK_USE_BASE64_DECODE
 #endif
+#endif
+
+	// Only allow MPFS uploading if using EEPROM for storage.  Done 
+	// here so HTTP_STATUS matches HTTPResponseHeaders[] in HTTP2.c.
+#if !defined(MPFS_USE_EEPROM) || !defined(HTTP_USE_POST)
+#undef HTTP_MPFS_UPLOAD
 #endif
 
 /*********************************************************************
@@ -50,6 +58,8 @@ typedef enum _HTTP_STATUS {
 	HTTP_MPFS_OK,				// An MPFS Upload was successful
 	HTTP_MPFS_ERROR,			// An MPFS Upload was not a valid image
 #endif
+	HTTP_NOT_MODIFIED,			// 304 Not Modified will be returned
+	HTTP_RANGE_NOT_SATISFIABLE,	// 416 Requested Range Not Satisfiable will be returned
 	HTTP_REDIRECT,				// 302 Redirect will be returned
 	HTTP_SSL_REQUIRED			// 403 Forbidden is returned, indicating SSL is required
 } HTTP_STATUS;
@@ -71,7 +81,8 @@ typedef enum _SM_HTTP2 {
 	SM_HTTP_SERVE_COOKIES,		// Adds any cookies to the response
 	SM_HTTP_SERVE_BODY,			// Serves the actual content
 	SM_HTTP_SEND_FROM_CALLBACK,	// Invokes a dynamic variable callback
-	SM_HTTP_DISCONNECT,			// Disconnects the server and closes all files
+	SM_HTTP_DISCONNECT,			// Closes all files and disconnects, unless the connection persists
+	SM_HTTP_KEEP_ALIVE,			// Waits for the next request on a persistent connection
 	SM_HTTP_WAIT				// Unused state
 } SM_HTTP2;
 
@@ -95,9 +106,28 @@ typedef enum _HTTP_FILE_TYPE {
 	HTTP_JPG,					// File is JPG image (extension .jpg)
 	HTTP_JAVA,					// File is java (extension .java)
 	HTTP_WAV,					// File is audio (extension .wav)
+	HTTP_JSON,					// File is JSON data (extension .json)
 	HTTP_UNKNOWN				// File type is unknown
 } HTTP_FILE_TYPE;
 
+	// Conditional GET state (HTTP_CONN.validators).  If-None-Match 
+	// decides when present, otherwise If-Modified-Since does.
+#define HTTP_VALIDATOR_ETAG_SENT	(0x01u)	// If-None-Match was received
+#define HTTP_VALIDATOR_ETAG_MATCH	(0x02u)	// It listed the file's ETag or *
+#define HTTP_VALIDATOR_DATE_MATCH	(0x04u)	// If-Modified-Since is the file's Last-Modified
+#define HTTP_VALIDATOR_RANGE_STALE	(0x08u)	// If-Range names another version, so send it all
+
+	// Hash of header and argument names, one byte at a time from zero.  
+	// Cheap on the PIC18 and free of collisions among the names parsed.
+#define HTTP_HASH(h, c)			((unsigned char) ((h) * 3u + (unsigned char) (c)))
+
+	// Body framing (HTTP_CONN.chunked).  Dynamic pages have no length 
+	// up front, so HTTP/1.1 clients get them in chunks.
+#define HTTP_CHUNKED_NONE		(0u)	// Delimited by Content-Length or by closing
+#define HTTP_CHUNKED_ALLOWED	(1u)	// HTTP/1.1 request, framing not decided yet
+#define HTTP_CHUNKED_FIRST		(2u)	// Chunked, no chunk sent yet
+#define HTTP_CHUNKED_NEXT		(3u)	// Chunked, the last chunk still needs its CRLF
+
 	// HTTP Connection Struct
 	// Stores partial state data for each connection
 	// Meant for storage in fast access RAM
@@ -121,6 +151,11 @@ typedef struct _HTTP_CONN {
 	MPFS_HANDLE offsets;		// File pointer for any offset info being used
 	unsigned char hasArgs;		// True if there were get or cookie arguments   
 	unsigned char isAuthorized;	// 0x00-0x79 on fail, 0x80-0xff on pass
+	unsigned char validators;	// HTTP_VALIDATOR_* flags of a conditional GET
+	unsigned char keepAlive;	// TRUE to read another request after this response
+	unsigned char chunked;		// HTTP_CHUNKED_* framing of the body
+	DWORD rangeStart;			// First byte of a static file to send, or 0xffffffff
+	DWORD rangeEnd;				// Last byte, or the suffix length while rangeStart is 0xffffffff
 	HTTP_STATUS httpStatus;		// Request method/status
 	HTTP_FILE_TYPE fileType;	// File type to return with Content-Type
 	unsigned char data[HTTP_MAX_DATA_LEN];	// General purpose data buffer
@@ -154,7 +189,11 @@ unsigned char *HTTPGetArg(unsigned char *data, unsigned char *arg);
 void HTTPIncFile(const unsigned char *file);
 
 		// const function variants for PIC18
+#if defined(__18CXX)
 unsigned char *HTTPGetROMArg(unsigned char *data, const unsigned char *arg);
+#else
+#define HTTPGetROMArg(a,b)	HTTPGetArg(a,(unsigned char*)(b))
+#endif
 
 #endif
 
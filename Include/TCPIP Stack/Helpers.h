@@ -25,6 +25,7 @@ void ultoa(DWORD Value, unsigned char *Buffer);
 
 DWORD GenerateRandomDWORD(void);
 void uitoa(WORD Value, unsigned char *Buffer);
+void fixtoa(LONG Value, unsigned char Decimals, unsigned char *Buffer);
 void UnencodeURL(unsigned char *URL);
 WORD Base64Decode(unsigned char *cSourceData, WORD wSourceLen,
 				  unsigned char *cDestData, WORD wDestLen);
@@ -27,6 +27,40 @@ typedef struct __attribute__ ((aligned(2), packed)) {
 #define MAC_ARP     	(0x06u)
 #define MAC_UNKNOWN 	(0xFFu)
 
+// Events latched by MACISR() for StackTask().  Single bit fields so that 
+// the main loop can clear them with one instruction while the ISR runs.
+typedef union {
+	unsigned char Val;
+	struct {
+		unsigned char bRxPacket:1;	// PKTIF: at least one frame in the RX ring
+		unsigned char bRxError:1;	// RXERIF: a frame was dropped (ring full)
+		unsigned char:6;
+	} bits;
+} MAC_EVENTS;
+
+// RX interrupt counters.  Latencies are in ticks from the PKTIF interrupt 
+// to the moment MACGetHeader() hands the first frame of a burst to the stack.
+typedef struct _MAC_RX_STATS {
+	DWORD dwInterrupts;
+	DWORD dwRxErrors;
+	WORD wLastLatency;
+	WORD wMaxLatency;
+	DWORD dwFiltered;			// Broadcasts dropped by the receive filter profile
+} MAC_RX_STATS;
+
+extern volatile MAC_EVENTS MACEvents;
+extern MAC_RX_STATS MACRxStats;
+
+// Frames kept in the RX ring after MACGetHeader() has moved on, for the 
+// UDP receive queues.  A handle is the location of the frame in the ring.  
+// Held frames may be released in any order, but the hardware only gets 
+// the space back once every older held frame is released too.
+typedef WORD MAC_RX_HANDLE;
+#define MAC_RX_INVALID_HANDLE	(0xFFFFu)
+#if !defined(MAC_RX_HOLD_SLOTS)
+#define MAC_RX_HOLD_SLOTS		(4u)
+#endif
+
 /*
  * Microchip Ethernet controller specific MAC items
  */
@@ -38,15 +72,27 @@ typedef struct __attribute__ ((aligned(2), packed)) {
 #define RESERVED_SSL_MEMORY 0ul
 #endif
 
+#if !defined(MAC_TX_BUFFER_COUNT)
+#define MAC_TX_BUFFER_COUNT		1
+#endif
+#if (MAC_TX_BUFFER_COUNT < 1) || (MAC_TX_BUFFER_COUNT > 4)
+#error Invalid MAC_TX_BUFFER_COUNT value specified
+#endif
+
 // MAC RAM definitions
+// Layout: RX ring | MAC_TX_BUFFER_COUNT TX slots | TCP | HTTP | SSL
+// Each TX slot holds the control byte, a full frame and the status vector.
 #define RAMSIZE	8192ul
-#define TXSTART (RAMSIZE - (1ul+1514ul+7ul) - TCP_ETH_RAM_SIZE - RESERVED_HTTP_MEMORY - RESERVED_SSL_MEMORY)
+#define MAC_TX_SLOT_SIZE	(1ul+1514ul+7ul)
+#define TXSTART (RAMSIZE - MAC_TX_BUFFER_COUNT*MAC_TX_SLOT_SIZE - TCP_ETH_RAM_SIZE - RESERVED_HTTP_MEMORY - RESERVED_SSL_MEMORY)
 #define RXSTART	(0ul)			// Should be an even memory address; must be 0 for errata
 #define	RXSTOP	((TXSTART-2ul) | 0x0001ul)	// Odd for errata workaround
 #define RXSIZE	(RXSTOP-RXSTART+1ul)
 
-#define BASE_TX_ADDR	(TXSTART + 1ul)
-#define BASE_TCB_ADDR	(BASE_TX_ADDR + (1514ul+7ul))
+// Slot currently being filled; moves on every MACFlush()
+extern WORD wMACTxBase;
+#define BASE_TX_ADDR	(wMACTxBase)
+#define BASE_TCB_ADDR	(TXSTART + MAC_TX_BUFFER_COUNT*MAC_TX_SLOT_SIZE)
 #define BASE_HTTPB_ADDR (BASE_TCB_ADDR + TCP_ETH_RAM_SIZE)
 #define BASE_SSLB_ADDR	(BASE_HTTPB_ADDR + RESERVED_HTTP_MEMORY)
 
@@ -167,6 +213,9 @@ unsigned char GetCLKOUT(void);
 #define GetLEDConfig()		ReadPHYReg(PHLCON).Val
 
 void MACInit(void);
+void MACISR(void);
+BOOL MACIsRxPending(void);
+void MACUpdateRxFilter(void);
 BOOL MACIsLinked(void);
 BOOL MACGetHeader(MAC_ADDR * remote, unsigned char *type);
 void MACSetReadPtrInRx(WORD offset);
@@ -175,6 +224,10 @@ WORD MACSetReadPtr(WORD address);
 unsigned char MACGet(void);
 WORD MACGetArray(unsigned char *val, WORD len);
 void MACDiscardRx(void);
+MAC_RX_HANDLE MACHoldRx(void);
+void MACReleaseRx(MAC_RX_HANDLE h);
+void MACSetReadPtrInHeldRx(MAC_RX_HANDLE h, WORD offset);
+MAC_RX_HANDLE MACGetOldestHeldRx(void);
 WORD MACGetFreeRxSize(void);
 void MACMemCopyAsync(WORD destAddr, WORD sourceAddr, WORD len);
 BOOL MACIsMemCopyDone(void);
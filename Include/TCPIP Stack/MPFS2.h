@@ -20,11 +20,53 @@ typedef DWORD MPFS_PTR;
 #else
 #define MPFS_WRITE_PAGE_SIZE		(64u)
 #endif
+
+#if !defined(MPFS_EEPROM_SIZE)
+#if defined(USE_EEPROM_25LC1024)
+#define MPFS_EEPROM_SIZE			(0x20000ul)
+#else
+#define MPFS_EEPROM_SIZE			(0x8000ul)
+#endif
+#endif
+
+// The EEPROM after the reserve block holds two image slots.  An upload 
+// goes to the one not in use, and the byte at MPFS_SLOT_FLAG switches 
+// to it only once it has been verified.  Slots start on a page boundary.
+//
+// An image larger than MPFS_SLOT_SIZE cannot be kept twice.  MPFSFormat() 
+// is given the upload's size and refuses such an image, so the upload 
+// gets the error page and the old site stays up.  The slots are 16 KB on 
+// the 25LC256 and 64 KB on the 25LC1024.
+//
+// Define MPFS_WRITE_WHOLE_AREA to write such an image over the whole 
+// area from MPFS_SLOT_BASE instead.  The upload is then no longer 
+// atomic: the old image is lost when the upload starts, no file opens 
+// until MPFSPutEnd() accepts the new one, and a rejected upload leaves 
+// no image at all.  MPFSImg2.bin (about 66 KB) needs it on the 25LC1024 
+// and does not fit the 25LC256.
+#define MPFS_SLOT_FLAG				((DWORD) MPFS_RESERVE_BLOCK)
+#define MPFS_SLOT_BASE				((MPFS_SLOT_FLAG + MPFS_WRITE_PAGE_SIZE) & ~((DWORD) MPFS_WRITE_PAGE_SIZE - 1))
+#define MPFS_SLOT_SIZE				(((MPFS_EEPROM_SIZE - MPFS_SLOT_BASE) / 2) & ~((DWORD) MPFS_WRITE_PAGE_SIZE - 1))
+
+// Values of the flag byte.  Any other value, as in a blank EEPROM, 
+// reads as MPFS_SLOT_FIRST.
+#define MPFS_SLOT_FIRST				(0x00u)
+#define MPFS_SLOT_SECOND			(0x01u)
+// Only with MPFS_WRITE_WHOLE_AREA:
+#define MPFS_SLOT_NONE				(0x02u)		// Whole area being written, or rejected
+#define MPFS_SLOT_WHOLE				(0x03u)		// Image at MPFS_SLOT_BASE runs into the second slot
 #endif
 
 #define MPFS_INVALID_HANDLE 		(0xffu)
 typedef unsigned char MPFS_HANDLE;
 
+#define MPFS_INVALID_FAT			(0xffffu)
+
+// Recently opened names MPFSOpen() finds without searching the image
+#if !defined(MPFS_OPEN_CACHE_SIZE)
+#define MPFS_OPEN_CACHE_SIZE		(4u)
+#endif
+
 // MPFS Flags
 #define MPFS2_FLAG_ISZIPPED		((WORD)0x0001)
 #define MPFS2_FLAG_HASINDEX		((WORD)0x0002)
@@ -82,8 +124,9 @@ BOOL MPFSGetLong(MPFS_HANDLE hMPFS, DWORD * ul);
 BOOL MPFSSeek(MPFS_HANDLE hMPFS, DWORD offset, MPFS_SEEK_MODE mode);
 
 // MPFS Writing Functions
-MPFS_HANDLE MPFSFormat(void);
-void MPFSPutEnd(void);
+MPFS_HANDLE MPFSFormat(DWORD dwSize);
+BOOL MPFSPutEnd(void);
+WORD MPFSIsPutReady(MPFS_HANDLE hMPFS);
 WORD MPFSPutArray(MPFS_HANDLE hMPFS, unsigned char *data, WORD len);
 
 
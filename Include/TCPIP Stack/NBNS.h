@@ -52,6 +52,7 @@
  ********************************************************************/
 #ifndef __NBNS_H
 #define __NBNS_H
+#define NBNS_PORT		(137u)
 
 
 void NBNSTask(void);
@@ -81,6 +81,20 @@ typedef struct __attribute__ ((__packed__)) _NODE_INFO {
 	MAC_ADDR MACAddr;
 } NODE_INFO;
 
+// StackTask() receive counters
+typedef struct _STACK_RX_STATS {
+	DWORD dwARP;				// Frames handed to each protocol
+	DWORD dwICMP;
+	DWORD dwTCP;
+	DWORD dwUDP;
+	DWORD dwOther;				// Unknown EtherType or IP protocol, bad IP header
+	DWORD dwBudgetStops;		// Calls that left frames for the next call
+	DWORD dwDrains;				// Calls that went past the budget to drain the ring
+	DWORD dwUDPDropped;			// Datagrams dropped by UDPProcess() (queue full)
+} STACK_RX_STATS;
+
+extern STACK_RX_STATS StackRxStats;
+
 typedef struct __attribute__ ((__packed__)) _APP_CONFIG {
 	IP_ADDR MyIPAddr;
 	IP_ADDR MyMask;
@@ -106,6 +120,10 @@ extern APP_CONFIG AppConfig;
 
 void StackInit(void);
 void StackTask(void);
+#if MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_SERVICES || \
+	(MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_STRICT && defined(HOST_BUILD))
+BOOL StackIsWantedBroadcast(unsigned char type);
+#endif
 
 
 #endif
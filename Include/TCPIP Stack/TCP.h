@@ -63,17 +63,23 @@ typedef struct _TCB_STUB {
 		unsigned char bTXASAP:1;
 		unsigned char bTXFIN:1;
 		unsigned char bSocketReset:1;
-		unsigned char filler:7;
+		unsigned char bTXHold:1;	// TX reservation open, TCPFlush() waits for TCPPutReserved()
+		unsigned char filler:6;
 	} Flags;
 	WORD_VAL remoteHash;		// Hash consists of remoteIP, remotePort, localPort for connected sockets.  It is a localPort number only for listening server sockets.
 	unsigned char vMemoryMedium;
 } TCB_STUB;
 
 // The rest of the TCB is stored in Ethernet buffer RAM
-// Current size is 37 (PIC18), 38 (PIC24/dsPIC), or 40 bytes (PIC32)
+// Current size is 52 (PIC18), 53 (PIC24/dsPIC), or 56 bytes (PIC32)
 typedef struct _TCB {
 	DWORD retryInterval;
 	DWORD MySEQ;
+	DWORD rttSEQ;				// Sequence number whose ACK completes the pending RTT sample
+	DWORD recoverSEQ;			// Highest SEQ sent when data was last rewound (NewReno "recover")
+	WORD rttStart;				// Time the timed segment was sent, in TCP_RTT_SHIFT units
+	WORD wSRTT;					// Smoothed RTT * 8, in TCP_RTT_SHIFT units (0 = no sample yet)
+	WORD wRTTVAR;				// RTT variation * 4, in TCP_RTT_SHIFT units
 	DWORD RemoteSEQ;
 	PTR_BASE txUnackedTail;
 	WORD_VAL remotePort;
@@ -89,11 +95,23 @@ typedef struct _TCB {
 		unsigned char bFINSent:1;
 		unsigned char bSYNSent:1;
 		unsigned char bRemoteHostIsROM:1;
-		unsigned char filler:5;
+		unsigned char bRTTPending:1;	// A segment is being timed for RTT estimation
+		unsigned char bRTTBackoff:1;	// Retransmitted data outstanding; no RTT samples (Karn's rule)
+		unsigned char bInRecovery:1;	// ACKs below recoverSEQ don't start another fast retransmit
+		unsigned char filler:2;
 	} flags;
 	unsigned char retryCount;
+	unsigned char dupACKCount;	// Consecutive duplicate ACKs seen (saturates at 0xFF)
 	unsigned char vSocketPurpose;
 } TCB;
+// Loss recovery counters, cumulative over all sockets
+typedef struct _TCP_STATS {
+	DWORD dwDupACKs;			// Duplicate ACKs received while data was in flight
+	DWORD dwFastRetransmits;	// Retransmits triggered by duplicate ACKs
+	DWORD dwTimeoutRetransmits;	// Retransmits triggered by the RTO timer
+} TCP_STATS;
+extern TCP_STATS TCPStats;
+
 typedef struct _SOCKET_INFO {
 	NODE_INFO remote;
 	WORD_VAL remotePort;
@@ -127,10 +145,21 @@ void TCPFlush(TCP_SOCKET hTCP);
 #define TCP_OPEN_IP_ADDRESS				3
 #define TCP_OPEN_NODE_INFO				4
 TCP_SOCKET TCPOpen(DWORD dwRemoteHost,unsigned char vRemoteHostType,WORD wPort,unsigned char vSocketPurpose);
+// const function variants for PIC18
+#if defined(__18CXX)
 WORD TCPFindROMArrayEx(TCP_SOCKET hTCP,const unsigned char *cFindArray,WORD wLen,WORD wStart,WORD wSearchLen,BOOL bTextCompare);
-#define TCPFindROMArray(a,b,c,d,e)		TCPFindROMArrayEx(a,b,c,d,0,e)
 WORD TCPPutROMArray(TCP_SOCKET hTCP, const unsigned char *Data, WORD Len);
 const unsigned char *TCPPutROMString(TCP_SOCKET hTCP,const unsigned char *Data);
+#else
+#define TCPFindROMArrayEx(a,b,c,d,e,f)	TCPFindArrayEx(a,(unsigned char*)(b),c,d,e,f)
+#define TCPPutROMArray(a,b,c)			TCPPutArray(a,(unsigned char*)(b),c)
+#define TCPPutROMString(a,b)			TCPPutString(a,(unsigned char*)(b))
+#endif
+#define TCPFindROMArray(a,b,c,d,e)		TCPFindROMArrayEx(a,b,c,d,0,e)
+// TCPPutReserve() failed; FIFO pointers never get this high
+#define TCP_INVALID_RESERVE		((PTR_BASE)0xFFFFu)
+PTR_BASE TCPPutReserve(TCP_SOCKET hTCP, WORD wLen);
+void TCPPutReserved(TCP_SOCKET hTCP, PTR_BASE wReserve, unsigned char *Data, WORD wLen);
 WORD TCPGetTxFIFOFull(TCP_SOCKET hTCP);
 #define TCPGetRxFIFOFull(a)				TCPIsGetReady(a)
 #define TCPGetTxFIFOFree(a) 			TCPIsPutReady(a)
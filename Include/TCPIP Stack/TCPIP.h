@@ -27,11 +27,26 @@
 #include "TCPIP Stack/IP.h"
 #include "TCPIP Stack/ARP.h"
 #include "TCPIP Stack/UDP.h"
+#if defined(STACK_USE_DHCP_CLIENT)
+#include "TCPIP Stack/DHCP.h"
+#endif
 #include "TCPIP Stack/TCP.h"
 #include "TCPIP Stack/ICMP.h"
 #include "TCPIP Stack/Announce.h"
 #include "TCPIP Stack/NBNS.h"
 #include "TCPIP Stack/ServidorTCP.h"
+#if defined(STACK_USE_TCP_PERFORMANCE_TEST)
+#include "TCPIP Stack/TCPPerformanceTest.h"
+#endif
+#if defined(STACK_USE_MPFS2)
+#include "TCPIP Stack/MPFS2.h"
+#endif
+#if defined(MPFS_USE_EEPROM)
+#include "TCPIP Stack/XEEPROM.h"
+#endif
+#if defined(STACK_USE_HTTP2_SERVER)
+#include "TCPIP Stack/HTTP2.h"
+#endif
 #include "Mod_Med_HT.h"
-#include "i2c.h"
+#include "I2C.h"
 #endif
@@ -16,10 +16,25 @@
 typedef WORD UDP_PORT;
 typedef unsigned char UDP_SOCKET;
 
+#if !defined(UDP_RX_QUEUE_DEPTH)
+#define UDP_RX_QUEUE_DEPTH	(1u)
+#endif
+
+// A received datagram left in the MAC RX ring until the application has 
+// read it
+typedef struct _UDP_RX_DESCRIPTOR {
+	MAC_RX_HANDLE hFrame;
+	WORD wReadOffset;			// Next byte to read, from the Ethernet header
+	WORD wRemaining;			// Data bytes not read yet
+	BOOL bAdoptRemote;			// Sender becomes the socket's remote node
+} UDP_RX_DESCRIPTOR;
+
 typedef struct _UDP_SOCKET_INFO {
 	NODE_INFO remoteNode;
 	UDP_PORT remotePort;
 	UDP_PORT localPort;
+	UDP_RX_DESCRIPTOR RxQueue[UDP_RX_QUEUE_DEPTH];	// Oldest first
+	unsigned char vRxQueued;
 } UDP_SOCKET_INFO;
 
 #define INVALID_UDP_SOCKET      (0xffu)
@@ -48,6 +63,7 @@ void UDPInit(void);
 UDP_SOCKET UDPOpen(UDP_PORT localPort, NODE_INFO * remoteNode,UDP_PORT remotePort);
 void UDPClose(UDP_SOCKET s);
 BOOL UDPProcess(NODE_INFO * remoteNode, IP_ADDR * localIP, WORD len);
+void UDPTrimRxQueues(void);
 
 void UDPSetTxBuffer(WORD wOffset);
 WORD UDPIsPutReady(UDP_SOCKET s);
@@ -71,22 +87,4 @@ WORD UDPGetArray(unsigned char *cData, WORD wDataLen);
 void UDPDiscard(void);
 
 
-/*********************************************************************
- * Macro:           UDPSetRxBuffer(a)
- *
- * PreCondition:    None
- *
- * Input:           a       - Offset
- *
- * Output:          Next Read/Write access to receive buffer is
- *                  set to offset 'b'
- *
- * Side Effects:    None
- *
- * Note:            None
- *
- ********************************************************************/
-#define UDPSetRxBuffer(a) IPSetRxBuffer(a+sizeof(UDP_HEADER))
-
-
 #endif
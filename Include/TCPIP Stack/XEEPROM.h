@@ -18,6 +18,7 @@ void XEEInit(void);
 XEE_RESULT XEEBeginWrite(DWORD address);
 XEE_RESULT XEEWrite(unsigned char val);
 XEE_RESULT XEEEndWrite(void);
+XEE_RESULT XEEWritePage(DWORD address, unsigned char *buffer, WORD length);
 XEE_RESULT XEEBeginRead(DWORD address);
 unsigned char XEERead(void);
 XEE_RESULT XEEReadArray(DWORD address, unsigned char *buffer,unsigned char length);
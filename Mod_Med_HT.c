@@ -9,38 +9,140 @@
 /*						PROTOTIPO DE FUNCIONES									*/
 #include "TCPIP Stack/TCPIP.h"
 unsigned char ack,dat[8];
-void Medicion_HT(unsigned char *cad)
+unsigned char Ultima_Medicion[4];
+DWORD Tick_Ultima_Medicion;
+unsigned char Hay_Medicion=0;
+DWORD Cant_Mediciones=0;
+DWORD Cant_Fallas=0;
+// Estados de la medicin en curso.  Medicion_Periodica() la avanza desde el
+// lazo principal sin esperar al sensor mientras convierte.
+#define MED_LIBRE			0	// Ninguna medicin en curso
+#define MED_HUMEDAD			1	// El sensor convierte la HR (12 bits)
+#define MED_TEMPERATURA		2	// El sensor convierte la T (14 bits)
+// Espera mxima por cada conversin, la misma que daban los lazos de 4000
+// vueltas de Delay10us(2) y Delay10us(4).
+#define ESPERA_HUMEDAD		((DWORD)(TICKS_PER_SECOND/12ull))	// 83 ms
+#define ESPERA_TEMPERATURA	((DWORD)(TICKS_PER_SECOND/6ull))	// 167 ms
+static unsigned char Estado_Medicion=MED_LIBRE;
+static unsigned char Medicion_Falla;
+static unsigned char Medicion_Parcial[4];
+static DWORD Tick_Comando;						// TickGet() al mandar el comando
+static void Comenzar_Conversion(unsigned char comando, unsigned char estado)
 {
-	unsigned int cont=0;
-	Start(); 
-	Comando(0b10100000);
-	Espera_ACK();
-	cont=0;
-	while(DATA && cont++<4000)
-		Delay10us(2);
-	Dos_Bytes();
-	if(cont>3990)       // Fall la comunicacion con el sensor
-    {
-		dat[0]=0XFF;
-		dat[1]=0XFF;
-    }
-	*cad++=dat[0];
-	*cad++=dat[1];
-	DelayMs(1);
 	Start(); 
-	Comando(0b11000000);
+	Comando(comando);
 	Espera_ACK();
-	cont=0;
-	while(DATA && cont++<4000)
-		Delay10us(4);
+	Tick_Comando=TickGet();
+	Estado_Medicion=estado;
+	return;
+}
+static void Comenzar_Medicion(void)
+{
+	Medicion_Falla=0;
+	Comenzar_Conversion(0b10100000,MED_HUMEDAD);
+	return;
+}
+// Lee la conversin en curso si el sensor ya termin (DATA en 0) o si se le
+// acab el tiempo, y sigue con la prxima.  Devuelve 1 al terminar la
+// medicin completa y 0 si el sensor sigue convirtiendo.
+static unsigned char Avanzar_Medicion(void)
+{
+	unsigned char listo;
+	unsigned char *parte;
+	DWORD espera;
+	if(Estado_Medicion==MED_HUMEDAD)
+	{
+		parte=&Medicion_Parcial[0];
+		espera=ESPERA_HUMEDAD;
+	}
+	else
+	{
+		parte=&Medicion_Parcial[2];
+		espera=ESPERA_TEMPERATURA;
+	}
+	listo=!DATA;
+	if(!listo && TickGet()-Tick_Comando<espera)
+		return 0;
 	Dos_Bytes();
-	if(cont>3990)       // Fall la comunicacion con el sensor
+	if(!listo)          // Fall la comunicacion con el sensor
     {
 		dat[0]=0XFF;
 		dat[1]=0XFF;
+		Medicion_Falla=1;
     }
-	*cad++=dat[0];
-	*cad++=dat[1];
+	parte[0]=dat[0];
+	parte[1]=dat[1];
+	if(Estado_Medicion==MED_HUMEDAD)
+	{
+		Comenzar_Conversion(0b11000000,MED_TEMPERATURA);
+		return 0;
+	}
+	Estado_Medicion=MED_LIBRE;
+	memcpy(Ultima_Medicion,Medicion_Parcial,4);	// Guardo la lectura para Announce.c
+	Tick_Ultima_Medicion=TickGetDiv256();
+	Hay_Medicion=1;
+	Cant_Mediciones++;
+	if(Medicion_Falla)
+		Cant_Fallas++;
+	return 1;
+}
+// Medicin a pedido: espera al sensor (hasta ~250 ms si no contesta).  Si
+// Medicion_Periodica() tena una en curso, devuelve esa.
+void Medicion_HT(unsigned char *cad)
+{
+	if(Estado_Medicion==MED_LIBRE)
+		Comenzar_Medicion();
+	while(!Avanzar_Medicion())
+		Delay10us(2);
+	memcpy(cad,Ultima_Medicion,4);
+	return;
+}
+// Ultima_Medicion sirve si hubo una medicin y el sensor contest las dos
+// partes: Medicion_HT() guarda 0xFFFF en la que fall.
+unsigned char Medicion_Valida(void)
+{
+	if(!Hay_Medicion)
+		return 0;
+	if(Ultima_Medicion[0]==0xFF && Ultima_Medicion[1]==0xFF)
+		return 0;
+	if(Ultima_Medicion[2]==0xFF && Ultima_Medicion[3]==0xFF)
+		return 0;
+	return 1;
+}
+// Conversin de Ultima_Medicion a centsimas de C y de %HR sin punto
+// flotante.  Mismos coeficientes que MCHPFleet (T de 14 bits y HR de 12
+// bits, como mide Medicion_HT()).
+SHORT Temperatura_Centesimas(void)
+{
+	WORD so=((WORD)Ultima_Medicion[2]<<8)|Ultima_Medicion[3];
+	return (SHORT)so-3966;						// T = -39.66 + 0.01*SO
+}
+SHORT Humedad_Centesimas(void)
+{
+	WORD so=((WORD)Ultima_Medicion[0]<<8)|Ultima_Medicion[1];
+	LONG hr;
+	// HR lineal = -2.0468 + 0.0367*SO - 1.5955E-6*SO^2
+	hr=((LONG)so*367l-20468l)/100l-(LONG)((DWORD)so*so/6268ul);
+	// Compensada por temperatura: + (T-25)*(0.01 + 0.00008*SO)
+	hr+=((LONG)Temperatura_Centesimas()-2500l)*(LONG)(so+125u)/12500l;
+	if(hr<0l)
+		hr=0;
+	if(hr>10000l)
+		hr=10000;
+	return (SHORT)hr;
+}
+void Medicion_Periodica(void)
+{
+	if(Estado_Medicion!=MED_LIBRE)
+	{
+		Avanzar_Medicion();				// Tambin actualiza Ultima_Medicion
+		return;
+	}
+	if(PERIODO_MEDICION==0ul)
+		return;
+	if(Hay_Medicion && TickGetDiv256()-Tick_Ultima_Medicion<PERIODO_MEDICION*(DWORD)(TICKS_PER_SECOND/256ull))
+		return;
+	Comenzar_Medicion();
 	return;
 }
 void Start(void)
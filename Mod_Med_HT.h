@@ -13,4 +13,21 @@ void Espera_ACK(void);
 void Comando(unsigned char dispositivo);
 void Dos_Bytes(void);
 void Envia_No_ACK(void);
+void Medicion_Periodica(void);
+unsigned char Medicion_Valida(void);
+SHORT Temperatura_Centesimas(void);
+SHORT Humedad_Centesimas(void);
+
+// Segundos entre mediciones hechas por Medicion_Periodica(), aunque nadie
+// las pida por TCP.  Mantienen fresca la lectura que devuelve Announce.c.
+// 0 = medir solo a pedido.  No frena el lazo principal: manda el comando y
+// vuelve, y en las pasadas siguientes lee el resultado cuando DATA baja.
+#define PERIODO_MEDICION	(60ul)
+
+/*						LTIMA MEDICIN											*/
+extern unsigned char Ultima_Medicion[4];	// Como la enva TCPServer(): HR MSB, HR LSB, T MSB, T LSB
+extern DWORD Tick_Ultima_Medicion;			// TickGetDiv256() al terminarla
+extern unsigned char Hay_Medicion;
+extern DWORD Cant_Mediciones;				// Mediciones hechas, sirve de nmero de secuencia
+extern DWORD Cant_Fallas;					// Mediciones en que el sensor no respondi
 
@@ -18,8 +18,6 @@
 
 #if defined(STACK_USE_ANNOUNCE)
 
-#define ANNOUNCE_PORT	30303
-
 extern NODE_INFO remoteNode;
 
 /*********************************************************************
@@ -86,6 +84,45 @@ void AnnounceIP(void)
 	UDPClose(MySocket);									// Close the socket so it can be used by other modules
 }
 
+#if defined(STACK_USE_ANNOUNCE_READING)
+/*********************************************************************
+ * Function:        static void DiscoveryPutReading(void)
+ * PreCondition:    UDPIsPutReady() on the discovery socket
+ * Input:           None
+ * Output:          None
+ * Side Effects:    None
+ * Overview:        Appends the 'M' trailer described in Announce.h:
+ *					the cached reading of Mod_Med_HT.c, its age, the
+ *					uptime and the firmware version.
+ * Note:            Ages and uptime come from TickGetDiv256(), which 
+ *					wraps after about 300 days.
+ ********************************************************************/
+static void DiscoveryPutReading(void)
+{
+	DWORD_VAL dw;
+	DWORD dwNow;
+	unsigned char i;
+	dwNow = TickGetDiv256();
+	UDPPut(ANNOUNCE_OPCODE_READING);
+	UDPPut(ANNOUNCE_READING_LENGTH);
+	UDPPut(Medicion_Valida() ? ANNOUNCE_READING_VALID : 0u);
+	for (i = 0; i < 4u; i++)
+		UDPPut(Ultima_Medicion[i]);
+	dw.Val = (dwNow - Tick_Ultima_Medicion) / (DWORD) (TICKS_PER_SECOND / 256ull);
+	if (!Hay_Medicion || dw.Val > 0xFFFFul)
+		dw.Val = 0xFFFFul;
+	UDPPut(dw.v[1]);
+	UDPPut(dw.v[0]);
+	dw.Val = dwNow / (DWORD) (TICKS_PER_SECOND / 256ull);
+	UDPPut(dw.v[3]);
+	UDPPut(dw.v[2]);
+	UDPPut(dw.v[1]);
+	UDPPut(dw.v[0]);
+	UDPPut((unsigned char) (FIRMWARE_VERSION >> 8));
+	UDPPut((unsigned char) FIRMWARE_VERSION);
+}
+#endif
+
 void DiscoveryTask(void)
 {
 	static enum
@@ -96,7 +133,11 @@ void DiscoveryTask(void)
 		DISCOVERY_DISABLED
 	} DiscoverySM = DISCOVERY_HOME;
 	static UDP_SOCKET MySocket;
-	unsigned char i;
+	static DWORD dwRequestTick, dwJitter;
+#if defined(STACK_USE_ANNOUNCE_READING)
+	static unsigned char vOpcode;
+#endif
+	unsigned char i, vWindow;
 	switch (DiscoverySM)
 	{
 		case DISCOVERY_HOME:
@@ -116,14 +157,32 @@ void DiscoveryTask(void)
 				return;
 			// See if this is a discovery query or reply
 			UDPGet(&i);
-			UDPDiscard();
-			if (i != 'D')
+			if (i != 'D') {
+				UDPDiscard();
 				return;
-			DiscoverySM++;			// We received a discovery request, reply when we can
+			}
+			vWindow = ANNOUNCE_JITTER_MS;
+#if defined(STACK_USE_ANNOUNCE_READING)
+			vOpcode = 0;
+			if (UDPGet(&i) && i == ANNOUNCE_OPCODE_READING) {
+				vOpcode = i;
+				UDPGet(&vWindow);	// Optional, left alone if absent
+			}
+#endif
 			// Change the destination to the unicast address of the last received packet
 			memcpy((void *) &UDPSocketInfo[MySocket].remoteNode,(const void *) &remoteNode, sizeof(remoteNode));
+			// Everything needed for the reply is copied out, so the request 
+			// doesn't pin MAC RX space through the jitter wait below
+			UDPDiscard();
+			DiscoverySM++;			// We received a discovery request, reply when we can
+			// Boards of a fleet have consecutive MAC addresses: the last 
+			// byte spreads their replies evenly over the window
+			dwJitter = ((DWORD) AppConfig.MyMACAddr.v[5] * vWindow * (DWORD) (TICKS_PER_SECOND / 1000ull)) >> 8;
+			dwRequestTick = TickGet();
 			// No break needed.  If we get down here, we are now ready for the DISCOVERY_REQUEST_RECEIVED state
 		case DISCOVERY_REQUEST_RECEIVED:
+			if (TickGet() - dwRequestTick < dwJitter)
+				return;
 			if (!UDPIsPutReady(MySocket))
 				return;
 			// Begin sending our MAC address in human readable form.
@@ -148,6 +207,10 @@ void DiscoveryTask(void)
 			}
 			UDPPut('\r');
 			UDPPut('\n');
+#if defined(STACK_USE_ANNOUNCE_READING)
+			if (vOpcode == ANNOUNCE_OPCODE_READING)
+				DiscoveryPutReading();
+#endif
 			UDPFlush();								// Send the packet
 			DiscoverySM = DISCOVERY_LISTEN;			// Listen for other discovery requests
 			break;
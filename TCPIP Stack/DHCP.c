@@ -196,6 +196,9 @@ void DHCPTask(void)
 	case SM_DHCP_GET_OFFER:
 		// Check to see if a packet has arrived
 		if (UDPIsGetReady(DHCPSocket) < 250) {
+			// Anything shorter than a BOOTP message would otherwise stay 
+			// pinned in the MAC RX buffer
+			UDPDiscard();
 			// Go back and transmit a new discovery if we didn't get an offer after 2 seconds
 			if ((LONG) (eventTime - TickGet()) <= (LONG) 0)
 				smDHCPState = SM_DHCP_SEND_DISCOVERY;
@@ -221,6 +224,7 @@ void DHCPTask(void)
 	case SM_DHCP_GET_REQUEST_ACK:
 		// Check to see if a packet has arrived
 		if (UDPIsGetReady(DHCPSocket) < 250) {
+			UDPDiscard();
 			// Go back and transmit a new discovery if we didn't get an ACK after 2 seconds
 			if ((LONG) (eventTime - TickGet()) <= (LONG) 0)
 				smDHCPState = SM_DHCP_SEND_DISCOVERY;
@@ -252,6 +256,10 @@ void DHCPTask(void)
 		}
 		break;
 	case SM_DHCP_BOUND:
+		// Nothing is expected while bound.  Drop strays, such as a second 
+		// server's offer, so they don't pin MAC RX space for the lease.
+		if (UDPIsGetReady(DHCPSocket))
+			UDPDiscard();
 		if ((LONG) (eventTime - TickGet()) >= (LONG) 0)
 			break;
 		// Check to see if our lease has nearly expired and we must renew
@@ -278,6 +286,7 @@ void DHCPTask(void)
 	case SM_DHCP_GET_RENEW_ACK3:
 		// Check to see if a packet has arrived
 		if (UDPIsGetReady(DHCPSocket) < 250) {
+			UDPDiscard();
 			// Go back and transmit a new discovery if we didn't get an ACK after 2 seconds
 			if ((LONG) (eventTime - TickGet()) <= (LONG) 0) {
 				if (++smDHCPState > SM_DHCP_GET_RENEW_ACK3)
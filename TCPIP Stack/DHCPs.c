@@ -89,22 +89,37 @@ void DHCPServerTask(void)
 		smDHCPServer++;
 	case DHCP_LISTEN:
 		if(UDPIsGetReady(MySocket)<241)		// Check to see if a valid DHCP packet has arrived
+		{
+			UDPDiscard();					// Runts would stay pinned in the MAC RX buffer
 			break;
+		}
 		UDPGetArray((unsigned char *)&BOOTPHeader,sizeof(BOOTPHeader));		// Retrieve the BOOTP header
 		bAccept=(BOOTPHeader.ClientIP.Val==DHCPNextLease.Val)||(BOOTPHeader.ClientIP.Val==0x00000000);
 		// Validate first three fields
 		if (BOOTPHeader.MessageType!=1u)
+		{
+			UDPDiscard();
 			break;
+		}
 		if (BOOTPHeader.HardwareType!=1u)
+		{
+			UDPDiscard();
 			break;
+		}
 		if (BOOTPHeader.HardwareLen!=6u)
+		{
+			UDPDiscard();
 			break;
+		}
 		// Throw away 10 unused bytes of hardware address, server host name, and boot file name -- unsupported/not needed.
 		for(i=0;i<64+128+(16-sizeof(MAC_ADDR)); i++)
 			UDPGet(&Option);
 		UDPGetArray((unsigned char *) &dw, sizeof(DWORD));		// Obtain Magic Cookie and verify
 		if (dw != 0x63538263ul)
+		{
+			UDPDiscard();
 			break;
+		}
 		// Obtain options
 		while(1)
 		{
@@ -223,8 +238,9 @@ static void DHCPReplyToRequest(BOOTP_HEADER * Header, BOOL bAccept)
 	if (UDPIsPutReady(MySocket) < 300)
 		return;
 	// Search through all remaining options and look for the Requested IP address field
-	// Obtain options
-	while (UDPIsGetReady(MySocket))
+	// Obtain options.  UDPGet() fails at the end of the datagram; calling 
+	// UDPIsGetReady() here would open the next one queued on the socket.
+	while (1)
 	{
 		unsigned char Option, Len;
 		DWORD dw;
@@ -352,6 +352,12 @@ BOOL DNSIsResolved(IP_ADDR * HostIP)
 		if (!UDPIsGetReady(MySocket)) {
 			if (TickGet() - StartTime > DNS_TIMEOUT) {
 				smDNS++;
+				// Late answers would stay pinned in the MAC RX buffer 
+				// until DNSEndUsage()
+				if (smDNS == DNS_QUERY_FAIL) {
+					UDPClose(MySocket);
+					MySocket = INVALID_UDP_SOCKET;
+				}
 			}
 			break;
 		}
@@ -51,7 +51,43 @@ typedef struct _ENC_PREAMBLE {
 static WORD_VAL NextPacketLocation;
 static WORD_VAL CurrentPacketLocation;
 static BOOL WasDiscarded;
+// Frames kept by MACHoldRx(), oldest first.  ERXRDPT stays behind the 
+// oldest one until it is released; UDPTrimRxQueues() releases it early 
+// when the RX buffer runs low.
+typedef struct _MAC_RX_HELD {
+	WORD wLocation;
+	BOOL bReleased;
+} MAC_RX_HELD;
+static MAC_RX_HELD HeldRx[MAC_RX_HOLD_SLOTS];
+static unsigned char vHeldRx;
 static WORD wTXWatchdog;
+// Transmit slot ring.  Slots are filled in order; vTxHead is the oldest 
+// flushed frame (on the wire when TxActive), vTxCount the number of 
+// flushed frames not yet sent and vTxFill the slot being built.
+static WORD wTxEnd[MAC_TX_BUFFER_COUNT];
+static unsigned char vTxHead;
+static unsigned char vTxFill;
+static unsigned char vTxCount;
+static BOOL TxActive;
+WORD wMACTxBase;
+static volatile WORD wRxStamp;
+static volatile BOOL RxStampValid;
+#if MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_STRICT
+static DWORD dwFilterIP;		// IP address the pattern match filter accepts ARP for
+#endif
+static void TxService(void);
+static void TxStart(void);
+static void FreeRxSpace(void);
+
+#define TX_SLOT_START(n)		(TXSTART + (WORD) (n) * MAC_TX_SLOT_SIZE)
+
+volatile MAC_EVENTS MACEvents;
+MAC_RX_STATS MACRxStats;
+
+// DMA errata workaround: EDATA must not be accessed while a DMA copy is 
+// running.  MACMemCopyAsync() returns as soon as the copy is started, so 
+// every routine that touches EDATA or releases buffer memory waits here first.
+#define WaitForDMA()			while(ECON1bits.DMAST)
 
 /******************************************************************************
  * Function:        void MACInit(void)
@@ -70,6 +106,9 @@ static WORD wTXWatchdog;
  *
  * Note:            This function blocks for at least 1ms, waiting for the 
  *                  hardware to stabilize.
+ *
+ *					The Ethernet interrupt is enabled at high priority; the 
+ *					application's high priority ISR must call MACISR().
  *****************************************************************************/
 void MACInit(void)
 {
@@ -82,19 +121,38 @@ void MACInit(void)
 	// Configure the receive buffer boundary pointers 
 	// and the buffer write protect pointer (receive buffer read pointer)
 	WasDiscarded = TRUE;
+	vHeldRx = 0;
 	NextPacketLocation.Val = RXSTART;
 	ERXST = RXSTART;
 	ERXRDPTL = LOW(RXSTOP);		// Write low byte first
 	ERXRDPTH = HIGH(RXSTOP);	// Write high byte last
 	ERXND = RXSTOP;
 	ETXST = TXSTART;
-	// Write a permanant per packet control byte of 0x00
-	EWRPT = TXSTART;
-	MACPut(0x00);
-	// Configure Receive Filters 
+	// Write a permanant per packet control byte of 0x00 in every TX slot
+	for (i = 0; i < MAC_TX_BUFFER_COUNT; i++) {
+		EWRPT = TX_SLOT_START(i);
+		MACPut(0x00);
+	}
+	vTxHead = 0;
+	vTxFill = 0;
+	vTxCount = 0;
+	TxActive = FALSE;
+	wMACTxBase = TX_SLOT_START(0) + 1;
+	// Configure Receive Filters (see MAC_RX_FILTER_PROFILE in TCPIPConfig.h)
+	//ERXFCON = ERXFCON_CRCEN;     // Promiscious mode
+#if MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_SERVICES
+	// Unicast, hashed multicast groups and broadcasts (triaged in 
+	// MACGetHeader())
+	ERXFCON = ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_HTEN | ERXFCON_BCEN;
+#elif MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_STRICT
+	// Unicast, hashed multicast groups and ARP requests for our IP
+	ERXFCON = ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_HTEN | ERXFCON_PMEN;
+	dwFilterIP = ~AppConfig.MyIPAddr.Val;
+	MACUpdateRxFilter();
+#else
 	// (No need to reconfigure - Unicast OR Broadcast with CRC checking is 
 	// acceptable)
-	//ERXFCON = ERXFCON_CRCEN;     // Promiscious mode
+#endif
 	// Configure the MAC
 	// Enable the receive portion of the MAC
 	MACON1 = MACON1_TXPAUS | MACON1_RXPAUS | MACON1_MARXEN;
@@ -154,9 +212,136 @@ void MACInit(void)
 	WritePHYReg(PHCON1, 0x0000);
 #endif
 
+	// Report pending frames and RX ring overflows through the high 
+	// priority interrupt so StackTask() only visits the MAC when needed
+	MACEvents.Val = 0;
+	EIR = 0;
+	EIE = EIE_PKTIE | EIE_RXERIE;
+	IPR2bits.ETHIP = 1;
+	PIR2bits.ETHIF = 0;
+	PIE2bits.ETHIE = 1;
 	// Enable packet reception
 	ECON1bits.RXEN = 1;
 }								//end MACInit
+/******************************************************************************
+ * Function:        void MACISR(void)
+ *
+ * PreCondition:    MACInit() is already called.
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    PKTIE is left disabled until MACGetHeader() finds the 
+ *					RX ring empty.
+ *
+ * Overview:        Latches Ethernet RX events into MACEvents and timestamps 
+ *					the first pending frame.  Must be called from the high 
+ *					priority interrupt service routine.
+ *
+ * Note:            PKTIF cannot be cleared in software; it follows EPKTCNT.  
+ *					The interrupt is therefore masked here and re-armed by 
+ *					the main loop once all frames have been fetched.
+ *****************************************************************************/
+void MACISR(void)
+{
+	WORD_VAL w;
+	if (!PIR2bits.ETHIF)
+		return;
+	if (EIEbits.PKTIE && EIRbits.PKTIF) {
+		EIEbits.PKTIE = 0;
+		// Low 16 bits of TickGet().  TMR0H is latched by the TMR0L read.
+		w.v[0] = TMR0L;
+		w.v[1] = TMR0H;
+		wRxStamp = w.Val;
+		RxStampValid = TRUE;
+		MACRxStats.dwInterrupts++;
+		MACEvents.bits.bRxPacket = 1;
+	}
+	if (EIRbits.RXERIF) {
+		EIRbits.RXERIF = 0;
+		MACRxStats.dwRxErrors++;
+		MACEvents.bits.bRxError = 1;
+	}
+	PIR2bits.ETHIF = 0;
+}
+/******************************************************************************
+ * Function:        BOOL MACIsRxPending(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          TRUE: If the interrupt reported a frame, or the last 
+ *						  frame returned by MACGetHeader() was not discarded
+ *					FALSE: If the RX path has nothing to do
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Lets StackTask() skip the RX loop while the link is idle.
+ *
+ * Note:            None
+ *****************************************************************************/
+BOOL MACIsRxPending(void)
+{
+	return MACEvents.Val || !WasDiscarded;
+}
+#if MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_STRICT
+/******************************************************************************
+ * Function:        void MACUpdateRxFilter(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    Reception is paused while the filter is reprogrammed.
+ *
+ * Overview:        Programs the pattern match filter to accept broadcast ARP 
+ *					requests for AppConfig.MyIPAddr.  Does nothing if the 
+ *					address has not changed since the last call, so it can 
+ *					be called on every StackTask() pass.
+ *
+ * Note:            The hardware compares a checksum of the selected bytes, 
+ *					not the bytes themselves.  The odd foreign ARP request 
+ *					with a colliding checksum still reaches ARPProcess(), 
+ *					which ignores it.
+ *****************************************************************************/
+void MACUpdateRxFilter(void)
+{
+	unsigned char pattern[14];
+	WORD w;
+	if (dwFilterIP == AppConfig.MyIPAddr.Val)
+		return;
+	dwFilterIP = AppConfig.MyIPAddr.Val;
+	// Bytes selected by EPMM: broadcast destination (0-5), EtherType ARP 
+	// (12-13), ARP opcode request (20-21) and target IP address (38-41)
+	memset((void *) pattern, 0xFF, 6);
+	pattern[6] = 0x08;
+	pattern[7] = 0x06;
+	pattern[8] = 0x00;
+	pattern[9] = 0x01;
+	memcpy((void *) &pattern[10], (void *) &dwFilterIP, 4);
+	// Returned in wire byte order: the low byte is the checksum MSB
+	w = CalcIPChecksum(pattern, sizeof(pattern));
+	ECON1bits.RXEN = 0;
+	while (ESTATbits.RXBUSY);
+	EPMM0 = 0x3F;
+	EPMM1 = 0x30;
+	EPMM2 = 0x30;
+	EPMM3 = 0x00;
+	EPMM4 = 0xC0;
+	EPMM5 = 0x03;
+	EPMM6 = 0x00;
+	EPMM7 = 0x00;
+	EPMOL = 0x00;
+	EPMOH = 0x00;
+	EPMCSL = HIGH(w);
+	EPMCSH = LOW(w);
+	ECON1bits.RXEN = 1;
+}
+#endif
 /******************************************************************************
  * Function:        BOOL MACIsLinked(void)
  *
@@ -192,29 +377,99 @@ BOOL MACIsLinked(void)
  *
  * Input:           None
  *
- * Output:          TRUE: If no Ethernet transmission is in progress
- *					FALSE: If a previous transmission was started, and it has 
- *						   not completed yet.  While FALSE, the data in the 
- *						   transmit buffer and the TXST/TXND pointers must not
- *						   be changed.
+ * Output:          TRUE: If a transmit slot is free to build the next frame 
+ *						  in (at BASE_TX_ADDR)
+ *					FALSE: If all MAC_TX_BUFFER_COUNT slots hold frames that 
+ *						   are queued or on the wire.  While FALSE, the data 
+ *						   in the transmit buffer must not be changed.
  *
- * Side Effects:    None
+ * Side Effects:    Starts the next queued frame if the previous one has 
+ *					finished.
  *
- * Overview:        Returns the ECON1.TXRTS bit
+ * Overview:        With more than one slot a frame can be built while the 
+ *					previous one is still being transmitted.
  *
  * Note:            None
  *****************************************************************************/
 BOOL MACIsTxReady(void)
 {
-	if (!ECON1bits.TXRTS)
-		return TRUE;
-	// Retry transmission if the current packet seems to be not completing
-	// Wait 3ms before triggering the retry.
-	if ((WORD) TickGet() - wTXWatchdog >= (3ull * TICK_SECOND / 1000ull)) {
-		ECON1bits.TXRTS = 0;
-		MACFlush();
+	TxService();
+	return vTxCount < MAC_TX_BUFFER_COUNT;
+}
+/******************************************************************************
+ * Function:        static void TxService(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Retires the frame on the wire once TXRTS clears and 
+ *					starts the next queued one.  Also restarts a frame that 
+ *					has not completed within 3ms.
+ *
+ * Note:            None
+ *****************************************************************************/
+static void TxService(void)
+{
+	if (TxActive) {
+		if (ECON1bits.TXRTS) {
+			// Retry transmission if the current packet seems to be not 
+			// completing.  Wait 3ms before triggering the retry.
+			if ((WORD) TickGet() - wTXWatchdog >=
+				(3ull * TICK_SECOND / 1000ull)) {
+				ECON1bits.TXRTS = 0;
+				TxStart();
+			}
+			return;
+		}
+		TxActive = FALSE;
+		vTxCount--;
+		if (++vTxHead >= MAC_TX_BUFFER_COUNT)
+			vTxHead = 0;
 	}
-	return FALSE;
+	if (vTxCount)
+		TxStart();
+}
+/******************************************************************************
+ * Function:        static void TxStart(void)
+ *
+ * PreCondition:    The frame in slot vTxHead is complete and TXRTS is clear.
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Points ETXST/ETXND at slot vTxHead and starts 
+ *					transmitting it.
+ *
+ * Note:            None
+ *****************************************************************************/
+static void TxStart(void)
+{
+	ETXST = TX_SLOT_START(vTxHead);
+	ETXND = wTxEnd[vTxHead];
+	// Reset the Ethernet TX logic.  This is a (suspected) errata workaround to 
+	// prevent the TXRTS bit from getting stuck set indefinitely, causing the 
+	// stack to lock up under certain bad conditions.
+	ECON1bits.TXRST = 1;
+	ECON1bits.TXRST = 0;
+	// Wait at least 1.6us after TX Reset before setting TXRTS.
+	// If you don't wait long enough, the TX logic won't be finished resetting.
+	{
+		volatile unsigned char i = 8;
+		while (i--);
+	}
+	EIRbits.TXERIF = 0;
+	// Start the transmission
+	ECON1bits.TXRTS = 1;
+	TxActive = TRUE;
+	wTXWatchdog = TickGet();
 }
 /******************************************************************************
  * Function:        void MACDiscardRx(void)
@@ -237,16 +492,54 @@ BOOL MACIsTxReady(void)
  *****************************************************************************/
 void MACDiscardRx(void)
 {
-	WORD_VAL NewRXRDLocation;
 	// Make sure the current packet was not already discarded
 	if (WasDiscarded)
 		return;
 	WasDiscarded = TRUE;
-	// Decrement the next packet pointer before writing it into 
+	// A background copy may still be reading from this packet
+	WaitForDMA();
+	// Decrement the RX packet counter register, EPKTCNT
+	ECON2bits.PKTDEC = 1;
+	// Unwrite-protect the memory used by the last packet, unless an 
+	// older held packet still sits in front of it
+	FreeRxSpace();
+	// The PKTIF flag should automatically be cleared by hardware, but 
+	// early beta silicon requires that you manually clear it.  This should be 
+	// unneeded for production A0 silicon and later.
+	EIRbits.PKTIF = 0;
+}
+/******************************************************************************
+ * Function:        static void FreeRxSpace(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Moves the receive read pointer up to the oldest packet 
+ *					still in use: the oldest held packet, else the current 
+ *					packet if it was not discarded, else the location the 
+ *					hardware writes the next packet to.
+ *
+ * Note:            None
+ *****************************************************************************/
+static void FreeRxSpace(void)
+{
+	WORD_VAL NewRXRDLocation;
+	if (vHeldRx)
+		NewRXRDLocation.Val = HeldRx[0].wLocation;
+	else if (!WasDiscarded)
+		NewRXRDLocation.Val = CurrentPacketLocation.Val;
+	else
+		NewRXRDLocation.Val = NextPacketLocation.Val;
+	// Decrement the packet location before writing it into 
 	// the ERXRDPT registers.  This is a silicon errata workaround.
 	// RX buffer wrapping must be taken into account if the 
-	// NextPacketLocation is precisely RXSTART.
-	NewRXRDLocation.Val = NextPacketLocation.Val - 1;
+	// location is precisely RXSTART.
+	NewRXRDLocation.Val--;
 #if RXSTART == 0
 	if (NewRXRDLocation.Val > RXSTOP)
 #else
@@ -255,17 +548,106 @@ void MACDiscardRx(void)
 	{
 		NewRXRDLocation.Val = RXSTOP;
 	}
-	// Decrement the RX packet counter register, EPKTCNT
-	ECON2bits.PKTDEC = 1;
-	// Move the receive read pointer to unwrite-protect the memory used by the 
-	// last packet.  The writing order is important: set the low byte first, 
-	// high byte last.
+	// The writing order is important: set the low byte first, high byte last.
 	ERXRDPTL = NewRXRDLocation.v[0];
 	ERXRDPTH = NewRXRDLocation.v[1];
-	// The PKTIF flag should automatically be cleared by hardware, but 
-	// early beta silicon requires that you manually clear it.  This should be 
-	// unneeded for production A0 silicon and later.
+}
+/******************************************************************************
+ * Function:        MAC_RX_HANDLE MACHoldRx(void)
+ *
+ * PreCondition:    MACGetHeader() returned TRUE
+ *
+ * Input:           None
+ *
+ * Output:          Handle of the current packet, or MAC_RX_INVALID_HANDLE 
+ *					if it was already discarded or all MAC_RX_HOLD_SLOTS 
+ *					are in use
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Marks the current packet as processed, like 
+ *					MACDiscardRx(), but leaves it write protected in the 
+ *					RX buffer so it can still be read with 
+ *					MACSetReadPtrInHeldRx().  MACGetHeader() moves on to 
+ *					the next packet.
+ *
+ * Note:            Every handle returned must be given back with 
+ *					MACReleaseRx().  Until then the hardware cannot reuse 
+ *					the space of this packet or of any packet after it.
+ *****************************************************************************/
+MAC_RX_HANDLE MACHoldRx(void)
+{
+	if (WasDiscarded || vHeldRx >= MAC_RX_HOLD_SLOTS)
+		return MAC_RX_INVALID_HANDLE;
+	HeldRx[vHeldRx].wLocation = CurrentPacketLocation.Val;
+	HeldRx[vHeldRx].bReleased = FALSE;
+	vHeldRx++;
+	// ERXRDPT already points in front of this packet; only EPKTCNT moves
+	WasDiscarded = TRUE;
+	ECON2bits.PKTDEC = 1;
 	EIRbits.PKTIF = 0;
+	return CurrentPacketLocation.Val;
+}
+/******************************************************************************
+ * Function:        void MACReleaseRx(MAC_RX_HANDLE h)
+ *
+ * PreCondition:    h was returned by MACHoldRx()
+ *
+ * Input:           h: Handle of the held packet
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Frees a held packet.  The RX buffer space is handed back 
+ *					to the hardware in arrival order, so a packet released 
+ *					ahead of an older one is only freed with it.
+ *
+ * Note:            None
+ *****************************************************************************/
+void MACReleaseRx(MAC_RX_HANDLE h)
+{
+	unsigned char i;
+	for (i = 0; i < vHeldRx; i++) {
+		if (HeldRx[i].wLocation == h) {
+			HeldRx[i].bReleased = TRUE;
+			break;
+		}
+	}
+	// Count the released packets at the front of the list
+	i = 0;
+	while (i < vHeldRx && HeldRx[i].bReleased)
+		i++;
+	if (i == 0u)
+		return;
+	vHeldRx -= i;
+	memmove((void *) HeldRx, (void *) &HeldRx[i],
+			vHeldRx * sizeof(HeldRx[0]));
+	WaitForDMA();
+	FreeRxSpace();
+}
+/******************************************************************************
+ * Function:        MAC_RX_HANDLE MACGetOldestHeldRx(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          Handle of the oldest held packet not released yet, or 
+ *					MAC_RX_INVALID_HANDLE if none is held
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Tells which packet keeps ERXRDPT where it is, so the 
+ *					caller can release it when the RX buffer runs low.
+ *
+ * Note:            None
+ *****************************************************************************/
+MAC_RX_HANDLE MACGetOldestHeldRx(void)
+{
+	if (vHeldRx == 0u)
+		return MAC_RX_INVALID_HANDLE;
+	return HeldRx[0].wLocation;
 }
 /******************************************************************************
  * Function:        WORD MACGetFreeRxSize(void)
@@ -333,51 +715,80 @@ WORD MACGetFreeRxSize(void)
 BOOL MACGetHeader(MAC_ADDR * remote, unsigned char *type)
 {
 	ENC_PREAMBLE header;
-	// Test if at least one packet has been received and is waiting
-	if (EPKTCNT == 0u) {
-		return FALSE;
-	}
-	// Make absolutely certain that any previous packet was discarded
-	if (WasDiscarded == FALSE) {
-		MACDiscardRx();
-		return FALSE;
-	}
-	// Save the location of this packet
-	CurrentPacketLocation.Val = NextPacketLocation.Val;
-	// Set the read pointer to the beginning of the next unprocessed packet
-	ERDPT = CurrentPacketLocation.Val;
-	// Obtain the MAC header from the Ethernet buffer
-	MACGetArray((unsigned char *) &header, sizeof(header));
-	// The EtherType field, like most items transmitted on the Ethernet medium
-	// are in big endian.
-	header.Type.Val = swaps(header.Type.Val);
-	// Do a sanity check.  There might be a bug in code someplace if this 
-	// Reset() ever happens.  Check for potential errors in array/pointer writing code.
-	if (header.NextPacketPointer > RXSTOP
-		|| ((BYTE_VAL *) (&header.NextPacketPointer))->bits.b0
-		|| header.StatusVector.bits.Zero
-		|| header.StatusVector.bits.CRCError
-		|| header.StatusVector.bits.ByteCount > 1518u
-		|| !header.StatusVector.bits.ReceiveOk) {
-		Reset();
-	}
-	// Save the location where the hardware will write the next packet to
-	NextPacketLocation.Val = header.NextPacketPointer;
-	// Return the Ethernet frame's Source MAC address field to the caller
-	// This parameter is useful for replying to requests without requiring an 
-	// ARP cycle.
-	memcpy((void *) remote->v, (void *) header.SourceMACAddr.v,
-		   sizeof(*remote));
-	// Return a simplified version of the EtherType field to the caller
-	*type = MAC_UNKNOWN;
-	if ((header.Type.v[1] == 0x08u) &&
-		((header.Type.v[0] == ETHER_IP)
-		 || (header.Type.v[0] == ETHER_ARP))) {
-		*type = header.Type.v[0];
+	WORD w;
+	while (1) {
+		// Test if at least one packet has been received and is waiting
+		if (EPKTCNT == 0u) {
+			// Ring is empty: clear the events and re-arm the packet 
+			// interrupt.  A frame arriving in between sets PKTIF, which 
+			// fires as soon as PKTIE is set again.
+			MACEvents.bits.bRxError = 0;
+			MACEvents.bits.bRxPacket = 0;
+			EIEbits.PKTIE = 1;
+			return FALSE;
+		}
+		// Make absolutely certain that any previous packet was discarded
+		if (WasDiscarded == FALSE) {
+			MACDiscardRx();
+			return FALSE;
+		}
+		// Save the location of this packet
+		CurrentPacketLocation.Val = NextPacketLocation.Val;
+		// Set the read pointer to the beginning of the next unprocessed packet
+		ERDPT = CurrentPacketLocation.Val;
+		// Obtain the MAC header from the Ethernet buffer
+		MACGetArray((unsigned char *) &header, sizeof(header));
+		// The EtherType field, like most items transmitted on the Ethernet medium
+		// are in big endian.
+		header.Type.Val = swaps(header.Type.Val);
+		// Do a sanity check.  There might be a bug in code someplace if this 
+		// Reset() ever happens.  Check for potential errors in array/pointer writing code.
+		if (header.NextPacketPointer > RXSTOP
+			|| ((BYTE_VAL *) (&header.NextPacketPointer))->bits.b0
+			|| header.StatusVector.bits.Zero
+			|| header.StatusVector.bits.CRCError
+			|| header.StatusVector.bits.ByteCount > 1518u
+			|| !header.StatusVector.bits.ReceiveOk) {
+			Reset();
+		}
+		// Save the location where the hardware will write the next packet to
+		NextPacketLocation.Val = header.NextPacketPointer;
+		// Return the Ethernet frame's Source MAC address field to the caller
+		// This parameter is useful for replying to requests without requiring an 
+		// ARP cycle.
+		memcpy((void *) remote->v, (void *) header.SourceMACAddr.v,
+			   sizeof(*remote));
+		// Return a simplified version of the EtherType field to the caller
+		*type = MAC_UNKNOWN;
+		if ((header.Type.v[1] == 0x08u) &&
+			((header.Type.v[0] == ETHER_IP)
+			 || (header.Type.v[0] == ETHER_ARP))) {
+			*type = header.Type.v[0];
+		}
+		// Measure the interrupt to service latency on the first frame of a burst
+		if (RxStampValid) {
+			RxStampValid = FALSE;
+			w = (WORD) TickGet() - wRxStamp;
+			MACRxStats.wLastLatency = w;
+			if (w > MACRxStats.wMaxLatency)
+				MACRxStats.wMaxLatency = w;
+		}
+		// Mark this packet as discardable
+		WasDiscarded = FALSE;
+#if MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_SERVICES
+		// The hardware passes every broadcast; drop the ones no local 
+		// service answers before the upper layers parse them
+		if ((header.DestMACAddr.v[0] & header.DestMACAddr.v[1] &
+			 header.DestMACAddr.v[2] & header.DestMACAddr.v[3] &
+			 header.DestMACAddr.v[4] & header.DestMACAddr.v[5]) == 0xFFu
+			&& !StackIsWantedBroadcast(*type)) {
+			MACRxStats.dwFiltered++;
+			MACDiscardRx();
+			continue;
+		}
+#endif
+		return TRUE;
 	}
-	// Mark this packet as discardable
-	WasDiscarded = FALSE;
-	return TRUE;
 }
 /******************************************************************************
  * Function:        void MACPutHeader(MAC_ADDR *remote, unsigned char type, WORD dataLen)
@@ -406,11 +817,11 @@ BOOL MACGetHeader(MAC_ADDR * remote, unsigned char *type)
 void MACPutHeader(MAC_ADDR * remote, unsigned char type, WORD dataLen)
 {
 	// Set the write pointer to the beginning of the transmit buffer
-	EWRPT = TXSTART + 1;
-	// Calculate where to put the TXND pointer
-	dataLen += (WORD) sizeof(ETHER_HEADER) + TXSTART;
-	// Write the TXND pointer into the registers, given the dataLen given
-	ETXND = dataLen;
+	EWRPT = wMACTxBase;
+	// Calculate where to put the TXND pointer.  It is loaded into ETXND 
+	// when the slot reaches the head of the transmit queue.
+	dataLen += (WORD) sizeof(ETHER_HEADER) + wMACTxBase - 1;
+	wTxEnd[vTxFill] = dataLen;
 	// Set the per-packet control byte and write the Ethernet destination 
 	// address
 	MACPutArray((unsigned char *) remote, sizeof(*remote));
@@ -433,38 +844,28 @@ void MACPutHeader(MAC_ADDR * remote, unsigned char type, WORD dataLen)
  *
  * Side Effects:    None
  *
- * Overview:        MACFlush causes the current TX packet to be sent out on 
- *					the Ethernet medium.  The hardware MAC will take control
- *					and handle CRC generation, collision retransmission and 
- *					other details.
- *
- * Note:			After transmission completes (MACIsTxReady() returns TRUE), 
- *					the packet can be modified and transmitted again by calling 
- *					MACFlush() again.  Until MACPutHeader() or MACPut() is 
- *					called (in the TX data area), the data in the TX buffer 
- *					will not be corrupted.
+ * Overview:        MACFlush queues the current TX packet to be sent out on 
+ *					the Ethernet medium and moves BASE_TX_ADDR to the next 
+ *					slot.  The packet is started immediately if the 
+ *					transmitter is idle, otherwise by MACIsTxReady() once 
+ *					the frames ahead of it are out.  The hardware MAC will 
+ *					take control and handle CRC generation, collision 
+ *					retransmission and other details.
+ *
+ * Note:			The slot contents belong to the MAC until the frame has 
+ *					been sent; build every packet from scratch after calling 
+ *					MACIsTxReady().
  *****************************************************************************/
 void MACFlush(void)
 {
-	// Reset the Ethernet TX logic.  This is a (suspected) errata workaround to 
-	// prevent the TXRTS bit from getting stuck set indefinitely, causing the 
-	// stack to lock up under certain bad conditions.
-	ECON1bits.TXRST = 1;
-	ECON1bits.TXRST = 0;
-	// Wait at least 1.6us after TX Reset before setting TXRTS.
-	// If you don't wait long enough, the TX logic won't be finished resetting.
-	{
-		volatile unsigned char i = 8;
-		while (i--);
-	}
-	EIRbits.TXERIF = 0;
-	// Start the transmission
-	// After transmission completes (MACIsTxReady() returns TRUE), the packet 
-	// can be modified and transmitted again by calling MACFlush() again.
-	// Until MACPutHeader() is called, the data in the TX buffer will not be 
-	// corrupted.
-	ECON1bits.TXRTS = 1;
-	wTXWatchdog = TickGet();
+	// Do not start transmitting while the DMA is still filling the frame
+	WaitForDMA();
+	vTxCount++;
+	// Next frame is built in the following slot
+	if (++vTxFill >= MAC_TX_BUFFER_COUNT)
+		vTxFill = 0;
+	wMACTxBase = TX_SLOT_START(vTxFill) + 1;
+	TxService();
 }
 /******************************************************************************
  * Function:        void MACSetReadPtrInRx(WORD offset)
@@ -501,6 +902,33 @@ void MACSetReadPtrInRx(WORD offset)
 	ERDPTL = ReadPT.v[0];
 	ERDPTH = ReadPT.v[1];
 }
+/******************************************************************************
+ * Function:        void MACSetReadPtrInHeldRx(MAC_RX_HANDLE h, WORD offset)
+ *
+ * PreCondition:    h was returned by MACHoldRx() and not released yet
+ *
+ * Input:           h: Handle of the held packet
+ *					offset: Number of bytes from the start of the Ethernet 
+ *							header (destination address) to seek to
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Like MACSetReadPtrInRx(), for a held packet.  All calls 
+ *					to MACGet() and MACGetArray() will read from there.
+ *
+ * Note:            None
+ *****************************************************************************/
+void MACSetReadPtrInHeldRx(MAC_RX_HANDLE h, WORD offset)
+{
+	WORD_VAL ReadPT;
+	ReadPT.Val = h + sizeof(ENC_PREAMBLE) - sizeof(ETHER_HEADER) + offset;
+	if (ReadPT.Val > RXSTOP)
+		ReadPT.Val -= RXSIZE;
+	ERDPTL = ReadPT.v[0];
+	ERDPTH = ReadPT.v[1];
+}
 /******************************************************************************
  * Function:        WORD MACSetWritePtr(WORD Address)
  *
@@ -665,6 +1093,13 @@ WORD CalcIPBufferChecksum(WORD len)
  * Note:            If a prior transfer is already in progress prior to 
  *					calling this function, this function will block until it 
  *					can start this transfer.
+ *
+ *					The function returns as soon as the DMA is started.  
+ *					ERDPT/EWRPT are advanced past the copied bytes up front, 
+ *					and MACGet(), MACPut(), MACGetArray(), MACPutArray(), 
+ *					MACFlush() and MACDiscardRx() wait for the copy to 
+ *					finish, so callers need not poll MACIsMemCopyDone() 
+ *					before touching the buffer again.
  *****************************************************************************/
 void MACMemCopyAsync(WORD destAddr, WORD sourceAddr, WORD len)
 {
@@ -682,6 +1117,7 @@ void MACMemCopyAsync(WORD destAddr, WORD sourceAddr, WORD len)
 	// Handle special conditions where len == 0 or len == 1
 	// The DMA module is not capable of handling those corner cases
 	if (len <= 1u) {
+		WaitForDMA();
 		ReadSave.Val = ERDPT;
 		WriteSave.Val = EWRPT;
 		ERDPT = sourceAddr;
@@ -700,22 +1136,22 @@ void MACMemCopyAsync(WORD destAddr, WORD sourceAddr, WORD len)
 			EWRPT = WriteSave.Val;
 		}
 		len += sourceAddr - 1;
-		while (ECON1bits.DMAST);
+		WaitForDMA();
 		EDMAST = sourceAddr;
 		EDMADST = destAddr;
 		if ((sourceAddr <= RXSTOP) && (len > RXSTOP))	//&& (sourceAddr >= RXSTART))
 			len -= RXSIZE;
 		EDMAND = len;
-		ECON1bits.CSUMEN = 0;
-		ECON1bits.DMAST = 1;
-		while (ECON1bits.DMAST);	// DMA errata workaround: Must not access EDATA while DMA active
-
+		// The DMA uses its own pointers, so ERDPT can be moved past the 
+		// source block before the copy is started
 		if (UpdateReadPointer) {
 			len++;
 			if ((sourceAddr <= RXSTOP) && (len > RXSTOP))	//&& (sourceAddr >= RXSTART))
 				len -= RXSIZE;
 			ERDPT = len;
 		}
+		ECON1bits.CSUMEN = 0;
+		ECON1bits.DMAST = 1;
 	}
 }
 BOOL MACIsMemCopyDone(void)
@@ -742,6 +1178,7 @@ BOOL MACIsMemCopyDone(void)
  *****************************************************************************/
 unsigned char MACGet()
 {
+	WaitForDMA();
 	return EDATA;
 }								//end MACGet
 /******************************************************************************
@@ -767,6 +1204,7 @@ WORD MACGetArray(unsigned char *val, WORD len)
 	WORD w;
 	volatile unsigned char i;
 	w = len;
+	WaitForDMA();
 	if (val) {
 		while (w--) {
 			*val++ = EDATA;
@@ -799,6 +1237,7 @@ void MACPut(unsigned char val)
 	// Note:  Due to a PIC18F97J60 bug, you must use the MOVFF instruction to 
 	// write to EDATA or else the read pointer (ERDPT) will inadvertently 
 	// increment.
+	WaitForDMA();
 	PRODL = val;
 #if defined(HI_TECH_C)
 	asm("movff	_PRODL, _EDATA");
@@ -826,6 +1265,7 @@ void MACPut(unsigned char val)
  *****************************************************************************/
 	void MACPutArray(unsigned char *val, WORD len)
 {
+	WaitForDMA();
 	while (len--) {
 		// Note:  Due to a PIC18F97J60 bug, you must use the MOVFF instruction to 
 		// write to EDATA or else the read pointer (ERDPT) will inadvertently 
@@ -839,6 +1279,7 @@ void MACPut(unsigned char val)
 }} //end MACPutArray
 	void MACPutROMArray(const unsigned char *val, WORD len)
 {
+	WaitForDMA();
 	while (len--) {
 		// Note:  Due to a PIC18F97J60 bug, you must use the MOVFF instruction to 
 		// write to EDATA or else the read pointer (ERDPT) will inadvertently 
@@ -966,8 +1407,9 @@ void MACPowerDown(void)
 	// Make sure any last packet which was in-progress when RXEN was cleared 
 	// is completed
 	while (ESTATbits.RXBUSY);
-	// If a packet is being transmitted, wait for it to finish
-	while (ECON1bits.TXRTS);
+	// If packets are queued or being transmitted, wait for them to finish
+	while (vTxCount)
+		TxService();
 	// Disable the Ethernet module
 	ECON2bits.ETHEN = 0;
 }								//end MACPowerDown
@@ -989,11 +1431,11 @@ void MACPowerDown(void)
  *					using bits 28:23 of the CRC, sets the appropriate bit in 
  *					the EHT* registers
  *
- * Note:            This code is commented out to save code space on systems 
- *					that do not need this function.  Change the "#if 0" line 
- *					to "#if 1" to uncomment it.
+ * Note:            Only compiled for the receive filter profiles that enable 
+ *					the Hash Table filter (see MAC_RX_FILTER_PROFILE).  
+ *					Call once per multicast group the application joins.
  *****************************************************************************/
-#if 0
+#if MAC_RX_FILTER_PROFILE != MAC_RX_FILTER_OPEN
 void SetRXHashTableEntry(MAC_ADDR DestMACAddr)
 {
 	DWORD_VAL CRC = { 0xFFFFFFFF };
@@ -61,11 +61,6 @@
 
 #if defined(STACK_USE_HTTP2_SERVER)
 
-// Only allow MPFS uploading if using EEPROM for storage
-#if !defined(MPFS_USE_EEPROM) || !defined(HTTP_USE_POST)
-#undef HTTP_MPFS_UPLOAD
-#endif
-
 /*********************************************************************
  * String Constants
  ********************************************************************/
@@ -89,6 +84,7 @@ static const char *httpFileExtensions[HTTP_UNKNOWN + 1] = {
 	"jpg",						// HTTP_JPG
 	"cla",						// HTTP_JAVA
 	"wav",						// HTTP_WAV
+	"json",						// HTTP_JSON
 	"\0\0\0"					// HTTP_UNKNOWN
 };
 
@@ -105,6 +101,7 @@ static const char *httpContentTypes[HTTP_UNKNOWN + 1] = {
 	"image/jpeg",				// HTTP_JPG
 	"application/java-vm",		// HTTP_JAVA
 	"audio/x-wave",				// HTTP_WAV
+	"application/json",			// HTTP_JSON
 	""							// HTTP_UNKNOWN
 };
 
@@ -114,8 +111,8 @@ static const char *httpContentTypes[HTTP_UNKNOWN + 1] = {
 
 	// Corresponding initial response strings (to HTTP_STATUS enum)
 static const char *HTTPResponseHeaders[] = {
-	"HTTP/1.1 200 OK\r\nConnection: close\r\n",
-	"HTTP/1.1 200 OK\r\nConnection: close\r\n",
+	"HTTP/1.1 200 OK\r\n",
+	"HTTP/1.1 200 OK\r\n",
 	"HTTP/1.1 401 Unauthorized\r\nWWW-Authenticate: Basic realm=\"Protected\"\r\n\r\n401 Unauthorized: Password required\r\n",
 #if defined(HTTP_MPFS_UPLOAD)
 	"HTTP/1.1 404 Not found\r\nContent-Type: text/html\r\n\r\n404: File not found<br>Use <a href=\"/mpfsupload\">MPFS Upload</a> to program web pages into EEPROM\r\n",
@@ -131,6 +128,8 @@ static const char *HTTPResponseHeaders[] = {
 	"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n<html><body style=\"margin:100px\"><b>MPFS Update Successful</b><p><a href=\"/\">Site main page</a></body></html>",
 	"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n<html><body style=\"margin:100px\"><b>MPFS Image Corrupt or Wrong Version</b><p><a href=\"/mpfsupload\">Try again?</a></body></html>",
 #endif
+	"HTTP/1.1 304 Not Modified\r\n",
+	"HTTP/1.1 416 Requested Range Not Satisfiable\r\n",
 	"HTTP/1.1 302 Found\r\nLocation: ",
 	"HTTP/1.1 403 Forbidden\r\n\r\n403 Forbidden: SSL Required - use HTTPS\r\n"
 };
@@ -138,17 +137,47 @@ static const char *HTTPResponseHeaders[] = {
 /*********************************************************************
  * Header Parsing Configuration
  ********************************************************************/
-#define HTTP_NUM_HEADERS		3
+#define HTTP_NUM_HEADERS		8
 
-	// Header strings for which we'd like to parse
+	// Header strings for which we'd like to parse, in lower case
 static const char *HTTPRequestHeaders[HTTP_NUM_HEADERS] = {
-	"Cookie:",
-	"Authorization:",
-	"Content-Length:"
+	"cookie:",
+	"authorization:",
+	"content-length:",
+	"if-none-match:",
+	"if-modified-since:",
+	"connection:",
+	"range:",
+	"if-range:"
 };
 
+	// HTTP_HASH() of each string above.  They must all differ, which 
+	// the switch in HTTPHeaderFind() checks at compile time.
+#define HTTP_HASH_COOKIE			(0xCAu)
+#define HTTP_HASH_AUTHORIZATION		(0x4Du)
+#define HTTP_HASH_CONTENT_LENGTH	(0xC8u)
+#define HTTP_HASH_IF_NONE_MATCH		(0x36u)
+#define HTTP_HASH_IF_MODIFIED_SINCE	(0x10u)
+#define HTTP_HASH_CONNECTION		(0x78u)
+#define HTTP_HASH_RANGE				(0x89u)
+#define HTTP_HASH_IF_RANGE			(0x19u)
+
 	// Set to length of longest string above
-#define HTTP_MAX_HEADER_LEN		(15u)
+#define HTTP_MAX_HEADER_LEN		(18u)
+
+	// Length of an ETag ("iiiitttttttt": FAT ID and timestamp in hex) 
+	// and of a date as Last-Modified sends it
+#define HTTP_ETAG_LEN			(14u)
+#define HTTP_DATE_LEN			(29u)
+
+	// Longest Range: value parsed, " bytes=4294967295-4294967295".  
+	// Longer ones list several ranges and get the whole file.
+#define HTTP_RANGE_LEN			(28u)
+
+	// Chunk header, "\r\nhhhh\r\n" with the CRLF ending the previous 
+	// chunk, and the last chunk
+#define HTTP_CHUNK_HEADER_LEN	(8u)
+#define HTTP_CHUNK_LAST_LEN		(7u)
 
 /*********************************************************************
  * HTTP Connection State Global Variable
@@ -159,11 +188,16 @@ HTTP_STUB httpStubs[MAX_HTTP_CONNECTIONS];	// HTTP stubs with state machine and
 unsigned char curHTTPID;		// Which HTTP stub is active
 //#pragma udata	// LO SAQUE PORQUE ME DA WARNING, NO SE QUE HACE////////////////////////////////////
 
+// Chunk being written by HTTPProcess(), which always ends it before returning
+static PTR_BASE wChunkHeader = TCP_INVALID_RESERVE;	// TX reservation for its header
+static WORD wChunkFree;			// TX FIFO free space after the header
+
 /*********************************************************************
  * Function Prototypes
  ********************************************************************/
 
 	// Prototypes for header parsers
+static unsigned char HTTPHeaderFind(unsigned char *name, unsigned char hash);
 static void HTTPHeaderParseLookup(unsigned char i);
 #if defined(HTTP_USE_COOKIES)
 static void HTTPHeaderParseCookie(void);
@@ -174,11 +208,24 @@ static void HTTPHeaderParseAuthorization(void);
 #if defined(HTTP_USE_POST)
 static void HTTPHeaderParseContentLength(void);
 #endif
+static void HTTPHeaderParseIfNoneMatch(void);
+static void HTTPHeaderParseIfModifiedSince(void);
+static void HTTPHeaderParseConnection(void);
+static void HTTPHeaderParseRange(void);
+static void HTTPHeaderParseIfRange(void);
 
 	// Internal function Prototypes
 static void HTTPProcess(void);
 static BOOL HTTPSendFile(void);
+static BOOL HTTPBeginChunk(void);
+static void HTTPEndChunk(void);
 static void HTTPLoadConn(unsigned char connID);
+static BOOL HTTPIsStaticFile(void);
+static void HTTPFormatETag(unsigned char *buf);
+static void HTTPFormatDate(DWORD t, unsigned char *buf);
+static void HTTPPutValidators(void);
+static void HTTPResolveRange(void);
+static unsigned char *HTTPFindArgHash(unsigned char *data, unsigned char hash, WORD len);
 
 #if defined(HTTP_MPFS_UPLOAD)
 static HTTP_IO_RESULT HTTPMPFSUpload(void);
@@ -213,7 +260,8 @@ void HTTPInit(void)
 
 	for (curHTTPID = 0; curHTTPID < MAX_HTTP_CONNECTIONS; curHTTPID++) {
 		smHTTP = SM_HTTP_IDLE;
-		sktHTTP = TCPListen(HTTP_PORT);
+		sktHTTP = TCPOpen(0, TCP_OPEN_SERVER, HTTP_PORT,
+						  TCP_PURPOSE_HTTP_SERVER);
 
 		// Save the default record (just invalid file handles)
 		oldPtr =
@@ -222,6 +270,9 @@ void HTTPInit(void)
 		MACPutArray((unsigned char *) &curHTTP, sizeof(HTTP_CONN));
 		MACSetWritePtr(oldPtr);
 	}
+
+	// curHTTP now holds the record of connection 0
+	curHTTPID = 0;
 }
 
 
@@ -363,6 +414,11 @@ static void HTTPProcess(void)
 				curHTTP.ptrData = curHTTP.data;
 				smHTTP = SM_HTTP_PARSE_REQUEST;
 				curHTTP.isAuthorized = 0xff;
+				curHTTP.validators = 0;
+				curHTTP.keepAlive = FALSE;
+				curHTTP.chunked = HTTP_CHUNKED_NONE;
+				curHTTP.rangeStart = 0xffffffff;
+				curHTTP.rangeEnd = 0xffffffff;
 				curHTTP.hasArgs = FALSE;
 				curHTTP.callbackID =
 					TickGet() + HTTP_TIMEOUT * TICK_SECOND;
@@ -383,6 +439,7 @@ static void HTTPProcess(void)
 					isDone = FALSE;
 				}
 				if (TickGet() > curHTTP.callbackID) {	// A timeout has occurred
+					curHTTP.keepAlive = FALSE;
 					TCPDisconnect(sktHTTP);
 					smHTTP = SM_HTTP_DISCONNECT;
 					isDone = FALSE;
@@ -521,8 +578,14 @@ static void HTTPProcess(void)
 				*(curHTTP.ptrData++) = '&';
 
 			}
-			// Clear the rest of the line
+			// Clear the rest of the line.  HTTP/1.1 connections persist 
+			// unless a Connection: header says otherwise.
 			lenA = TCPFind(sktHTTP, '\n', 0, FALSE);
+			if (TCPFindROMArrayEx(sktHTTP, (const unsigned char *) "HTTP/1.1", 8,
+								  0, lenA, FALSE) != 0xffff) {
+				curHTTP.keepAlive = TRUE;
+				curHTTP.chunked = HTTP_CHUNKED_ALLOWED;
+			}
 			TCPGetArray(sktHTTP, NULL, lenA + 1);
 
 			// Move to parsing the headers
@@ -543,6 +606,7 @@ static void HTTPProcess(void)
 						isDone = FALSE;
 					}
 					if (TickGet() > curHTTP.callbackID) {	// A timeout has occured
+						curHTTP.keepAlive = FALSE;
 						TCPDisconnect(sktHTTP);
 						smHTTP = SM_HTTP_DISCONNECT;
 						isDone = FALSE;
@@ -574,13 +638,19 @@ static void HTTPProcess(void)
 				buffer[lenB - 1] = '\0';
 				lenA -= lenB;
 
-				// Compare header read to ones we're interested in
-				for (i = 0; i < HTTP_NUM_HEADERS; i++) {
-					if (strcmppgm2ram((char *) buffer, (const char *) HTTPRequestHeaders[i]) == 0) {	// Parse the header and stop the loop
-						HTTPHeaderParseLookup(i);
-						isDone = TRUE;
-						break;
-					}
+				// Fold the name to lower case and hash it in one pass
+				c = 0;
+				for (i = 0; buffer[i] != '\0'; i++) {
+					if (buffer[i] >= 'A' && buffer[i] <= 'Z')
+						buffer[i] += 'a' - 'A';
+					c = HTTP_HASH(c, buffer[i]);
+				}
+
+				// Parse it if it's one we're interested in
+				i = HTTPHeaderFind(buffer, c);
+				if (i < HTTP_NUM_HEADERS) {
+					HTTPHeaderParseLookup(i);
+					isDone = TRUE;
 				}
 
 				// Clear the rest of the line, and call the loop again
@@ -623,10 +693,17 @@ static void HTTPProcess(void)
 			}
 #endif
 
-			// Move on to GET args, unless there are none
+			// Move on to GET args.  GETs of a file always get there, 
+			// so the application can prepare dynamic content.
+			// callbackPos is zero on the first HTTPExecuteGet() call.
 			smHTTP = SM_HTTP_PROCESS_GET;
-			if (!curHTTP.hasArgs)
+			curHTTP.callbackPos = 0;
+			if (!curHTTP.hasArgs
+				&& (curHTTP.httpStatus != HTTP_GET
+					|| curHTTP.file == MPFS_INVALID_HANDLE)) {
 				smHTTP = SM_HTTP_PROCESS_POST;
+				curHTTP.callbackPos = 0xffffffff;
+			}
 			isDone = FALSE;
 			curHTTP.hasArgs = FALSE;
 			break;
@@ -637,8 +714,9 @@ static void HTTPProcess(void)
 			if (HTTPExecuteGet() == HTTP_IO_WAITING) {	// If waiting for asynchronous process, return to main app
 				break;
 			}
-			// Move on to POST data
+			// Move on to POST data, which sets its own watchdog
 			smHTTP = SM_HTTP_PROCESS_POST;
+			curHTTP.callbackPos = 0xffffffff;
 
 		case SM_HTTP_PROCESS_POST:
 
@@ -647,6 +725,7 @@ static void HTTPProcess(void)
 			// See if we have any new data
 			if (TCPIsGetReady(sktHTTP) == curHTTP.callbackPos) {
 				if (TickGet() > curHTTP.callbackID) {	// If a timeout has occured, disconnect
+					curHTTP.keepAlive = FALSE;
 					TCPDisconnect(sktHTTP);
 					smHTTP = SM_HTTP_DISCONNECT;
 					isDone = FALSE;
@@ -694,6 +773,10 @@ static void HTTPProcess(void)
 					}
 				}
 			}
+
+			// Unread request body would be taken for the next request
+			if (curHTTP.byteCount != 0)
+				curHTTP.keepAlive = FALSE;
 #endif
 
 			// We're done with POST
@@ -709,6 +792,18 @@ static void HTTPProcess(void)
 				isDone = FALSE;
 				break;
 			}
+			// If the client's copy of a static file is current, send 
+			// only the headers
+			c = curHTTP.validators;
+			if (curHTTP.httpStatus == HTTP_GET &&
+				((c & HTTP_VALIDATOR_ETAG_SENT) ?
+				 (c & HTTP_VALIDATOR_ETAG_MATCH) :
+				 (c & HTTP_VALIDATOR_DATE_MATCH))) {
+				curHTTP.httpStatus = HTTP_NOT_MODIFIED;
+				smHTTP = SM_HTTP_SERVE_HEADERS;
+				isDone = FALSE;
+				break;
+			}
 			// Set up the dynamic substitutions
 			curHTTP.byteCount = 0;
 			if (curHTTP.offsets == MPFS_INVALID_HANDLE) {	// If no index file, then set next offset to huge
@@ -722,15 +817,57 @@ static void HTTPProcess(void)
 
 		case SM_HTTP_SERVE_HEADERS:
 
+			// A pipelined request waits until the previous response 
+			// has left room for the headers
+			if (TCPGetTxFIFOFull(sktHTTP) != 0
+				&& TCPIsPutReady(sktHTTP) < HTTP_MIN_HEADER_FREE)
+				break;
+
 			// We're in write mode now:
 			// Adjust the TCP FIFOs for optimal transmission of 
-			// the HTTP response to the browser
-			TCPAdjustFIFOSize(sktHTTP, 1, 0, TCP_ADJUST_GIVE_REST_TO_TX);
+			// the HTTP response to the browser.  Keep the rest of 
+			// any earlier response and any pipelined requests.
+			TCPAdjustFIFOSize(sktHTTP, 1, 0,
+							  TCP_ADJUST_GIVE_REST_TO_TX |
+							  TCP_ADJUST_PRESERVE_RX |
+							  TCP_ADJUST_PRESERVE_TX);
+
+			// Decide between the whole file, part of it and a 416
+			HTTPResolveRange();
+
+			// Only responses of known length can be followed by 
+			// another one: static files, 304s, 416s and dynamic pages 
+			// sent in chunks.  Everything else is delimited by closing 
+			// the connection.
+			if (curHTTP.httpStatus != HTTP_GET && curHTTP.httpStatus != HTTP_POST
+				&& curHTTP.httpStatus != HTTP_NOT_MODIFIED
+				&& curHTTP.httpStatus != HTTP_RANGE_NOT_SATISFIABLE)
+				curHTTP.keepAlive = FALSE;
+			if ((curHTTP.httpStatus == HTTP_GET || curHTTP.httpStatus == HTTP_POST)
+				&& curHTTP.nextCallback != 0xffffffff) {
+				if (curHTTP.keepAlive && curHTTP.chunked == HTTP_CHUNKED_ALLOWED)
+					curHTTP.chunked = HTTP_CHUNKED_FIRST;
+				else
+					curHTTP.keepAlive = FALSE;
+			}
+			if (curHTTP.chunked != HTTP_CHUNKED_FIRST)
+				curHTTP.chunked = HTTP_CHUNKED_NONE;
 
 			// Send headers
-			TCPPutROMString(sktHTTP,
-							(const unsigned char *)
-							HTTPResponseHeaders[curHTTP.httpStatus]);
+			if (curHTTP.rangeStart != 0xffffffff)
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *)
+								"HTTP/1.1 206 Partial Content\r\n");
+			else
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *)
+								HTTPResponseHeaders[curHTTP.httpStatus]);
+			if (curHTTP.httpStatus == HTTP_GET || curHTTP.httpStatus == HTTP_POST
+				|| curHTTP.httpStatus == HTTP_NOT_MODIFIED
+				|| curHTTP.httpStatus == HTTP_RANGE_NOT_SATISFIABLE)
+				TCPPutROMString(sktHTTP, curHTTP.keepAlive ?
+								(const unsigned char *) "Connection: keep-alive\r\n" :
+								(const unsigned char *) "Connection: close\r\n");
 
 			// If this is a redirect, print the rest of the Location: header               
 			if (curHTTP.httpStatus == HTTP_REDIRECT) {
@@ -742,6 +879,28 @@ static void HTTPProcess(void)
 				TCPPutROMString(sktHTTP,
 								(const unsigned char *) HTTP_CRLF);
 			}
+			// A 304 repeats the validators and lifetime of the cached copy
+			if (curHTTP.httpStatus == HTTP_NOT_MODIFIED) {
+				HTTPPutValidators();
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *)
+								"Cache-Control: max-age=");
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *) HTTP_CACHE_LEN);
+				TCPPutROMString(sktHTTP, HTTP_CRLF);
+				TCPPutROMString(sktHTTP, HTTP_CRLF);
+			}
+			// A 416 gives the size, so the client can ask again
+			if (curHTTP.httpStatus == HTTP_RANGE_NOT_SATISFIABLE) {
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *)
+								"Content-Range: bytes */");
+				ultoa(MPFSGetSize(curHTTP.file), buffer);
+				TCPPutString(sktHTTP, buffer);
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *)
+								"\r\nContent-Length: 0\r\n\r\n");
+			}
 			// If not GET or POST, we're done
 			if (curHTTP.httpStatus != HTTP_GET && curHTTP.httpStatus != HTTP_POST) {	// Disconnect
 				smHTTP = SM_HTTP_DISCONNECT;
@@ -756,6 +915,36 @@ static void HTTPProcess(void)
 								httpContentTypes[curHTTP.fileType]);
 				TCPPutROMString(sktHTTP, HTTP_CRLF);
 			}
+			// Persistent connections need the length or the chunks 
+			// to find the end of the body
+			if (curHTTP.chunked != HTTP_CHUNKED_NONE) {
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *)
+								"Transfer-Encoding: chunked\r\n");
+			} else if (curHTTP.rangeStart != 0xffffffff) {
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *) "Content-Length: ");
+				ultoa(curHTTP.rangeEnd - curHTTP.rangeStart + 1, buffer);
+				TCPPutString(sktHTTP, buffer);
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *)
+								"\r\nContent-Range: bytes ");
+				ultoa(curHTTP.rangeStart, buffer);
+				TCPPutString(sktHTTP, buffer);
+				TCPPut(sktHTTP, '-');
+				ultoa(curHTTP.rangeEnd, buffer);
+				TCPPutString(sktHTTP, buffer);
+				TCPPut(sktHTTP, '/');
+				ultoa(MPFSGetSize(curHTTP.file), buffer);
+				TCPPutString(sktHTTP, buffer);
+				TCPPutROMString(sktHTTP, HTTP_CRLF);
+			} else if (curHTTP.keepAlive) {
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *) "Content-Length: ");
+				ultoa(MPFSGetSize(curHTTP.file), buffer);
+				TCPPutString(sktHTTP, buffer);
+				TCPPutROMString(sktHTTP, HTTP_CRLF);
+			}
 			// Output the gzip encoding header if needed
 			if (MPFSGetFlags(curHTTP.file) & MPFS2_FLAG_ISZIPPED) {
 				TCPPutROMString(sktHTTP,
@@ -776,6 +965,23 @@ static void HTTPProcess(void)
 			}
 			TCPPutROMString(sktHTTP, HTTP_CRLF);
 
+			// Static files can be revalidated instead of downloaded 
+			// again, and an interrupted download can be resumed
+			if (curHTTP.httpStatus == HTTP_GET && curHTTP.nextCallback == 0xffffffff) {
+				HTTPPutValidators();
+				TCPPutROMString(sktHTTP,
+								(const unsigned char *)
+								"Accept-Ranges: bytes\r\n");
+			}
+
+			// Read only the range, stopping at its end as if a 
+			// callback were there
+			if (curHTTP.rangeStart != 0xffffffff) {
+				MPFSSeek(curHTTP.file, curHTTP.rangeStart, MPFS_SEEK_START);
+				curHTTP.byteCount = curHTTP.rangeStart;
+				curHTTP.nextCallback = curHTTP.rangeEnd + 1;
+			}
+
 			// Check if we should output cookies
 			if (curHTTP.hasArgs)
 				smHTTP = SM_HTTP_SERVE_COOKIES;
@@ -843,6 +1049,11 @@ static void HTTPProcess(void)
 
 			isDone = FALSE;
 
+			// Dynamic pages go out one chunk per call
+			if (!HTTPBeginChunk()) {
+				isDone = TRUE;
+				break;
+			}
 			// Try to send next packet
 			if (HTTPSendFile()) {	// If EOF, then we're done so close and disconnect
 				MPFSClose(curHTTP.file);
@@ -860,7 +1071,8 @@ static void HTTPProcess(void)
 			isDone = TRUE;
 
 			// Check that at least the minimum bytes are free
-			if (TCPIsPutReady(sktHTTP) < HTTP_MIN_CALLBACK_FREE)
+			if (!HTTPBeginChunk()
+				|| TCPIsPutReady(sktHTTP) < HTTP_MIN_CALLBACK_FREE)
 				break;
 
 			// Fill TX FIFO from callback
@@ -879,6 +1091,16 @@ static void HTTPProcess(void)
 			if (TCPIsLoopback(sktHTTP) && TCPGetTxFIFOFull(sktHTTP) != 0)
 				break;
 
+			// End a chunked body with the last chunk
+			if (curHTTP.chunked != HTTP_CHUNKED_NONE) {
+				if (TCPIsPutReady(sktHTTP) < HTTP_CHUNK_LAST_LEN)
+					break;
+				TCPPutROMString(sktHTTP, curHTTP.chunked == HTTP_CHUNKED_NEXT ?
+								(const unsigned char *) "\r\n0\r\n\r\n" :
+								(const unsigned char *) "0\r\n\r\n");
+				curHTTP.chunked = HTTP_CHUNKED_NONE;
+			}
+
 			// Make sure any opened files are closed
 			if (curHTTP.file != MPFS_INVALID_HANDLE) {
 				MPFSClose(curHTTP.file);
@@ -889,12 +1111,47 @@ static void HTTPProcess(void)
 				curHTTP.offsets = MPFS_INVALID_HANDLE;
 			}
 
+			// Send the end of the response now and wait for the 
+			// next request, with the FIFOs set up to receive it
+			if (curHTTP.keepAlive) {
+				TCPFlush(sktHTTP);
+				TCPAdjustFIFOSize(sktHTTP, 1, 0,
+								  TCP_ADJUST_GIVE_REST_TO_RX |
+								  TCP_ADJUST_PRESERVE_RX |
+								  TCP_ADJUST_PRESERVE_TX);
+				curHTTP.callbackID =
+					TickGet() + HTTP_KEEP_ALIVE_TIMEOUT * TICK_SECOND;
+				smHTTP = SM_HTTP_KEEP_ALIVE;
+				isDone = FALSE;
+				break;
+			}
+
 			TCPDisconnect(sktHTTP);
 			smHTTP = SM_HTTP_IDLE;
 			break;
+
+		case SM_HTTP_KEEP_ALIVE:
+
+			// Serve the next request, which may already be queued 
+			// behind the last one
+			if (TCPIsGetReady(sktHTTP)) {
+				smHTTP = SM_HTTP_IDLE;
+				isDone = FALSE;
+			} else if (TickGet() > curHTTP.callbackID) {	// Idle for too long
+				curHTTP.keepAlive = FALSE;
+				smHTTP = SM_HTTP_DISCONNECT;
+				isDone = FALSE;
+			}
+			break;
+
+		case SM_HTTP_WAIT:
+			// No-op state
+			break;
 		}
 	} while (!isDone);
 
+	// Give the body written in this call its chunk header
+	HTTPEndChunk();
 }
 
 
@@ -941,6 +1198,10 @@ static BOOL HTTPSendFile(void)
 
 	// Check if a callback index was reached
 	if (curHTTP.byteCount == curHTTP.nextCallback) {
+		// A static file only stops there at the end of its range
+		if (curHTTP.offsets == MPFS_INVALID_HANDLE)
+			return TRUE;
+
 		// Update the state machine
 		smHTTP = SM_HTTP_SEND_FROM_CALLBACK;
 		curHTTP.callbackPos = 0;
@@ -966,6 +1227,146 @@ static BOOL HTTPSendFile(void)
 	return FALSE;
 }
 
+/*********************************************************************
+ * Function:        static BOOL HTTPBeginChunk(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          FALSE if the TX FIFO has no room for a chunk
+ *					TRUE if the body can be written
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Opens a chunk for a chunked body, reserving room 
+ *					for its header.  The chunk takes everything 
+ *					written until HTTPEndChunk(), so it is sized by 
+ *					the TX free space of this call.
+ *
+ * Note:            Does nothing if the body is not chunked or a 
+ *					chunk is already open.
+ ********************************************************************/
+static BOOL HTTPBeginChunk(void)
+{
+	if (curHTTP.chunked == HTTP_CHUNKED_NONE
+		|| wChunkHeader != TCP_INVALID_RESERVE)
+		return TRUE;
+
+	if (TCPIsPutReady(sktHTTP) <= HTTP_CHUNK_HEADER_LEN)
+		return FALSE;
+
+	wChunkHeader = TCPPutReserve(sktHTTP, HTTP_CHUNK_HEADER_LEN);
+	if (wChunkHeader == TCP_INVALID_RESERVE)
+		return FALSE;
+	wChunkFree = TCPIsPutReady(sktHTTP);
+	return TRUE;
+}
+
+/*********************************************************************
+ * Function:        static void HTTPEndChunk(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Writes the header of the chunk opened by 
+ *					HTTPBeginChunk() now that its length is known.  
+ *					An empty chunk would end the body, so its header 
+ *					is given back instead.
+ *
+ * Note:            The header is fixed width; chunk sizes may have 
+ *					leading zeros.
+ ********************************************************************/
+static void HTTPEndChunk(void)
+{
+	WORD_VAL len;
+	unsigned char header[HTTP_CHUNK_HEADER_LEN];
+
+	if (wChunkHeader == TCP_INVALID_RESERVE)
+		return;
+
+	len.Val = wChunkFree - TCPIsPutReady(sktHTTP);
+	if (len.Val == 0u) {
+		TCPPutReserved(sktHTTP, wChunkHeader, NULL, HTTP_CHUNK_HEADER_LEN);
+	} else {
+		// The first chunk has no CRLF to finish, pad with zeros
+		header[0] = curHTTP.chunked == HTTP_CHUNKED_NEXT ? '\r' : '0';
+		header[1] = curHTTP.chunked == HTTP_CHUNKED_NEXT ? '\n' : '0';
+		header[2] = btohexa_high(len.v[1]);
+		header[3] = btohexa_low(len.v[1]);
+		header[4] = btohexa_high(len.v[0]);
+		header[5] = btohexa_low(len.v[0]);
+		header[6] = '\r';
+		header[7] = '\n';
+		TCPPutReserved(sktHTTP, wChunkHeader, header, HTTP_CHUNK_HEADER_LEN);
+		curHTTP.chunked = HTTP_CHUNKED_NEXT;
+	}
+	wChunkHeader = TCP_INVALID_RESERVE;
+}
+
+/*********************************************************************
+ * Function:        static unsigned char HTTPHeaderFind(unsigned char *name, unsigned char hash)
+ *
+ * PreCondition:    None
+ *
+ * Input:           name: header name in lower case, with its colon
+ *					hash: HTTP_HASH() of name
+ *
+ * Output:          Index of name in HTTPRequestHeaders, or 
+ *					HTTP_NUM_HEADERS if it isn't one of them
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Maps the hash to the only header that can have it, 
+ *					then compares the name to that one header.
+ *
+ * Note:            Most headers a browser sends (Host, User-Agent, 
+ *					Accept...) hash to no case and are never compared.
+ ********************************************************************/
+static unsigned char HTTPHeaderFind(unsigned char *name, unsigned char hash)
+{
+	unsigned char i;
+
+	switch (hash) {
+	case HTTP_HASH_COOKIE:
+		i = 0u;
+		break;
+	case HTTP_HASH_AUTHORIZATION:
+		i = 1u;
+		break;
+	case HTTP_HASH_CONTENT_LENGTH:
+		i = 2u;
+		break;
+	case HTTP_HASH_IF_NONE_MATCH:
+		i = 3u;
+		break;
+	case HTTP_HASH_IF_MODIFIED_SINCE:
+		i = 4u;
+		break;
+	case HTTP_HASH_CONNECTION:
+		i = 5u;
+		break;
+	case HTTP_HASH_RANGE:
+		i = 6u;
+		break;
+	case HTTP_HASH_IF_RANGE:
+		i = 7u;
+		break;
+	default:
+		return HTTP_NUM_HEADERS;
+	}
+
+	// Rule out an unknown header with the same hash
+	if (strcmppgm2ram((char *) name, (const char *) HTTPRequestHeaders[i]) != 0)
+		return HTTP_NUM_HEADERS;
+	return i;
+}
+
 /*********************************************************************
  * Function:        static void HTTPHeaderParseLookup(unsigned char i)
  *
@@ -1005,6 +1406,31 @@ static void HTTPHeaderParseLookup(unsigned char i)
 		return;
 	}
 #endif
+
+	if (i == 3u) {
+		HTTPHeaderParseIfNoneMatch();
+		return;
+	}
+
+	if (i == 4u) {
+		HTTPHeaderParseIfModifiedSince();
+		return;
+	}
+
+	if (i == 5u) {
+		HTTPHeaderParseConnection();
+		return;
+	}
+
+	if (i == 6u) {
+		HTTPHeaderParseRange();
+		return;
+	}
+
+	if (i == 7u) {
+		HTTPHeaderParseIfRange();
+		return;
+	}
 }
 
 /*********************************************************************
@@ -1169,6 +1595,427 @@ static void HTTPHeaderParseContentLength(void)
 }
 #endif
 
+/*********************************************************************
+ * Function:        static void HTTPHeaderParseIfNoneMatch(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          curHTTP.validators is updated
+ * 
+ * Side Effects:    None
+ *
+ * Overview:        Parses the "If-None-Match:" header, a list of the 
+ *					ETags the client has cached, or "*".  Looks for 
+ *					the ETag of the requested file in it.
+ *
+ * Note:            A weak tag (W/"...") matches too: RFC 2616 allows 
+ *					the weak comparison for GET.
+ ********************************************************************/
+static void HTTPHeaderParseIfNoneMatch(void)
+{
+	WORD len;
+	unsigned char etag[HTTP_ETAG_LEN + 1];
+
+	if (!HTTPIsStaticFile())
+		return;
+	curHTTP.validators |= HTTP_VALIDATOR_ETAG_SENT;
+
+	len = TCPFindROMArray(sktHTTP, HTTP_CRLF, HTTP_CRLF_LEN, 0, FALSE);
+	HTTPFormatETag(etag);
+	if (TCPFindArrayEx(sktHTTP, etag, HTTP_ETAG_LEN, 0, len, FALSE) != 0xffff
+		|| TCPFindEx(sktHTTP, '*', 0, len, FALSE) != 0xffff)
+		curHTTP.validators |= HTTP_VALIDATOR_ETAG_MATCH;
+}
+
+/*********************************************************************
+ * Function:        static void HTTPHeaderParseIfModifiedSince(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          curHTTP.validators is updated
+ * 
+ * Side Effects:    None
+ *
+ * Overview:        Parses the "If-Modified-Since:" header.  Browsers 
+ *					send back the Last-Modified date they were given, 
+ *					so the date is compared as text instead of being 
+ *					converted.  Any other date gets the whole file.
+ *
+ * Note:            Text after the date, such as IE's "; length=", 
+ *					is ignored.
+ ********************************************************************/
+static void HTTPHeaderParseIfModifiedSince(void)
+{
+	unsigned char date[HTTP_DATE_LEN + 1];
+	unsigned char *ptr, c;
+
+	if (!HTTPIsStaticFile() || MPFSGetTimestamp(curHTTP.file) == 0ul)
+		return;
+	if (TCPFindROMArray(sktHTTP, HTTP_CRLF, HTTP_CRLF_LEN, 0, FALSE) < HTTP_DATE_LEN)
+		return;
+
+	HTTPFormatDate(MPFSGetTimestamp(curHTTP.file), date);
+	for (ptr = date; *ptr != '\0'; ptr++) {
+		TCPGet(sktHTTP, &c);
+		if (c != *ptr)
+			return;
+	}
+	curHTTP.validators |= HTTP_VALIDATOR_DATE_MATCH;
+}
+
+/*********************************************************************
+ * Function:        static void HTTPHeaderParseConnection(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          curHTTP.keepAlive is updated
+ * 
+ * Side Effects:    None
+ *
+ * Overview:        Parses the "Connection:" header.  "close" ends the 
+ *					connection after this response, "keep-alive" lets 
+ *					HTTP/1.0 clients keep it.
+ *
+ * Note:            None
+ ********************************************************************/
+static void HTTPHeaderParseConnection(void)
+{
+	WORD len;
+
+	len = TCPFindROMArray(sktHTTP, HTTP_CRLF, HTTP_CRLF_LEN, 0, FALSE);
+	if (TCPFindROMArrayEx(sktHTTP, (const unsigned char *) "close", 5, 0, len, TRUE) != 0xffff)
+		curHTTP.keepAlive = FALSE;
+	else if (TCPFindROMArrayEx(sktHTTP, (const unsigned char *) "keep-alive", 10, 0, len, TRUE) != 0xffff)
+		curHTTP.keepAlive = TRUE;
+}
+
+/*********************************************************************
+ * Function:        static void HTTPHeaderParseRange(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          curHTTP.rangeStart and curHTTP.rangeEnd are updated
+ * 
+ * Side Effects:    None
+ *
+ * Overview:        Parses the "Range:" header of a static file.  One 
+ *					range is accepted: "bytes=first-last", "bytes=first-" 
+ *					or "bytes=-length" for the end of the file.  
+ *					HTTPResolveRange() checks it against the file size.
+ *
+ * Note:            A list of ranges or a malformed one is ignored, 
+ *					and the whole file is sent as RFC 2616 allows.
+ ********************************************************************/
+static void HTTPHeaderParseRange(void)
+{
+	WORD len;
+	unsigned char buf[HTTP_RANGE_LEN + 1], *ptr;
+	DWORD start, end;
+
+	if (!HTTPIsStaticFile())
+		return;
+	len = TCPFindROMArray(sktHTTP, HTTP_CRLF, HTTP_CRLF_LEN, 0, FALSE);
+	if (len > HTTP_RANGE_LEN)
+		return;
+	len = TCPGetArray(sktHTTP, buf, len);
+	buf[len] = '\0';
+
+	for (ptr = buf; *ptr == ' '; ptr++);
+	if (memcmppgm2ram((void *) ptr, (const void *) "bytes=", 6) != 0)
+		return;
+	ptr += 6;
+
+	// First byte, absent for a suffix
+	start = 0xffffffff;
+	if (*ptr != '-') {
+		if (*ptr < '0' || *ptr > '9')
+			return;
+		start = atol((char *) ptr);
+		while (*ptr >= '0' && *ptr <= '9')
+			ptr++;
+		if (*ptr != '-')
+			return;
+	}
+	ptr++;
+
+	// Last byte, absent to the end of the file
+	end = 0xffffffff;
+	if (*ptr >= '0' && *ptr <= '9') {
+		end = atol((char *) ptr);
+		while (*ptr >= '0' && *ptr <= '9')
+			ptr++;
+	} else if (start == 0xffffffff)
+		return;
+
+	while (*ptr == ' ')
+		ptr++;
+	if (*ptr != '\0' || (start != 0xffffffff && end < start))
+		return;
+
+	curHTTP.rangeStart = start;
+	curHTTP.rangeEnd = end;
+}
+
+/*********************************************************************
+ * Function:        static void HTTPHeaderParseIfRange(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          curHTTP.validators is updated
+ * 
+ * Side Effects:    None
+ *
+ * Overview:        Parses the "If-Range:" header, the ETag or the 
+ *					Last-Modified date of the copy a client is resuming.
+ *					If the file has changed since, the range is dropped 
+ *					and the whole new file is sent.
+ *
+ * Note:            Weak tags never match, as RFC 2616 requires.
+ ********************************************************************/
+static void HTTPHeaderParseIfRange(void)
+{
+	WORD len;
+	unsigned char buf[HTTP_DATE_LEN + 1];
+
+	if (!HTTPIsStaticFile())
+		return;
+
+	len = TCPFindROMArray(sktHTTP, HTTP_CRLF, HTTP_CRLF_LEN, 0, FALSE);
+	HTTPFormatETag(buf);
+	if (TCPFindArrayEx(sktHTTP, buf, HTTP_ETAG_LEN, 0, len, FALSE) != 0xffff
+		&& TCPFindROMArrayEx(sktHTTP, (const unsigned char *) "W/", 2, 0, len, FALSE) == 0xffff)
+		return;
+	if (MPFSGetTimestamp(curHTTP.file) != 0ul) {
+		HTTPFormatDate(MPFSGetTimestamp(curHTTP.file), buf);
+		if (TCPFindArrayEx(sktHTTP, buf, HTTP_DATE_LEN, 0, len, FALSE) != 0xffff)
+			return;
+	}
+	curHTTP.validators |= HTTP_VALIDATOR_RANGE_STALE;
+}
+
+/*********************************************************************
+ * Function:        static void HTTPResolveRange(void)
+ *
+ * PreCondition:    SM_HTTP_PROCESS_REQUEST is done
+ *
+ * Input:           None
+ *
+ * Output:          curHTTP.rangeStart and curHTTP.rangeEnd hold the 
+ *					bytes to send, or 0xffffffff to send the whole file
+ *
+ * Side Effects:    curHTTP.httpStatus may become 
+ *					HTTP_RANGE_NOT_SATISFIABLE
+ *
+ * Overview:        Turns a suffix into byte offsets and cuts the last 
+ *					byte to the file size.  A range starting past the 
+ *					end gets a 416.
+ *
+ * Note:            Only a 200 for a static file becomes a 206.
+ ********************************************************************/
+static void HTTPResolveRange(void)
+{
+	DWORD size;
+
+	if (curHTTP.httpStatus != HTTP_GET || curHTTP.nextCallback != 0xffffffff
+		|| (curHTTP.validators & HTTP_VALIDATOR_RANGE_STALE)
+		|| (curHTTP.rangeStart == 0xffffffff && curHTTP.rangeEnd == 0xffffffff)) {
+		curHTTP.rangeStart = 0xffffffff;
+		return;
+	}
+
+	size = MPFSGetSize(curHTTP.file);
+	if (curHTTP.rangeStart == 0xffffffff) {	// The last rangeEnd bytes
+		curHTTP.rangeStart = (curHTTP.rangeEnd < size) ?
+			size - curHTTP.rangeEnd : 0ul;
+		if (curHTTP.rangeEnd == 0ul)
+			curHTTP.rangeStart = size;
+		curHTTP.rangeEnd = size - 1;
+	} else if (curHTTP.rangeEnd >= size)
+		curHTTP.rangeEnd = size - 1;
+
+	if (curHTTP.rangeStart >= size) {
+		curHTTP.httpStatus = HTTP_RANGE_NOT_SATISFIABLE;
+		curHTTP.rangeStart = 0xffffffff;
+	}
+}
+
+/*********************************************************************
+ * Function:        static BOOL HTTPIsStaticFile(void)
+ *
+ * PreCondition:    The request line has been parsed
+ *
+ * Input:           None
+ *
+ * Output:          TRUE if the requested file exists and has no 
+ *					dynamic variables
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Only static files are given validators.  Dynamic 
+ *					pages change with every request.
+ *
+ * Note:            None
+ ********************************************************************/
+static BOOL HTTPIsStaticFile(void)
+{
+	return curHTTP.file != MPFS_INVALID_HANDLE
+		&& curHTTP.offsets == MPFS_INVALID_HANDLE;
+}
+
+/*********************************************************************
+ * Function:        static void HTTPFormatETag(unsigned char *buf)
+ *
+ * PreCondition:    curHTTP.file is open
+ *
+ * Input:           buf: HTTP_ETAG_LEN + 1 bytes
+ *
+ * Output:          The quoted, NULL terminated ETag of the file
+ *
+ * Side Effects:    None
+ *
+ * Overview:        The tag is the FAT ID and the timestamp in hex.  A 
+ *					new image changes the timestamp of every file that 
+ *					was rebuilt, and the FAT ID of every file that moved.
+ *
+ * Note:            None
+ ********************************************************************/
+static void HTTPFormatETag(unsigned char *buf)
+{
+	WORD_VAL id;
+	DWORD_VAL t;
+	unsigned char i;
+
+	id.Val = MPFSGetID(curHTTP.file);
+	t.Val = MPFSGetTimestamp(curHTTP.file);
+	*buf++ = '"';
+	for (i = 2; i-- != 0;) {
+		*buf++ = btohexa_high(id.v[i]);
+		*buf++ = btohexa_low(id.v[i]);
+	}
+	for (i = 4; i-- != 0;) {
+		*buf++ = btohexa_high(t.v[i]);
+		*buf++ = btohexa_low(t.v[i]);
+	}
+	*buf++ = '"';
+	*buf = '\0';
+}
+
+/*********************************************************************
+ * Function:        static void HTTPFormatDate(DWORD t, unsigned char *buf)
+ *
+ * PreCondition:    None
+ *
+ * Input:           t: seconds since 1970, as MPFS2 timestamps are
+ *					buf: HTTP_DATE_LEN + 1 bytes
+ *
+ * Output:          A NULL terminated RFC 1123 date, such as 
+ *					"Sun, 06 Nov 1994 08:49:37 GMT"
+ *
+ * Side Effects:    None
+ *
+ * Overview:        None
+ *
+ * Note:            Years and months are counted off one at a time: 
+ *					slower than dividing, but small, and it only runs 
+ *					for static files.
+ ********************************************************************/
+static void HTTPFormatDate(DWORD t, unsigned char *buf)
+{
+	static const char days[] = "ThuFriSatSunMonTueWed";	// 1/1/1970 was a Thursday
+	static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	static const unsigned char monthDays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	WORD day, year, len;
+	unsigned char month, sec, min, hour;
+
+	sec = t % 60ul;
+	t /= 60ul;
+	min = t % 60ul;
+	t /= 60ul;
+	hour = t % 24ul;
+	day = t / 24ul;
+
+	memcpypgm2ram((void *) buf, (const void *) &days[(day % 7u) * 3u], 3);
+	buf[3] = ',';
+	buf[4] = ' ';
+
+	for (year = 1970u;; year++) {
+		len = ((year & 3u) == 0u && year != 2100u) ? 366u : 365u;
+		if (day < len)
+			break;
+		day -= len;
+	}
+	for (month = 0u;; month++) {
+		len = monthDays[month];
+		if (month == 1u && ((year & 3u) == 0u && year != 2100u))
+			len++;
+		if (day < len)
+			break;
+		day -= len;
+	}
+	day++;
+
+	buf[5] = '0' + day / 10u;
+	buf[6] = '0' + day % 10u;
+	buf[7] = ' ';
+	memcpypgm2ram((void *) &buf[8], (const void *) &months[month * 3u], 3);
+	buf[11] = ' ';
+	uitoa(year, &buf[12]);
+	buf[16] = ' ';
+	buf[17] = '0' + hour / 10u;
+	buf[18] = '0' + hour % 10u;
+	buf[19] = ':';
+	buf[20] = '0' + min / 10u;
+	buf[21] = '0' + min % 10u;
+	buf[22] = ':';
+	buf[23] = '0' + sec / 10u;
+	buf[24] = '0' + sec % 10u;
+	strcpypgm2ram((void *) &buf[25], " GMT");
+}
+
+/*********************************************************************
+ * Function:        static void HTTPPutValidators(void)
+ *
+ * PreCondition:    curHTTP.file is open
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Writes the ETag and Last-Modified headers of the 
+ *					file.  Images built without timestamps get only 
+ *					the ETag.
+ *
+ * Note:            None
+ ********************************************************************/
+static void HTTPPutValidators(void)
+{
+	unsigned char buf[HTTP_DATE_LEN + 1];
+
+	TCPPutROMString(sktHTTP, (const unsigned char *) "ETag: ");
+	HTTPFormatETag(buf);
+	TCPPutString(sktHTTP, buf);
+	TCPPutROMString(sktHTTP, HTTP_CRLF);
+
+	if (MPFSGetTimestamp(curHTTP.file) != 0ul) {
+		TCPPutROMString(sktHTTP, (const unsigned char *) "Last-Modified: ");
+		HTTPFormatDate(MPFSGetTimestamp(curHTTP.file), buf);
+		TCPPutString(sktHTTP, buf);
+		TCPPutROMString(sktHTTP, HTTP_CRLF);
+	}
+}
+
 /*********************************************************************
  * Function:        unsigned char* HTTPURLDecode(unsigned char *data)
  *
@@ -1253,14 +2100,22 @@ unsigned char *HTTPURLDecode(unsigned char *data)
  ********************************************************************/
 unsigned char *HTTPGetArg(unsigned char *data, unsigned char *arg)
 {
+	unsigned char hash;
+	WORD len;
+
+	// Hash the name once, so each pair only costs a pass over its name
+	hash = 0;
+	for (len = 0; arg[len] != '\0'; len++)
+		hash = HTTP_HASH(hash, arg[len]);
+
 	// Search through the array while bytes remain
-	while (*data != '\0') {
-		// Look for arg at current position
-		if (!strcmp((char *) arg, (char *) data)) {	// Found it, so return parameter
-			return data + strlen((char *) arg) + 1;
+	while ((data = HTTPFindArgHash(data, hash, len)) != NULL) {
+		// Compare only names with the same hash and length
+		if (!memcmp((void *) data, (void *) arg, len)) {	// Found it, so return parameter
+			return data + len + 1;
 		}
 		// Skip past two strings (NUL bytes)
-		data += strlen((char *) data) + 1;
+		data += len + 1;
 		data += strlen((char *) data) + 1;
 	}
 
@@ -1271,14 +2126,18 @@ unsigned char *HTTPGetArg(unsigned char *data, unsigned char *arg)
 #if defined(__18CXX)
 unsigned char *HTTPGetROMArg(unsigned char *data, const unsigned char *arg)
 {
-	// Search through the array while bytes remain
-	while (*data != '\0') {
-		// Look for arg at current position
-		if (!memcmppgm2ram(data, (const void *) arg, strlenpgm((const char *) arg) + 1)) {	// Found it, so skip to next string
-			return data + strlenpgm((const char *) arg) + 1;
+	unsigned char hash;
+	WORD len;
+
+	hash = 0;
+	for (len = 0; arg[len] != '\0'; len++)
+		hash = HTTP_HASH(hash, arg[len]);
+
+	while ((data = HTTPFindArgHash(data, hash, len)) != NULL) {
+		if (!memcmppgm2ram(data, (const void *) arg, len)) {	// Found it, so skip to next string
+			return data + len + 1;
 		}
-		// Skip past two strings (NUL bytes)
-		data += strlen((char *) data) + 1;
+		data += len + 1;
 		data += strlen((char *) data) + 1;
 	}
 
@@ -1287,6 +2146,49 @@ unsigned char *HTTPGetROMArg(unsigned char *data, const unsigned char *arg)
 }
 #endif
 
+/*********************************************************************
+ * Function:        static unsigned char* HTTPFindArgHash(unsigned char *data, unsigned char hash, WORD len)
+ *
+ * PreCondition:    None
+ *
+ * Input:           *data: the pair to start searching at
+ *					hash: HTTP_HASH() of the argument name
+ *					len: length of the argument name
+ *
+ * Output:          Pointer to the first name with that hash and 
+ *					length, NULL if there is none
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Hashes each name while walking to its end, which 
+ *					the search has to do anyway, so names that can't 
+ *					match are skipped without a string compare.
+ *
+ * Note:            None
+ ********************************************************************/
+static unsigned char *HTTPFindArgHash(unsigned char *data, unsigned char hash, WORD len)
+{
+	unsigned char *name;
+	unsigned char h;
+
+	while (*data != '\0') {
+		name = data;
+		h = 0;
+		while (*data != '\0') {
+			h = HTTP_HASH(h, *data);
+			data++;
+		}
+		if (h == hash && (WORD) (data - name) == len)
+			return name;
+
+		// Skip past the NUL and the value
+		data++;
+		data += strlen((char *) data) + 1;
+	}
+
+	return NULL;
+}
+
 /*********************************************************************
  * Function:        HTTP_IO_RESULT HTTPMPFSUpload(void)
  *
@@ -1296,6 +2198,7 @@ unsigned char *HTTPGetROMArg(unsigned char *data, const unsigned char *arg)
  *
  * Output:          HTTP_IO_DONE on success
  *					HTTP_IO_NEED_DATA if more data is requested
+ *					HTTP_IO_WAITING while the EEPROM is busy
  *
  * Side Effects:    None
  *
@@ -1305,8 +2208,11 @@ unsigned char *HTTPGetROMArg(unsigned char *data, const unsigned char *arg)
  *					will be the MIME separator.  Following that is 
  *					more headers about the file, which we discard. 
  *					After another CRLFCRLF, the file data begins, and 
- *					we read it 16 bytes at a time and write it to 
- *					the EEPROM.
+ *					we read it 16 bytes at a time into the MPFS page 
+ *					buffer.  Data is left in the socket while the 
+ *					buffer is full, so the next segment arrives while 
+ *					the EEPROM programs the last page.  The new image 
+ *					is only used if MPFSPutEnd() verifies it.
  ********************************************************************/
 #if defined(HTTP_MPFS_UPLOAD)
 static HTTP_IO_RESULT HTTPMPFSUpload(void)
@@ -1334,12 +2240,16 @@ static HTTP_IO_RESULT HTTPMPFSUpload(void)
 			// Make sure it's an MPFS of the correct version
 			lenA = TCPGetArray(sktHTTP, c, 10);
 			curHTTP.byteCount -= lenA;
-			if (memcmppgm2ram(c, (const void *) "\r\n\r\nMPFS\x02\x00", 10) == 0) {	// Read as Ver 2.0
+			if (memcmppgm2ram(c, (const void *) "\r\n\r\nMPFS\x02", 9) == 0) {	// Read as Ver 2.x
 				curHTTP.httpStatus = HTTP_MPFS_OK;
 
-				// Format MPFS storage and put 6 byte tag
-				curHTTP.file = MPFSFormat();
-				MPFSPutArray(curHTTP.file, &c[4], 6);
+				// Format the spare MPFS slot and put 6 byte tag.  The 
+				// rest of the body bounds the image, boundary included.
+				curHTTP.file = MPFSFormat(curHTTP.byteCount + 6);
+				if (curHTTP.file == MPFS_INVALID_HANDLE)
+					curHTTP.httpStatus = HTTP_MPFS_ERROR;
+				else
+					MPFSPutArray(curHTTP.file, &c[4], 6);
 			} else {			// Version is wrong
 				curHTTP.httpStatus = HTTP_MPFS_ERROR;
 			}
@@ -1368,7 +2278,10 @@ static HTTP_IO_RESULT HTTPMPFSUpload(void)
 			lenA = curHTTP.byteCount;
 
 		while (lenA > 0) {
-			lenB = TCPGetArray(sktHTTP, c, mMIN(lenA, 16));
+			lenB = MPFSIsPutReady(curHTTP.file);
+			if (lenB == 0)		// Page buffer full until the EEPROM is done
+				return HTTP_IO_WAITING;
+			lenB = TCPGetArray(sktHTTP, c, mMIN(mMIN(lenA, lenB), 16));
 			curHTTP.byteCount -= lenB;
 			lenA -= lenB;
 			MPFSPutArray(curHTTP.file, c, lenB);
@@ -1376,7 +2289,8 @@ static HTTP_IO_RESULT HTTPMPFSUpload(void)
 
 		// If we've read all the data
 		if (curHTTP.byteCount == 0) {
-			MPFSPutEnd();
+			if (!MPFSPutEnd())
+				curHTTP.httpStatus = HTTP_MPFS_ERROR;
 			smHTTP = SM_HTTP_SERVE_HEADERS;
 			return HTTP_IO_DONE;
 		}
@@ -49,6 +49,10 @@ DWORD GenerateRandomDWORD(void)
 	WORD w, wTime, wLastValue;
 	DWORD dwTotalTime;
 	DWORD dwRandomResult;
+
+	// The A/D and timer entropy sampling below is disabled on this board, so
+	// fall back to the current state of the C library generator.
+	dwRandomResult = rand() | (((DWORD) rand()) << 15) | (((DWORD) rand()) << 30);
 /*
 #if defined __18CXX
 	{
@@ -400,6 +404,46 @@ void ultoa(DWORD Value, unsigned char *Buffer)
 	*Buffer = '\0';
 }
 #endif
+/*********************************************************************
+ * Function:		void fixtoa(LONG Value, unsigned char Decimals, unsigned char *Buffer)
+ * PreCondition:	None
+ * Input:			Value: Signed fixed-point number, in units of 
+ *						10^-Decimals
+ *					Decimals: Digits after the decimal point
+ *					Buffer: Pointer to a location to write the string
+ * Output:			*Buffer: Receives the resulting string
+ * Side Effects:	None
+ * Overview:		The function converts a fixed-point number into a 
+ *					null terminated decimal string with exactly 
+ *					Decimals digits after the point, e.g. -5 with 2 
+ *					decimals gives "-0.05".
+ * Note:			Decimals must be 9 or less.
+ ********************************************************************/
+void fixtoa(LONG Value, unsigned char Decimals, unsigned char *Buffer)
+{
+	DWORD Magnitude;
+	DWORD Scale;
+	unsigned char i;
+	if (Value < 0) {
+		*Buffer++ = '-';
+		Magnitude = (DWORD) - Value;
+	} else
+		Magnitude = (DWORD) Value;
+	for (i = Decimals, Scale = 1; i; i--)
+		Scale *= 10;
+	ultoa(Magnitude / Scale, Buffer);
+	if (Decimals == 0u)
+		return;
+	while (*Buffer)
+		Buffer++;
+	*Buffer++ = '.';
+	Magnitude %= Scale;
+	Buffer[Decimals] = '\0';
+	while (Decimals--) {
+		Buffer[Decimals] = '0' + (unsigned char) (Magnitude % 10);
+		Magnitude /= 10;
+	}
+}
 /*********************************************************************
  * Function:        unsigned char btohexa_high(unsigned char b)
  * PreCondition:    None
@@ -434,6 +478,37 @@ unsigned char btohexa_low(unsigned char b)
 	b &= 0x0F;
 	return (b > 9u) ? b + 'A' - 10 : b + '0';
 }
+/*********************************************************************
+ * Function:        unsigned char hexatob(WORD_VAL AsciiChars)
+ * PreCondition:    None
+ * Input:           Two ascii bytes, each '0'-'9', 'a'-'f' or 'A'-'F', 
+ *					the upper nibble in AsciiChars.v[1]
+ * Output:          The byte they encode
+ *					ex: v[1] = 'a', v[0] = 'E', hexatob() returns 0xAE
+ * Side Effects:    None
+ * Overview:        None
+ * Note:			None
+ ********************************************************************/
+unsigned char hexatob(WORD_VAL AsciiChars)
+{
+	// Convert lowercase to uppercase
+	if (AsciiChars.v[1] > 'F')
+		AsciiChars.v[1] -= 'a' - 'A';
+	if (AsciiChars.v[0] > 'F')
+		AsciiChars.v[0] -= 'a' - 'A';
+
+	// Convert 0-9, A-F to 0x0-0x9, 0xA-0xF
+	if (AsciiChars.v[1] > '9')
+		AsciiChars.v[1] -= 'A' - 10;
+	else
+		AsciiChars.v[1] -= '0';
+	if (AsciiChars.v[0] > '9')
+		AsciiChars.v[0] -= 'A' - 10;
+	else
+		AsciiChars.v[0] -= '0';
+
+	return (AsciiChars.v[1] << 4) | AsciiChars.v[0];
+}
 /*********************************************************************
  * Function:        signed char stricmppgm2ram(unsigned char* a, const unsigned char* b)
  * PreCondition:    None
@@ -628,6 +703,7 @@ char *strupr(char *s)
 	return s;
 }
 #endif
+#if defined(__18CXX)
 /*********************************************************************
  * Function:		DWORD leftRotateDWORD(DWORD val, unsigned char bits)
  * PreCondition:	None
@@ -664,3 +740,4 @@ DWORD leftRotateDWORD(DWORD val, unsigned char bits)
 	}
 	return toRotate.Val;
 }
+#endif
@@ -24,8 +24,9 @@
 /*
  * MPFS Structure:
  *     [M][P][F][S]
- *     [unsigned char Ver Hi][unsigned char Ver Lo][DWORD Number of Files]
+ *     [unsigned char Ver Hi][unsigned char Ver Lo][WORD Number of Files]
  *     [File Record 1][File Record 2]...[File Record N]
+ *     [Index Entry 1][Index Entry 2]...[Index Entry N]	(2.1 and later)
  *     [String 1][String 2]...[String N]
  *     [File Data 1][File Data 2]...[File Data N]
  *
@@ -34,6 +35,9 @@
  *     [DWORD Data Ptr][DWORD Len]
  *     [DWORD Timestamp][DWORD Microtime]
  *
+ * Index Entry Structure (6 bytes), sorted by hash, then by FAT ID:
+ *     [DWORD FNV-1a Name Hash][WORD FAT ID]
+ *
  * String Structure (1 to 64 bytes):
  *     ["path/to/file.ext"][0x00]
  *
@@ -41,8 +45,17 @@
  *		[File Data]
  *
  * Note: Unlike previous versions, there are no delimiters or flags
+ *
+ * The record Name Hash is the sum of the name's bytes.  It is kept in 
+ * 2.1 images so that older firmware, which scans the records and ignores 
+ * the version, can still read them.  2.1 firmware binary searches the 
+ * index instead and scans only 2.0 images.
  */
 
+#define MPFS_FAT_RECORD_SIZE	(24u)
+#define MPFS_INDEX_ENTRY_SIZE	(6u)
+#define MPFS_FNV_OFFSET_BASIS	(0x811C9DC5ul)
+
 #if defined(STACK_USE_MPFS) && defined(STACK_USE_MPFS2)
 #error Both MPFS and MPFS2 are included
 #endif
@@ -54,27 +67,70 @@ MPFS_STUB MPFSStubs[MAX_MPFS_HANDLES + 1];
 // Allows the MPFS to be locked altogether
 BOOL isMPFSLocked;
 
+// Name hashes of recently opened files and their FAT IDs, most recent 
+// first.  Cleared whenever the image may change.
+#if MPFS_OPEN_CACHE_SIZE > 0
+typedef struct _MPFS_OPEN_CACHE {
+	DWORD dwHash;
+	WORD fatID;
+} MPFS_OPEN_CACHE;
+static MPFS_OPEN_CACHE OpenCache[MPFS_OPEN_CACHE_SIZE];
+#endif
+
 // Static Function Declarations
 static void LoadFATRecord(MPFS_HANDLE hMPFS);
+static MPFS_HANDLE FindFreeHandle(void);
+static DWORD HashName(unsigned char *name);
+static BOOL NameMatches(WORD fatID, unsigned char *name);
+static WORD FindFile(unsigned char *name, DWORD dwHash);
+static void ClearOpenCache(void);
 
 // Settings for EEPROM vs Flash
 #if defined(MPFS_USE_EEPROM)
 
-	// Start in EEPROM after the reserve block
-#define MPFS_HEAD		MPFS_RESERVE_BLOCK
+	// Start of the image slot in use, selected by the flag byte
+static MPFS_PTR mpfsHead;
+static unsigned char mpfsSlot;	// Flag byte in use, MPFS_SLOT_*
+#define MPFS_HEAD		mpfsHead
 
 	// Tracks the last read address
 MPFS_PTR lastRead;
 
+	// Upload writer.  PageBuf fills from the network while the EEPROM 
+	// programs the previous page, and each page is read back and hashed 
+	// before the next one is written over the SPI bus.
+static unsigned char PageBuf[MPFS_WRITE_PAGE_SIZE];
+static WORD pageLen;
+static MPFS_PTR writeBase;		// Start of the slot being written
+static MPFS_PTR writeAddr;		// Next EEPROM page to program
+static MPFS_PTR writeEnd;		// End of the slot being written
+static MPFS_PTR verifyAddr;		// Programmed bytes read back so far
+static DWORD writeHash;			// FNV-1a of the bytes accepted
+static DWORD verifyHash;		// FNV-1a of the bytes read back
+static BOOL isWriting;
+static BOOL writeOverflow;
+
+static DWORD HashBytes(DWORD h, unsigned char *data, WORD len);
+static void VerifyWritten(void);
+static BOOL WritePage(void);
+static BOOL ImageFits(MPFS_PTR base, DWORD size);
+
 #else
 
-	// An address where MPFS data starts in program memory.
-#if defined(__18CXX) || defined(__C32__)
+	// An address where MPFS data starts in program memory.  The host 
+	// build keeps the image in RAM and needs a full pointer for it.
+#if defined(HOST_BUILD)
+extern const unsigned char MPFS_Start[];
+#define MPFS_HEAD		((PTR_BASE)(&MPFS_Start[0]))
+#define MPFS_ROM_ADDR	PTR_BASE
+#elif defined(__18CXX) || defined(__C32__)
 extern const unsigned char MPFS_Start[];
 #define MPFS_HEAD		((DWORD)(&MPFS_Start[0]))
+#define MPFS_ROM_ADDR	DWORD
 #else
 extern DWORD MPFS_Start;
 #define MPFS_HEAD		MPFS_Start;
+#define MPFS_ROM_ADDR	DWORD
 #endif
 
 #endif
@@ -91,7 +147,10 @@ extern DWORD MPFS_Start;
  * Side Effects:    None
  *
  * Overview:        Sets all MPFS handles to closed, and initializes
- *					EEPROM if necessary.
+ *					EEPROM if necessary.  With EEPROM, the flag byte 
+ *					picks which image slot is read, and MPFS stays 
+ *					locked if the last upload over the whole area 
+ *					did not finish.
  *
  * Note:            This function is called only one during lifetime
  *                  of the application.
@@ -106,8 +165,18 @@ void MPFSInit(void)
 #if defined(MPFS_USE_EEPROM)
 	XEEInit();							// Initialize the EEPROM access routines.
 	lastRead = MPFS_INVALID;
+	XEEReadArray(MPFS_SLOT_FLAG, &mpfsSlot, 1);
+	if (mpfsSlot > MPFS_SLOT_WHOLE)
+		mpfsSlot = MPFS_SLOT_FIRST;
+	mpfsHead = (mpfsSlot == MPFS_SLOT_SECOND) ? MPFS_SLOT_BASE + MPFS_SLOT_SIZE : MPFS_SLOT_BASE;
+	isWriting = FALSE;
 #endif
+	ClearOpenCache();
 	isMPFSLocked = FALSE;
+#if defined(MPFS_USE_EEPROM)
+	if (mpfsSlot == MPFS_SLOT_NONE)
+		isMPFSLocked = TRUE;
+#endif
 }
 /*********************************************************************
  * Function:        MPFS_HANDLE MPFSOpen(unsigned char* file)
@@ -121,122 +190,71 @@ void MPFSInit(void)
  *
  * Side Effects:    None
  *
- * Overview:        None
+ * Overview:        Looks the name up in the open cache, then in the 
+ *					image (see FindFile()).
  *
  * Note:            None
  ********************************************************************/
 MPFS_HANDLE MPFSOpen(unsigned char *file)
 {
 	MPFS_HANDLE hMPFS;
-	WORD nameHash, i;
-	unsigned char *ptr, c;
-	Nop();
+	DWORD dwHash;
+	WORD fatID;
+	unsigned char i;
 	// Make sure MPFS is unlocked and we got a filename
 	if (*file == '\0' || isMPFSLocked == TRUE)
 		return MPFS_INVALID_HANDLE;
-	// Calculate the name hash for faster searching
-	for (nameHash = 0, ptr = file; *ptr != '\0'; ptr++)
-		nameHash += *ptr;
-	// Find a free file handle to use
-	for (hMPFS = 1; hMPFS <= MAX_MPFS_HANDLES; hMPFS++)
-		if (MPFSStubs[hMPFS].addr == MPFS_INVALID)
-			break;
-	if (hMPFS == MAX_MPFS_HANDLES)
+	hMPFS = FindFreeHandle();
+	if (hMPFS == MPFS_INVALID_HANDLE)
 		return MPFS_INVALID_HANDLE;
-	MPFSStubs[0].addr=0;						// Initialize the FAT pointer
-	MPFSStubs[0].bytesRem=8;					// Read in the number of records
-	MPFSGetArray(0,NULL,6);
-	MPFSGetArray(0,(unsigned char *)&i,2);
-	MPFSStubs[0].bytesRem=i*(24);
-	for (i = 0;									// Read in FAT records and compare the hash
-		 MPFSGetArray(0, (unsigned char *) &(MPFSStubs[hMPFS].fatID),
-					  2) == 2; i++) {
-		if (MPFSStubs[hMPFS].fatID == nameHash)	// If the hash matches, compare the full filename
-		{
-			MPFSGetArray(0, NULL, 2);
-			MPFSGetArray(0, (unsigned char *) &(MPFSStubs[hMPFS].addr), 4);
-			MPFSStubs[hMPFS].bytesRem = 255;
-			for (ptr = file; *ptr != '\0'; ptr++)	// Loop over the filename
-			{
-				MPFSGet(hMPFS, &c);
-				if (*ptr != c)
-					break;
-			}
-			MPFSGet(hMPFS, &c);
-			if (c == '\0' && *ptr == '\0')		// Filename matches, so return true
-			{
-				MPFSGetArray(0, (unsigned char *) &(MPFSStubs[hMPFS].addr),4);
-				MPFSGetArray(0,(unsigned char *) &(MPFSStubs[hMPFS].bytesRem), 4);
-				MPFSStubs[hMPFS].fatID = i;
-				return hMPFS;
-			}
-			else
-			{			// No match, so skip to next
-				MPFSGetArray(0, NULL, 16);
-			}
-		}
-		else
-		{				// No match, so skip to next
-			MPFSGetArray(0, NULL, 22);
+	dwHash = HashName(file);
+	fatID = MPFS_INVALID_FAT;
+#if MPFS_OPEN_CACHE_SIZE > 0
+	for (i = 0; i < MPFS_OPEN_CACHE_SIZE; i++) {
+		if (OpenCache[i].fatID != MPFS_INVALID_FAT
+			&& OpenCache[i].dwHash == dwHash
+			&& NameMatches(OpenCache[i].fatID, file)) {
+			fatID = OpenCache[i].fatID;
+			break;
 		}
 	}
-	MPFSStubs[hMPFS].addr = MPFS_INVALID;		// No file name matched, so return nothing
-	return MPFS_INVALID_HANDLE;
+	if (i == MPFS_OPEN_CACHE_SIZE) {
+		fatID = FindFile(file, dwHash);
+		if (fatID == MPFS_INVALID_FAT)
+			return MPFS_INVALID_HANDLE;
+		i = MPFS_OPEN_CACHE_SIZE - 1;		// Evict the least recent
+	}
+	// Move the entry to the front
+	for (; i > 0u; i--)
+		OpenCache[i] = OpenCache[i - 1];
+	OpenCache[0].dwHash = dwHash;
+	OpenCache[0].fatID = fatID;
+#else
+	fatID = FindFile(file, dwHash);
+	if (fatID == MPFS_INVALID_FAT)
+		return MPFS_INVALID_HANDLE;
+#endif
+	MPFSStubs[hMPFS].fatID = fatID;		// Set up the file handle
+	MPFSStubs[0].addr = 8 + MPFS_FAT_RECORD_SIZE * fatID + 8;
+	MPFSStubs[0].bytesRem = 8;
+	MPFSGetArray(0, (unsigned char *) &MPFSStubs[hMPFS].addr, 4);
+	MPFSGetArray(0, (unsigned char *) &MPFSStubs[hMPFS].bytesRem, 4);
+	return hMPFS;
 }
+#if defined(__18CXX)
 MPFS_HANDLE MPFSOpenROM(const unsigned char *file)
 {
-	MPFS_HANDLE hMPFS;
-	WORD nameHash, i;
-	const unsigned char *ptr;
-	unsigned char c;
-	if(*file=='\0'||isMPFSLocked==TRUE)			// Make sure MPFS is unlocked and we got a filename
-		return MPFS_INVALID_HANDLE;
-	for(nameHash=0,ptr=file;*ptr!='\0';ptr++)	// Calculate the name hash for faster searching
-		nameHash += *ptr;
-	for(hMPFS=1;hMPFS<=MAX_MPFS_HANDLES;hMPFS++)	// Find a free file handle to use
-		if (MPFSStubs[hMPFS].addr==MPFS_INVALID)
-			break;
-	if (hMPFS == MAX_MPFS_HANDLES)
+	unsigned char name[MAX_FILE_NAME_LEN + 1];
+	unsigned char i;
+	// Names longer than any in the image cannot match
+	for (i = 0; i < MAX_FILE_NAME_LEN && file[i] != '\0'; i++)
+		name[i] = file[i];
+	if (file[i] != '\0')
 		return MPFS_INVALID_HANDLE;
-	MPFSStubs[0].addr=0;						// Initialize the FAT pointer
-	MPFSStubs[0].bytesRem=8;					// Read in the number of records
-	MPFSGetArray(0,NULL,6);
-	MPFSGetArray(0,(unsigned char *) &i, 2);
-	MPFSStubs[0].bytesRem=i*(24);
-	for(i=0;MPFSGetArray(0,(unsigned char *)&(MPFSStubs[hMPFS].fatID),2)==2;i++)	// Read in FAT records and compare the hash
-	{
-		if(MPFSStubs[hMPFS].fatID==nameHash)	// If the hash matches, compare the full filename
-		{
-			MPFSGetArray(0, NULL, 2);
-			MPFSGetArray(0, (unsigned char *) &(MPFSStubs[hMPFS].addr), 4);
-			MPFSStubs[hMPFS].bytesRem = 255;
-			for (ptr = file; *ptr != '\0'; ptr++)	// Loop over the filename
-			{
-				MPFSGet(hMPFS, &c);
-				if (*ptr != c)
-					break;
-			}
-			MPFSGet(hMPFS, &c);
-			if (c == '\0' && *ptr == '\0')		// Filename matches, so return true
-			{
-				MPFSGetArray(0,(unsigned char *)&(MPFSStubs[hMPFS].addr),4);
-				MPFSGetArray(0,(unsigned char *)&(MPFSStubs[hMPFS].bytesRem),4);
-				MPFSStubs[hMPFS].fatID = i;
-				return hMPFS;
-			}
-			else								// No match, so skip to next
-			{
-				MPFSGetArray(0, NULL, 16);
-			}
-		}
-		else									// No match, so skip to next
-		{
-			MPFSGetArray(0, NULL, 22);
-		}
-	}
-	MPFSStubs[hMPFS].addr = MPFS_INVALID;		// No file name matched, so return nothing
-	return MPFS_INVALID_HANDLE;
+	name[i] = '\0';
+	return MPFSOpen(name);
 }
+#endif
 /*********************************************************************
  * Function:        MPFS_HANDLE MPFSOpenID(WORD fatID)
  *
@@ -261,10 +279,8 @@ MPFS_HANDLE MPFSOpenID(WORD fatID)
 	WORD i;
 	if(isMPFSLocked==TRUE)							// Make sure MPFS is unlocked and we got a filename
 		return MPFS_INVALID_HANDLE;
-	for(hMPFS=1;hMPFS<=MAX_MPFS_HANDLES;hMPFS++)	// Find a free file handle to use
-		if(MPFSStubs[hMPFS].addr==MPFS_INVALID)
-			break;
-	if(hMPFS==MAX_MPFS_HANDLES)
+	hMPFS=FindFreeHandle();							// Find a free file handle to use
+	if(hMPFS==MPFS_INVALID_HANDLE)
 		return MPFS_INVALID_HANDLE;
 	MPFSStubs[0].addr=0;							// Initialize the FAT pointer
 	MPFSStubs[0].bytesRem=8;						// Read in the number of records
@@ -273,12 +289,322 @@ MPFS_HANDLE MPFSOpenID(WORD fatID)
 	if(fatID>=i)									// Make sure ID isn't past the last record
 		return MPFS_INVALID_HANDLE;
 	MPFSStubs[hMPFS].fatID=fatID;					// Set up the file handle
-	MPFSStubs[0].addr=8+24*fatID+8;
+	MPFSStubs[0].addr=8+MPFS_FAT_RECORD_SIZE*fatID+8;
 	MPFSStubs[0].bytesRem=8;
 	MPFSGetArray(0,(unsigned char *)&MPFSStubs[hMPFS].addr,4);
 	MPFSGetArray(0,(unsigned char *)&MPFSStubs[hMPFS].bytesRem,4);
 	return hMPFS;
 }
+/*********************************************************************
+ * Function:        static MPFS_HANDLE FindFreeHandle(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          A closed handle, or MPFS_INVALID_HANDLE if all are 
+ *					open
+ *
+ * Side Effects:    None
+ *
+ * Overview:        None
+ *
+ * Note:            None
+ ********************************************************************/
+static MPFS_HANDLE FindFreeHandle(void)
+{
+	MPFS_HANDLE hMPFS;
+	for (hMPFS = 1; hMPFS <= MAX_MPFS_HANDLES; hMPFS++)
+		if (MPFSStubs[hMPFS].addr == MPFS_INVALID)
+			return hMPFS;
+	return MPFS_INVALID_HANDLE;
+}
+/*********************************************************************
+ * Function:        static DWORD HashName(unsigned char *name)
+ *
+ * PreCondition:    None
+ *
+ * Input:           name: a NULL terminated file name
+ *
+ * Output:          32 bit FNV-1a hash of the name, as stored in the 
+ *					image index
+ *
+ * Side Effects:    None
+ *
+ * Overview:        None
+ *
+ * Note:            The multiplication by the FNV prime (0x01000193) is 
+ *					done with shifts, which the PIC18 does much faster 
+ *					than a 32 bit multiply.
+ ********************************************************************/
+static DWORD HashName(unsigned char *name)
+{
+	DWORD h;
+	h = MPFS_FNV_OFFSET_BASIS;
+	while (*name != '\0') {
+		h ^= *name++;
+		h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
+	}
+	return h;
+}
+/*********************************************************************
+ * Function:        static BOOL NameMatches(WORD fatID, unsigned char *name)
+ *
+ * PreCondition:    fatID is a valid FAT ID
+ *
+ * Input:           fatID: the file record to compare with
+ *					name: a NULL terminated file name
+ *
+ * Output:          TRUE if the record has this name
+ *
+ * Side Effects:    Uses MPFSStubs[0]
+ *
+ * Overview:        None
+ *
+ * Note:            None
+ ********************************************************************/
+static BOOL NameMatches(WORD fatID, unsigned char *name)
+{
+	DWORD addr;
+	unsigned char c;
+	MPFSStubs[0].addr = 8 + MPFS_FAT_RECORD_SIZE * fatID + 4;
+	MPFSStubs[0].bytesRem = 4;
+	MPFSGetArray(0, (unsigned char *) &addr, 4);
+	MPFSStubs[0].addr = addr;
+	MPFSStubs[0].bytesRem = MAX_FILE_NAME_LEN + 1;
+	do {
+		if (!MPFSGet(0, &c) || c != *name)
+			return FALSE;
+	} while (*name++ != '\0');
+	return TRUE;
+}
+/*********************************************************************
+ * Function:        static WORD FindFile(unsigned char *name, DWORD dwHash)
+ *
+ * PreCondition:    None
+ *
+ * Input:           name: a NULL terminated file name
+ *					dwHash: HashName(name)
+ *
+ * Output:          FAT ID of the file, or MPFS_INVALID_FAT
+ *
+ * Side Effects:    Uses MPFSStubs[0]
+ *
+ * Overview:        Binary searches the hash index of 2.1 images for the 
+ *					first entry with this hash and compares the names of 
+ *					the entries sharing it.  2.0 images have no index; 
+ *					their records are scanned for the byte sum hash.
+ *
+ * Note:            None
+ ********************************************************************/
+static WORD FindFile(unsigned char *name, DWORD dwHash)
+{
+	unsigned char ver[2];
+	unsigned char *ptr;
+	WORD count, lo, hi, mid, fatID, nameHash;
+	DWORD entryHash, index;
+	MPFSStubs[0].addr = 4;						// Read the version and number of records
+	MPFSStubs[0].bytesRem = 4;
+	MPFSGetArray(0, ver, 2);
+	MPFSGetArray(0, (unsigned char *) &count, 2);
+	if (ver[0] == 0x02u && ver[1] == 0x00u) {
+		for (nameHash = 0, ptr = name; *ptr != '\0'; ptr++)
+			nameHash += *ptr;
+		for (fatID = 0; fatID < count; fatID++) {
+			MPFSStubs[0].addr = 8 + MPFS_FAT_RECORD_SIZE * fatID;
+			MPFSStubs[0].bytesRem = 2;
+			MPFSGetArray(0, (unsigned char *) &hi, 2);
+			if (hi == nameHash && NameMatches(fatID, name))
+				return fatID;
+		}
+		return MPFS_INVALID_FAT;
+	}
+	index = 8 + (DWORD) MPFS_FAT_RECORD_SIZE * count;
+	lo = 0;
+	hi = count;
+	while (lo < hi) {							// Find the first entry >= dwHash
+		mid = lo + ((hi - lo) >> 1);
+		MPFSStubs[0].addr = index + (DWORD) MPFS_INDEX_ENTRY_SIZE * mid;
+		MPFSStubs[0].bytesRem = 4;
+		MPFSGetArray(0, (unsigned char *) &entryHash, 4);
+		if (entryHash < dwHash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < count; lo++) {					// Compare names while the hash matches
+		MPFSStubs[0].addr = index + (DWORD) MPFS_INDEX_ENTRY_SIZE * lo;
+		MPFSStubs[0].bytesRem = MPFS_INDEX_ENTRY_SIZE;
+		MPFSGetArray(0, (unsigned char *) &entryHash, 4);
+		MPFSGetArray(0, (unsigned char *) &fatID, 2);
+		if (entryHash != dwHash)
+			break;
+		if (NameMatches(fatID, name))
+			return fatID;
+	}
+	return MPFS_INVALID_FAT;
+}
+/*********************************************************************
+ * Function:        static void ClearOpenCache(void)
+ *
+ * PreCondition:    None
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Forgets the FAT IDs of recently opened files, for 
+ *					when the image is about to change.
+ *
+ * Note:            None
+ ********************************************************************/
+static void ClearOpenCache(void)
+{
+#if MPFS_OPEN_CACHE_SIZE > 0
+	unsigned char i;
+	for (i = 0; i < MPFS_OPEN_CACHE_SIZE; i++)
+		OpenCache[i].fatID = MPFS_INVALID_FAT;
+#endif
+}
+#if defined(MPFS_USE_EEPROM)
+/*********************************************************************
+ * Function:        static DWORD HashBytes(DWORD h, unsigned char *data, 
+ *						WORD len)
+ *
+ * PreCondition:    None
+ *
+ * Input:           h: hash of the preceding bytes
+ *					data: bytes to add
+ *					len: how many bytes to add
+ *
+ * Output:          32 bit FNV-1a hash including data
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Same hash as HashName(), carried across calls.
+ *
+ * Note:            None
+ ********************************************************************/
+static DWORD HashBytes(DWORD h, unsigned char *data, WORD len)
+{
+	while (len--) {
+		h ^= *data++;
+		h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
+	}
+	return h;
+}
+/*********************************************************************
+ * Function:        static void VerifyWritten(void)
+ *
+ * PreCondition:    MPFSFormat() has been called
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    Waits if the last page is still being programmed
+ *
+ * Overview:        Reads back every byte programmed since the last 
+ *					call and adds it to verifyHash.
+ *
+ * Note:            None
+ ********************************************************************/
+static void VerifyWritten(void)
+{
+	unsigned char c[16];
+	unsigned char len;
+
+	while (verifyAddr != writeAddr) {
+		len = (writeAddr - verifyAddr > sizeof(c)) ? sizeof(c) : (unsigned char) (writeAddr - verifyAddr);
+		XEEReadArray(verifyAddr, c, len);
+		verifyHash = HashBytes(verifyHash, c, len);
+		verifyAddr += len;
+	}
+}
+/*********************************************************************
+ * Function:        static BOOL WritePage(void)
+ *
+ * PreCondition:    MPFSFormat() has been called
+ *
+ * Input:           None
+ *
+ * Output:          TRUE if PageBuf is free again
+ *					FALSE if the EEPROM is still busy
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Verifies the page programmed last, then starts 
+ *					programming PageBuf without waiting for it.
+ *
+ * Note:            Data beyond the end of the slot is dropped, and 
+ *					MPFSPutEnd() then rejects the image.
+ ********************************************************************/
+static BOOL WritePage(void)
+{
+	if (pageLen == 0)
+		return TRUE;
+	if (XEEIsBusy())
+		return FALSE;
+
+	VerifyWritten();
+	if (writeAddr + pageLen <= writeEnd) {
+		XEEWritePage(writeAddr, PageBuf, pageLen);
+		writeAddr += pageLen;
+	} else {
+		writeOverflow = TRUE;
+	}
+	pageLen = 0;
+	return TRUE;
+}
+/*********************************************************************
+ * Function:        static BOOL ImageFits(MPFS_PTR base, DWORD size)
+ *
+ * PreCondition:    None
+ *
+ * Input:           base: EEPROM address of the image
+ *					size: number of bytes written there
+ *
+ * Output:          TRUE if the image looks usable
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Checks the header, and that every file name and 
+ *					file in the FAT lies inside the bytes written.
+ *
+ * Note:            The hash only shows the bytes arrived intact; this 
+ *					catches a truncated or foreign upload.
+ ********************************************************************/
+static BOOL ImageFits(MPFS_PTR base, DWORD size)
+{
+	unsigned char c[8];
+	DWORD rec[3];		// String Ptr, Data Ptr, Len
+	DWORD end;
+	WORD numFiles;
+
+	if (size < 8)
+		return FALSE;
+	XEEReadArray(base, c, 8);
+	if (memcmppgm2ram(c, (const void *) "MPFS\x02", 5) != 0)
+		return FALSE;
+	numFiles = ((WORD) c[7] << 8) | c[6];
+
+	end = 8 + (DWORD) MPFS_FAT_RECORD_SIZE * numFiles;
+	if (c[5] != 0u)
+		end += (DWORD) MPFS_INDEX_ENTRY_SIZE * numFiles;
+	if (end > size)
+		return FALSE;
+
+	while (numFiles--) {
+		XEEReadArray(base + 8 + (DWORD) MPFS_FAT_RECORD_SIZE * numFiles + 4,
+					 (unsigned char *) rec, sizeof(rec));
+		if (rec[0] >= size || rec[1] > size || rec[2] > size - rec[1])
+			return FALSE;
+	}
+	return TRUE;
+}
+#endif
 /*********************************************************************
  * Function:        void MPFSClose(MPFS_HANDLE hMPFS)
  *
@@ -336,7 +662,7 @@ BOOL MPFSGet(MPFS_HANDLE hMPFS, unsigned char *c)
 	MPFSStubs[hMPFS].addr++;
 #else
 	{
-		DWORD dwHITECHWorkaround=MPFS_HEAD;
+		MPFS_ROM_ADDR dwHITECHWorkaround=MPFS_HEAD;
 		*c=*((const unsigned char *) (MPFSStubs[hMPFS].addr +dwHITECHWorkaround));
 		MPFSStubs[hMPFS].addr++;
 	}
@@ -382,7 +708,7 @@ WORD MPFSGetArray(MPFS_HANDLE hMPFS, unsigned char *data, WORD len)
 	lastRead = MPFS_INVALID;
 #else
 	{
-		DWORD dwHITECHWorkaround = MPFS_HEAD;
+		MPFS_ROM_ADDR dwHITECHWorkaround = MPFS_HEAD;
 		memcpypgm2ram(data,(const void *) (MPFSStubs[hMPFS].addr +dwHITECHWorkaround), len);
 		MPFSStubs[hMPFS].addr += len;
 		MPFSStubs[hMPFS].bytesRem -= len;
@@ -391,36 +717,97 @@ WORD MPFSGetArray(MPFS_HANDLE hMPFS, unsigned char *data, WORD len)
 	return len;
 }
 /*********************************************************************
- * Function:        MPFS MPFSFormat(void)
+ * Function:        MPFS MPFSFormat(DWORD dwSize)
  *
  * PreCondition:    None
  *
- * Input:           None
+ * Input:           dwSize: most bytes the upload will write
  *
  * Output:          A valid MPFS handle that can be used for MPFSPut
+ *					MPFS_INVALID_HANDLE if the image is not in EEPROM
+ *					or dwSize does not fit a slot (the whole area 
+ *					with MPFS_WRITE_WHOLE_AREA)
+ *
+ * Side Effects:    Discards any upload in progress.  Locks MPFS when 
+ *					the old image is written over.
+ *
+ * Overview:        Prepares the image slot not in use to be written.  
+ *					With MPFS_WRITE_WHOLE_AREA, the whole area is 
+ *					prepared instead if the image does not fit a slot, 
+ *					and also whenever the image in use runs into the 
+ *					other slot.
+ *
+ * Note:            In a slot, the current image stays readable until 
+ *                  MPFSPutEnd() switches to the new one, so pages keep 
+ *                  being served during an upload.
+ ********************************************************************/
+MPFS_HANDLE MPFSFormat(DWORD dwSize)
+{
+#if defined(MPFS_USE_EEPROM)
+	unsigned char i;
+
+	if (dwSize > MPFS_EEPROM_SIZE - MPFS_SLOT_BASE)
+		return MPFS_INVALID_HANDLE;
+#if !defined(MPFS_WRITE_WHOLE_AREA)
+	// Keep the old image up rather than write over it
+	if (dwSize > MPFS_SLOT_SIZE)
+		return MPFS_INVALID_HANDLE;
+#endif
+	if (dwSize <= MPFS_SLOT_SIZE
+		&& (mpfsSlot == MPFS_SLOT_FIRST || mpfsSlot == MPFS_SLOT_SECOND)) {
+		writeBase = (mpfsSlot == MPFS_SLOT_FIRST) ? MPFS_SLOT_BASE + MPFS_SLOT_SIZE : MPFS_SLOT_BASE;
+		writeEnd = writeBase + MPFS_SLOT_SIZE;
+	} else {
+		// No room for two images: close the old one and mark the 
+		// EEPROM as being written before any of it is lost
+		for (i = 1; i <= MAX_MPFS_HANDLES; i++)
+			MPFSStubs[i].bytesRem = 0;
+		ClearOpenCache();
+		isMPFSLocked = TRUE;
+		mpfsSlot = MPFS_SLOT_NONE;
+		XEEWritePage(MPFS_SLOT_FLAG, &mpfsSlot, 1);
+		writeBase = MPFS_SLOT_BASE;
+		writeEnd = MPFS_EEPROM_SIZE;
+	}
+	writeAddr = writeBase;
+	verifyAddr = writeAddr;
+	writeHash = MPFS_FNV_OFFSET_BASIS;
+	verifyHash = MPFS_FNV_OFFSET_BASIS;
+	pageLen = 0;
+	writeOverflow = FALSE;
+	isWriting = TRUE;
+	return 0x00;
+#else
+	return MPFS_INVALID_HANDLE;
+#endif
+}
+/*********************************************************************
+ * Function:        WORD MPFSIsPutReady(MPFS_HANDLE hMPFS)
  *
- * Side Effects:    None
+ * PreCondition:    MPFSFormat() must have been called
  *
- * Overview:        Prepares MPFS image to get re-written
- *                  Declares MPFS as in use.
+ * Input:           hMPFS: the MPFS handle for writing
  *
- * Note:            MPFS will be unaccessible until MPFSClose is
- *                  called.
+ * Output:          Number of bytes MPFSPutArray() will accept now
+ *
+ * Side Effects:    May start programming a full page
+ *
+ * Overview:        None
+ *
+ * Note:            Returns 0 while a full page waits for the EEPROM 
+ *					to finish the previous one.
  ********************************************************************/
-MPFS_HANDLE MPFSFormat(void)
+WORD MPFSIsPutReady(MPFS_HANDLE hMPFS)
 {
 #if defined(MPFS_USE_EEPROM)
-	unsigned char i;
-	for (i=0;i<MAX_MPFS_HANDLES;i++)				// Close all files
-		MPFSStubs[i].addr = MPFS_INVALID;
-	isMPFSLocked=TRUE;								// Lock the image
-	MPFSStubs[0].addr = 0;							// Set FAT ptr for writing
-	MPFSStubs[0].fatID = 0xffff;
-	MPFSStubs[0].bytesRem=MPFS_WRITE_PAGE_SIZE-(((unsigned char)MPFSStubs[0].addr+MPFS_HEAD)&(MPFS_WRITE_PAGE_SIZE-1));
-	if(XEEBeginWrite(MPFSStubs[0].addr + MPFS_HEAD) == XEE_SUCCESS)	// Set up EEPROM for writing
-		return 0x00;
+	if (!isWriting)
+		return 0;
+	if (pageLen == MPFS_WRITE_PAGE_SIZE && !WritePage())
+		return 0;
+	return MPFS_WRITE_PAGE_SIZE - pageLen;
+#else
+	return 0;
 #endif
-	return MPFS_INVALID_HANDLE;
 }
 /*********************************************************************
  * Function:        WORD MPFSPutArray(MPFS_HANDLE hMPFS, unsigned char *data, WORD len)
@@ -431,63 +818,93 @@ MPFS_HANDLE MPFSFormat(void)
  *					data: the data array to write
  *					len: how many bytes to write
  *
- * Output:          number of bytes successfully written
+ * Output:          number of bytes accepted
  *
  * Side Effects:    None
  *
- * Overview:        None
+ * Overview:        Copies data into the page buffer, and starts 
+ *					programming the page once it is full.
  *
- * Note:            Actual write may not get started until internal
- *                  write page is full.  To ensure that previously
- *                  data gets written, caller must call MPFSPutEnd()
- *                  after last call to MPFSPutArray().
+ * Note:            Never waits for the EEPROM, so fewer than len bytes 
+ *                  may be accepted.  Use MPFSIsPutReady() to find how 
+ *                  many will be.  Nothing is used until MPFSPutEnd() 
+ *                  is called after the last call to MPFSPutArray().
  ********************************************************************/
 WORD MPFSPutArray(MPFS_HANDLE hMPFS, unsigned char *data, WORD len)
 {
 #if defined(MPFS_USE_EEPROM)
 	WORD count;
-	for(count=0;count<len;count++)
-		{
-		XEEWrite(data[count]);
-		MPFSStubs[hMPFS].addr++;
-		MPFSStubs[hMPFS].bytesRem--;
-		if (MPFSStubs[hMPFS].bytesRem == 0)
-		{
-			MPFSPutEnd();
-			isMPFSLocked=TRUE;
-			XEEBeginWrite(MPFSStubs[hMPFS].addr + MPFS_HEAD);
-			MPFSStubs[hMPFS].bytesRem = MPFS_WRITE_PAGE_SIZE;
-		}
-	}
-	return count;
+	count = MPFSIsPutReady(hMPFS);
+	if (len > count)
+		len = count;
+	memcpy(&PageBuf[pageLen], data, len);
+	writeHash = HashBytes(writeHash, data, len);
+	pageLen += len;
+	if (pageLen == MPFS_WRITE_PAGE_SIZE)
+		WritePage();
+	return len;
 #else
 	return 0;
 #endif
 }
 /*********************************************************************
- * Function:        MPFS MPFSPutEnd(void)
+ * Function:        BOOL MPFSPutEnd(void)
  *
- * PreCondition:    XEEBeginWrite() is already called.
+ * PreCondition:    MPFSFormat() must have been called
  *
  * Input:           None
  *
- * Output:          None
+ * Output:          TRUE if the new image was verified and is now used
+ *					FALSE if it was rejected and the old one kept
  *
- * Side Effects:    None
+ * Side Effects:    Open files read nothing more once the image changes
  *
- * Overview:        None
+ * Overview:        Writes the last page and checks that the bytes read 
+ *					back hash to the same as the bytes written, and 
+ *					that the image fits in its slot.  Only then is the 
+ *					flag byte set to use the new slot.
  *
- * Note:            Actual write may not get started until internal
- *                  write page is full.  To ensure that previously
- *                  data gets written, caller must call MPFSPutEnd()
- *                  after last call to MPFSPut().
+ * Note:            Waits for the EEPROM to finish programming.  A 
+ *					rejected image written over the whole area leaves 
+ *					MPFS locked until an upload is accepted.
  ********************************************************************/
-void MPFSPutEnd(void)
+BOOL MPFSPutEnd(void)
 {
 #if defined(MPFS_USE_EEPROM)
-	isMPFSLocked = FALSE;
-	XEEEndWrite();
+	MPFS_PTR base;
+	unsigned char i;
+
+	if (!isWriting)
+		return FALSE;
+	isWriting = FALSE;
+	while (!WritePage());
 	while (XEEIsBusy());
+	VerifyWritten();
+
+	base = writeBase;
+	if (writeOverflow || verifyHash != writeHash
+		|| !ImageFits(base, verifyAddr - base))
+		return FALSE;
+
+	// Switch slots
+	if (base != MPFS_SLOT_BASE)
+		mpfsSlot = MPFS_SLOT_SECOND;
+	else if (verifyAddr - base > MPFS_SLOT_SIZE)
+		mpfsSlot = MPFS_SLOT_WHOLE;
+	else
+		mpfsSlot = MPFS_SLOT_FIRST;
+	XEEWritePage(MPFS_SLOT_FLAG, &mpfsSlot, 1);
+	while (XEEIsBusy());
+
+	for (i = 1; i <= MAX_MPFS_HANDLES; i++)
+		MPFSStubs[i].bytesRem = 0;
+	mpfsHead = base;
+	lastRead = MPFS_INVALID;
+	ClearOpenCache();
+	isMPFSLocked = FALSE;
+	return TRUE;
+#else
+	return FALSE;
 #endif
 }
 /*********************************************************************
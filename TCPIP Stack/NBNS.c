@@ -19,7 +19,6 @@
 
 #if defined(STACK_USE_NBNS)
 
-#define NBNS_PORT		(137u)
 
 typedef struct _NBNS_HEADER {
 	WORD_VAL TransactionID;
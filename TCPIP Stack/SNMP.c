@@ -356,13 +356,11 @@ BOOL SNMPTask(void)
 		MPFSClose();
 	}
 
-	if (lbReturn == FALSE)
-		goto _SNMPDiscard;
-
-	UDPFlush();
-
-	return TRUE;
+	if (lbReturn)
+		UDPFlush();
 
+	// Answered or not, the request must be released: it stays pinned in 
+	// the MAC RX buffer until then
   _SNMPDiscard:
 	UDPDiscard();
 
@@ -1580,7 +1578,9 @@ static unsigned char _SNMPGet(void)
 {
 	unsigned char v;
 
-	UDPSetRxBuffer(SNMPRxOffset++);
+	// The request is read in order, and UDPGet() keeps its own offset 
+	// into the held datagram
+	SNMPRxOffset++;
 	UDPGet(&v);
 	return v;
 }
@@ -2266,13 +2266,11 @@ BOOL SNMPTask(void)
 		MPFSClose(hMPFS);
 	}
 
-	if (lbReturn == FALSE)
-		goto _SNMPDiscard;
-
-	UDPFlush();
-
-	return TRUE;
+	if (lbReturn)
+		UDPFlush();
 
+	// Answered or not, the request must be released: it stays pinned in 
+	// the MAC RX buffer until then
   _SNMPDiscard:
 	UDPDiscard();
 
@@ -3477,7 +3475,9 @@ static unsigned char _SNMPGet(void)
 {
 	unsigned char v;
 
-	UDPSetRxBuffer(SNMPRxOffset++);
+	// The request is read in order, and UDPGet() keeps its own offset 
+	// into the held datagram
+	SNMPRxOffset++;
 	UDPGet(&v);
 	return v;
 }
@@ -81,10 +81,12 @@
 #define EEPROM_MAX_SPI_FREQ		(10000000ul)	// Hz
 
 static void DoWrite(void);
+static void SendWrite(DWORD address, unsigned char *buffer, WORD length);
 
 static DWORD EEPROMAddress;
 static unsigned char EEPROMBuffer[EEPROM_BUFFER_SIZE];
 static unsigned char *EEPROMBufferPtr;
+static BOOL EEPROMWriting;		// A write cycle started by XEEWritePage() may be running
 
 /*********************************************************************
  * Function:        void XEEInit(unsigned char speed)
@@ -257,6 +259,10 @@ XEE_RESULT XEEReadArray(DWORD address,
 	DWORD SPICON1Save;
 #endif
 
+	// The EEPROM ignores reads during a write cycle
+	if (EEPROMWriting)
+		while (XEEIsBusy());
+
 	// Save SPI state (clock speed)
 	SPICON1Save = EEPROM_SPICON1;
 	EEPROM_SPICON1 = PROPER_SPICON1;
@@ -389,8 +395,52 @@ XEE_RESULT XEEEndWrite(void)
 
 static void DoWrite(void)
 {
-	unsigned char Dummy;
 	unsigned char BytesToWrite;
+
+	BytesToWrite = (unsigned char) (EEPROMBufferPtr - EEPROMBuffer);
+	SendWrite(EEPROMAddress, EEPROMBuffer, BytesToWrite);
+	EEPROMAddress += BytesToWrite;
+	EEPROMBufferPtr = EEPROMBuffer;
+
+	// Wait for write to complete
+	while (XEEIsBusy());
+}
+
+
+/*********************************************************************
+ * Function:        XEE_RESULT XEEWritePage(DWORD address, 
+ *                                          unsigned char *buffer,
+ *                                          WORD length)
+ *
+ * PreCondition:    XEEInit() is already called.
+ *
+ * Input:           address     - Address the bytes are written to
+ *                  buffer      - Caller supplied bytes to write
+ *                  length      - Number of bytes to write
+ *
+ * Output:          XEE_SUCCESS
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Writes the bytes straight from the caller's buffer 
+ *                  in one write cycle, and returns as soon as the 
+ *                  cycle has started.  XEEIsBusy() tells when it ends, 
+ *                  and reads wait for it.
+ *
+ * Note:            The bytes must not cross a page boundary, or they 
+ *                  wrap to the beginning of the page.
+ ********************************************************************/
+XEE_RESULT XEEWritePage(DWORD address, unsigned char *buffer, WORD length)
+{
+	SendWrite(address, buffer, length);
+	EEPROMWriting = TRUE;
+
+	return XEE_SUCCESS;
+}
+
+static void SendWrite(DWORD address, unsigned char *buffer, WORD length)
+{
+	unsigned char Dummy;
 #if defined(__18CXX)
 	unsigned char SPICON1Save;
 #elif defined(__C30__)
@@ -399,6 +449,10 @@ static void DoWrite(void)
 	DWORD SPICON1Save;
 #endif
 
+	// Let a cycle started by XEEWritePage() finish
+	if (EEPROMWriting)
+		while (XEEIsBusy());
+
 	// Save SPI state (clock speed)
 	SPICON1Save = EEPROM_SPICON1;
 	EEPROM_SPICON1 = PROPER_SPICON1;
@@ -420,28 +474,23 @@ static void DoWrite(void)
 
 	// Send address
 #if defined(USE_EEPROM_25LC1024)
-	EEPROM_SSPBUF = ((DWORD_VAL *) & EEPROMAddress)->v[2];
+	EEPROM_SSPBUF = ((DWORD_VAL *) & address)->v[2];
 	while (!EEPROM_SPI_IF);
 	Dummy = EEPROM_SSPBUF;
 	EEPROM_SPI_IF = 0;
 #endif
-	EEPROM_SSPBUF = ((DWORD_VAL *) & EEPROMAddress)->v[1];
+	EEPROM_SSPBUF = ((DWORD_VAL *) & address)->v[1];
 	while (!EEPROM_SPI_IF);
 	Dummy = EEPROM_SSPBUF;
 	EEPROM_SPI_IF = 0;
-	EEPROM_SSPBUF = ((DWORD_VAL *) & EEPROMAddress)->v[0];
+	EEPROM_SSPBUF = ((DWORD_VAL *) & address)->v[0];
 	while (!EEPROM_SPI_IF);
 	Dummy = EEPROM_SSPBUF;
 	EEPROM_SPI_IF = 0;
 
-	BytesToWrite = (unsigned char) (EEPROMBufferPtr - EEPROMBuffer);
-
-	EEPROMAddress += BytesToWrite;
-	EEPROMBufferPtr = EEPROMBuffer;
-
-	while (BytesToWrite--) {
+	while (length--) {
 		// Send the byte to write
-		EEPROM_SSPBUF = *EEPROMBufferPtr++;
+		EEPROM_SSPBUF = *buffer++;
 		while (!EEPROM_SPI_IF);
 		Dummy = EEPROM_SSPBUF;
 		EEPROM_SPI_IF = 0;
@@ -450,13 +499,8 @@ static void DoWrite(void)
 	// Begin the write
 	EEPROM_CS_IO = 1;
 
-	EEPROMBufferPtr = EEPROMBuffer;
-
 	// Restore SPI State
 	EEPROM_SPICON1 = SPICON1Save;
-
-	// Wait for write to complete
-	while (XEEIsBusy());
 }
 
 
@@ -508,6 +552,8 @@ BOOL XEEIsBusy(void)
 	// Restore SPI State
 	EEPROM_SPICON1 = SPICON1Save;
 
+	if (!result.bits.b0)
+		EEPROMWriting = FALSE;
 	return result.bits.b0;
 }
 
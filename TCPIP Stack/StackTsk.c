@@ -33,6 +33,7 @@ typedef enum _SM_STACK {
 static SM_STACK smStack;
 
 NODE_INFO remoteNode;
+STACK_RX_STATS StackRxStats;
 
 
 
@@ -79,6 +80,13 @@ void StackInit(void)
 	TCPInit();
 #endif
 
+#if defined(STACK_USE_MPFS2)
+	MPFSInit();
+#endif
+
+#if defined(STACK_USE_HTTP2_SERVER)
+	HTTPInit();
+#endif
 }
 
 
@@ -97,6 +105,11 @@ void StackInit(void)
  *                  and routes it to appropriate stack components.
  *                  It also performs timed operations.
  *
+ *                  At most STACK_RX_BUDGET packets are processed per 
+ *                  call, unless the RX buffer has less than 
+ *                  STACK_RX_DRAIN_WATERMARK bytes free.  Packets left 
+ *                  over keep MACIsRxPending() set for the next call.
+ *
  *                  This function must be called periodically to
  *                  ensure timely responses.
  *
@@ -107,6 +120,8 @@ void StackTask(void)
 	IP_ADDR tempLocalIP;
 	unsigned char cFrameType;
 	unsigned char cIPFrameType;
+	unsigned char vBudget;
+	BOOL bDraining;
 
 
 #if defined(STACK_USE_DHCP_CLIENT)
@@ -138,21 +153,48 @@ void StackTask(void)
 	TCPTick();
 #endif
 
+#if MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_STRICT
+	// Follow IP address changes in the hardware ARP filter
+	MACUpdateRxFilter();
+#endif
+	// MACISR() flags arriving frames; nothing to fetch until it does
+	if (!MACIsRxPending())
+		return;
 
-	// Process as many incomming packets as we can
+	// Process incoming packets, up to the budget
+	vBudget = STACK_RX_BUDGET;
+	bDraining = FALSE;
 	while (1) {
 		//if using the random module, generate entropy
 #if defined(STACK_USE_RANDOM)
 		RandomAdd(remoteNode.MACAddr.v[5]);
 #endif
 
-		// We are about to fetch a new packet, make sure that the 
-		// UDP module knows that any old RX data it has laying 
-		// around will now be gone.
+		// Free the last packet now rather than in MACGetHeader(), which 
+		// would return FALSE after doing so, and before the free space 
+		// is measured
+		MACDiscardRx();
 #if defined(STACK_USE_UDP)
-		UDPDiscard();
+		// Unread datagrams must not keep the ring from being reused
+		UDPTrimRxQueues();
 #endif
 
+		if (vBudget == 0u) {
+			// The rest waits for the next call, unless the buffer is 
+			// filling up faster than the main loop comes back
+			if (MACGetFreeRxSize() >= STACK_RX_DRAIN_WATERMARK) {
+				if (MACIsRxPending())
+					StackRxStats.dwBudgetStops++;
+				break;
+			}
+			if (!bDraining) {
+				bDraining = TRUE;
+				StackRxStats.dwDrains++;
+			}
+		} else {
+			vBudget--;
+		}
+
 		// Fetch a packet (throws old one away, if not thrown away 
 		// yet)
 		if (!MACGetHeader(&remoteNode.MACAddr, &cFrameType))
@@ -161,16 +203,20 @@ void StackTask(void)
 		// Dispatch the packet to the appropriate handler
 		switch (cFrameType) {
 		case MAC_ARP:
+			StackRxStats.dwARP++;
 			ARPProcess();
 			break;
 
 		case MAC_IP:
 			if (!IPGetHeader
-				(&tempLocalIP, &remoteNode, &cIPFrameType, &dataCount))
+				(&tempLocalIP, &remoteNode, &cIPFrameType, &dataCount)) {
+				StackRxStats.dwOther++;
 				break;
+			}
 
 #if defined(STACK_USE_ICMP_SERVER) || defined(STACK_USE_ICMP_CLIENT)
 			if (cIPFrameType == IP_PROT_ICMP) {
+				StackRxStats.dwICMP++;
 #if defined(STACK_USE_IP_GLEANING)
 				if (AppConfig.Flags.bInConfigMode
 					&& AppConfig.Flags.bIsDHCPEnabled) {
@@ -202,6 +248,7 @@ void StackTask(void)
 
 #if defined(STACK_USE_TCP)
 			if (cIPFrameType == IP_PROT_TCP) {
+				StackRxStats.dwTCP++;
 				TCPProcess(&remoteNode, &tempLocalIP, dataCount);
 				break;
 			}
@@ -209,13 +256,91 @@ void StackTask(void)
 
 #if defined(STACK_USE_UDP)
 			if (cIPFrameType == IP_PROT_UDP) {
-				// Stop processing packets if we came upon a UDP frame with application data in it
-				if (UDPProcess(&remoteNode, &tempLocalIP, dataCount))
-					return;
+				StackRxStats.dwUDP++;
+				// Datagrams for a socket stay in the RX buffer, queued 
+				// on it, until the application reads them
+				UDPProcess(&remoteNode, &tempLocalIP, dataCount);
+				break;
 			}
 #endif
+			StackRxStats.dwOther++;
+			break;
 
+		default:
+			StackRxStats.dwOther++;
 			break;
 		}
 	}
 }
+
+#if MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_SERVICES || \
+	(MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_STRICT && defined(HOST_BUILD))
+/*********************************************************************
+ * Function:        BOOL StackIsWantedBroadcast(unsigned char type)
+ *
+ * PreCondition:    MACGetHeader() is reading the header of a frame 
+ *					sent to the broadcast address.
+ *
+ * Input:           type: MAC_ARP, MAC_IP or MAC_UNKNOWN
+ *
+ * Output:          TRUE: If the broadcast is an ARP request for our IP, 
+ *						  or (MAC_RX_FILTER_SERVICES) a UDP datagram for 
+ *						  one of the local broadcast services (Announce, 
+ *						  NBNS, DHCP client)
+ *					FALSE: Otherwise
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Peeks at a few bytes of the payload and leaves the 
+ *					read pointer at the start of the payload again.
+ *
+ * Note:            Shared by the MAC drivers so that the profile means 
+ *					the same everywhere.  On the PIC the STRICT profile 
+ *					is filtered in hardware and doesn't need this.
+ ********************************************************************/
+BOOL StackIsWantedBroadcast(unsigned char type)
+{
+	DWORD_VAL dw;
+	BOOL wanted = FALSE;
+#if MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_SERVICES
+	WORD_VAL port;
+	unsigned char ihl;
+#endif
+
+	if (type == MAC_ARP) {
+		// ARP target protocol address
+		MACSetReadPtrInRx(24);
+		MACGetArray((unsigned char *) &dw, sizeof(dw));
+		wanted = (dw.Val == AppConfig.MyIPAddr.Val);
+	}
+#if MAC_RX_FILTER_PROFILE == MAC_RX_FILTER_SERVICES
+	else if (type == MAC_IP) {
+		MACSetReadPtrInRx(0);
+		ihl = MACGet();
+		MACSetReadPtrInRx(9);
+		if (MACGet() == IP_PROT_UDP) {
+			// UDP destination port, right after the IP header
+			MACSetReadPtrInRx(((ihl & 0x0F) << 2) + 2);
+			port.v[1] = MACGet();
+			port.v[0] = MACGet();
+#if defined(STACK_USE_ANNOUNCE)
+			if (port.Val == ANNOUNCE_PORT)
+				wanted = TRUE;
+#endif
+#if defined(STACK_USE_NBNS)
+			if (port.Val == NBNS_PORT)
+				wanted = TRUE;
+#endif
+#if defined(STACK_USE_DHCP_CLIENT)
+			// Servers may broadcast OFFER and ACK to a client without 
+			// an address
+			if (port.Val == DHCP_CLIENT_PORT)
+				wanted = TRUE;
+#endif
+		}
+	}
+#endif
+	MACSetReadPtrInRx(0);
+	return wanted;
+}
+#endif
@@ -32,22 +32,42 @@ extern unsigned int desbordador;
 // undefined, the local caching will be disabled.  On PIC18 
 // products, this will improve TCP performance/throughput by 
 // approximately 15%.
+// Defining TCP_OPTIMIZE_FOR_SPEED in TCPIPConfig.h selects the 
+// uncached mode and goes one step further: every TCB is also kept 
+// resident in PIC RAM next to its stub and both are reached through 
+// a pointer, so switching sockets copies nothing and SyncTCB() no 
+// longer moves TCBs to and from TCP_*_RAM.  This costs sizeof(TCB) 
+// bytes of PIC RAM per socket and frees the same amount of TCP_*_RAM.
+#if !defined(TCP_OPTIMIZE_FOR_SPEED)
 #define TCP_OPTIMIZE_FOR_SIZE
+#endif
 
 // TCP Maximum Segment Size (TX and RX)
 #define TCP_MAX_SEG_SIZE			(1024)
 
 // TCP Timeout and retransmit numbers
-#define TCP_START_TIMEOUT_VAL   	((TICK)TICK_SECOND*1)
+#define TCP_START_TIMEOUT_VAL   	((TICK)TICK_SECOND*1)	// Initial RTO until the first RTT sample
 #define TCP_DELAYED_ACK_TIMEOUT		((TICK)TICK_SECOND/10)
 #define TCP_FIN_WAIT_2_TIMEOUT		((TICK)TICK_SECOND*5)
 #define TCP_KEEP_ALIVE_TIMEOUT		((TICK)TICK_SECOND*5)	// 10
 #define TCP_CLOSE_WAIT_TIMEOUT		((TICK)TICK_SECOND/5)
-#define TCP_MAX_RETRIES			    (5u)
+#define TCP_MAX_RETRIES			    (9u)	// ~45s of backoff from TCP_MIN_RTO_VAL
 #define TCP_MAX_SYN_RETRIES			(2u)	// Smaller than all other retries to reduce SYN flood DoS duration
+#define TCP_DUP_ACK_THRESHOLD		(3u)	// Duplicate ACKs that trigger a fast retransmit
 
 #define TCP_AUTO_TRANSMIT_TIMEOUT_VAL	(TICK_SECOND/25ull)
 
+// Adaptive retransmission timeout (RFC 6298).  RTT samples are taken 
+// in units of (1<<TCP_RTT_SHIFT) ticks (~0.4ms at 41.67MHz) so the 
+// scaled SRTT and RTTVAR estimators each fit in a WORD of the TCB.
+#define TCP_RTT_SHIFT				(4u)
+#define TCP_RTT_MAX_SAMPLE			(0x1FFFu)	// Keeps SRTT*8 inside a WORD
+// The floor stays above the delayed ACK timers of common peers (up to 
+// 200ms), which would otherwise cause spurious retransmits and, through 
+// Karn's rule, lose the RTT sample.
+#define TCP_MIN_RTO_VAL				((TICK)TICK_SECOND/5)
+#define TCP_MAX_RTO_VAL				((TICK)TICK_SECOND*8)
+
 // TCP Flags defined in RFC
 #define FIN     (0x01)
 #define SYN     (0x02)
@@ -105,8 +125,20 @@ static WORD NextPort __attribute__ ((persistent));
 #define TCP_SOCKET_COUNT	(sizeof(TCPSocketInitializer)/sizeof(TCPSocketInitializer[0]))
 
 static TCB_STUB TCBStubs[TCP_SOCKET_COUNT] = { '\0' };
-static TCB MyTCB;
 static TCP_SOCKET hCurrentTCP = INVALID_SOCKET;
+#if defined(TCP_OPTIMIZE_FOR_SIZE)
+static TCB MyTCB;
+#define TCP_TCB_MEDIUM_SIZE		sizeof(TCB)		// TCB stored in front of the TX FIFO
+#else
+static TCB TCBs[TCP_SOCKET_COUNT];
+static TCB_STUB *pMyTCBStub;
+static TCB *pMyTCB;
+#define MyTCBStub				(*pMyTCBStub)
+#define MyTCB					(*pMyTCB)
+#define TCP_TCB_MEDIUM_SIZE		0u				// TCB resident in TCBs[]
+#endif
+
+TCP_STATS TCPStats;
 
 static void TCPRAMCopy(void *wDest, unsigned char vDestType, void *wSource,
 					   unsigned char vSourceType, WORD wLength);
@@ -114,15 +146,23 @@ static void TCPRAMCopy(void *wDest, unsigned char vDestType, void *wSource,
 #define SENDTCP_RESET_TIMERS	0x01
 #define SENDTCP_KEEP_ALIVE		0x02
 static void SendTCP(unsigned char vTCPFlags, unsigned char vSendFlags);
+static void SendTCPReset(TCP_HEADER * h, NODE_INFO * remote, WORD len);
 static void HandleTCPSeg(TCP_HEADER * h, WORD len);
 static BOOL FindMatchingSocket(TCP_HEADER * h, NODE_INFO * remote);
+static BOOL IsPortBound(WORD wPort);
 static void SwapTCPHeader(TCP_HEADER * header);
 static void CloseSocket(void);
-static void SyncTCB(void);
+static void UpdateRTO(DWORD dwAckNumber);
+static void RewindUnackedData(void);
+static DWORD GetRTO(void);
+static void TCPRAMReverse(PTR_BASE ptrStart, PTR_BASE ptrEnd);
+static void TCPRAMRotate(PTR_BASE ptrStart, PTR_BASE ptrEnd, PTR_BASE ptrFirst);
+static void TCPRAMMoveUp(PTR_BASE ptrDest, PTR_BASE ptrSource, WORD wLength);
 
 
 #if defined(TCP_OPTIMIZE_FOR_SIZE)
 static TCB_STUB MyTCBStub;
+static void SyncTCB(void);
 
 	// Flushes MyTCBStub cache and loads up the specified TCB_STUB
 	// Does nothing on cache hit
@@ -147,12 +187,14 @@ static void SyncTCBStub(TCP_SOCKET hTCP)
 		   sizeof(MyTCBStub));
 }
 #else
-#define SyncTCBStub(a)	hCurrentTCP = a
-#define MyTCBStub		TCBStubs[hCurrentTCP]
+	// Point MyTCBStub and MyTCB straight at the resident copies
+#define SyncTCBStub(a)	(hCurrentTCP = (a), pMyTCBStub = &TCBStubs[hCurrentTCP], pMyTCB = &TCBs[hCurrentTCP])
+#define SyncTCB()
 #endif
 
 
 
+#if defined(TCP_OPTIMIZE_FOR_SIZE)
 // Flushes MyTCB cache and loads up the specified TCB
 // Does nothing on cache hit
 static void SyncTCB(void)
@@ -176,6 +218,7 @@ static void SyncTCB(void)
 						 sizeof(MyTCB)), TCBStubs[hLastTCB].vMemoryMedium,
 			   sizeof(MyTCB));
 }
+#endif
 
 
 /*********************************************************************
@@ -201,9 +244,9 @@ void TCPInit(void)
 	WORD wTXSize, wRXSize;
 	PTR_BASE ptrBaseAddress;
 	unsigned char vMedium;
-#if TCP_ETH_RAM_SIZE > 0
+	// The Ethernet RAM plan always leaves TCP the rest of the buffer, 
+	// and its size involves sizeof(HTTP_CONN), which #if can't evaluate
 	WORD wCurrentETHAddress = TCP_ETH_RAM_BASE_ADDRESS;
-#endif
 #if TCP_PIC_RAM_SIZE > 0
 	PTR_BASE ptrCurrentPICAddress = TCP_PIC_RAM_BASE_ADDRESS;
 #endif
@@ -224,22 +267,20 @@ void TCPInit(void)
 		wRXSize = TCPSocketInitializer[i].wRXBufferSize;
 
 		switch (vMedium) {
-#if TCP_ETH_RAM_SIZE > 0
 		case TCP_ETH_RAM:
 			ptrBaseAddress = wCurrentETHAddress;
-			wCurrentETHAddress += sizeof(TCB) + wTXSize + 1 + wRXSize + 1;
+			wCurrentETHAddress += TCP_TCB_MEDIUM_SIZE + wTXSize + 1 + wRXSize + 1;
 			// Do a sanity check to ensure that we aren't going to use memory that hasn't been allocated to us.
 			// If your code locks up right here, it means you've incorrectly allocated your TCP socket buffers in TCPIPConfig.h.  See the TCP memory allocation section.  More RAM needs to be allocated to the base memory mediums, or the individual sockets TX and RX FIFOS and socket quantiy needs to be shrunken.
 			while (wCurrentETHAddress >
 				   TCP_ETH_RAM_BASE_ADDRESS + TCP_ETH_RAM_SIZE);
 			break;
-#endif
 
 #if TCP_PIC_RAM_SIZE > 0
 		case TCP_PIC_RAM:
 			ptrBaseAddress = ptrCurrentPICAddress;
 			ptrCurrentPICAddress +=
-				sizeof(TCB) + wTXSize + 1 + wRXSize + 1;
+				TCP_TCB_MEDIUM_SIZE + wTXSize + 1 + wRXSize + 1;
 			// Do a sanity check to ensure that we aren't going to use memory that hasn't been allocated to us.
 			// If your code locks up right here, it means you've incorrectly allocated your TCP socket buffers in TCPIPConfig.h.  See the TCP memory allocation section.  More RAM needs to be allocated to the base memory mediums, or the individual sockets TX and RX FIFOS and socket quantiy needs to be shrunken.
 			while (ptrCurrentPICAddress >
@@ -250,7 +291,7 @@ void TCPInit(void)
 #if TCP_SPI_RAM_SIZE > 0
 		case TCP_SPI_RAM:
 			ptrBaseAddress = wCurrentSPIAddress;
-			wCurrentSPIAddress += sizeof(TCB) + wTXSize + 1 + wRXSize + 1;
+			wCurrentSPIAddress += TCP_TCB_MEDIUM_SIZE + wTXSize + 1 + wRXSize + 1;
 			// Do a sanity check to ensure that we aren't going to use memory that hasn't been allocated to us.
 			// If your code locks up right here, it means you've incorrectly allocated your TCP socket buffers in TCPIPConfig.h.  See the TCP memory allocation section.  More RAM needs to be allocated to the base memory mediums, or the individual sockets TX and RX FIFOS and socket quantiy needs to be shrunken.
 			while (wCurrentSPIAddress >
@@ -265,7 +306,7 @@ void TCPInit(void)
 		MyTCB.vSocketPurpose = TCPSocketInitializer[i].vSocketPurpose;
 
 		MyTCBStub.vMemoryMedium = vMedium;
-		MyTCBStub.bufferTxStart = ptrBaseAddress + sizeof(TCB);
+		MyTCBStub.bufferTxStart = ptrBaseAddress + TCP_TCB_MEDIUM_SIZE;
 		MyTCBStub.bufferRxStart = MyTCBStub.bufferTxStart + wTXSize + 1;
 		MyTCBStub.bufferEnd = MyTCBStub.bufferRxStart + wRXSize;
 		MyTCBStub.smState = TCP_CLOSED;
@@ -425,6 +466,29 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, unsigned char vRemoteHostType,
 	return INVALID_SOCKET;
 }
 
+/*********************************************************************
+* Function:        BOOL TCPWasReset(TCP_SOCKET hTCP)
+* PreCondition:    TCPInit() is already called
+* Input:           hTCP - Socket to test
+* Output:          TRUE if the socket was closed or reset since the 
+*				   last call, FALSE otherwise
+* Side Effects:    Clears the reset indication
+* Overview:        Lets a server notice that its connection went away 
+*				   and the socket is listening again, so any state 
+*				   kept for it must be discarded.
+* Note:            Every socket reports one reset after TCPInit().
+********************************************************************/
+BOOL TCPWasReset(TCP_SOCKET hTCP)
+{
+	SyncTCBStub(hTCP);
+
+	if (MyTCBStub.Flags.bSocketReset) {
+		MyTCBStub.Flags.bSocketReset = 0;
+		return TRUE;
+	}
+	return FALSE;
+}
+
 /*********************************************************************
 * Function:        BOOL TCPIsConnected(TCP_SOCKET hTCP)
 *
@@ -470,6 +534,18 @@ void TCPDisconnect(TCP_SOCKET hTCP)
 	// could interfere with the remote node sending us a FIN if our
 	// RX window is zero
 	MyTCBStub.rxTail = MyTCBStub.rxHead;
+
+	// A TCPPutReserve() placeholder that was never filled can't be 
+	// sent, so the data can't end with a FIN: abort instead
+	if (MyTCBStub.Flags.bTXHold
+		&& (MyTCBStub.smState == TCP_SYN_RECEIVED
+			|| MyTCBStub.smState == TCP_ESTABLISHED
+			|| MyTCBStub.smState == TCP_CLOSE_WAIT)) {
+		SendTCP(RST | ACK, 0);
+		CloseSocket();
+		return;
+	}
+
 	switch (MyTCBStub.smState) {
 #if defined(STACK_CLIENT_MODE) && defined(STACK_USE_DNS)
 	case TCP_DNS_RESOLVE:
@@ -543,6 +619,11 @@ void TCPDisconnect(TCP_SOCKET hTCP)
 void TCPFlush(TCP_SOCKET hTCP)
 {
 	SyncTCBStub(hTCP);
+
+	// Reserved bytes must not leave before they are written
+	if (MyTCBStub.Flags.bTXHold)
+		return;
+
 	SyncTCB();
 
 	if (MyTCBStub.txHead != MyTCB.txUnackedTail) {
@@ -587,6 +668,27 @@ WORD TCPIsPutReady(TCP_SOCKET hTCP)
 		return MyTCBStub.txTail - MyTCBStub.txHead - 1;
 }
 
+/*********************************************************************
+* Function:        BOOL TCPPut(TCP_SOCKET hTCP, unsigned char byte)
+*
+* PreCondition:    TCPIsPutReady() != 0
+*
+* Input:           hTCP    - Socket handle to use
+*                  byte    - Data byte to put
+*
+* Output:          TRUE if the byte was placed in the TX buffer
+*
+* Side Effects:    None
+*
+* Overview:        None
+*
+* Note:            None
+********************************************************************/
+BOOL TCPPut(TCP_SOCKET hTCP, unsigned char byte)
+{
+	return TCPPutArray(hTCP, &byte, 1) == 1u;
+}
+
 /*********************************************************************
 * Function:        WORD TCPPutArray(TCP_SOCKET hTCP, unsigned char *data, WORD len)
 *
@@ -625,7 +727,7 @@ WORD TCPPutArray(TCP_SOCKET hTCP, unsigned char *data, WORD len)
 	// Send all current bytes if we are crossing half full
 	// This is required to improve performance with the delayed 
 	// acknowledgement algorithm
-	if ((!MyTCBStub.Flags.bHalfFullFlush)
+	if ((!MyTCBStub.Flags.bHalfFullFlush) && (!MyTCBStub.Flags.bTXHold)
 		&& (wFreeTXSpace <=
 			((MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart) >> 1))) {
 		TCPFlush(hTCP);
@@ -662,6 +764,187 @@ WORD TCPPutArray(TCP_SOCKET hTCP, unsigned char *data, WORD len)
 	return wActualLen + wRightLen;
 }
 
+/*********************************************************************
+* Function:        unsigned char *TCPPutString(TCP_SOCKET hTCP, unsigned char *data)
+*
+* PreCondition:    None
+*
+* Input:           hTCP    - Socket handle to use
+*                  data    - Null terminated string to put
+*
+* Output:          Pointer to the first byte that didn't fit, or to 
+*				   the terminator if all of them were put
+*
+* Side Effects:    None
+*
+* Overview:        None
+*
+* Note:            The terminator is not put.
+********************************************************************/
+unsigned char *TCPPutString(TCP_SOCKET hTCP, unsigned char *data)
+{
+	return data + TCPPutArray(hTCP, data, strlen((char *) data));
+}
+
+#if defined(__18CXX)
+	// Program memory is copied through PIC RAM a few bytes at a time
+WORD TCPPutROMArray(TCP_SOCKET hTCP, const unsigned char *data, WORD len)
+{
+	unsigned char vBuffer[16];
+	WORD w, wPut, wTotal;
+
+	wTotal = 0;
+	while (len) {
+		w = sizeof(vBuffer);
+		if (w > len)
+			w = len;
+		memcpypgm2ram(vBuffer, (const void *) data, w);
+		wPut = TCPPutArray(hTCP, vBuffer, w);
+		wTotal += wPut;
+		if (wPut != w)
+			break;
+		data += w;
+		len -= w;
+	}
+
+	return wTotal;
+}
+
+const unsigned char *TCPPutROMString(TCP_SOCKET hTCP, const unsigned char *data)
+{
+	return data + TCPPutROMArray(hTCP, data, strlenpgm((const char *) data));
+}
+#endif
+
+/*********************************************************************
+* Function:        PTR_BASE TCPPutReserve(TCP_SOCKET hTCP, WORD wLen)
+*
+* PreCondition:    None
+*
+* Input:           hTCP    - Socket handle to use
+*				   wLen    - Count of bytes to reserve
+*
+* Output:          Reservation to pass to TCPPutReserved(), or 
+*				   TCP_INVALID_RESERVE if the TX FIFO doesn't have 
+*				   wLen bytes free or a reservation is already open
+*
+* Side Effects:    Nothing is transmitted until TCPPutReserved() is 
+*				   called.
+*
+* Overview:        Appends wLen bytes to the TX FIFO whose contents 
+*				   are only known later, such as a length prefix.  
+*				   Data put after them is queued as usual.
+*
+* Note:            No data or FIN leaves the socket while the 
+*				   reservation is open, retransmissions included, so 
+*				   call TCPPutReserved() before returning to the stack.
+********************************************************************/
+PTR_BASE TCPPutReserve(TCP_SOCKET hTCP, WORD wLen)
+{
+	PTR_BASE wReserve;
+
+	SyncTCBStub(hTCP);
+	if (MyTCBStub.Flags.bTXHold || TCPIsPutReady(hTCP) < wLen)
+		return TCP_INVALID_RESERVE;
+
+	wReserve = MyTCBStub.txHead;
+	MyTCBStub.txHead += wLen;
+	if (MyTCBStub.txHead >= MyTCBStub.bufferRxStart)
+		MyTCBStub.txHead -= MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+	MyTCBStub.Flags.bTXHold = 1;
+
+	return wReserve;
+}
+
+/*********************************************************************
+* Function:        void TCPPutReserved(TCP_SOCKET hTCP, PTR_BASE wReserve, unsigned char *data, WORD len)
+*
+* PreCondition:    wReserve was returned by TCPPutReserve() for len 
+*				   bytes
+*
+* Input:           hTCP     - Socket handle to use
+*				   wReserve - Reservation to fill
+*                  data     - Pointer to the reserved bytes, or NULL 
+*							  to give them back
+*				   len      - Count of bytes reserved
+*
+* Output:          None
+*
+* Side Effects:    None
+*
+* Overview:        Writes the reserved bytes and lets the socket 
+*				   transmit again, flushing if the FIFO went past 
+*				   half full meanwhile.
+*
+* Note:            A reservation can only be given back while nothing 
+*				   has been put after it.
+********************************************************************/
+void TCPPutReserved(TCP_SOCKET hTCP, PTR_BASE wReserve, unsigned char *data, WORD len)
+{
+	WORD wRightLen;
+
+	SyncTCBStub(hTCP);
+	MyTCBStub.Flags.bTXHold = 0;
+
+	if (data == NULL) {
+		MyTCBStub.txHead = wReserve;
+		return;
+	}
+	// See if we need a two part write
+	if (wReserve + len >= MyTCBStub.bufferRxStart) {
+		wRightLen = MyTCBStub.bufferRxStart - wReserve;
+		TCPRAMCopy((void *) wReserve, MyTCBStub.vMemoryMedium,
+				   data, TCP_PIC_RAM, wRightLen);
+		data += wRightLen;
+		len -= wRightLen;
+		wReserve = MyTCBStub.bufferTxStart;
+	}
+	TCPRAMCopy((void *) wReserve, MyTCBStub.vMemoryMedium, data,
+			   TCP_PIC_RAM, len);
+
+	// Do the flushes TCPPutArray() held back
+	if ((!MyTCBStub.Flags.bHalfFullFlush)
+		&& (TCPIsPutReady(hTCP) <=
+			((MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart) >> 1))) {
+		TCPFlush(hTCP);
+		MyTCBStub.Flags.bHalfFullFlush = TRUE;
+	} else if (TCPIsPutReady(hTCP) == 0u)
+		TCPFlush(hTCP);
+	else if (!MyTCBStub.Flags.bTimer2Enabled) {
+		MyTCBStub.Flags.bTimer2Enabled = TRUE;
+		MyTCBStub.eventTime2 =
+			(WORD) TickGetDiv256() +
+			TCP_AUTO_TRANSMIT_TIMEOUT_VAL / 256ull;
+	}
+}
+
+/*********************************************************************
+* Function:        WORD TCPGetTxFIFOFull(TCP_SOCKET hTCP)
+*
+* PreCondition:    TCPInit() is already called.
+*
+* Input:           hTCP: handle of socket to test
+*
+* Output:          Number of bytes in the TX FIFO that are unsent or 
+*				   not yet acknowledged, including any reservation
+*
+* Side Effects:    None
+*
+* Overview:        None
+*
+* Note:            Unlike TCPIsPutReady(), valid in any state.
+********************************************************************/
+WORD TCPGetTxFIFOFull(TCP_SOCKET hTCP)
+{
+	SyncTCBStub(hTCP);
+
+	if (MyTCBStub.txHead >= MyTCBStub.txTail)
+		return MyTCBStub.txHead - MyTCBStub.txTail;
+	else
+		return (MyTCBStub.bufferRxStart - MyTCBStub.txTail) +
+			(MyTCBStub.txHead - MyTCBStub.bufferTxStart);
+}
+
 /*********************************************************************
 * Function:        void TCPDiscard(TCP_SOCKET hTCP)
 *
@@ -723,6 +1006,51 @@ WORD TCPIsGetReady(TCP_SOCKET hTCP)
 			(MyTCBStub.rxHead - MyTCBStub.bufferRxStart);
 }
 
+/*********************************************************************
+* Function:        WORD TCPGetRxFIFOFree(TCP_SOCKET hTCP)
+*
+* PreCondition:    TCPInit() is already called.
+*
+* Input:           hTCP       - socket to test
+*
+* Output:          Number of bytes the RX FIFO can still receive
+*
+* Side Effects:    None
+*
+* Overview:        None
+*
+* Note:            None
+********************************************************************/
+WORD TCPGetRxFIFOFree(TCP_SOCKET hTCP)
+{
+	WORD wDataLen;
+
+	wDataLen = TCPIsGetReady(hTCP);
+	return (MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart) - wDataLen;
+}
+
+/*********************************************************************
+* Function:        BOOL TCPGet(TCP_SOCKET hTCP, unsigned char *byte)
+*
+* PreCondition:    TCPInit() is already called
+*
+* Input:           hTCP    - socket handle
+*                  byte    - Where to store the byte, or NULL to 
+*							 discard it
+*
+* Output:          TRUE if a byte was read
+*
+* Side Effects:    None
+*
+* Overview:        None
+*
+* Note:            None
+********************************************************************/
+BOOL TCPGet(TCP_SOCKET hTCP, unsigned char *byte)
+{
+	return TCPGetArray(hTCP, byte, 1) == 1u;
+}
+
 /*********************************************************************
 * Function:        WORD TCPGetArray(TCP_SOCKET hTCP, unsigned char *buffer,
 *                                      WORD len)
@@ -785,6 +1113,132 @@ WORD TCPGetArray(TCP_SOCKET hTCP, unsigned char *buffer, WORD len)
 	return len + RightLen;
 }
 
+/*********************************************************************
+* Function:        WORD TCPFindArrayEx(TCP_SOCKET hTCP, unsigned char *cFindArray, 
+*									WORD wLen, WORD wStart, WORD wSearchLen, 
+*									BOOL bTextCompare)
+*
+* PreCondition:    TCPInit() is already called
+*
+* Input:           hTCP         - socket handle
+*                  cFindArray   - Bytes to look for
+*                  wLen         - Count of bytes in cFindArray
+*                  wStart       - Offset in the RX FIFO to start at
+*                  wSearchLen   - Bytes from wStart the match must lie 
+*								  in, 0 for the whole FIFO
+*                  bTextCompare - TRUE to ignore the case of letters
+*
+* Output:          Offset of the first match from the head of the RX 
+*				   FIFO, or 0xFFFF if there is none
+*
+* Side Effects:    None
+*
+* Overview:        Searches the received data without removing any of 
+*				   it.
+*
+* Note:            After a partial match fails the current byte is 
+*				   tried as the start of a new one, which is exact for 
+*				   arrays that don't repeat their own beginning (such 
+*				   as CRLF sequences).
+********************************************************************/
+WORD TCPFindArrayEx(TCP_SOCKET hTCP, unsigned char *cFindArray, WORD wLen,
+					WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+{
+	PTR_BASE ptrRead;
+	WORD wDataLen;
+	WORD wBytesUntilWrap;
+	WORD wLocation;
+	WORD wMatched;
+	unsigned char i, j, k, c;
+	unsigned char buffer[32];
+
+	if (wLen == 0u)
+		return 0u;
+
+	SyncTCBStub(hTCP);
+
+	// Find out how many bytes are in the RX FIFO and return 
+	// immediately if we won't possibly find a match
+	wDataLen = TCPIsGetReady(hTCP);
+	if (wDataLen < wLen || wDataLen - wLen < wStart)
+		return 0xFFFFu;
+	wDataLen -= wStart;
+	if (wSearchLen && wDataLen > wSearchLen)
+		wDataLen = wSearchLen;
+
+	ptrRead = MyTCBStub.rxTail + wStart;
+	if (ptrRead > MyTCBStub.bufferEnd)
+		ptrRead -= MyTCBStub.bufferEnd - MyTCBStub.bufferRxStart + 1;
+	wBytesUntilWrap = MyTCBStub.bufferEnd - ptrRead + 1;
+	wLocation = wStart;
+	wMatched = 0;
+
+	while (wDataLen >= wLen - wMatched) {
+		// Read a chunk of data into the buffer
+		k = sizeof(buffer);
+		if ((WORD) k > wBytesUntilWrap)
+			k = wBytesUntilWrap;
+		if ((WORD) k > wDataLen)
+			k = wDataLen;
+		TCPRAMCopy(buffer, TCP_PIC_RAM, (void *) ptrRead,
+				   MyTCBStub.vMemoryMedium, (WORD) k);
+		ptrRead += k;
+		wBytesUntilWrap -= k;
+		if (wBytesUntilWrap == 0u) {
+			ptrRead = MyTCBStub.bufferRxStart;
+			wBytesUntilWrap = 0xFFFFu;
+		}
+
+		for (i = 0; i < k; i++) {
+			c = buffer[i];
+			if (bTextCompare && c >= 'a' && c <= 'z')
+				c -= 32;
+			while (1) {
+				j = cFindArray[wMatched];
+				if (bTextCompare && j >= 'a' && j <= 'z')
+					j -= 32;
+				if (c == j) {
+					if (++wMatched == wLen)
+						return wLocation + i + 1 - wLen;
+					break;
+				}
+				if (wMatched == 0u)
+					break;
+				// Try this byte as the start of a new match
+				wMatched = 0;
+			}
+		}
+		wLocation += k;
+		wDataLen -= k;
+	}
+
+	return 0xFFFFu;
+}
+
+/*********************************************************************
+* Function:        WORD TCPFindEx(TCP_SOCKET hTCP, unsigned char cFind, 
+*								WORD wStart, WORD wSearchLen, BOOL bTextCompare)
+*
+* PreCondition:    TCPInit() is already called
+*
+* Input:           As TCPFindArrayEx(), for a single byte
+*
+* Output:          Offset of the byte from the head of the RX FIFO, or 
+*				   0xFFFF if it isn't there
+*
+* Side Effects:    None
+*
+* Overview:        None
+*
+* Note:            None
+********************************************************************/
+WORD TCPFindEx(TCP_SOCKET hTCP, unsigned char cFind, WORD wStart,
+			   WORD wSearchLen, BOOL bTextCompare)
+{
+	return TCPFindArrayEx(hTCP, &cFind, 1, wStart, wSearchLen,
+						  bTextCompare);
+}
+
 #if defined(__18CXX)
 WORD TCPFindROMArrayEx(TCP_SOCKET hTCP, const unsigned char *cFindArray,
 					   WORD wLen, WORD wStart, WORD wSearchLen,
@@ -913,6 +1367,278 @@ WORD TCPFindROMArrayEx(TCP_SOCKET hTCP, const unsigned char *cFindArray,
 }
 #endif
 
+/*********************************************************************
+* Function:        BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, 
+*										WORD wMinTXSize, unsigned char vFlags)
+*
+* PreCondition:    TCPInit() is already called
+*
+* Input:           hTCP       - socket handle
+*                  wMinRXSize - Smallest RX FIFO to leave, at least 1
+*                  wMinTXSize - Smallest TX FIFO to leave
+*                  vFlags     - TCP_ADJUST_GIVE_REST_TO_RX or 
+*								TCP_ADJUST_GIVE_REST_TO_TX to give that 
+*								FIFO the space over the minimums (half 
+*								each when neither or both are given), 
+*								plus TCP_ADJUST_PRESERVE_RX and/or 
+*								TCP_ADJUST_PRESERVE_TX to keep the data 
+*								in that FIFO
+*
+* Output:          TRUE if the FIFOs now have the requested sizes, 
+*				   FALSE if they were left as they were
+*
+* Side Effects:    Data in a FIFO that isn't preserved is discarded
+*
+* Overview:        Moves the boundary between the socket's TX and RX 
+*				   FIFOs, so a socket can receive a request in a big 
+*				   RX FIFO and then answer it from a big TX FIFO.
+*
+* Note:            Data already sent, or held by TCPPutReserve(), is 
+*				   always preserved.  Preserved data moves to the 
+*				   start of its resized FIFO; the call fails if it 
+*				   doesn't fit, or if a TCPPutReserve() reservation 
+*				   would have to move.
+********************************************************************/
+BOOL TCPAdjustFIFOSize(TCP_SOCKET hTCP, WORD wMinRXSize, WORD wMinTXSize,
+					   unsigned char vFlags)
+{
+	PTR_BASE ptrRxStart;
+	WORD wTotal, wTXFull, wRXFull, wTXSize, wUnacked;
+
+	SyncTCBStub(hTCP);
+	SyncTCB();
+
+	// The RX FIFO must hold at least one byte to receive SYN and FIN
+	if (wMinRXSize == 0u)
+		wMinRXSize = 1;
+
+	// Bytes the remote node may already have seen can't be taken back
+	if (MyTCB.txUnackedTail != MyTCBStub.txTail || MyTCBStub.Flags.bTXHold)
+		vFlags |= TCP_ADJUST_PRESERVE_TX;
+
+	wTXFull = TCPGetTxFIFOFull(hTCP);
+	if (MyTCBStub.rxHead >= MyTCBStub.rxTail)
+		wRXFull = MyTCBStub.rxHead - MyTCBStub.rxTail;
+	else
+		wRXFull = (MyTCBStub.bufferEnd - MyTCBStub.rxTail + 1) +
+			(MyTCBStub.rxHead - MyTCBStub.bufferRxStart);
+	if ((vFlags & TCP_ADJUST_PRESERVE_TX) && wMinTXSize < wTXFull)
+		wMinTXSize = wTXFull;
+	if ((vFlags & TCP_ADJUST_PRESERVE_RX) && wMinRXSize < wRXFull)
+		wMinRXSize = wRXFull;
+
+	// Make sure the minimums fit and split the rest
+	wTotal = MyTCBStub.bufferEnd - MyTCBStub.bufferTxStart - 1;
+	if ((DWORD) wMinRXSize + wMinTXSize > wTotal)
+		return FALSE;
+	wTXSize = wMinTXSize;
+	switch (vFlags &
+			(TCP_ADJUST_GIVE_REST_TO_RX | TCP_ADJUST_GIVE_REST_TO_TX)) {
+	case TCP_ADJUST_GIVE_REST_TO_RX:
+		break;
+	case TCP_ADJUST_GIVE_REST_TO_TX:
+		wTXSize += wTotal - wMinRXSize - wMinTXSize;
+		break;
+	default:
+		wTXSize += (wTotal - wMinRXSize - wMinTXSize) >> 1;
+		break;
+	}
+
+	ptrRxStart = MyTCBStub.bufferTxStart + wTXSize + 1;
+	if (ptrRxStart == MyTCBStub.bufferRxStart)
+		return TRUE;
+
+	// A reservation from TCPPutReserve() is a pointer into the FIFO
+	if (MyTCBStub.Flags.bTXHold && wTXFull
+		&& MyTCBStub.txTail != MyTCBStub.bufferTxStart)
+		return FALSE;
+
+	// Move the TX data to the start of the TX FIFO, unwrapped
+	wUnacked = 0;
+	if ((vFlags & TCP_ADJUST_PRESERVE_TX) && wTXFull) {
+		wUnacked = MyTCB.txUnackedTail - MyTCBStub.txTail;
+		if (MyTCB.txUnackedTail < MyTCBStub.txTail)
+			wUnacked += MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
+		if (MyTCBStub.txHead < MyTCBStub.txTail)
+			TCPRAMRotate(MyTCBStub.bufferTxStart, MyTCBStub.bufferRxStart,
+						 MyTCBStub.txTail);
+		else if (MyTCBStub.txTail != MyTCBStub.bufferTxStart)
+			TCPRAMCopy((void *) MyTCBStub.bufferTxStart,
+					   MyTCBStub.vMemoryMedium, (void *) MyTCBStub.txTail,
+					   MyTCBStub.vMemoryMedium, wTXFull);
+	} else {
+		wTXFull = 0;
+	}
+
+	// Likewise the RX data, then slide it to the new start of the 
+	// RX FIFO.  The minimums keep it clear of the TX data.
+	if ((vFlags & TCP_ADJUST_PRESERVE_RX) && wRXFull) {
+		if (MyTCBStub.rxHead < MyTCBStub.rxTail)
+			TCPRAMRotate(MyTCBStub.bufferRxStart, MyTCBStub.bufferEnd + 1,
+						 MyTCBStub.rxTail);
+		else if (MyTCBStub.rxTail != MyTCBStub.bufferRxStart)
+			TCPRAMCopy((void *) MyTCBStub.bufferRxStart,
+					   MyTCBStub.vMemoryMedium, (void *) MyTCBStub.rxTail,
+					   MyTCBStub.vMemoryMedium, wRXFull);
+		if (ptrRxStart < MyTCBStub.bufferRxStart)
+			TCPRAMCopy((void *) ptrRxStart, MyTCBStub.vMemoryMedium,
+					   (void *) MyTCBStub.bufferRxStart,
+					   MyTCBStub.vMemoryMedium, wRXFull);
+		else
+			TCPRAMMoveUp(ptrRxStart, MyTCBStub.bufferRxStart, wRXFull);
+	} else {
+		wRXFull = 0;
+	}
+
+	MyTCBStub.txTail = MyTCBStub.bufferTxStart;
+	MyTCBStub.txHead = MyTCBStub.bufferTxStart + wTXFull;
+	MyTCB.txUnackedTail = MyTCBStub.bufferTxStart + wUnacked;
+	MyTCBStub.Flags.bHalfFullFlush = FALSE;
+	MyTCBStub.rxTail = ptrRxStart;
+	MyTCBStub.rxHead = ptrRxStart + wRXFull;
+	MyTCB.sHoleSize = -1;
+
+	// Advertise a larger window right away
+	if (ptrRxStart < MyTCBStub.bufferRxStart
+		&& MyTCBStub.smState == TCP_ESTABLISHED)
+		MyTCBStub.Flags.bTXASAP = 1;
+	MyTCBStub.bufferRxStart = ptrRxStart;
+
+	return TRUE;
+}
+
+/*********************************************************************
+* Function:        static void TCPRAMReverse(PTR_BASE ptrStart, 
+*											 PTR_BASE ptrEnd)
+*
+* PreCondition:    SyncTCBStub() has been called for the socket
+*
+* Input:           ptrStart, ptrEnd - the bytes [ptrStart, ptrEnd) of 
+*									  the socket's FIFO memory
+*
+* Output:          None
+*
+* Side Effects:    None
+*
+* Overview:        Reverses the order of the bytes, swapping a few 
+*				   from each end at a time through PIC RAM.
+*
+* Note:            None
+********************************************************************/
+static void TCPRAMReverse(PTR_BASE ptrStart, PTR_BASE ptrEnd)
+{
+	unsigned char vLow[8], vHigh[8], c;
+	unsigned char i, n;
+
+	while (ptrEnd - ptrStart >= 2u) {
+		n = sizeof(vLow);
+		if ((ptrEnd - ptrStart) / 2u < n)
+			n = (ptrEnd - ptrStart) / 2u;
+		TCPRAMCopy(vLow, TCP_PIC_RAM, (void *) ptrStart,
+				   MyTCBStub.vMemoryMedium, n);
+		TCPRAMCopy(vHigh, TCP_PIC_RAM, (void *) (ptrEnd - n),
+				   MyTCBStub.vMemoryMedium, n);
+		for (i = 0; i < n / 2u; i++) {
+			c = vLow[i];
+			vLow[i] = vLow[n - 1 - i];
+			vLow[n - 1 - i] = c;
+			c = vHigh[i];
+			vHigh[i] = vHigh[n - 1 - i];
+			vHigh[n - 1 - i] = c;
+		}
+		TCPRAMCopy((void *) ptrStart, MyTCBStub.vMemoryMedium, vHigh,
+				   TCP_PIC_RAM, n);
+		TCPRAMCopy((void *) (ptrEnd - n), MyTCBStub.vMemoryMedium, vLow,
+				   TCP_PIC_RAM, n);
+		ptrStart += n;
+		ptrEnd -= n;
+	}
+}
+
+/*********************************************************************
+* Function:        static void TCPRAMRotate(PTR_BASE ptrStart, 
+*							PTR_BASE ptrEnd, PTR_BASE ptrFirst)
+*
+* PreCondition:    SyncTCBStub() has been called for the socket
+*
+* Input:           ptrStart, ptrEnd - a ring [ptrStart, ptrEnd) of the 
+*									  socket's FIFO memory
+*				   ptrFirst - the byte to bring to ptrStart
+*
+* Output:          None
+*
+* Side Effects:    None
+*
+* Overview:        Rotates the ring in place, so data that wraps 
+*				   around its end becomes one block at its start.
+*
+* Note:            Three reversals: no room beyond the ring is needed
+********************************************************************/
+static void TCPRAMRotate(PTR_BASE ptrStart, PTR_BASE ptrEnd, PTR_BASE ptrFirst)
+{
+	TCPRAMReverse(ptrStart, ptrFirst);
+	TCPRAMReverse(ptrFirst, ptrEnd);
+	TCPRAMReverse(ptrStart, ptrEnd);
+}
+
+/*********************************************************************
+* Function:        static void TCPRAMMoveUp(PTR_BASE ptrDest, 
+*							PTR_BASE ptrSource, WORD wLength)
+*
+* PreCondition:    SyncTCBStub() has been called for the socket
+*
+* Input:           ptrDest - where the data goes, above ptrSource
+*				   ptrSource - where the data is
+*				   wLength - bytes to move
+*
+* Output:          None
+*
+* Side Effects:    None
+*
+* Overview:        Moves data to a higher, possibly overlapping, 
+*				   address, the last bytes first.
+*
+* Note:            TCPRAMCopy() handles moves to a lower address
+********************************************************************/
+static void TCPRAMMoveUp(PTR_BASE ptrDest, PTR_BASE ptrSource, WORD wLength)
+{
+	unsigned char vBuffer[16];
+	unsigned char n;
+
+	while (wLength) {
+		n = sizeof(vBuffer);
+		if (wLength < n)
+			n = wLength;
+		wLength -= n;
+		TCPRAMCopy(vBuffer, TCP_PIC_RAM, (void *) (ptrSource + wLength),
+				   MyTCBStub.vMemoryMedium, n);
+		TCPRAMCopy((void *) (ptrDest + wLength), MyTCBStub.vMemoryMedium,
+				   vBuffer, TCP_PIC_RAM, n);
+	}
+}
+
+/*********************************************************************
+* Function:        BOOL TCPIsLoopback(TCP_SOCKET hTCP)
+*
+* PreCondition:    TCPInit() is already called
+*
+* Input:           hTCP - socket to test
+*
+* Output:          TRUE if the socket is a loopback socket
+*
+* Side Effects:    None
+*
+* Overview:        None
+*
+* Note:            None
+********************************************************************/
+BOOL TCPIsLoopback(TCP_SOCKET hTCP)
+{
+	SyncTCBStub(hTCP);
+	return (MyTCBStub.smState == TCP_LOOPBACK)
+		|| (MyTCBStub.smState == TCP_LOOPBACK_CLOSED);
+}
+
 /*********************************************************************
 * Function:        void TCPTick(void)
 *
@@ -1159,6 +1885,8 @@ void TCPTick(void)
 				bCloseSocket = TRUE;
 			}
 			break;
+			default:
+				break;
 		}
 
 		if (vFlags)
@@ -1168,16 +1896,11 @@ void TCPTick(void)
 				// Set the appropriate retry time
 				MyTCB.retryCount++;
 				MyTCB.retryInterval <<= 1;
+				if (MyTCB.retryInterval > TCP_MAX_RTO_VAL)
+					MyTCB.retryInterval = TCP_MAX_RTO_VAL;
+				TCPStats.dwTimeoutRetransmits++;
 				// Transmit all unacknowledged data over again
-				// Roll back unacknowledged TX tail pointer to cause retransmit to occur
-				MyTCB.MySEQ -=
-					(LONG) (SHORT) (MyTCB.txUnackedTail -
-									MyTCBStub.txTail);
-				if (MyTCB.txUnackedTail < MyTCBStub.txTail)
-					MyTCB.MySEQ -=
-						(LONG) (SHORT) (MyTCBStub.bufferRxStart -
-										MyTCBStub.bufferTxStart);
-				MyTCB.txUnackedTail = MyTCBStub.txTail;
+				RewindUnackedData();
 				SendTCP(vFlags, 0);
 			}
 			else
@@ -1258,17 +1981,22 @@ BOOL TCPProcess(NODE_INFO * remote, IP_ADDR * localIP, WORD len)
 	// Find matching socket.
 	if (FindMatchingSocket(&TCPHeader, remote)) {
 		HandleTCPSeg(&TCPHeader, len);
+	} else {
+		// RFC 793: if the connection does not exist, a segment
+		// that doesn't itself carry a RST is answered with a RST.
+		// Only unicast segments addressed to us are answered so
+		// that broadcast traffic can't turn us into an amplifier.
+		// A connection request for a port with a socket that is 
+		// merely busy is not refused: the SYN is dropped and the 
+		// client retransmits it until the socket listens again.  
+		// Anything else for such a port belongs to a connection we 
+		// no longer have and is reset as usual.
+		if (!(TCPHeader.Flags.byte & RST)
+			&& (localIP->Val == AppConfig.MyIPAddr.Val)
+			&& !((TCPHeader.Flags.byte & (SYN | ACK)) == SYN
+				 && IsPortBound(TCPHeader.DestPort)))
+			SendTCPReset(&TCPHeader, remote, len);
 	}
-//  else
-//  {
-//      // \TODO: RFC 793 specifies that if the socket is closed 
-//      // and a segment arrives, we should send back a RST if 
-//      // the RST bit in the incoming packet is not set.  The 
-//      // code to respond with the RST packet and believable SEQ 
-//      // and ACK numbers needs to be implemented.
-//      //if(!TCPHeader.Flags.bits.flagRST)
-//      //  SendTCP(RST, SENDTCP_RESET_TIMERS);
-//  }
 
 	// Finished with this packet, discard it and free the Ethernet RAM for new packets
 	MACDiscardRx();
@@ -1334,13 +2062,16 @@ static void SendTCP(unsigned char vTCPFlags, unsigned char vSendFlags)
 		// Don't put any data in SYN and RST messages
 		len = 0;
 	} else {
-		// Begin copying any application data over to the TX space
-		if (MyTCBStub.txHead == MyTCB.txUnackedTail) {
+		// Begin copying any application data over to the TX space.  
+		// Nothing goes while a TCPPutReserve() placeholder is in the 
+		// FIFO: not new data, not a retransmission, not the FIN.
+		if (MyTCBStub.txHead == MyTCB.txUnackedTail
+			|| MyTCBStub.Flags.bTXHold) {
 			// All caught up on data TX, no real data for this packet
 			len = 0;
 
 			// If we are to transmit a FIN, make sure we can put one in this packet
-			if (MyTCBStub.Flags.bTXFIN) {
+			if (MyTCBStub.Flags.bTXFIN && !MyTCBStub.Flags.bTXHold) {
 				if (MyTCB.remoteWindow)
 					vTCPFlags |= FIN;
 			}
@@ -1438,7 +2169,8 @@ static void SendTCP(unsigned char vTCPFlags, unsigned char vSendFlags)
 	if (len || (vTCPFlags & (SYN | FIN))) {
 		if (vSendFlags & SENDTCP_RESET_TIMERS) {
 			MyTCB.retryCount = 0;
-			MyTCB.retryInterval = TCP_START_TIMEOUT_VAL;
+			if (!MyTCB.flags.bRTTBackoff)
+				MyTCB.retryInterval = GetRTO();
 		}
 
 		MyTCBStub.eventTime = TickGet() + MyTCB.retryInterval;
@@ -1490,6 +2222,13 @@ static void SendTCP(unsigned char vTCPFlags, unsigned char vSendFlags)
 			MyTCB.flags.bFINSent = 1;
 		}
 	}
+	// Time one new segment at a time for the RTT estimator
+	if ((len || (vTCPFlags & (SYN | FIN))) && (vSendFlags & SENDTCP_RESET_TIMERS)
+		&& !MyTCB.flags.bRTTPending && !MyTCB.flags.bRTTBackoff) {
+		MyTCB.flags.bRTTPending = 1;
+		MyTCB.rttSEQ = MyTCB.MySEQ;
+		MyTCB.rttStart = (WORD) (TickGet() >> TCP_RTT_SHIFT);
+	}
 	// Calculate the amount of free space in the RX buffer area of this socket
 	if (MyTCBStub.rxHead >= MyTCBStub.rxTail)
 		header.Window =
@@ -1561,6 +2300,87 @@ static void SendTCP(unsigned char vTCPFlags, unsigned char vSendFlags)
 	MACFlush();
 }
 
+/*********************************************************************
+* Function:        static void SendTCPReset(TCP_HEADER *h,
+*											NODE_INFO *remote,
+*											WORD len)
+*
+* PreCondition:    TCPProcess() is the caller and no socket matched
+*				   the received segment
+*
+* Input:           h           - Received TCP header (host byte order)
+*                  remote      - Node who sent the segment
+*                  len         - Length of the segment text
+*
+* Output:          A RST segment is transmitted to the remote node
+*
+* Side Effects:    None
+*
+* Overview:        The reset is generated straight from the received
+*				   header, so no socket (and no TCB swap) is needed.
+*				   SEQ and ACK follow RFC 793 section 3.4:
+*					SEG.ACK set:   <SEQ=SEG.ACK><CTL=RST>
+*					otherwise:     <SEQ=0><ACK=SEG.SEQ+SEG.LEN><CTL=RST,ACK>
+*
+* Note:            Must not be called for segments carrying RST.
+********************************************************************/
+static void SendTCPReset(TCP_HEADER * h, NODE_INFO * remote, WORD len)
+{
+	WORD_VAL wVal;
+	TCP_HEADER header;
+	PSEUDO_HEADER pseudoHeader;
+
+	header.SourcePort = h->DestPort;
+	header.DestPort = h->SourcePort;
+	if (h->Flags.byte & ACK) {
+		header.SeqNumber = h->AckNumber;
+		header.AckNumber = 0;
+		header.Flags.byte = RST;
+	} else {
+		// SYN and FIN each occupy one sequence number
+		if (h->Flags.byte & SYN)
+			len++;
+		if (h->Flags.byte & FIN)
+			len++;
+		header.SeqNumber = 0;
+		header.AckNumber = h->SeqNumber + (DWORD) len;
+		header.Flags.byte = RST | ACK;
+	}
+	header.Window = 0;
+	header.UrgentPointer = 0;
+	SwapTCPHeader(&header);
+	header.DataOffset.Reserved3 = 0;
+	header.DataOffset.Val = sizeof(header) >> 2;
+
+	// Calculate IP pseudoheader checksum.
+	pseudoHeader.SourceAddress = AppConfig.MyIPAddr;
+	pseudoHeader.DestAddress = remote->IPAddr;
+	pseudoHeader.Zero = 0x0;
+	pseudoHeader.Protocol = IP_PROT_TCP;
+	pseudoHeader.Length = sizeof(header);
+	SwapPseudoHeader(pseudoHeader);
+	header.Checksum =
+		~CalcIPChecksum((unsigned char *) &pseudoHeader,
+						sizeof(pseudoHeader));
+
+	//  Make sure that we can write to the MAC transmit area
+	while(!IPIsTxReady());
+
+	// Write IP and TCP headers
+	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
+	IPPutHeader(remote, IP_PROT_TCP, sizeof(header));
+	MACPutArray((unsigned char *) &header, sizeof(header));
+
+	// Update the TCP checksum
+	MACSetReadPtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER));
+	wVal.Val = CalcIPBufferChecksum(sizeof(header));
+	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) +
+				   sizeof(IP_HEADER) + 16);
+	MACPutArray((unsigned char *) &wVal, sizeof(WORD));
+
+	MACFlush();
+}
+
 
 
 /*********************************************************************
@@ -1639,6 +2459,46 @@ static BOOL FindMatchingSocket(TCP_HEADER * h, NODE_INFO * remote)
 
 
 
+/*********************************************************************
+* Function:        static BOOL IsPortBound(WORD wPort)
+*
+* PreCondition:    TCPInit() is already called
+*
+* Input:           wPort       - Local port number
+*
+* Output:          TRUE if a socket is listening on or connected 
+*				   through wPort
+*
+* Side Effects:    None
+*
+* Overview:        None
+*
+* Note:            Loads MyTCBStub and MyTCB.
+********************************************************************/
+static BOOL IsPortBound(WORD wPort)
+{
+	TCP_SOCKET hTCP;
+
+	for (hTCP = 0; hTCP < TCP_SOCKET_COUNT; hTCP++) {
+		SyncTCBStub(hTCP);
+
+		if (MyTCBStub.smState == TCP_CLOSED)
+			continue;
+		if (MyTCBStub.smState == TCP_LISTEN) {
+			if (MyTCBStub.remoteHash.Val == wPort)
+				return TRUE;
+			continue;
+		}
+
+		SyncTCB();
+		if (MyTCB.localPort.Val == wPort)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+
+
 /*********************************************************************
 * Function:        static void SwapTCPHeader(TCP_HEADER* header)
 *
@@ -1701,10 +2561,18 @@ static void CloseSocket(void)
 	MyTCBStub.Flags.bHalfFullFlush = 0;
 	MyTCBStub.Flags.bTXASAP = 0;
 	MyTCBStub.Flags.bTXFIN = 0;
+	MyTCBStub.Flags.bTXHold = 0;
 	MyTCBStub.Flags.bSocketReset = 1;
 
 	MyTCB.flags.bFINSent = 0;
 	MyTCB.flags.bSYNSent = 0;
+	MyTCB.flags.bRTTPending = 0;
+	MyTCB.flags.bRTTBackoff = 0;
+	MyTCB.flags.bInRecovery = 0;
+	MyTCB.dupACKCount = 0;
+	MyTCB.wSRTT = 0;
+	MyTCB.wRTTVAR = 0;
+	MyTCB.retryInterval = TCP_START_TIMEOUT_VAL;
 	MyTCB.txUnackedTail = MyTCBStub.bufferTxStart;
 	((DWORD_VAL *) (&MyTCB.MySEQ))->w[0] = rand();
 	((DWORD_VAL *) (&MyTCB.MySEQ))->w[1] = rand();
@@ -1714,6 +2582,150 @@ static void CloseSocket(void)
 
 
 
+/*********************************************************************
+* Function:        static void UpdateRTO(DWORD dwAckNumber)
+*
+* PreCondition:    SyncTCB() has been called for the current socket
+*
+* Input:           dwAckNumber - Acknowledgement number just received
+*
+* Output:          None
+*
+* Side Effects:    None
+*
+* Overview:        Completes a pending RTT measurement if this ACK 
+*				   covers the timed segment and folds the sample 
+*				   into the smoothed estimators using Jacobson's 
+*				   fixed point arithmetic (SRTT scaled by 8, RTTVAR 
+*				   scaled by 4).  While retransmitted data is still 
+*				   outstanding no samples are taken (Karn's rule).
+*
+* Note:            None
+********************************************************************/
+static void UpdateRTO(DWORD dwAckNumber)
+{
+	WORD wSample;
+	SHORT sDelta;
+
+	if (MyTCB.flags.bRTTBackoff) {
+		// Leave backoff once everything we sent has been acknowledged
+		if (MyTCB.MySEQ == dwAckNumber)
+			MyTCB.flags.bRTTBackoff = 0;
+		return;
+	}
+
+	if (!MyTCB.flags.bRTTPending)
+		return;
+	if ((LONG) (dwAckNumber - MyTCB.rttSEQ) < (LONG) 0)
+		return;
+	MyTCB.flags.bRTTPending = 0;
+
+	wSample = (WORD) (TickGet() >> TCP_RTT_SHIFT) - MyTCB.rttStart;
+	if (wSample > TCP_RTT_MAX_SAMPLE)
+		wSample = TCP_RTT_MAX_SAMPLE;
+	else if (wSample == 0u)
+		wSample = 1;			// wSRTT == 0 is reserved for "no sample yet"
+
+	if (MyTCB.wSRTT == 0u) {
+		// First measurement: SRTT = R, RTTVAR = R/2
+		MyTCB.wSRTT = wSample << 3;
+		MyTCB.wRTTVAR = wSample << 1;
+	} else {
+		// SRTT += (R - SRTT)/8, RTTVAR += (|R - SRTT| - RTTVAR)/4
+		sDelta = (SHORT) wSample - (SHORT) (MyTCB.wSRTT >> 3);
+		MyTCB.wSRTT += sDelta;
+		if (sDelta < 0)
+			sDelta = -sDelta;
+		sDelta -= (SHORT) (MyTCB.wRTTVAR >> 2);
+		MyTCB.wRTTVAR += sDelta;
+	}
+}
+
+/*********************************************************************
+* Function:        static DWORD GetRTO(void)
+*
+* PreCondition:    SyncTCB() has been called for the current socket
+*
+* Input:           None
+*
+* Output:          Retransmission timeout for the next new segment, 
+*				   in ticks
+*
+* Side Effects:    None
+*
+* Overview:        RTO = SRTT + 4*RTTVAR, clamped to 
+*				   [TCP_MIN_RTO_VAL, TCP_MAX_RTO_VAL].  Sockets with 
+*				   no RTT sample yet use TCP_START_TIMEOUT_VAL.
+*
+* Note:            None
+********************************************************************/
+static DWORD GetRTO(void)
+{
+	DWORD dwRTO;
+
+	if (MyTCB.wSRTT == 0u)
+		return TCP_START_TIMEOUT_VAL;
+
+	dwRTO = ((DWORD) (MyTCB.wSRTT >> 3) + MyTCB.wRTTVAR) << TCP_RTT_SHIFT;
+	if (dwRTO < TCP_MIN_RTO_VAL)
+		dwRTO = TCP_MIN_RTO_VAL;
+	else if (dwRTO > TCP_MAX_RTO_VAL)
+		dwRTO = TCP_MAX_RTO_VAL;
+
+	return dwRTO;
+}
+
+
+
+/*********************************************************************
+* Function:        static void RewindUnackedData(void)
+*
+* PreCondition:    SyncTCB() has been called for the current socket
+*
+* Input:           None
+*
+* Output:          None
+*
+* Side Effects:    None
+*
+* Overview:        Rolls the unacknowledged TX tail pointer and our 
+*				   sequence number back to the last acknowledged 
+*				   byte so that the next SendTCP() transmits all 
+*				   unacknowledged data over again.  Used by both the 
+*				   RTO timer and fast retransmit.
+*
+* Note:            The highest sequence number sent so far is kept in 
+*				   recoverSEQ, as NewReno (RFC 6582) does.  The resent 
+*				   data draws duplicate ACKs of its own, and they must 
+*				   not start another fast retransmit before the 
+*				   remote node has acknowledged up to recoverSEQ.
+********************************************************************/
+static void RewindUnackedData(void)
+{
+	// Karn's rule: never sample the RTT of retransmitted data and 
+	// keep the backed off RTO until everything outstanding has been 
+	// acknowledged
+	MyTCB.flags.bRTTPending = 0;
+	MyTCB.flags.bRTTBackoff = 1;
+	MyTCB.dupACKCount = 0;
+
+	if (!MyTCB.flags.bInRecovery
+		|| (LONG) (MyTCB.MySEQ - MyTCB.recoverSEQ) > (LONG) 0)
+		MyTCB.recoverSEQ = MyTCB.MySEQ;
+	MyTCB.flags.bInRecovery = 1;
+
+	// Roll back unacknowledged TX tail pointer to cause retransmit to occur
+	MyTCB.MySEQ -=
+		(LONG) (SHORT) (MyTCB.txUnackedTail - MyTCBStub.txTail);
+	if (MyTCB.txUnackedTail < MyTCBStub.txTail)
+		MyTCB.MySEQ -=
+			(LONG) (SHORT) (MyTCBStub.bufferRxStart -
+							MyTCBStub.bufferTxStart);
+	MyTCB.txUnackedTail = MyTCBStub.txTail;
+}
+
+
+
 /*********************************************************************
 * Function:        static void HandleTCPSeg(TCP_HEADER *h, WORD len)
 *
@@ -1828,6 +2840,7 @@ static void HandleTCPSeg(TCP_HEADER * h, WORD len)
 			MyTCB.remoteWindow = h->Window;
 
 			if (localHeaderFlags & ACK) {
+				UpdateRTO(localAckNumber);
 				SendTCP(ACK, SENDTCP_RESET_TIMERS);
 				MyTCBStub.smState = TCP_ESTABLISHED;
 				MyTCBStub.Flags.bTimerEnabled = 0;
@@ -1838,6 +2851,8 @@ static void HandleTCPSeg(TCP_HEADER * h, WORD len)
 		}
 		// Fifth: drop the segment if neither SYN or RST is set
 		return;
+		default:
+			break;
 	}
 
 	//
@@ -1966,13 +2981,37 @@ static void HandleTCPSeg(TCP_HEADER * h, WORD len)
 				MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart)) {
 			MyTCBStub.Flags.bHalfFullFlush = FALSE;
 
+			MyTCB.dupACKCount = 0;
+			if (MyTCB.flags.bInRecovery
+				&& (LONG) (localAckNumber - MyTCB.recoverSEQ) >= (LONG) 0)
+				MyTCB.flags.bInRecovery = 0;
+
 			// Bytes ACKed, free up the TX FIFO space
 			MyTCBStub.txTail += dwTemp;
 			if (MyTCBStub.txTail >= MyTCBStub.bufferRxStart) {
 				MyTCBStub.txTail -=
 					MyTCBStub.bufferRxStart - MyTCBStub.bufferTxStart;
 			}
+		} else if ((dwTemp == 0u) && (len == 0u)
+				   && !(localHeaderFlags & (SYN | FIN))
+				   && (h->Window == MyTCB.remoteWindow)
+				   && (MyTCB.txUnackedTail != MyTCBStub.txTail)) {
+			// A pure ACK that acknowledges nothing new while we have 
+			// data in flight means the remote node received a segment 
+			// beyond a hole.  After TCP_DUP_ACK_THRESHOLD of them, 
+			// retransmit from txTail without waiting for the RTO, 
+			// unless this loss has already been recovered from.
+			TCPStats.dwDupACKs++;
+			if (MyTCB.dupACKCount != 0xFFu)
+				MyTCB.dupACKCount++;
+			if (MyTCB.dupACKCount == TCP_DUP_ACK_THRESHOLD
+				&& !MyTCB.flags.bInRecovery) {
+				TCPStats.dwFastRetransmits++;
+				RewindUnackedData();
+				SendTCP(PSH | ACK, 0);
+			}
 		}
+		UpdateRTO(localAckNumber);
 		// No need to keep our retransmit timer going if we have nothing that needs ACKing anymore
 		if (MyTCBStub.txTail == MyTCBStub.txHead) {
 			// Make sure there isn't a "FIN byte in our TX FIFO"
@@ -2049,6 +3088,8 @@ static void HandleTCPSeg(TCP_HEADER * h, WORD len)
 //          // Nothing is supposed to arrive here.  If it does, reset the quiet timer.
 //          SendTCP(ACK, SENDTCP_RESET_TIMERS);
 //          return;
+		default:
+			break;
 	}
 
 	//
@@ -2302,6 +3343,8 @@ static void HandleTCPSeg(TCP_HEADER * h, WORD len)
 				SendTCP(ACK, 0);
 				CloseSocket();
 				return;
+				default:
+					break;
 			}
 
 			// Acknowledge receipt of FIN
@@ -2341,6 +3384,10 @@ static void HandleTCPSeg(TCP_HEADER * h, WORD len)
  *					the destination start address is at a lower 
  *					memory address (closer to 0x0000) than the 
  *					source pointer.
+ *
+ *					Ethernet RAM to Ethernet RAM copies are done by the 
+ *					DMA and may still be in progress when this function 
+ *					returns.
 ********************************************************************/
 static void TCPRAMCopy(void *ptrDest, unsigned char vDestType,
 					   void *ptrSource, unsigned char vSourceType,
@@ -2382,9 +3429,12 @@ static void TCPRAMCopy(void *ptrDest, unsigned char vDestType,
 			break;
 
 		case TCP_ETH_RAM:
+			// Left running in the background: SendTCP() builds the headers 
+			// and HandleTCPSeg() updates the FIFO pointers while the DMA 
+			// moves the payload.  The MAC layer waits for the copy to 
+			// finish before the next EDATA access.
 			MACMemCopyAsync((PTR_BASE) ptrDest, (PTR_BASE) ptrSource,
 							wLength);
-			while(!MACIsMemCopyDone());
 			break;
 
 #if defined(SPIRAM_CS_TRIS)
@@ -59,9 +59,29 @@
 
 #define TX_PERFORMANCE_PORT	9762
 #define RX_PERFORMANCE_PORT	9763
+#define API_BENCHMARK_PORT	9764
+
+// Calls timed per API in TCPAPIBenchmarkTask().  The client must 
+// send at least this many bytes to start a run.
+#define API_BENCHMARK_CALLS	32u
+
+#if defined(HOST_BUILD)
+	// One Tick of the host build is 25.6us, too coarse for a few calls 
+	// of a PC; time them with the clock behind it (HostTick.c)
+QWORD HostGetNanoseconds(void);
+#define BenchmarkTime()			((DWORD)HostGetNanoseconds())
+#define BENCHMARK_SHIFT			0
+#define BENCHMARK_UNIT			" ns/call\r\n"
+#else
+	// TickGet() advances once per 256 instruction cycles
+#define BenchmarkTime()			TickGet()
+#define BENCHMARK_SHIFT			8
+#define BENCHMARK_UNIT			" cycles/call\r\n"
+#endif
 
 void TCPTXPerformanceTask(void);
 void TCPRXPerformanceTask(void);
+void TCPAPIBenchmarkTask(void);
 
 /*********************************************************************
  * Function:        void TCPPerformanceTask(void)
@@ -83,6 +103,7 @@ void TCPPerformanceTask(void)
 {
 	TCPTXPerformanceTask();
 	TCPRXPerformanceTask();
+	TCPAPIBenchmarkTask();
 }
 
 void TCPTXPerformanceTask(void)
@@ -231,4 +252,122 @@ void TCPRXPerformanceTask(void)
 
 }
 
+/*********************************************************************
+ * Function:        void TCPAPIBenchmarkTask(void)
+ *
+ * PreCondition:    Stack is initialized()
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Listens on API_BENCHMARK_PORT.  Each time the 
+ *					client sends API_BENCHMARK_CALLS or more bytes, 
+ *					the instruction cycles spent per TCPIsConnected(), 
+ *					TCPGetArray() and TCPPutArray() call are measured 
+ *					and reported back as a text line tagged with the 
+ *					TCB storage mode (SIZE or SPEED, see TCP.c).
+ *
+ * Note:            Every timed call is preceded by a TCPIsConnected() 
+ *					on another socket so that each call pays for a 
+ *					socket switch, as it does when several sockets 
+ *					are serviced round-robin.  The cost of that 
+ *					switch call is measured first and subtracted.  
+ *					The host build reports nanoseconds instead of 
+ *					instruction cycles.
+ ********************************************************************/
+void TCPAPIBenchmarkTask(void)
+{
+	static TCP_SOCKET MySocket = INVALID_SOCKET;
+	TCP_SOCKET hOther, hOther2;
+	unsigned char vBuffer[12];
+	unsigned char i;
+	DWORD dwStart;
+	DWORD dwSwitch, dwIsConnected, dwGetArray, dwPutArray;
+
+	if (MySocket == INVALID_SOCKET) {
+		MySocket =
+			TCPOpen(0, TCP_OPEN_SERVER, API_BENCHMARK_PORT,
+					TCP_PURPOSE_DEFAULT);
+		if (MySocket == INVALID_SOCKET)
+			return;
+	}
+
+	if (!TCPIsConnected(MySocket))
+		return;
+	if (TCPIsGetReady(MySocket) < API_BENCHMARK_CALLS)
+		return;
+	if (TCPIsPutReady(MySocket) < API_BENCHMARK_CALLS * 2u + 80u)
+		return;
+
+	// Any other socket handles will do; TCPIsConnected() only reads them
+	hOther = (MySocket == 0u) ? 1 : 0;
+	hOther2 = (MySocket >= 2u) ? 1 : 2;
+	vBuffer[0] = '.';
+
+	// Baseline: API_BENCHMARK_CALLS TCPIsConnected() calls that each 
+	// switch sockets
+	dwStart = BenchmarkTime();
+	for (i = 0; i < API_BENCHMARK_CALLS / 2u; i++) {
+		TCPIsConnected(hOther);
+		TCPIsConnected(hOther2);
+	}
+	dwSwitch = BenchmarkTime() - dwStart;
+
+	dwStart = BenchmarkTime();
+	for (i = 0; i < API_BENCHMARK_CALLS; i++) {
+		TCPIsConnected(hOther);
+		TCPIsConnected(MySocket);
+	}
+	dwIsConnected = BenchmarkTime() - dwStart;
+
+	dwStart = BenchmarkTime();
+	for (i = 0; i < API_BENCHMARK_CALLS; i++) {
+		TCPIsConnected(hOther);
+		TCPGetArray(MySocket, vBuffer + 1, 1);
+	}
+	dwGetArray = BenchmarkTime() - dwStart;
+
+	dwStart = BenchmarkTime();
+	for (i = 0; i < API_BENCHMARK_CALLS; i++) {
+		TCPIsConnected(hOther);
+		TCPPutArray(MySocket, vBuffer, 1);
+	}
+	dwPutArray = BenchmarkTime() - dwStart;
+
+	// Convert to time per call, less the switch overhead.  A loop can 
+	// come out faster than the baseline by the clock's jitter.
+	if (dwIsConnected < dwSwitch)
+		dwIsConnected = dwSwitch;
+	if (dwGetArray < dwSwitch)
+		dwGetArray = dwSwitch;
+	if (dwPutArray < dwSwitch)
+		dwPutArray = dwSwitch;
+	dwIsConnected =
+		((dwIsConnected - dwSwitch) << BENCHMARK_SHIFT) / API_BENCHMARK_CALLS;
+	dwGetArray =
+		((dwGetArray - dwSwitch) << BENCHMARK_SHIFT) / API_BENCHMARK_CALLS;
+	dwPutArray =
+		((dwPutArray - dwSwitch) << BENCHMARK_SHIFT) / API_BENCHMARK_CALLS;
+
+#if defined(TCP_OPTIMIZE_FOR_SPEED)
+	TCPPutROMString(MySocket, (const unsigned char *) "\r\nSPEED");
+#else
+	TCPPutROMString(MySocket, (const unsigned char *) "\r\nSIZE");
+#endif
+	TCPPutROMString(MySocket, (const unsigned char *) " TCPIsConnected=");
+	ultoa(dwIsConnected, vBuffer);
+	TCPPutString(MySocket, vBuffer);
+	TCPPutROMString(MySocket, (const unsigned char *) " TCPGetArray=");
+	ultoa(dwGetArray, vBuffer);
+	TCPPutString(MySocket, vBuffer);
+	TCPPutROMString(MySocket, (const unsigned char *) " TCPPutArray=");
+	ultoa(dwPutArray, vBuffer);
+	TCPPutString(MySocket, vBuffer);
+	TCPPutROMString(MySocket, (const unsigned char *) BENCHMARK_UNIT);
+	TCPFlush(MySocket);
+}
+
 #endif							//#if defined(STACK_USE_TCP_PERFORMANCE_TEST)
@@ -43,14 +43,22 @@ void TickInit(void)
 }
 static void GetTickCopy(void)
 {
+	unsigned char GIEHSave;
+
 	// Perform an Interrupt safe and synchronized read of the 48-bit 
 	// tick value
 	do {
 		INTCONbits.TMR0IE = 1;	// Enable interrupt
 		Nop();
 		INTCONbits.TMR0IE = 0;	// Disable interrupt
+		// MACISR() also reads Timer0; keep it from re-latching TMR0H 
+		// between these two reads.  Callers may already have 
+		// interrupts disabled, so only restore what was there.
+		GIEHSave = INTCON & 0x80;	// Save GIEH bit
+		INTCONbits.GIEH = 0;
 		vTickReading[0] = TMR0L;
 		vTickReading[1] = TMR0H;
+		INTCON |= GIEHSave;			// Restore GIEH value
 		*((DWORD *) & vTickReading[2]) = dwInternalTicks;
 	} while (INTCONbits.TMR0IF);
 	INTCONbits.TMR0IE = 1;		// Enable interrupt
@@ -23,6 +23,12 @@
 #define LOCAL_UDP_PORT_START_NUMBER (4096u)
 #define LOCAL_UDP_PORT_END_NUMBER   (8192u)
 
+#if !defined(UDP_RX_QUEUE_MIN_FREE)
+#define UDP_RX_QUEUE_MIN_FREE		(MAC_RX_BUFFER_SIZE/4)
+#endif
+
+extern NODE_INFO remoteNode;
+
 
 UDP_SOCKET_INFO UDPSocketInfo[MAX_UDP_SOCKETS];
 UDP_SOCKET activeUDPSocket;
@@ -30,16 +36,17 @@ WORD UDPTxCount;
 WORD UDPRxCount;
 static UDP_SOCKET LastPutSocket = INVALID_UDP_SOCKET;
 static WORD wPutOffset;
-static struct {
-	unsigned char bFirstRead:1;
-	unsigned char bWasDiscarded:1;
-} Flags;
+// Socket whose oldest datagram UDPIsGetReady() opened for UDPGet(), 
+// until UDPDiscard() releases it
 static UDP_SOCKET SocketWithRxData = INVALID_UDP_SOCKET;
 
 
 static UDP_SOCKET FindMatchingSocket(UDP_HEADER * h,
 									 NODE_INFO * remoteNode,
-									 IP_ADDR * localIP);
+									 IP_ADDR * localIP,
+									 BOOL * pbAdoptRemote);
+static void LoadSender(UDP_SOCKET_INFO * p);
+static void ReleaseHead(UDP_SOCKET_INFO * p);
 
 /*********************************************************************
  * Function:        void UDPInit(void)
@@ -61,9 +68,11 @@ void UDPInit(void)
 	volatile UDP_SOCKET s;
 
 	for (s = 0; s < MAX_UDP_SOCKETS; s++) {
+		UDPSocketInfo[s].vRxQueued = 0;
 		UDPClose(s);
 	}
-	Flags.bWasDiscarded = 1;
+	SocketWithRxData = INVALID_UDP_SOCKET;
+	UDPRxCount = 0;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -146,7 +155,8 @@ UDP_SOCKET UDPOpen(UDP_PORT localPort,
  * Side Effects:    None
  *
  * Overview:        Given socket is marked as available for future
- *                  new communcations.
+ *                  new communcations.  Datagrams still queued on it
+ *                  are released.
  *
  * Note:            This function does not affect previous
  *                  active UDP socket designation.
@@ -156,6 +166,12 @@ void UDPClose(UDP_SOCKET s)
 	if (s == INVALID_UDP_SOCKET)
 		return;
 
+	while (UDPSocketInfo[s].vRxQueued)
+		ReleaseHead(&UDPSocketInfo[s]);
+	if (SocketWithRxData == s) {
+		SocketWithRxData = INVALID_UDP_SOCKET;
+		UDPRxCount = 0;
+	}
 	UDPSocketInfo[s].localPort = INVALID_UDP_PORT;
 	UDPSocketInfo[s].remoteNode.IPAddr.Val = 0x00000000;
 }
@@ -429,8 +445,12 @@ void UDPFlush(void)
  *					retrieved.  0 if no data received on this socket.
  *
  * Side Effects:    Given socket is set as an active UDP Socket.
+ *					remoteNode is loaded with the sender of the 
+ *					datagram, as StackTask() does for the frame it is 
+ *					processing.
  *
- * Overview:        None
+ * Overview:        Opens the oldest datagram queued on the socket for 
+ *					UDPGet() and UDPGetArray().
  *
  * Note:            This function automatically sets supplied socket
  *                  as an active socket.  Caller need not call
@@ -440,10 +460,21 @@ void UDPFlush(void)
  ********************************************************************/
 WORD UDPIsGetReady(UDP_SOCKET s)
 {
+	UDP_SOCKET_INFO *p;
+
 	activeUDPSocket = s;
-	if (SocketWithRxData != s)
+	p = &UDPSocketInfo[s];
+	if (p->vRxQueued == 0u) {
+		if (SocketWithRxData == s) {
+			SocketWithRxData = INVALID_UDP_SOCKET;
+			UDPRxCount = 0;
+		}
 		return 0;
+	}
 
+	LoadSender(p);
+	SocketWithRxData = s;
+	UDPRxCount = p->RxQueue[0].wRemaining;
 	return UDPRxCount;
 }
 
@@ -467,19 +498,21 @@ WORD UDPIsGetReady(UDP_SOCKET s)
  ********************************************************************/
 BOOL UDPGet(unsigned char *v)
 {
+	UDP_RX_DESCRIPTOR *d;
+
 	// Make sure that there is data to return
-	if (UDPRxCount == 0u || (SocketWithRxData != activeUDPSocket))
+	if (SocketWithRxData == INVALID_UDP_SOCKET
+		|| SocketWithRxData != activeUDPSocket)
 		return FALSE;
 
-	// If if this very first read to packet, set MAC Rx Pointer to
-	// beginig of UDP data area.
-	if (Flags.bFirstRead) {
-		Flags.bFirstRead = 0;
-		UDPSetRxBuffer(0);
-	}
+	// The datagram stays in the MAC RX buffer; other frames may have 
+	// moved the read pointer since the last call
+	d = &UDPSocketInfo[SocketWithRxData].RxQueue[0];
+	MACSetReadPtrInHeldRx(d->hFrame, d->wReadOffset);
 
 	*v = MACGet();
-	UDPRxCount--;
+	d->wReadOffset++;
+	UDPRxCount = --d->wRemaining;
 
 	if (UDPRxCount == 0u) {
 		UDPDiscard();
@@ -508,22 +541,24 @@ BOOL UDPGet(unsigned char *v)
  ********************************************************************/
 WORD UDPGetArray(unsigned char *cData, WORD wDataLen)
 {
+	UDP_RX_DESCRIPTOR *d;
+
 	// Make sure that there is data to return
-	if (UDPRxCount == 0u || (SocketWithRxData != activeUDPSocket))
+	if (SocketWithRxData == INVALID_UDP_SOCKET
+		|| SocketWithRxData != activeUDPSocket)
 		return 0;
 
-	// If this is the very first read of the packet, set MAC Rx Pointer to
-	// beginig of UDP data area.
-	if (Flags.bFirstRead) {
-		Flags.bFirstRead = 0;
-		UDPSetRxBuffer(0);
-	}
+	d = &UDPSocketInfo[SocketWithRxData].RxQueue[0];
+	MACSetReadPtrInHeldRx(d->hFrame, d->wReadOffset);
+
 	// Make sure we don't try to read more data than exists
-	if (UDPRxCount < wDataLen)
-		wDataLen = UDPRxCount;
+	if (d->wRemaining < wDataLen)
+		wDataLen = d->wRemaining;
 
 	wDataLen = MACGetArray(cData, wDataLen);
-	UDPRxCount -= wDataLen;
+	d->wReadOffset += wDataLen;
+	d->wRemaining -= wDataLen;
+	UDPRxCount = d->wRemaining;
 
 	if (UDPRxCount == 0u) {
 		UDPDiscard();
@@ -543,22 +578,146 @@ WORD UDPGetArray(unsigned char *cData, WORD wDataLen)
  *
  * Side Effects:    None
  *
- * Overview:        This function discards any UDP socket Rx content, 
- *					if any.
+ * Overview:        This function discards the datagram opened by the 
+ *					last UDPIsGetReady() call, if any, and gives its 
+ *					space back to the MAC.
  *
  * Note:            It is safe to call this function more than needed.  
  *					If no data is available, this function does 
- *					nothing.
+ *					nothing.  Datagrams queued behind the discarded one 
+ *					wait for the next UDPIsGetReady().
  ********************************************************************/
 void UDPDiscard(void)
 {
-	if (!Flags.bWasDiscarded) {
-		MACDiscardRx();
-		UDPRxCount = 0;
-		Flags.bWasDiscarded = 1;
+	if (SocketWithRxData == INVALID_UDP_SOCKET)
+		return;
+
+	ReleaseHead(&UDPSocketInfo[SocketWithRxData]);
+	SocketWithRxData = INVALID_UDP_SOCKET;
+	UDPRxCount = 0;
+}
+
+/*********************************************************************
+ * Function:        static void LoadSender(UDP_SOCKET_INFO *p)
+ *
+ * PreCondition:    p->vRxQueued > 0
+ *
+ * Input:           p       - Socket with a datagram queued
+ *
+ * Output:          None
+ *
+ * Side Effects:    remoteNode is overwritten
+ *
+ * Overview:        Reads the sender of the oldest queued datagram from 
+ *					its frame into remoteNode.  A socket the datagram 
+ *					only matched by local port also takes the sender as 
+ *					its remote node and port, the first time.
+ *
+ * Note:            None
+ ********************************************************************/
+static void LoadSender(UDP_SOCKET_INFO * p)
+{
+	UDP_RX_DESCRIPTOR *d;
+	WORD_VAL port;
+
+	d = &p->RxQueue[0];
+
+	// Ethernet source address, then IP source address
+	MACSetReadPtrInHeldRx(d->hFrame, sizeof(MAC_ADDR));
+	MACGetArray(remoteNode.MACAddr.v, sizeof(remoteNode.MACAddr));
+	MACSetReadPtrInHeldRx(d->hFrame, sizeof(ETHER_HEADER) + 12);
+	MACGetArray(remoteNode.IPAddr.v, sizeof(remoteNode.IPAddr));
+
+	// Nothing was read yet, so the UDP header is right in front
+	if (d->bAdoptRemote) {
+		d->bAdoptRemote = FALSE;
+		MACSetReadPtrInHeldRx(d->hFrame,
+							  d->wReadOffset - sizeof(UDP_HEADER));
+		port.v[1] = MACGet();
+		port.v[0] = MACGet();
+		memcpy((void *) &p->remoteNode,
+			   (const void *) &remoteNode, sizeof(p->remoteNode));
+		p->remotePort = port.Val;
 	}
 }
 
+/*********************************************************************
+ * Function:        static void ReleaseHead(UDP_SOCKET_INFO *p)
+ *
+ * PreCondition:    p->vRxQueued > 0
+ *
+ * Input:           p       - Socket with a datagram queued
+ *
+ * Output:          None
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Hands the oldest datagram of the socket back to the 
+ *					MAC and moves the rest of the queue up.
+ *
+ * Note:            None
+ ********************************************************************/
+static void ReleaseHead(UDP_SOCKET_INFO * p)
+{
+	unsigned char i;
+
+	MACReleaseRx(p->RxQueue[0].hFrame);
+	p->vRxQueued--;
+	for (i = 0; i < p->vRxQueued; i++)
+		p->RxQueue[i] = p->RxQueue[i + 1];
+}
+
+/*********************************************************************
+ * Function:        void UDPTrimRxQueues(void)
+ *
+ * PreCondition:    UDPInit() is already called
+ *
+ * Input:           None
+ *
+ * Output:          None
+ *
+ * Side Effects:    The datagram opened by UDPIsGetReady() may be 
+ *					dropped, after which UDPGet() returns FALSE.
+ *
+ * Overview:        While less than UDP_RX_QUEUE_MIN_FREE bytes of the 
+ *					MAC RX buffer are free, drops the oldest datagram 
+ *					queued on any socket and counts it in 
+ *					StackRxStats.dwUDPDropped.  The hardware only reuses 
+ *					the buffer up to the oldest held frame, so a 
+ *					datagram left unread would otherwise stop all 
+ *					reception once the ring wraps around to it.
+ *
+ * Note:            StackTask() calls it for every frame it takes.
+ ********************************************************************/
+void UDPTrimRxQueues(void)
+{
+	MAC_RX_HANDLE hFrame;
+	UDP_SOCKET s;
+	UDP_SOCKET_INFO *p;
+
+	while (MACGetFreeRxSize() < UDP_RX_QUEUE_MIN_FREE) {
+		hFrame = MACGetOldestHeldRx();
+		if (hFrame == MAC_RX_INVALID_HANDLE)
+			return;
+
+		// Sockets queue in arrival order, so the oldest frame is at 
+		// the head of one of them
+		p = UDPSocketInfo;
+		for (s = 0; s < MAX_UDP_SOCKETS; s++, p++) {
+			if (p->vRxQueued && p->RxQueue[0].hFrame == hFrame)
+				break;
+		}
+		if (s == MAX_UDP_SOCKETS)
+			return;
+
+		if (SocketWithRxData == s) {
+			SocketWithRxData = INVALID_UDP_SOCKET;
+			UDPRxCount = 0;
+		}
+		ReleaseHead(p);
+		StackRxStats.dwUDPDropped++;
+	}
+}
 
 /*********************************************************************
  * Function:        BOOL UDPProcess(NODE_INFO* remoteNode,
@@ -572,12 +731,18 @@ void UDPDiscard(void)
  *					localIP			- Destination IP address of the packet
  *                  len             - Total length of UDP semgent.
  *
- * Output:          TRUE if a valid packet is waiting
+ * Output:          TRUE if the datagram was queued on its socket
  *                  FALSE if the packet was discarded
  *
  * Side Effects:    None
  *
- * Overview:        None
+ * Overview:        The frame is held in the MAC RX buffer until the 
+ *					application reads or discards the datagram.  It is 
+ *					dropped if it is empty, its socket already has 
+ *					UDP_RX_QUEUE_DEPTH datagrams waiting, the MAC has no 
+ *					hold slot left or less than UDP_RX_QUEUE_MIN_FREE 
+ *					bytes of the RX buffer are free even after 
+ *					UDPTrimRxQueues() dropped the older datagrams.
  *
  * Note:            None
  ********************************************************************/
@@ -585,12 +750,13 @@ BOOL UDPProcess(NODE_INFO * remoteNode, IP_ADDR * localIP, WORD len)
 {
 	UDP_HEADER h;
 	UDP_SOCKET s;
+	UDP_SOCKET_INFO *p;
+	UDP_RX_DESCRIPTOR *d;
 	PSEUDO_HEADER pseudoHeader;
 	DWORD_VAL checksums;
-
-	SocketWithRxData = INVALID_UDP_SOCKET;
-	UDPRxCount = 0;
-	Flags.bFirstRead = 0;
+	BOOL bAdoptRemote;
+	MAC_RX_HANDLE hFrame;
+	WORD wDataOffset;
 
 	// Retrieve UDP header.
 	MACGetArray((unsigned char *) &h, sizeof(h));
@@ -624,19 +790,43 @@ BOOL UDPProcess(NODE_INFO * remoteNode, IP_ADDR * localIP, WORD len)
 		}
 	}
 
-	s = FindMatchingSocket(&h, remoteNode, localIP);
+	s = FindMatchingSocket(&h, remoteNode, localIP, &bAdoptRemote);
 	if (s == INVALID_UDP_SOCKET) {
 		// If there is no matching socket, There is no one to handle
 		// this data.  Discard it.
 		MACDiscardRx();
 		return FALSE;
-	} else {
-		SocketWithRxData = s;
-		UDPRxCount = h.Length;
-		Flags.bFirstRead = 1;
-		Flags.bWasDiscarded = 0;
 	}
 
+	// The data follows the Ethernet, IP (with options) and UDP headers
+	MACSetReadPtrInRx(0);
+	wDataOffset = sizeof(ETHER_HEADER) + ((MACGet() & 0x0F) << 2)
+		+ sizeof(UDP_HEADER);
+
+	p = &UDPSocketInfo[s];
+	if (h.Length == 0u || p->vRxQueued >= UDP_RX_QUEUE_DEPTH)
+		hFrame = MAC_RX_INVALID_HANDLE;
+	else {
+		// Older datagrams make room for this one first
+		UDPTrimRxQueues();
+		if (MACGetFreeRxSize() < UDP_RX_QUEUE_MIN_FREE)
+			hFrame = MAC_RX_INVALID_HANDLE;
+		else
+			hFrame = MACHoldRx();
+	}
+	if (hFrame == MAC_RX_INVALID_HANDLE) {
+		if (h.Length)
+			StackRxStats.dwUDPDropped++;
+		MACDiscardRx();
+		return FALSE;
+	}
+
+	d = &p->RxQueue[p->vRxQueued++];
+	d->hFrame = hFrame;
+	d->wReadOffset = wDataOffset;
+	d->wRemaining = h.Length;
+	d->bAdoptRemote = bAdoptRemote;
+
 
 	return TRUE;
 }
@@ -645,13 +835,18 @@ BOOL UDPProcess(NODE_INFO * remoteNode, IP_ADDR * localIP, WORD len)
 /*********************************************************************
  * Function:        UDP_SOCKET FindMatchingSocket(UDP_HEADER *h,
  *                                NODE_INFO *remoteNode,
- *                                IP_ADDR *localIP)
+ *                                IP_ADDR *localIP,
+ *                                BOOL *pbAdoptRemote)
  *
  * PreCondition:    UDP Segment header has been retrieved from buffer
  *                  The IP header has also been retrieved
  *
  * Input:           remoteNode      - Remote node info from IP header
  *                  h               - header of UDP semgent.
+ *                  pbAdoptRemote   - Set when the socket only matched
+ *                                    by local port and should take
+ *                                    the sender as its remote node
+ *                                    once the datagram is read
  *
  * Output:          matching UDP socket or INVALID_UDP_SOCKET
  *
@@ -663,13 +858,15 @@ BOOL UDPProcess(NODE_INFO * remoteNode, IP_ADDR * localIP, WORD len)
  ********************************************************************/
 static UDP_SOCKET FindMatchingSocket(UDP_HEADER * h,
 									 NODE_INFO * remoteNode,
-									 IP_ADDR * localIP)
+									 IP_ADDR * localIP,
+									 BOOL * pbAdoptRemote)
 {
 	volatile UDP_SOCKET s;
 	UDP_SOCKET partialMatch;
 	UDP_SOCKET_INFO *p;
 
 	partialMatch = INVALID_UDP_SOCKET;
+	*pbAdoptRemote = FALSE;
 
 	p = UDPSocketInfo;
 	for (s = 0; s < MAX_UDP_SOCKETS; s++) {
@@ -692,14 +889,10 @@ static UDP_SOCKET FindMatchingSocket(UDP_HEADER * h,
 		p++;
 	}
 
-	if (partialMatch != INVALID_UDP_SOCKET) {
-		p = &UDPSocketInfo[partialMatch];
-
-		memcpy((void *) &p->remoteNode,
-			   (const void *) remoteNode, sizeof(p->remoteNode));
-
-		p->remotePort = h->SourcePort;
-	}
+	// The remote node changes when the application gets to this datagram, 
+	// not while older ones queued on the socket are still being answered
+	if (partialMatch != INVALID_UDP_SOCKET)
+		*pbAdoptRemote = TRUE;
 	return partialMatch;
 }
 
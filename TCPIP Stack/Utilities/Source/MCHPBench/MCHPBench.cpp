@@ -0,0 +1,492 @@
+/*********************************************************************
+ *
+ *     Load generator and latency benchmark for TCPServer() (port 4321)
+ *
+ *********************************************************************
+ * FileName:        MCHPBench.cpp
+ * Dependencies:    None (Linux sockets and epoll)
+ * Processor:       x86/x86-64 Linux
+ * Compiler:        g++ -O2 -o MCHPBench MCHPBench.cpp
+ *
+ * Every request is one connection, as TCPServer() in ServidorTCP.c
+ * answers "Lecturas" with 4 bytes and disconnects.  A request's latency
+ * runs from its start to the last byte of the reply.
+ *
+ * Closed loop (default): -c connections, each one starting the next
+ * request as soon as the previous one ends.  Measures the sustainable
+ * throughput.
+ * Open loop (-R rate): requests are started on a fixed schedule whatever
+ * the server does, with at most -c in flight.  Requests that cannot
+ * start on time wait, and their latency counts from the time they were
+ * due, so a stalled server shows up in the tail instead of slowing the
+ * load down (no coordinated omission).
+ *
+ * Latencies go into a log-linear histogram in the style of
+ * HdrHistogram: exact below 2048 us, then 1024 sub-buckets per power of
+ * two (3 significant digits) up to 2^37 us.
+ *
+ * "make bench" in Host/ runs this against the host build of the stack.
+ *
+ * Usage: MCHPBench [options] board_address
+ *  -p port    measurement port (4321)
+ *  -c n       connections in flight (1)
+ *  -R rate    open loop at rate requests/s (0 = closed loop)
+ *  -d s       measured duration (10)
+ *  -w s       warm-up, not measured (1)
+ *  -t ms      request timeout (2000)
+ *  -m text    request (Lecturas)
+ *  -o file    write the percentile distribution as CSV
+ ********************************************************************/
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+#define MEASURE_PORT		4321
+#define REPLY_SIZE			4u		// RH MSB, RH LSB, T MSB, T LSB
+
+/*********************************************************************
+ * Latency histogram
+ ********************************************************************/
+#define HIST_SUB_BITS		10u						// 1024 sub-buckets per octave
+#define HIST_LINEAR			(2u << HIST_SUB_BITS)	// Values recorded exactly
+#define HIST_OCTAVES		27u						// 2048 us .. 2^37 us
+#define HIST_SIZE			(HIST_LINEAR + HIST_OCTAVES * (1u << HIST_SUB_BITS))
+
+class Histogram
+{
+public:
+	Histogram() : Counts(HIST_SIZE, 0), qwTotal(0), qwMax(0), dSum(0.0) {}
+
+	void Record(uint64_t v)
+	{
+		Counts[Index(v)]++;
+		qwTotal++;
+		dSum += (double) v;
+		if (v > qwMax)
+			qwMax = v;
+	}
+	uint64_t Total() const { return qwTotal; }
+	uint64_t Max() const { return qwMax; }
+	double Mean() const { return qwTotal ? dSum / (double) qwTotal : 0.0; }
+
+	// Highest value of the bucket holding the p-th percentile
+	uint64_t Percentile(double p) const
+	{
+		uint64_t qwRank, qwSeen = 0;
+		unsigned int i;
+
+		if (!qwTotal)
+			return 0;
+		qwRank = (uint64_t) ceil(p / 100.0 * (double) qwTotal);
+		if (qwRank < 1)
+			qwRank = 1;
+		for (i = 0; i < HIST_SIZE; i++) {
+			qwSeen += Counts[i];
+			if (qwSeen >= qwRank)
+				return Highest(i) < qwMax ? Highest(i) : qwMax;
+		}
+		return qwMax;
+	}
+
+	// HdrHistogram style percentile distribution
+	void WriteDistribution(FILE *f) const
+	{
+		static const double Points[] = {0, 10, 20, 30, 40, 50, 55, 60, 65, 70, 75,
+			77.5, 80, 82.5, 85, 87.5, 88.75, 90, 91.25, 92.5, 93.75, 94.375, 95,
+			95.625, 96.25, 96.875, 97.1875, 97.5, 97.8125, 98.125, 98.4375,
+			98.59375, 98.75, 98.90625, 99, 99.21875, 99.375, 99.53125, 99.6,
+			99.7, 99.8, 99.9, 99.95, 99.99, 99.999, 100};
+		unsigned int i;
+
+		fprintf(f, "latency_us,percentile,count_below\n");
+		for (i = 0; i < sizeof(Points) / sizeof(Points[0]); i++) {
+			uint64_t v = Percentile(Points[i]);
+			fprintf(f, "%llu,%.6f,%llu\n", (unsigned long long) v, Points[i] / 100.0,
+				(unsigned long long) CountAtOrBelow(v));
+		}
+	}
+
+private:
+	std::vector<uint64_t> Counts;
+	uint64_t qwTotal;
+	uint64_t qwMax;
+	double dSum;
+
+	static unsigned int Index(uint64_t v)
+	{
+		unsigned int e;
+
+		if (v < HIST_LINEAR)
+			return (unsigned int) v;
+		e = 63u - __builtin_clzll(v) - HIST_SUB_BITS;		// >= 1
+		if (e > HIST_OCTAVES)
+			return HIST_SIZE - 1u;
+		return HIST_LINEAR + (e - 1u) * (1u << HIST_SUB_BITS)
+			+ (unsigned int) ((v >> e) - (1u << HIST_SUB_BITS));
+	}
+	static uint64_t Highest(unsigned int i)
+	{
+		unsigned int e;
+
+		if (i < HIST_LINEAR)
+			return i;
+		i -= HIST_LINEAR;
+		e = i / (1u << HIST_SUB_BITS) + 1u;
+		return ((uint64_t) ((i % (1u << HIST_SUB_BITS)) + (1u << HIST_SUB_BITS) + 1u) << e) - 1u;
+	}
+	uint64_t CountAtOrBelow(uint64_t v) const
+	{
+		uint64_t n = 0;
+		unsigned int i, iLast = Index(v);
+
+		for (i = 0; i <= iLast; i++)
+			n += Counts[i];
+		return n;
+	}
+};
+
+/*********************************************************************
+ * Load generator
+ ********************************************************************/
+// After the reply a connection waits for the server to close it, so
+// TIME_WAIT stays on the server side and long runs keep their local ports
+enum {CONN_IDLE = 0, CONN_CONNECTING, CONN_READING, CONN_CLOSING};
+
+struct CONN {
+	int fd;
+	unsigned int vGeneration;	// Invalidates stale deadline entries
+	unsigned char vState;
+	unsigned char vReceived;
+	unsigned char Reply[REPLY_SIZE];
+	uint64_t qwDueUs;			// When the request should have started
+	uint64_t qwDeadlineUs;
+};
+
+struct TIMER {
+	uint64_t qwDueUs;
+	unsigned int iConn;
+	unsigned int vGeneration;
+};
+
+struct STATS {
+	uint64_t qwCompleted;		// 4-byte replies
+	uint64_t qwConnectFailures;	// Refused, reset or unreachable before connecting
+	uint64_t qwTimeouts;
+	uint64_t qwShort;			// Closed or reset after connecting, before 4 bytes
+	uint64_t qwSensorErrors;	// Replies carrying the FF FF failure marker
+	uint64_t qwLate;			// Open loop: started after their due time
+	Histogram Latency;
+	Histogram Connect;			// Connection establishment only
+};
+
+static volatile sig_atomic_t bStop;
+static int ep;
+static struct sockaddr_in Server;
+static const char *szRequest = "Lecturas";
+static unsigned int dwTimeoutMs = 2000;
+static std::vector<CONN> Conns;
+static std::vector<unsigned int> FreeConns;
+static std::deque<TIMER> Deadlines;
+static STATS Stat;
+static bool bMeasuring;
+
+static uint64_t NowUs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000ull + (uint64_t) ts.tv_nsec / 1000ull;
+}
+
+static void OnSignal(int)
+{
+	bStop = 1;
+}
+
+static void Finish(unsigned int iConn, uint64_t *pCounter)
+{
+	CONN &c = Conns[iConn];
+
+	if (c.fd >= 0) {
+		close(c.fd);
+		c.fd = -1;
+	}
+	c.vGeneration++;
+	c.vState = CONN_IDLE;
+	FreeConns.push_back(iConn);
+	if (bMeasuring && pCounter)
+		(*pCounter)++;
+}
+
+// Starts a request that was due at qwDueUs on a free connection slot
+static void Start(uint64_t qwDueUs)
+{
+	struct epoll_event ev;
+	unsigned int iConn;
+	int on = 1;
+
+	iConn = FreeConns.back();
+	FreeConns.pop_back();
+	CONN &c = Conns[iConn];
+	c.vGeneration++;
+	c.vReceived = 0;
+	c.qwDueUs = qwDueUs;
+	c.qwDeadlineUs = NowUs() + (uint64_t) dwTimeoutMs * 1000ull;
+	c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+	if (c.fd < 0) {
+		Finish(iConn, &Stat.qwConnectFailures);
+		return;
+	}
+	setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	if (connect(c.fd, (struct sockaddr *) &Server, sizeof(Server)) < 0 && errno != EINPROGRESS) {
+		Finish(iConn, &Stat.qwConnectFailures);
+		return;
+	}
+	c.vState = CONN_CONNECTING;
+	ev.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP;
+	ev.data.u32 = iConn;
+	epoll_ctl(ep, EPOLL_CTL_ADD, c.fd, &ev);
+	TIMER t = {c.qwDeadlineUs, iConn, c.vGeneration};
+	Deadlines.push_back(t);
+}
+
+static void OnEvent(unsigned int iConn, uint32_t dwEvents)
+{
+	CONN &c = Conns[iConn];
+	unsigned char Discard[64];
+	struct epoll_event ev;
+	socklen_t errlen;
+	int err = 0, len;
+	size_t n;
+
+	if (c.vState == CONN_CONNECTING) {
+		errlen = sizeof(err);
+		getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+		if (err) {
+			Finish(iConn, &Stat.qwConnectFailures);
+			return;
+		}
+		if (!(dwEvents & EPOLLOUT))
+			return;
+		if (bMeasuring)
+			Stat.Connect.Record(NowUs() - c.qwDueUs);
+		// TCPServer() compares the whole segment with strcmp(): one send
+		n = strlen(szRequest);
+		if (send(c.fd, szRequest, n, MSG_NOSIGNAL) != (ssize_t) n) {
+			Finish(iConn, &Stat.qwShort);
+			return;
+		}
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.u32 = iConn;
+		epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+		c.vState = CONN_READING;
+		return;
+	}
+
+	for (;;) {
+		if (c.vState == CONN_CLOSING)
+			len = recv(c.fd, Discard, sizeof(Discard), 0);
+		else
+			len = recv(c.fd, c.Reply + c.vReceived, REPLY_SIZE - c.vReceived, 0);
+		if (len > 0) {
+			if (c.vState == CONN_CLOSING)
+				continue;
+			c.vReceived += len;
+			if (c.vReceived == REPLY_SIZE) {
+				if (bMeasuring) {
+					Stat.Latency.Record(NowUs() - c.qwDueUs);
+					Stat.qwCompleted++;
+					// Medicion_HT() reports a sensor that did not answer as FF FF
+					if ((c.Reply[0] == 0xFF && c.Reply[1] == 0xFF) || (c.Reply[2] == 0xFF && c.Reply[3] == 0xFF))
+						Stat.qwSensorErrors++;
+				}
+				c.vState = CONN_CLOSING;
+			}
+			continue;
+		}
+		if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		Finish(iConn, c.vState == CONN_CLOSING ? NULL : &Stat.qwShort);
+		return;
+	}
+}
+
+static void RunTimers(uint64_t qwNow)
+{
+	while (!Deadlines.empty() && Deadlines.front().qwDueUs <= qwNow) {
+		TIMER t = Deadlines.front();
+		Deadlines.pop_front();
+		if (Conns[t.iConn].vGeneration == t.vGeneration)
+			Finish(t.iConn, Conns[t.iConn].vState == CONN_CLOSING ? NULL : &Stat.qwTimeouts);
+	}
+	while (!Deadlines.empty() && Conns[Deadlines.front().iConn].vGeneration != Deadlines.front().vGeneration)
+		Deadlines.pop_front();
+}
+
+static void Usage(void)
+{
+	fprintf(stderr,
+		"Usage: MCHPBench [-p port] [-c connections] [-R rate] [-d seconds]\n"
+		"                 [-w warmup_s] [-t timeout_ms] [-m request] [-o file.csv]\n"
+		"                 board_address\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int wPort = MEASURE_PORT, dwConns = 1, dwDurationS = 10, dwWarmupS = 1;
+	double dRate = 0.0, dSeconds;
+	const char *szOut = NULL;
+	struct epoll_event Events[256];
+	struct rlimit rl;
+	uint64_t qwNow, qwMeasure, qwEnd, qwNextDue = 0, qwPeriodNs = 0, qwDueNs = 0;
+	std::deque<uint64_t> Backlog;		// Open loop: due but not started
+	unsigned int i;
+	int c, n, wait;
+	FILE *f;
+
+	while ((c = getopt(argc, argv, "p:c:R:d:w:t:m:o:")) != -1) {
+		switch (c) {
+		case 'p': wPort = strtoul(optarg, NULL, 0); break;
+		case 'c': dwConns = strtoul(optarg, NULL, 0); break;
+		case 'R': dRate = strtod(optarg, NULL); break;
+		case 'd': dwDurationS = strtoul(optarg, NULL, 0); break;
+		case 'w': dwWarmupS = strtoul(optarg, NULL, 0); break;
+		case 't': dwTimeoutMs = strtoul(optarg, NULL, 0); break;
+		case 'm': szRequest = optarg; break;
+		case 'o': szOut = optarg; break;
+		default: Usage();
+		}
+	}
+	if (optind != argc - 1 || dwConns == 0 || dwDurationS == 0 || dwTimeoutMs == 0 || dRate < 0.0)
+		Usage();
+	memset(&Server, 0, sizeof(Server));
+	Server.sin_family = AF_INET;
+	Server.sin_port = htons(wPort);
+	if (!inet_aton(argv[optind], &Server.sin_addr))
+		Usage();
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	if (ep < 0) {
+		perror("epoll_create1");
+		return 1;
+	}
+	Conns.resize(dwConns);
+	for (i = dwConns; i-- > 0;) {
+		Conns[i].fd = -1;
+		FreeConns.push_back(i);
+	}
+
+	fprintf(stderr, "%s:%u, %u connections, %s", inet_ntoa(Server.sin_addr), wPort, dwConns,
+		dRate > 0.0 ? "open loop at " : "closed loop\n");
+	if (dRate > 0.0)
+		fprintf(stderr, "%.1f requests/s\n", dRate);
+
+	qwNow = NowUs();
+	qwMeasure = qwNow + (uint64_t) dwWarmupS * 1000000ull;
+	qwEnd = qwMeasure + (uint64_t) dwDurationS * 1000000ull;
+	if (dRate > 0.0) {
+		qwPeriodNs = (uint64_t) (1e9 / dRate);
+		if (qwPeriodNs == 0)
+			qwPeriodNs = 1;
+		qwDueNs = qwNow * 1000ull;
+		qwNextDue = qwNow;
+	}
+	bMeasuring = dwWarmupS == 0;
+
+	while (!bStop) {
+		qwNow = NowUs();
+		if (!bMeasuring && qwNow >= qwMeasure)
+			bMeasuring = true;
+		if (qwNow >= qwEnd)
+			break;
+		RunTimers(qwNow);
+
+		if (dRate > 0.0) {
+			while (qwNextDue <= qwNow) {
+				Backlog.push_back(qwNextDue);
+				qwDueNs += qwPeriodNs;
+				qwNextDue = qwDueNs / 1000ull;
+			}
+			while (!Backlog.empty() && !FreeConns.empty()) {
+				if (bMeasuring && qwNow > Backlog.front() + 1000ull)
+					Stat.qwLate++;
+				Start(Backlog.front());
+				Backlog.pop_front();
+			}
+		} else {
+			while (!FreeConns.empty())
+				Start(NowUs());
+		}
+
+		wait = 100;
+		if (dRate > 0.0 && qwNextDue > qwNow && (qwNextDue - qwNow) / 1000ull < (uint64_t) wait)
+			wait = (int) ((qwNextDue - qwNow) / 1000ull);
+		if (!Deadlines.empty() && Deadlines.front().qwDueUs > qwNow
+			&& (Deadlines.front().qwDueUs - qwNow) / 1000ull < (uint64_t) wait)
+			wait = (int) ((Deadlines.front().qwDueUs - qwNow) / 1000ull);
+		if (dRate > 0.0 && !Backlog.empty() && !FreeConns.empty())
+			wait = 0;
+		n = epoll_wait(ep, Events, sizeof(Events) / sizeof(Events[0]), wait);
+		for (c = 0; c < n; c++)
+			OnEvent(Events[c].data.u32, Events[c].events);
+	}
+
+	// Requests still in flight at the end are not counted
+	qwNow = NowUs();
+	dSeconds = (double) (qwNow - qwMeasure) / 1e6;
+	if (dSeconds <= 0.0)
+		dSeconds = 1e-6;
+	printf("duration            %.3f s\n", dSeconds);
+	printf("completed           %llu\n", (unsigned long long) Stat.qwCompleted);
+	printf("throughput          %.1f requests/s\n", (double) Stat.qwCompleted / dSeconds);
+	printf("connect failures    %llu\n", (unsigned long long) Stat.qwConnectFailures);
+	printf("timeouts            %llu\n", (unsigned long long) Stat.qwTimeouts);
+	printf("short replies       %llu\n", (unsigned long long) Stat.qwShort);
+	printf("sensor errors       %llu\n", (unsigned long long) Stat.qwSensorErrors);
+	if (dRate > 0.0)
+		printf("started late        %llu (backlog %u at the end)\n", (unsigned long long) Stat.qwLate, (unsigned int) Backlog.size());
+	printf("latency us          mean %.0f  p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %llu\n",
+		Stat.Latency.Mean(),
+		(unsigned long long) Stat.Latency.Percentile(50.0),
+		(unsigned long long) Stat.Latency.Percentile(90.0),
+		(unsigned long long) Stat.Latency.Percentile(99.0),
+		(unsigned long long) Stat.Latency.Percentile(99.9),
+		(unsigned long long) Stat.Latency.Max());
+	printf("connect us          mean %.0f  p50 %llu  p99 %llu  max %llu\n",
+		Stat.Connect.Mean(),
+		(unsigned long long) Stat.Connect.Percentile(50.0),
+		(unsigned long long) Stat.Connect.Percentile(99.0),
+		(unsigned long long) Stat.Connect.Max());
+
+	if (szOut) {
+		f = fopen(szOut, "w");
+		if (!f) {
+			perror(szOut);
+			return 1;
+		}
+		Stat.Latency.WriteDistribution(f);
+		fclose(f);
+	}
+	return 0;
+}
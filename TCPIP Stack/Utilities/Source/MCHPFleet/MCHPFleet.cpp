@@ -0,0 +1,798 @@
+/*********************************************************************
+ *
+ *     Fleet poller: discovery on UDP 30303, readings on TCP 4321
+ *
+ *********************************************************************
+ * FileName:        MCHPFleet.cpp
+ * Dependencies:    None (Linux sockets and epoll)
+ * Processor:       x86/x86-64 Linux
+ * Compiler:        g++ -O2 -o MCHPFleet MCHPFleet.cpp
+ *
+ * Linux counterpart of MCHPDetect.  Instead of printing announce
+ * packets one at a time it:
+ *  1. broadcasts the 'D' discovery request of DiscoveryTask() a few
+ *     times and builds an inventory from the replies (NetBIOS name and
+ *     MAC address, see Announce.c),
+ *  2. sends "Lecturas" to every board on port 4321 (TCPServer() in
+ *     ServidorTCP.c) with all connections in flight at once on
+ *     non-blocking sockets and one epoll set,
+ *  3. writes one record per board and sweep, as CSV or as a compact
+ *     binary log (-x turns a binary log back into CSV).
+ *
+ * Every attempt has its own deadline and failed boards are retried.
+ * The discovery socket stays open during the sweeps, so boards that
+ * announce themselves later (AnnounceIP() on a DHCP or power event)
+ * join the inventory.
+ *
+ * With -S no connection is made: each sweep is one "DM" discovery
+ * request, and the boards append their cached reading, its age, their
+ * uptime and firmware version to the reply (see Announce.h).  Replies
+ * are spread over the -j window by MAC address.
+ *
+ * Usage: MCHPFleet [options] [board address...]
+ *  -b addr    discovery broadcast address (255.255.255.255)
+ *  -I iface   send discovery out of this interface (SO_BINDTODEVICE)
+ *  -d ms      discovery window (2000), 0 = only the listed boards
+ *  -p port    measurement port (4321)
+ *  -t ms      per-attempt timeout (3000)
+ *  -r n       retries after a failed attempt (2)
+ *  -c n       connections in flight (1024)
+ *  -n n       sweeps, 0 = until interrupted (1)
+ *  -s s       seconds from the start of one sweep to the next (60)
+ *  -f fmt     csv or bin (csv)
+ *  -o file    output file (stdout)
+ *  -S         snapshot sweeps from discovery replies, no TCP
+ *  -j ms      reply window requested from the boards with -S (16)
+ *  -x file    convert a binary log to CSV on stdout and exit
+ ********************************************************************/
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#define ANNOUNCE_PORT		30303
+#define MEASURE_PORT		4321
+#define DISCOVERY_RESEND_MS	500			// Discovery is UDP: ask more than once
+#define RETRY_DELAY_MS		200			// Lets a busy board finish the last poll
+
+// Result of one board in one sweep
+enum {
+	STATUS_OK = 0,
+	STATUS_REFUSED,			// Connection refused/reset, or no socket left on the board
+	STATUS_TIMEOUT,			// No complete answer before the deadline
+	STATUS_SHORT,			// Closed before sending 4 bytes
+	STATUS_ERROR,			// Local socket error
+	STATUS_NO_READING		// Snapshot: the board has not measured yet
+};
+static const char *szStatus[] = {"ok", "refused", "timeout", "short", "error", "noreading"};
+
+// Discovery reply trailer (Announce.h)
+#define ANNOUNCE_OPCODE_READING		'M'
+#define ANNOUNCE_READING_LENGTH		13
+#define ANNOUNCE_READING_VALID		0x01
+
+// Binary log: this header, then one LOG_RECORD per board and sweep, all
+// little-endian
+static const char szLogMagic[8] = {'M','C','H','P','F','L','T','2'};
+#define LOG_RECORD_V1_SIZE	32		// "MCHPFLT1": no age, uptime or firmware
+
+#pragma pack(push, 1)
+struct LOG_RECORD {
+	uint64_t qwTimeMs;		// Unix time the attempt finished
+	uint32_t dwSweep;
+	uint32_t dwAddress;		// IPv4, network order
+	uint8_t  vMAC[6];
+	uint8_t  vStatus;
+	uint8_t  vAttempts;
+	uint32_t dwLatencyUs;	// Connect to last byte of the successful attempt
+	uint16_t wHumidity;		// Raw SHT1x words, as sent by the board
+	uint16_t wTemperature;
+	uint16_t wAgeS;			// Snapshot only, else 0xFFFF: age of the reading
+	uint32_t dwUptimeS;		// Snapshot only
+	uint16_t wFirmware;		// Snapshot only
+};
+#pragma pack(pop)
+
+struct BOARD {
+	in_addr_t Address;
+	uint8_t vMAC[6];
+	std::string Name;
+	// Latest discovery reply trailer
+	unsigned int dwSnapshot;	// Snapshot sweep it answered, 0 = none
+	uint64_t qwReplyUs;
+	uint8_t vFlags;
+	uint8_t Reading[4];
+	uint16_t wAgeS;
+	uint32_t dwUptimeS;
+	uint16_t wFirmware;
+};
+
+// One poll in progress
+struct POLL {
+	int fd;
+	unsigned int iBoard;
+	unsigned int vAttempts;
+	unsigned int vGeneration;	// Invalidates stale deadline entries
+	uint64_t qwStartUs;			// Start of the current attempt
+	uint64_t qwDeadlineUs;
+	unsigned char vState;
+	unsigned char vReceived;
+	unsigned char Data[4];
+};
+enum {POLL_IDLE = 0, POLL_CONNECTING, POLL_READING};
+
+// All attempts share one timeout, so deadlines and retries come due in
+// the order they were queued and a FIFO replaces a timer heap.
+struct TIMER {
+	uint64_t qwDueUs;
+	unsigned int iPoll;
+	unsigned int vGeneration;
+};
+
+static std::vector<BOARD> Boards;
+static std::map<in_addr_t, unsigned int> BoardIndex;
+static volatile sig_atomic_t bStop;
+
+static unsigned int wPort = MEASURE_PORT;
+static unsigned int dwTimeoutMs = 3000;
+static unsigned int vRetries = 2;
+static unsigned int dwMaxInFlight = 1024;
+
+static uint64_t NowUs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000ull + (uint64_t) ts.tv_nsec / 1000ull;
+}
+
+static uint64_t UnixMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * 1000ull + (uint64_t) ts.tv_nsec / 1000000ull;
+}
+
+static void OnSignal(int)
+{
+	bStop = 1;
+}
+
+/*********************************************************************
+ * Discovery
+ ********************************************************************/
+static int OpenDiscovery(const char *szInterface)
+{
+	struct sockaddr_in sa;
+	int fd, on = 1;
+
+	fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+	if (szInterface && setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, szInterface, strlen(szInterface)) < 0) {
+		perror("SO_BINDTODEVICE");
+		close(fd);
+		return -1;
+	}
+	// Boards answer to port 30303, whatever port the request came from
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(ANNOUNCE_PORT);
+	sa.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+		perror("bind UDP 30303");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void SendDiscovery(int fd, in_addr_t Broadcast, int iWindowMs)
+{
+	struct sockaddr_in sa;
+	char Request[3] = {'D', ANNOUNCE_OPCODE_READING, 0};
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(ANNOUNCE_PORT);
+	sa.sin_addr.s_addr = Broadcast;
+	if (iWindowMs < 0) {
+		sendto(fd, "D", 1, 0, (struct sockaddr *) &sa, sizeof(sa));
+		return;
+	}
+	Request[2] = (char) iWindowMs;
+	sendto(fd, Request, sizeof(Request), 0, (struct sockaddr *) &sa, sizeof(sa));
+}
+
+static unsigned int AddBoard(in_addr_t Address, const uint8_t *pMAC, const std::string &Name)
+{
+	std::map<in_addr_t, unsigned int>::iterator it = BoardIndex.find(Address);
+	BOARD b;
+
+	if (it != BoardIndex.end()) {
+		if (pMAC) {
+			memcpy(Boards[it->second].vMAC, pMAC, 6);
+			Boards[it->second].Name = Name;
+		}
+		return it->second;
+	}
+	b.Address = Address;
+	memset(b.vMAC, 0, 6);
+	if (pMAC)
+		memcpy(b.vMAC, pMAC, 6);
+	b.Name = Name;
+	b.dwSnapshot = 0;
+	Boards.push_back(b);
+	BoardIndex[Address] = Boards.size() - 1;
+	return Boards.size() - 1;
+}
+
+// Reply and announce payload: "<NetBIOS name>\r\nXX-XX-XX-XX-XX-XX\r\n..."
+// *ppTrailer is set to the 'M' trailer when there is one
+static bool ParseAnnounce(const char *p, int len, std::string &Name, uint8_t *pMAC, const uint8_t **ppTrailer)
+{
+	const char *pEnd = p + len, *pLine;
+	unsigned int i, v;
+
+	pLine = (const char *) memchr(p, '\r', len);
+	if (!pLine || pEnd - pLine < 2 + 17 || pLine[1] != '\n')
+		return false;
+	Name.assign(p, pLine - p);
+	while (!Name.empty() && Name[Name.size() - 1] == ' ')
+		Name.erase(Name.size() - 1);
+	pLine += 2;
+	for (i = 0; i < 6; i++) {
+		if (sscanf(pLine + i * 3, "%2x", &v) != 1)
+			return false;
+		if (i < 5 && pLine[i * 3 + 2] != '-')
+			return false;
+		pMAC[i] = (uint8_t) v;
+	}
+	*ppTrailer = NULL;
+	pLine += 17;
+	if (pEnd - pLine >= 2 + 2 + ANNOUNCE_READING_LENGTH && pLine[0] == '\r' && pLine[1] == '\n'
+		&& pLine[2] == ANNOUNCE_OPCODE_READING && (uint8_t) pLine[3] >= ANNOUNCE_READING_LENGTH)
+		*ppTrailer = (const uint8_t *) pLine + 4;
+	return true;
+}
+
+static unsigned int dwSnapshot;				// Current snapshot sweep
+static uint64_t qwSnapshotUs;				// When its request went out
+
+
+static void ReadDiscovery(int fd)
+{
+	char Payload[1500];
+	struct sockaddr_in sa;
+	socklen_t salen;
+	std::string Name;
+	uint8_t vMAC[6];
+	const uint8_t *t;
+	unsigned int iBoard;
+	int len;
+
+	for (;;) {
+		salen = sizeof(sa);
+		len = recvfrom(fd, Payload, sizeof(Payload), 0, (struct sockaddr *) &sa, &salen);
+		if (len < 0)
+			return;
+		// Our own request comes back through broadcast loopback
+		if (!ParseAnnounce(Payload, len, Name, vMAC, &t))
+			continue;
+		iBoard = AddBoard(sa.sin_addr.s_addr, vMAC, Name);
+		if (!t || !dwSnapshot)
+			continue;
+		BOARD &b = Boards[iBoard];
+		b.dwSnapshot = dwSnapshot;
+		b.qwReplyUs = NowUs() - qwSnapshotUs;
+		b.vFlags = t[0];
+		memcpy(b.Reading, t + 1, 4);
+		b.wAgeS = (uint16_t) (t[5] << 8 | t[6]);
+		b.dwUptimeS = (uint32_t) t[7] << 24 | (uint32_t) t[8] << 16 | (uint32_t) t[9] << 8 | t[10];
+		b.wFirmware = (uint16_t) (t[11] << 8 | t[12]);
+	}
+}
+
+/*********************************************************************
+ * Output
+ ********************************************************************/
+static FILE *fOut;
+static bool bBinary;
+
+static void WriteHeader(void)
+{
+	if (bBinary)
+		fwrite(szLogMagic, 1, sizeof(szLogMagic), fOut);
+	else
+		fprintf(fOut, "time_ms,sweep,address,mac,name,status,attempts,latency_us,rh_raw,t_raw,temperature_c,humidity_pct,age_s,uptime_s,firmware\n");
+}
+
+static void WriteCSV(FILE *f, const LOG_RECORD &r, const char *szName)
+{
+	struct in_addr a;
+	double t, rh;
+
+	a.s_addr = r.dwAddress;
+	fprintf(f, "%llu,%u,%s,%02X-%02X-%02X-%02X-%02X-%02X,%s,%s,%u,%u,%u,%u",
+		(unsigned long long) r.qwTimeMs, r.dwSweep, inet_ntoa(a),
+		r.vMAC[0], r.vMAC[1], r.vMAC[2], r.vMAC[3], r.vMAC[4], r.vMAC[5],
+		szName, r.vStatus < sizeof(szStatus) / sizeof(szStatus[0]) ? szStatus[r.vStatus] : "?",
+		r.vAttempts, r.dwLatencyUs, r.wHumidity, r.wTemperature);
+	if (r.vStatus == STATUS_OK) {
+		// SHT1x conversion for 5 V, 14-bit T and 12-bit RH (the defaults
+		// Mod_Med_HT.c runs the sensor at)
+		t = -39.66 + 0.01 * r.wTemperature;
+		rh = -2.0468 + 0.0367 * r.wHumidity - 1.5955e-6 * r.wHumidity * r.wHumidity;
+		rh = (t - 25.0) * (0.01 + 0.00008 * r.wHumidity) + rh;
+		fprintf(f, ",%.2f,%.2f", t, rh);
+	} else
+		fprintf(f, ",,");
+	if (r.wFirmware)
+		fprintf(f, ",%u,%u,%u.%u\n", r.wAgeS, r.dwUptimeS, r.wFirmware >> 8, r.wFirmware & 0xFF);
+	else
+		fprintf(f, ",,,\n");
+}
+
+static void Emit(const LOG_RECORD &r, const BOARD &b)
+{
+	if (bBinary)
+		fwrite(&r, sizeof(r), 1, fOut);
+	else
+		WriteCSV(fOut, r, b.Name.c_str());
+}
+
+static void InitRecord(LOG_RECORD &r, unsigned int dwSweep, const BOARD &b, unsigned char vStatus)
+{
+	memset(&r, 0, sizeof(r));
+	r.qwTimeMs = UnixMs();
+	r.dwSweep = dwSweep;
+	r.dwAddress = b.Address;
+	memcpy(r.vMAC, b.vMAC, 6);
+	r.vStatus = vStatus;
+	r.wAgeS = 0xFFFF;
+}
+
+static void WriteRecord(unsigned int dwSweep, const BOARD &b, const POLL &p, unsigned char vStatus, uint32_t dwLatencyUs)
+{
+	LOG_RECORD r;
+
+	InitRecord(r, dwSweep, b, vStatus);
+	r.vAttempts = (uint8_t) p.vAttempts;
+	if (vStatus == STATUS_OK) {
+		r.dwLatencyUs = dwLatencyUs;
+		r.wHumidity = (uint16_t) (p.Data[0] << 8 | p.Data[1]);
+		r.wTemperature = (uint16_t) (p.Data[2] << 8 | p.Data[3]);
+	}
+	Emit(r, b);
+}
+
+// Boards that did not answer this snapshot time out
+static void WriteSnapshotRecord(unsigned int dwSweep, const BOARD &b)
+{
+	LOG_RECORD r;
+
+	if (b.dwSnapshot != dwSnapshot) {
+		InitRecord(r, dwSweep, b, STATUS_TIMEOUT);
+		Emit(r, b);
+		return;
+	}
+	InitRecord(r, dwSweep, b, (b.vFlags & ANNOUNCE_READING_VALID) ? STATUS_OK : STATUS_NO_READING);
+	r.vAttempts = 1;
+	r.dwLatencyUs = (uint32_t) b.qwReplyUs;
+	if (r.vStatus == STATUS_OK) {
+		r.wHumidity = (uint16_t) (b.Reading[0] << 8 | b.Reading[1]);
+		r.wTemperature = (uint16_t) (b.Reading[2] << 8 | b.Reading[3]);
+	}
+	r.wAgeS = b.wAgeS;
+	r.dwUptimeS = b.dwUptimeS;
+	r.wFirmware = b.wFirmware;
+	Emit(r, b);
+}
+
+static int ConvertLog(const char *szFile)
+{
+	char Magic[sizeof(szLogMagic)];
+	LOG_RECORD r;
+	size_t size = sizeof(r);
+	FILE *f;
+
+	f = fopen(szFile, "rb");
+	if (!f) {
+		perror(szFile);
+		return 1;
+	}
+	if (fread(Magic, 1, sizeof(Magic), f) == sizeof(Magic) && !memcmp(Magic, szLogMagic, 7) && Magic[7] == '1')
+		size = LOG_RECORD_V1_SIZE;
+	else if (memcmp(Magic, szLogMagic, sizeof(Magic))) {
+		fprintf(stderr, "%s: not a fleet log\n", szFile);
+		fclose(f);
+		return 1;
+	}
+	fOut = stdout;
+	bBinary = false;
+	WriteHeader();
+	memset(&r, 0, sizeof(r));
+	r.wAgeS = 0xFFFF;
+	while (fread(&r, size, 1, f) == 1)
+		WriteCSV(stdout, r, "");
+	fclose(f);
+	return 0;
+}
+
+/*********************************************************************
+ * Polling
+ ********************************************************************/
+static int ep;
+static std::vector<POLL> Polls;				// One slot per connection in flight
+static std::vector<unsigned int> FreePolls;
+static std::deque<TIMER> Deadlines;
+static std::deque<TIMER> Retries;
+static std::deque<unsigned int> Pending;	// Boards not started yet
+static unsigned int dwSweep;
+static unsigned int dwOutstanding;			// Boards of this sweep without a record
+
+static void Finish(unsigned int iPoll, unsigned char vStatus);
+
+// Starts (or restarts) the attempt of slot iPoll
+static void Connect(unsigned int iPoll)
+{
+	POLL &p = Polls[iPoll];
+	struct sockaddr_in sa;
+	struct epoll_event ev;
+	int on = 1;
+
+	p.vAttempts++;
+	p.vGeneration++;
+	p.vReceived = 0;
+	p.qwStartUs = NowUs();
+	p.qwDeadlineUs = p.qwStartUs + (uint64_t) dwTimeoutMs * 1000ull;
+	p.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+	if (p.fd < 0) {
+		Finish(iPoll, STATUS_ERROR);
+		return;
+	}
+	setsockopt(p.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(wPort);
+	sa.sin_addr.s_addr = Boards[p.iBoard].Address;
+	if (connect(p.fd, (struct sockaddr *) &sa, sizeof(sa)) < 0 && errno != EINPROGRESS) {
+		Finish(iPoll, errno == ECONNREFUSED ? STATUS_REFUSED : STATUS_ERROR);
+		return;
+	}
+	p.vState = POLL_CONNECTING;
+	ev.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP;
+	ev.data.u32 = iPoll;
+	epoll_ctl(ep, EPOLL_CTL_ADD, p.fd, &ev);
+	TIMER t = {p.qwDeadlineUs, iPoll, p.vGeneration};
+	Deadlines.push_back(t);
+}
+
+static void Start(unsigned int iBoard)
+{
+	unsigned int iPoll;
+
+	if (FreePolls.empty()) {
+		POLL p;
+		memset(&p, 0, sizeof(p));
+		p.fd = -1;
+		Polls.push_back(p);
+		iPoll = Polls.size() - 1;
+	} else {
+		iPoll = FreePolls.back();
+		FreePolls.pop_back();
+	}
+	Polls[iPoll].iBoard = iBoard;
+	Polls[iPoll].vAttempts = 0;
+	Connect(iPoll);
+}
+
+static void StartPending(void)
+{
+	while (!Pending.empty() && Polls.size() - FreePolls.size() < dwMaxInFlight) {
+		unsigned int iBoard = Pending.front();
+		Pending.pop_front();
+		Start(iBoard);
+	}
+}
+
+// Ends the current attempt: records the board, or queues a retry
+static void Finish(unsigned int iPoll, unsigned char vStatus)
+{
+	POLL &p = Polls[iPoll];
+	uint64_t qwNow = NowUs();
+
+	if (p.fd >= 0) {
+		close(p.fd);			// Also removes it from the epoll set
+		p.fd = -1;
+	}
+	p.vGeneration++;
+	p.vState = POLL_IDLE;
+	if (vStatus != STATUS_OK && p.vAttempts <= vRetries) {
+		TIMER t = {qwNow + RETRY_DELAY_MS * 1000ull, iPoll, p.vGeneration};
+		Retries.push_back(t);
+		return;
+	}
+	WriteRecord(dwSweep, Boards[p.iBoard], p, vStatus, (uint32_t) (qwNow - p.qwStartUs));
+	FreePolls.push_back(iPoll);
+	dwOutstanding--;
+}
+
+static void OnEvent(unsigned int iPoll, uint32_t dwEvents)
+{
+	POLL &p = Polls[iPoll];
+	int err = 0, len;
+	socklen_t errlen = sizeof(err);
+
+	if (p.vState == POLL_CONNECTING) {
+		getsockopt(p.fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+		if (err) {
+			Finish(iPoll, err == ECONNREFUSED || err == ECONNRESET ? STATUS_REFUSED : STATUS_ERROR);
+			return;
+		}
+		if (!(dwEvents & EPOLLOUT))
+			return;
+		// TCPServer() compares the whole segment with strcmp(): send it
+		// in one piece.  8 bytes always fit an empty send buffer.
+		if (send(p.fd, "Lecturas", 8, MSG_NOSIGNAL) != 8) {
+			Finish(iPoll, STATUS_ERROR);
+			return;
+		}
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.u32 = iPoll;
+		epoll_ctl(ep, EPOLL_CTL_MOD, p.fd, &ev);
+		p.vState = POLL_READING;
+		return;
+	}
+
+	for (;;) {
+		len = recv(p.fd, p.Data + p.vReceived, sizeof(p.Data) - p.vReceived, 0);
+		if (len > 0) {
+			p.vReceived += len;
+			if (p.vReceived == sizeof(p.Data)) {
+				Finish(iPoll, STATUS_OK);
+				return;
+			}
+			continue;
+		}
+		if (len == 0) {
+			Finish(iPoll, STATUS_SHORT);
+			return;
+		}
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return;
+		Finish(iPoll, errno == ECONNRESET ? STATUS_REFUSED : STATUS_ERROR);
+		return;
+	}
+}
+
+static void RunTimers(uint64_t qwNow)
+{
+	while (!Deadlines.empty() && Deadlines.front().qwDueUs <= qwNow) {
+		TIMER t = Deadlines.front();
+		Deadlines.pop_front();
+		if (Polls[t.iPoll].vGeneration == t.vGeneration)
+			Finish(t.iPoll, STATUS_TIMEOUT);
+	}
+	while (!Retries.empty() && Retries.front().qwDueUs <= qwNow) {
+		TIMER t = Retries.front();
+		Retries.pop_front();
+		if (Polls[t.iPoll].vGeneration == t.vGeneration)
+			Connect(t.iPoll);
+	}
+	// Entries of finished attempts only go stale; drop them from the
+	// front so the queues stay as long as the number in flight
+	while (!Deadlines.empty() && Polls[Deadlines.front().iPoll].vGeneration != Deadlines.front().vGeneration)
+		Deadlines.pop_front();
+}
+
+static int NextTimeoutMs(uint64_t qwNow, uint64_t qwLimitUs)
+{
+	uint64_t qwDue = qwLimitUs;
+
+	if (!Deadlines.empty() && Deadlines.front().qwDueUs < qwDue)
+		qwDue = Deadlines.front().qwDueUs;
+	if (!Retries.empty() && Retries.front().qwDueUs < qwDue)
+		qwDue = Retries.front().qwDueUs;
+	if (qwDue <= qwNow)
+		return 0;
+	return (int) ((qwDue - qwNow + 999ull) / 1000ull);
+}
+
+// Waits for sockets until qwUntilUs, or until the sweep is done when
+// bSweep is set.  Announce packets are taken at any time.
+static void Run(int fdDiscovery, uint64_t qwUntilUs, bool bSweep)
+{
+	struct epoll_event Events[256];
+	int i, n;
+	uint64_t qwNow;
+
+	while (!bStop) {
+		qwNow = NowUs();
+		RunTimers(qwNow);
+		if (bSweep) {
+			StartPending();
+			if (dwOutstanding == 0)
+				return;
+		} else if (qwNow >= qwUntilUs)
+			return;
+		n = epoll_wait(ep, Events, sizeof(Events) / sizeof(Events[0]), NextTimeoutMs(qwNow, bSweep ? qwNow + 1000000ull : qwUntilUs));
+		for (i = 0; i < n; i++) {
+			if (Events[i].data.u32 == 0xFFFFFFFFu)
+				ReadDiscovery(fdDiscovery);
+			else
+				OnEvent(Events[i].data.u32, Events[i].events);
+		}
+	}
+}
+
+static void Sweep(int fdDiscovery)
+{
+	unsigned int i;
+	uint64_t qwStart = NowUs();
+
+	dwSweep++;
+	for (i = 0; i < Boards.size(); i++)
+		Pending.push_back(i);
+	dwOutstanding = Boards.size();
+	Run(fdDiscovery, 0, true);
+	fflush(fOut);
+	fprintf(stderr, "Sweep %u: %u boards in %.3f s\n", dwSweep, (unsigned int) Boards.size(), (NowUs() - qwStart) / 1e6);
+}
+
+// One "DM" request, replies collected for the window plus a margin for
+// the boards' main loops and the network
+static void SnapshotSweep(int fdDiscovery, in_addr_t Broadcast, unsigned int dwWindowMs, unsigned int dwWaitMs)
+{
+	unsigned int i;
+
+	dwSweep++;
+	dwSnapshot = dwSweep;
+	qwSnapshotUs = NowUs();
+	SendDiscovery(fdDiscovery, Broadcast, (int) dwWindowMs);
+	Run(fdDiscovery, qwSnapshotUs + (uint64_t) (dwWindowMs + dwWaitMs) * 1000ull, false);
+	for (i = 0; i < Boards.size(); i++)
+		WriteSnapshotRecord(dwSweep, Boards[i]);
+	fflush(fOut);
+	fprintf(stderr, "Snapshot %u: %u boards\n", dwSweep, (unsigned int) Boards.size());
+}
+
+static void RaiseFileLimit(void)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < dwMaxInFlight + 16) {
+		dwMaxInFlight = rl.rlim_cur > 32 ? rl.rlim_cur - 16 : 16;
+		fprintf(stderr, "Open file limit: at most %u connections in flight\n", dwMaxInFlight);
+	}
+}
+
+static void Usage(void)
+{
+	fprintf(stderr,
+		"Usage: MCHPFleet [-b broadcast] [-I iface] [-d discovery_ms] [-p port]\n"
+		"                 [-t timeout_ms] [-r retries] [-c in_flight] [-n sweeps]\n"
+		"                 [-s period_s] [-f csv|bin] [-o file] [-S [-j window_ms]]\n"
+		"                 [board address...]\n"
+		"       MCHPFleet -x file.bin\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	in_addr_t Broadcast = htonl(INADDR_BROADCAST);
+	const char *szInterface = NULL, *szOut = NULL;
+	unsigned int dwDiscoveryMs = 2000, dwSweeps = 1, dwPeriodS = 60, dwWindowMs = 16;
+	bool bSnapshot = false;
+	struct epoll_event ev;
+	struct in_addr a;
+	uint64_t qwNow, qwEnd, qwNext;
+	int fdDiscovery, c;
+
+	while ((c = getopt(argc, argv, "b:I:d:p:t:r:c:n:s:f:o:Sj:x:")) != -1) {
+		switch (c) {
+		case 'b':
+			if (!inet_aton(optarg, &a))
+				Usage();
+			Broadcast = a.s_addr;
+			break;
+		case 'I': szInterface = optarg; break;
+		case 'd': dwDiscoveryMs = strtoul(optarg, NULL, 0); break;
+		case 'p': wPort = strtoul(optarg, NULL, 0); break;
+		case 't': dwTimeoutMs = strtoul(optarg, NULL, 0); break;
+		case 'r': vRetries = strtoul(optarg, NULL, 0); break;
+		case 'c': dwMaxInFlight = strtoul(optarg, NULL, 0); break;
+		case 'n': dwSweeps = strtoul(optarg, NULL, 0); break;
+		case 's': dwPeriodS = strtoul(optarg, NULL, 0); break;
+		case 'f':
+			if (!strcmp(optarg, "bin"))
+				bBinary = true;
+			else if (strcmp(optarg, "csv"))
+				Usage();
+			break;
+		case 'o': szOut = optarg; break;
+		case 'S': bSnapshot = true; break;
+		case 'j': dwWindowMs = strtoul(optarg, NULL, 0); break;
+		case 'x': return ConvertLog(optarg);
+		default: Usage();
+		}
+	}
+	if (dwMaxInFlight == 0 || dwTimeoutMs == 0 || vRetries > 254 || dwWindowMs > 255)
+		Usage();
+	for (; optind < argc; optind++) {
+		if (!inet_aton(argv[optind], &a))
+			Usage();
+		AddBoard(a.s_addr, NULL, "");
+	}
+
+	fOut = stdout;
+	if (szOut && !(fOut = fopen(szOut, bBinary ? "wb" : "w"))) {
+		perror(szOut);
+		return 1;
+	}
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+	RaiseFileLimit();
+
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	fdDiscovery = OpenDiscovery(szInterface);
+	if (ep < 0 || fdDiscovery < 0)
+		return 1;
+	ev.events = EPOLLIN;
+	ev.data.u32 = 0xFFFFFFFFu;
+	epoll_ctl(ep, EPOLL_CTL_ADD, fdDiscovery, &ev);
+
+	// Discovery: the request is repeated, replies are collected in Run()
+	qwEnd = NowUs() + (uint64_t) dwDiscoveryMs * 1000ull;
+	while (!bStop && (qwNow = NowUs()) < qwEnd) {
+		SendDiscovery(fdDiscovery, Broadcast, -1);
+		qwNext = qwNow + DISCOVERY_RESEND_MS * 1000ull;
+		Run(fdDiscovery, qwNext < qwEnd ? qwNext : qwEnd, false);
+	}
+	fprintf(stderr, "Inventory: %u boards\n", (unsigned int) Boards.size());
+	for (std::vector<BOARD>::const_iterator it = Boards.begin(); it != Boards.end(); ++it) {
+		a.s_addr = it->Address;
+		fprintf(stderr, "  %-15s %02X-%02X-%02X-%02X-%02X-%02X %s\n", inet_ntoa(a),
+			it->vMAC[0], it->vMAC[1], it->vMAC[2], it->vMAC[3], it->vMAC[4], it->vMAC[5], it->Name.c_str());
+	}
+
+	WriteHeader();
+	while (!bStop) {
+		qwNext = NowUs() + (uint64_t) dwPeriodS * 1000000ull;
+		if (bSnapshot)
+			SnapshotSweep(fdDiscovery, Broadcast, dwWindowMs, dwTimeoutMs);
+		else
+			Sweep(fdDiscovery);
+		if (dwSweeps && dwSweep >= dwSweeps)
+			break;
+		Run(fdDiscovery, qwNext, false);
+	}
+
+	if (fOut != stdout)
+		fclose(fOut);
+	close(fdDiscovery);
+	close(ep);
+	return 0;
+}
@@ -0,0 +1,667 @@
+/*********************************************************************
+ *
+ *     MPFS2 image builder for the HTTP2 web pages
+ *
+ *********************************************************************
+ * FileName:        MCHPMPFS2.cpp
+ * Dependencies:    zlib
+ * Processor:       x86/x86-64 Linux
+ * Compiler:        g++ -O2 -o MCHPMPFS2 MCHPMPFS2.cpp -lz
+ *
+ * Linux counterpart of the MPFS2 Utility.  Packs a directory of web
+ * pages into an image for MPFS2.c, either as a binary to upload or as
+ * a C source like MPFSImg2.c, and rewrites HTTPPrint.h:
+ *  - files whose extension is in the -y list are searched for ~name~
+ *    dynamic variables.  They get MPFS2_FLAG_HASINDEX and a companion
+ *    file, named with the last character replaced by '#', holding
+ *    [DWORD offset of the first '~'][DWORD callback ID] pairs as
+ *    HTTP2.c reads them.  ~inc:file~ becomes HTTPIncFile("file").
+ *  - other files are gzipped unless their extension is in the -z list,
+ *    and get MPFS2_FLAG_ISZIPPED when that makes them smaller.  Included
+ *    files (.inc) must stay uncompressed: HTTP2.c copies them into
+ *    pages that are not.
+ *  - identical file data, companion tables included, is stored once
+ *    and shared by the records.
+ *  - the image is version 2.1: the FNV-1a name index follows the FAT
+ *    records (see the format description in MPFS2.c).
+ *
+ * Callback IDs are read back from the HTTPPrint.h given with -h, so a
+ * variable keeps its ID from one build to the next and firmware built
+ * against the old header still serves the new image.  New variables
+ * are numbered after the highest ID found.
+ *
+ * Usage: MCHPMPFS2 [options] directory image
+ *  -c         write a C source (default when the image name ends in .c)
+ *  -h file    HTTPPrint.h to read the callback IDs from and rewrite
+ *  -y exts    dynamic file extensions (htm,html,cgi,xml,json)
+ *  -z exts    extensions never compressed (inc,gif,png,jpg,jpeg,ico,
+ *             zip,gz,bib)
+ *  -0         compress nothing
+ *  -v         list the files
+ ********************************************************************/
+#include <ctype.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// MPFS2.h/MPFS2.c
+#define MPFS2_FLAG_ISZIPPED		0x0001
+#define MPFS2_FLAG_HASINDEX		0x0002
+#define MAX_FILE_NAME_LEN		64
+#define MPFS_FAT_RECORD_SIZE	24
+#define MPFS_INDEX_ENTRY_SIZE	6
+#define MPFS_FNV_OFFSET_BASIS	0x811C9DC5u
+#define MPFS_FNV_PRIME			0x01000193u
+#define MAX_VARIABLE_LEN		60
+
+struct MPFS_FILE {
+	std::string Name;
+	std::string Data;			// As stored: compressed or not
+	uint16_t wFlags;
+	uint32_t dwTimestamp;
+	uint32_t dwDataPtr;
+	uint32_t dwStringPtr;
+	size_t iOriginalSize;
+};
+
+static std::set<std::string> DynamicExts, StoredExts;
+static bool bCompress = true;
+static bool bVerbose;
+
+// Callback IDs by variable ("name", "name(args)" or "inc:file")
+static std::map<std::string, uint32_t> CallbackIDs;
+static std::set<std::string> UsedVariables;
+static uint32_t dwNextCallbackID;
+
+static void Usage(void)
+{
+	fprintf(stderr, "Usage: MCHPMPFS2 [-c] [-h HTTPPrint.h] [-y exts] [-z exts] [-0] [-v] directory image\n");
+	exit(1);
+}
+
+static void ParseExtensions(const char *szList, std::set<std::string> &Exts)
+{
+	std::string s(szList);
+	size_t i = 0, j;
+
+	Exts.clear();
+	while (i <= s.size()) {
+		j = s.find(',', i);
+		if (j == std::string::npos)
+			j = s.size();
+		if (j > i)
+			Exts.insert(s.substr(i, j - i));
+		i = j + 1;
+	}
+}
+
+static std::string Extension(const std::string &Name)
+{
+	size_t dot = Name.rfind('.');
+	size_t slash = Name.rfind('/');
+
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return "";
+	std::string Ext = Name.substr(dot + 1);
+	for (size_t i = 0; i < Ext.size(); i++)
+		Ext[i] = (char) tolower((unsigned char) Ext[i]);
+	return Ext;
+}
+
+static bool ReadFile(const std::string &Path, std::string &Data)
+{
+	FILE *f = fopen(Path.c_str(), "rb");
+	char buf[4096];
+	size_t n;
+
+	if (!f) {
+		perror(Path.c_str());
+		return false;
+	}
+	Data.clear();
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		Data.append(buf, n);
+	fclose(f);
+	return true;
+}
+
+// Collects the regular files under Dir, with names relative to Root,
+// skipping hidden entries
+static bool Walk(const std::string &Root, const std::string &Dir, std::vector<MPFS_FILE> &Files)
+{
+	std::string Path = Dir.empty() ? Root : Root + "/" + Dir;
+	DIR *d = opendir(Path.c_str());
+	struct dirent *e;
+	std::vector<std::string> Names;
+	struct stat st;
+
+	if (!d) {
+		perror(Path.c_str());
+		return false;
+	}
+	while ((e = readdir(d)) != NULL) {
+		if (e->d_name[0] != '.')
+			Names.push_back(e->d_name);
+	}
+	closedir(d);
+	std::sort(Names.begin(), Names.end());
+
+	for (size_t i = 0; i < Names.size(); i++) {
+		std::string Name = Dir.empty() ? Names[i] : Dir + "/" + Names[i];
+		std::string Full = Root + "/" + Name;
+		if (stat(Full.c_str(), &st) != 0) {
+			perror(Full.c_str());
+			return false;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			if (!Walk(Root, Name, Files))
+				return false;
+			continue;
+		}
+		if (!S_ISREG(st.st_mode))
+			continue;
+		if (Name.size() > MAX_FILE_NAME_LEN) {
+			fprintf(stderr, "%s: name longer than %d characters\n", Name.c_str(), MAX_FILE_NAME_LEN);
+			return false;
+		}
+		MPFS_FILE f;
+		f.Name = Name;
+		f.wFlags = 0;
+		f.dwTimestamp = (uint32_t) st.st_mtime;
+		f.dwDataPtr = f.dwStringPtr = 0;
+		if (!ReadFile(Full, f.Data))
+			return false;
+		f.iOriginalSize = f.Data.size();
+		Files.push_back(f);
+	}
+	return true;
+}
+
+/*********************************************************************
+ * HTTPPrint.h
+ ********************************************************************/
+
+// Reads the callback IDs of an HTTPPrint.h written by this tool or by
+// the MPFS2 Utility: each "case 0x...:" is followed by either
+// HTTPIncFile((ROM BYTE*)"file") or HTTPPrint_name(args)
+static void LoadCallbackIDs(const char *szFile)
+{
+	std::string Text, Line;
+	size_t i = 0, j;
+	bool bCase = false;
+	uint32_t dwID = 0;
+
+	if (access(szFile, F_OK) != 0 || !ReadFile(szFile, Text))
+		return;
+	while (i < Text.size()) {
+		j = Text.find('\n', i);
+		if (j == std::string::npos)
+			j = Text.size();
+		Line = Text.substr(i, j - i);
+		i = j + 1;
+
+		size_t p = Line.find_first_not_of(" \t");
+		if (p == std::string::npos)
+			continue;
+		Line = Line.substr(p);
+		if (Line.compare(0, 5, "case ") == 0) {
+			dwID = strtoul(Line.c_str() + 5, NULL, 0);
+			bCase = true;
+			continue;
+		}
+		if (!bCase)
+			continue;
+		bCase = false;
+
+		std::string Variable;
+		if (Line.compare(0, 12, "HTTPIncFile(") == 0) {
+			size_t a = Line.find('"'), b = Line.rfind('"');
+			if (a == std::string::npos || b <= a)
+				continue;
+			Variable = "inc:" + Line.substr(a + 1, b - a - 1);
+		} else if (Line.compare(0, 10, "HTTPPrint_") == 0) {
+			size_t a = Line.find('(');
+			size_t b = Line.rfind(')');
+			if (a == std::string::npos || b == std::string::npos || b < a)
+				continue;
+			Variable = Line.substr(10, a - 10);
+			if (b > a + 1)
+				Variable += Line.substr(a, b - a + 1);
+		} else
+			continue;
+		CallbackIDs[Variable] = dwID;
+		if (dwID >= dwNextCallbackID)
+			dwNextCallbackID = dwID + 1;
+	}
+}
+
+static uint32_t GetCallbackID(const std::string &Variable)
+{
+	std::map<std::string, uint32_t>::const_iterator it = CallbackIDs.find(Variable);
+
+	UsedVariables.insert(Variable);
+	if (it != CallbackIDs.end())
+		return it->second;
+	CallbackIDs[Variable] = dwNextCallbackID;
+	return dwNextCallbackID++;
+}
+
+static bool WriteHTTPPrint(const char *szFile)
+{
+	std::vector<std::pair<uint32_t, std::string> > Used;
+	std::set<std::string> Declared;
+	FILE *f = fopen(szFile, "w");
+
+	if (!f) {
+		perror(szFile);
+		return false;
+	}
+	for (std::set<std::string>::const_iterator it = UsedVariables.begin(); it != UsedVariables.end(); ++it)
+		Used.push_back(std::make_pair(CallbackIDs[*it], *it));
+	std::sort(Used.begin(), Used.end());
+
+	fprintf(f,
+		"/**************************************************************\n"
+		" * HTTPPrint.h\n"
+		" * Provides callback headers and resolution for user's custom\n"
+		" * HTTP Application.\n"
+		" * \n"
+		" * This file is automatically generated by the MPFS Utility\n"
+		" * ALL MODIFICATIONS WILL BE OVERWRITTEN BY THE MPFS GENERATOR\n"
+		" **************************************************************/\n"
+		"\n"
+		"#ifndef __HTTPPRINT_H\n"
+		"#define __HTTPPRINT_H\n"
+		"\n"
+		"#include \"TCPIP Stack/TCPIP.h\"\n"
+		"\n"
+		"#if defined(STACK_USE_HTTP2_SERVER)\n"
+		"\n"
+		"extern HTTP_CONN curHTTP;\n"
+		"extern HTTP_STUB httpStubs[MAX_HTTP_CONNECTIONS];\n"
+		"extern BYTE curHTTPID;\n"
+		"\n"
+		"void HTTPPrint(DWORD callbackID);\n");
+	for (size_t i = 0; i < Used.size(); i++) {
+		const std::string &v = Used[i].second;
+		if (v.compare(0, 4, "inc:") == 0 || v.empty())
+			continue;
+		size_t a = v.find('(');
+		std::string Name = v.substr(0, a);
+		if (!Declared.insert(Name).second)
+			continue;
+		if (a == std::string::npos)
+			fprintf(f, "void HTTPPrint_%s(void);\n", Name.c_str());
+		else {
+			// One WORD per argument, as in ~led(3)~ or ~pair(1,2)~
+			std::string Args = "WORD";
+			for (size_t k = a; k < v.size(); k++)
+				if (v[k] == ',')
+					Args += ",WORD";
+			fprintf(f, "void HTTPPrint_%s(%s);\n", Name.c_str(), Args.c_str());
+		}
+	}
+
+	fprintf(f, "\nvoid HTTPPrint(DWORD callbackID)\n{\n\tswitch(callbackID)\n\t{\n");
+	for (size_t i = 0; i < Used.size(); i++) {
+		const std::string &v = Used[i].second;
+		fprintf(f, "\t\tcase 0x%08x:\n", Used[i].first);
+		if (v.compare(0, 4, "inc:") == 0)
+			fprintf(f, "\t\t\tHTTPIncFile((ROM BYTE*)\"%s\");\n", v.c_str() + 4);
+		else if (v.find('(') != std::string::npos)
+			fprintf(f, "\t\t\tHTTPPrint_%s;\n", v.c_str());
+		else
+			fprintf(f, "\t\t\tHTTPPrint_%s();\n", v.c_str());
+		fprintf(f, "\t\t\tbreak;\n");
+	}
+	fprintf(f,
+		"\t\tdefault:\n"
+		"\t\t\t// Output notification for undefined values\n"
+		"\t\t\tTCPPutROMArray(sktHTTP, (ROM BYTE*)\"!DEF\", 4);\n"
+		"\t}\n"
+		"\n"
+		"\treturn;\n"
+		"}\n"
+		"\n"
+		"void HTTPPrint_(void)\n"
+		"{\n"
+		"\tTCPPut(sktHTTP, '~');\n"
+		"\treturn;\n"
+		"}\n"
+		"\n"
+		"#endif\n"
+		"\n"
+		"#endif\n");
+	fclose(f);
+	return true;
+}
+
+/*********************************************************************
+ * Dynamic variables and compression
+ ********************************************************************/
+
+static bool IsVariableChar(char c, bool bInclude)
+{
+	if (isalnum((unsigned char) c) || c == '_')
+		return true;
+	if (bInclude)
+		return c == '.' || c == '-' || c == '/' || c == ' ';
+	return c == '(' || c == ')' || c == ',';
+}
+
+// Finds the ~name~ variables of a dynamic file and returns its
+// companion table, empty when there are none
+static std::string BuildCallbackTable(const MPFS_FILE &File)
+{
+	const std::string &d = File.Data;
+	std::string Table;
+	size_t i = 0, j;
+
+	while ((i = d.find('~', i)) != std::string::npos) {
+		bool bInclude = d.compare(i + 1, 4, "inc:") == 0;
+		j = i + 1 + (bInclude ? 4 : 0);
+		while (j < d.size() && j - i <= MAX_VARIABLE_LEN && IsVariableChar(d[j], bInclude))
+			j++;
+		if (j >= d.size() || d[j] != '~' || j - i > MAX_VARIABLE_LEN) {
+			i++;					// A lone '~' is served as it is
+			continue;
+		}
+		std::string Variable = d.substr(i + 1, j - i - 1);
+		if (Variable.find('(') != Variable.rfind('(') ||
+			(Variable.find('(') == std::string::npos) != (Variable.find(')') == std::string::npos)) {
+			i++;
+			continue;
+		}
+		uint32_t dwOffset = (uint32_t) i;
+		uint32_t dwID = GetCallbackID(Variable);
+		for (int k = 0; k < 4; k++)
+			Table += (char) (dwOffset >> (8 * k));
+		for (int k = 0; k < 4; k++)
+			Table += (char) (dwID >> (8 * k));
+		i = j + 1;
+	}
+	return Table;
+}
+
+static bool Gzip(const std::string &In, std::string &Out)
+{
+	z_stream z;
+	char buf[4096];
+	int r;
+
+	memset(&z, 0, sizeof(z));
+	// 15 + 16: 32k window with a gzip header, as browsers expect for
+	// Content-Encoding: gzip
+	if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+	z.next_in = (Bytef *) In.data();
+	z.avail_in = (uInt) In.size();
+	Out.clear();
+	do {
+		z.next_out = (Bytef *) buf;
+		z.avail_out = sizeof(buf);
+		r = deflate(&z, Z_FINISH);
+		Out.append(buf, sizeof(buf) - z.avail_out);
+	} while (r == Z_OK);
+	deflateEnd(&z);
+	return r == Z_STREAM_END;
+}
+
+/*********************************************************************
+ * Image
+ ********************************************************************/
+
+static void PutWord(std::string &s, uint32_t w)
+{
+	s += (char) w;
+	s += (char) (w >> 8);
+}
+
+static void PutLong(std::string &s, uint32_t dw)
+{
+	PutWord(s, dw);
+	PutWord(s, dw >> 16);
+}
+
+static uint16_t ByteSumHash(const std::string &Name)
+{
+	uint16_t w = 0;
+	for (size_t i = 0; i < Name.size(); i++)
+		w += (unsigned char) Name[i];
+	return w;
+}
+
+static uint32_t FNVHash(const std::string &Name)
+{
+	uint32_t h = MPFS_FNV_OFFSET_BASIS;
+	for (size_t i = 0; i < Name.size(); i++) {
+		h ^= (unsigned char) Name[i];
+		h *= MPFS_FNV_PRIME;
+	}
+	return h;
+}
+
+static std::string BuildImage(std::vector<MPFS_FILE> &Files)
+{
+	std::map<std::string, uint32_t> Blobs;		// Data already placed, by content
+	std::vector<std::pair<uint32_t, uint16_t> > Index;
+	std::string Image, Data;
+	uint32_t dwStrings, dwData;
+	size_t n = Files.size();
+
+	dwStrings = 8 + (MPFS_FAT_RECORD_SIZE + MPFS_INDEX_ENTRY_SIZE) * n;
+	for (size_t i = 0; i < n; i++) {
+		Files[i].dwStringPtr = dwStrings;
+		dwStrings += Files[i].Name.size() + 1;
+	}
+	dwData = dwStrings;
+	for (size_t i = 0; i < n; i++) {
+		std::map<std::string, uint32_t>::const_iterator it = Blobs.find(Files[i].Data);
+		if (it != Blobs.end()) {
+			Files[i].dwDataPtr = it->second;
+			continue;
+		}
+		Files[i].dwDataPtr = dwData + Data.size();
+		Blobs[Files[i].Data] = Files[i].dwDataPtr;
+		Data += Files[i].Data;
+	}
+
+	Image = "MPFS";
+	Image += (char) 0x02;
+	Image += (char) 0x01;
+	PutWord(Image, n);
+	for (size_t i = 0; i < n; i++) {
+		PutWord(Image, ByteSumHash(Files[i].Name));
+		PutWord(Image, Files[i].wFlags);
+		PutLong(Image, Files[i].dwStringPtr);
+		PutLong(Image, Files[i].dwDataPtr);
+		PutLong(Image, Files[i].Data.size());
+		PutLong(Image, Files[i].dwTimestamp);
+		PutLong(Image, 0);
+		Index.push_back(std::make_pair(FNVHash(Files[i].Name), (uint16_t) i));
+	}
+	std::sort(Index.begin(), Index.end());
+	for (size_t i = 0; i < n; i++) {
+		PutLong(Image, Index[i].first);
+		PutWord(Image, Index[i].second);
+	}
+	for (size_t i = 0; i < n; i++) {
+		Image += Files[i].Name;
+		Image += '\0';
+	}
+	return Image + Data;
+}
+
+static bool WriteC(const char *szFile, const std::string &Image)
+{
+	FILE *f = fopen(szFile, "w");
+	char szDate[64];
+	time_t t = time(NULL);
+
+	if (!f) {
+		perror(szFile);
+		return false;
+	}
+	strftime(szDate, sizeof(szDate), "%A, %d %B %Y %H:%M:%S", localtime(&t));
+	fprintf(f,
+		"/***************************************************************\n"
+		" * %s\n"
+		" * Defines an MPFS2 image to be stored in program memory.\n"
+		" *\n"
+		" * NOT FOR HAND MODIFICATION\n"
+		" * This file is automatically generated by the MPFS2 Utility\n"
+		" * ALL MODIFICATIONS WILL BE OVERWRITTEN BY THE MPFS2 GENERATOR\n"
+		" * Generated %s\n"
+		" ***************************************************************/\n"
+		"\n"
+		"#define __MPFSIMG2_C\n"
+		"\n"
+		"#include \"TCPIP Stack/TCPIP.h\"\n"
+		"\n"
+		"#if defined(STACK_USE_MPFS2) && !defined(MPFS_USE_EEPROM)\n"
+		"\n"
+		"\n"
+		"/**************************************\n"
+		" * MPFS2 Image\n"
+		" **************************************/\n"
+		"ROM BYTE MPFS_Start[] =\n"
+		"{",
+		strrchr(szFile, '/') ? strrchr(szFile, '/') + 1 : szFile, szDate);
+	for (size_t i = 0; i < Image.size(); i++) {
+		if (i % 16 == 0)
+			fprintf(f, "\n\t");
+		fprintf(f, "0x%02x%s", (unsigned char) Image[i], i + 1 < Image.size() ? "," : "");
+	}
+	fprintf(f,
+		"\n};\n"
+		"\n"
+		"/**************************************************************\n"
+		" * End of MPFS\n"
+		" **************************************************************/\n"
+		"#endif // #if defined(STACK_USE_MPFS2) && !defined(MPFS_USE_EEPROM)\n");
+	fclose(f);
+	return true;
+}
+
+static bool WriteBinary(const char *szFile, const std::string &Image)
+{
+	FILE *f = fopen(szFile, "wb");
+
+	if (!f) {
+		perror(szFile);
+		return false;
+	}
+	if (fwrite(Image.data(), 1, Image.size(), f) != Image.size()) {
+		perror(szFile);
+		fclose(f);
+		return false;
+	}
+	return fclose(f) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *szHTTPPrint = NULL;
+	std::vector<MPFS_FILE> Files, Tables;
+	std::set<uint32_t> Placed;
+	std::string Image;
+	bool bC = false;
+	size_t iShared = 0;
+	int c;
+
+	ParseExtensions("htm,html,cgi,xml,json", DynamicExts);
+	ParseExtensions("inc,gif,png,jpg,jpeg,ico,zip,gz,bib", StoredExts);
+	while ((c = getopt(argc, argv, "ch:y:z:0v")) != -1) {
+		switch (c) {
+		case 'c': bC = true; break;
+		case 'h': szHTTPPrint = optarg; break;
+		case 'y': ParseExtensions(optarg, DynamicExts); break;
+		case 'z': ParseExtensions(optarg, StoredExts); break;
+		case '0': bCompress = false; break;
+		case 'v': bVerbose = true; break;
+		default: Usage();
+		}
+	}
+	if (argc - optind != 2)
+		Usage();
+	std::string Out(argv[optind + 1]);
+	if (Out.size() > 2 && Out.compare(Out.size() - 2, 2, ".c") == 0)
+		bC = true;
+
+	if (szHTTPPrint)
+		LoadCallbackIDs(szHTTPPrint);
+	if (!Walk(argv[optind], "", Files))
+		return 1;
+
+	for (size_t i = 0; i < Files.size(); i++) {
+		MPFS_FILE &f = Files[i];
+		std::string Ext = Extension(f.Name);
+		if (DynamicExts.count(Ext)) {
+			std::string Table = BuildCallbackTable(f);
+			if (Table.empty())
+				continue;
+			// The companion goes after all pages, as the MPFS2 Utility
+			// places it
+			MPFS_FILE t;
+			t.Name = f.Name.substr(0, f.Name.size() - 1) + "#";
+			t.Data = Table;
+			t.wFlags = 0;
+			t.dwTimestamp = f.dwTimestamp;
+			t.iOriginalSize = Table.size();
+			Tables.push_back(t);
+			f.wFlags |= MPFS2_FLAG_HASINDEX;
+		} else if (bCompress && !StoredExts.count(Ext)) {
+			std::string Zipped;
+			if (Gzip(f.Data, Zipped) && Zipped.size() < f.Data.size()) {
+				f.Data.swap(Zipped);
+				f.wFlags |= MPFS2_FLAG_ISZIPPED;
+			}
+		}
+	}
+	Files.insert(Files.end(), Tables.begin(), Tables.end());
+	if (Files.size() > 0xFFFEu) {
+		fprintf(stderr, "Too many files\n");
+		return 1;
+	}
+	for (size_t i = 0; i < Files.size(); i++) {
+		for (size_t k = 0; k < i; k++) {
+			if (Files[k].Name == Files[i].Name) {
+				fprintf(stderr, "%s: companion name clashes with a file\n", Files[i].Name.c_str());
+				return 1;
+			}
+		}
+	}
+
+	Image = BuildImage(Files);
+	for (size_t i = 0; i < Files.size(); i++) {
+		bool bShared = !Placed.insert(Files[i].dwDataPtr).second;
+		if (bShared)
+			iShared += Files[i].Data.size();
+		if (bVerbose)
+			fprintf(stderr, "%-40s %7u %7u%s%s%s\n", Files[i].Name.c_str(),
+				(unsigned int) Files[i].iOriginalSize, (unsigned int) Files[i].Data.size(),
+				Files[i].wFlags & MPFS2_FLAG_ISZIPPED ? " gzip" : "",
+				Files[i].wFlags & MPFS2_FLAG_HASINDEX ? " dynamic" : "",
+				bShared ? " shared" : "");
+	}
+	fprintf(stderr, "%u files, %u bytes (%u bytes shared)\n", (unsigned int) Files.size(),
+		(unsigned int) Image.size(), (unsigned int) iShared);
+
+	if (!(bC ? WriteC(Out.c_str(), Image) : WriteBinary(Out.c_str(), Image)))
+		return 1;
+	if (szHTTPPrint && !WriteHTTPPrint(szHTTPPrint))
+		return 1;
+	return 0;
+}
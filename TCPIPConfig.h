@@ -15,9 +15,18 @@
 #define STACK_USE_GENERIC_TCP_SERVER_EXAMPLE	// ToUpper server example in GenericTCPServer.c
 #define STACK_USE_ANNOUNCE						// Microchip Embedded Ethernet Device Discoverer server/client
 #define STACK_USE_NBNS							// NetBIOS Name Service Server
+#define STACK_USE_HTTP2_SERVER					// HTTP server with keep-alive, cookies and authentication
+#define STACK_USE_MPFS2							// File system for the web pages, MPFSImg2.c
+
+// Discovery requests with the 'M' opcode get the latest measurement,
+// its age, the uptime and FIRMWARE_VERSION appended (see Announce.h)
+#define STACK_USE_ANNOUNCE_READING
+#define ANNOUNCE_JITTER_MS				(16u)		// Default window discovery replies are spread over, by MAC address
+#define FIRMWARE_VERSION				(0x0100u)	// Major, minor
 
 #define MPFS_RESERVE_BLOCK              (8)
 #define MAX_MPFS_HANDLES				(7ul)
+#define MPFS_OPEN_CACHE_SIZE			(4u)		// Names MPFSOpen() remembers the FAT ID of
 
 /*
  * Following low level modules are automatically enabled/disabled based on high-level
@@ -108,13 +117,18 @@
 //
 
 #if defined(STACK_USE_TCP)
+	// Uncomment to keep every TCB resident in PIC RAM instead of 
+	// caching one at a time (see TCP.c).  Faster socket switching at 
+	// the cost of one TCB of PIC RAM per socket.
+//#define TCP_OPTIMIZE_FOR_SPEED
+
 	// Allocate how much total RAM (in bytes) you want to allocate 
 	// for use by your TCP TCBs, RX FIFOs, and TX FIFOs.  
 	// Sockets can be scattered across several different storage 
 	// mediums if you are out of space on one medium.
 #define TCP_ETH_RAM							32
 #define TCP_ETH_RAM_BASE_ADDRESS			(BASE_TCB_ADDR)
-#define TCP_ETH_RAM_SIZE					3600
+#define TCP_ETH_RAM_SIZE					(RAMSIZE - MAC_RX_BUFFER_SIZE - MAC_TX_BUFFER_COUNT*MAC_TX_SLOT_SIZE - RESERVED_HTTP_MEMORY - RESERVED_SSL_MEMORY)
 #define TCP_PIC_RAM							1
 #define TCP_PIC_RAM_BASE_ADDRESS			((PTR_BASE)&TCPBufferInPIC[0])
 #define TCP_PIC_RAM_SIZE					32
@@ -135,6 +149,7 @@
 #define TCP_PURPOSE_TCP_PERFORMANCE_RX		7
 #define TCP_PURPOSE_UART_2_TCP_BRIDGE		8
 #define TCP_PURPOSE_MP3_CLIENT				9
+#define TCP_PURPOSE_HTTP_SERVER				10
 
 #if defined(__TCP_C)
 		// Define how many sockets are needed, what type they are,
@@ -143,29 +158,50 @@
 		// initializer bigger or smaller defines how many total TCP
 		// sockets are available.
 		// Each socket requires up to 48 bytes of PIC RAM and 
-		// 40+(TX FIFO size)+(RX FIFO size) bytes bytes of 
+		// 51+(TX FIFO size)+(RX FIFO size) bytes bytes of 
 		// TCP_*_RAM each.
 		// Note: The RX FIFO must be at least 1 byte in order to 
 		// receive SYN and FIN messages required by TCP.  The TX 
 		// FIFO can be zero if desired.
+		// Sockets of modules that aren't built take no RAM.  TCPInit() 
+		// locks up if the rest outgrows TCP_ETH_RAM_SIZE.
 const struct {
 	unsigned char vSocketPurpose;
 	unsigned char vMemoryMedium;
 	WORD wTXBufferSize;
 	WORD wRXBufferSize;
 } TCPSocketInitializer[] = {
+#if defined(STACK_USE_GENERIC_TCP_CLIENT_EXAMPLE)
+	{
+	TCP_PURPOSE_GENERIC_TCP_CLIENT, TCP_ETH_RAM, 125, 200},
+#endif
+	{
+	TCP_PURPOSE_GENERIC_TCP_SERVER, TCP_ETH_RAM, 20, 20},
+#if defined(STACK_USE_TELNET_SERVER)
 	{
-	TCP_PURPOSE_GENERIC_TCP_CLIENT, TCP_ETH_RAM, 125, 200}, {
-	TCP_PURPOSE_GENERIC_TCP_SERVER, TCP_ETH_RAM, 20, 20}, {
 	TCP_PURPOSE_TELNET, TCP_ETH_RAM, 150, 20},
+#endif
+#if defined(STACK_USE_TCP_PERFORMANCE_TEST)
+	// Two lines of TCPTXPerformanceTask() output.  Its API benchmark 
+	// takes one of the TCP_PURPOSE_DEFAULT sockets below.
+	{
+	TCP_PURPOSE_TCP_PERFORMANCE_TX, TCP_ETH_RAM, 160, 1},
+#endif
+#if defined(STACK_USE_HTTP2_SERVER)
+	// One per MAX_HTTP_CONNECTIONS.  HTTP2 moves the boundary between 
+	// the FIFOs as the request is read and the response written 
+	// (TCPAdjustFIFOSize()).
 	{
-	TCP_PURPOSE_TCP_PERFORMANCE_TX, TCP_ETH_RAM, 256, 1},
+	TCP_PURPOSE_HTTP_SERVER, TCP_ETH_RAM, 200, 200}, {
+	TCP_PURPOSE_HTTP_SERVER, TCP_ETH_RAM, 200, 200},
+#else
 	{
-	TCP_PURPOSE_UART_2_TCP_BRIDGE, TCP_ETH_RAM, 256, 256},
+	TCP_PURPOSE_DEFAULT, TCP_ETH_RAM, 200, 200},
+#endif
+	// TCPServer() in ServidorTCP.c takes one of these
 	{
 	TCP_PURPOSE_DEFAULT, TCP_ETH_RAM, 200, 200}, {
 	TCP_PURPOSE_DEFAULT, TCP_ETH_RAM, 200, 200}, {
-	TCP_PURPOSE_DEFAULT, TCP_ETH_RAM, 200, 200}, {
 	TCP_PURPOSE_DEFAULT, TCP_ETH_RAM, 200, 200},
 };
 		// If PIC RAM is used to store TCP socket FIFOs and TCBs, 
@@ -187,13 +223,85 @@ static unsigned char TCPBufferInPIC[TCP_PIC_RAM_SIZE]
 // Maximum avaialble UDP Sockets
 #define MAX_UDP_SOCKETS     (5ul)
 
+//
+// UDP receive queues
+//
+// Received datagrams stay in the RX ring until the application reads 
+// them: up to UDP_RX_QUEUE_DEPTH per socket and MAC_RX_HOLD_SLOTS for 
+// all sockets together.  A held datagram keeps the ring space after it 
+// from being reused, so while fewer than UDP_RX_QUEUE_MIN_FREE bytes of 
+// the ring are free the oldest datagrams are dropped, and new ones too if 
+// that does not make room.
+//
+#define UDP_RX_QUEUE_DEPTH		(2u)
+#define MAC_RX_HOLD_SLOTS		(4u)
+#define UDP_RX_QUEUE_MIN_FREE	(MAC_RX_BUFFER_SIZE/4)
+
+//
+// Ethernet RAM plan (8kB).  The RX ring and the transmit slots are sized 
+// here; the TCP socket area (TCP_ETH_RAM_SIZE) gets whatever is left.
+// With two or more TX slots a frame can be built while the previous one 
+// is still on the wire.  Each slot takes 1522 bytes.
+//
+#define MAC_RX_BUFFER_SIZE		(2048ul)	// Even, at least 1400
+#define MAC_TX_BUFFER_COUNT		2
+
+//
+// Ethernet receive filter profile
+//
+// MAC_RX_FILTER_OPEN		Unicast and every broadcast (hardware default).
+// MAC_RX_FILTER_SERVICES	Unicast, multicast groups registered with 
+//							SetRXHashTableEntry() and only the broadcasts 
+//							the stack answers: ARP requests for our IP and 
+//							UDP to the Announce (30303), NBNS (137) and, 
+//							with STACK_USE_DHCP_CLIENT, DHCP client (68) 
+//							ports.  Other broadcasts are dropped in 
+//							MACGetHeader() before any protocol code parses 
+//							them (see StackIsWantedBroadcast()).
+// MAC_RX_FILTER_STRICT		Unicast, registered multicast groups and ARP 
+//							requests for our IP, all filtered in hardware.  
+//							Broadcast discovery and NetBIOS name queries 
+//							are no longer answered.
+#define MAC_RX_FILTER_OPEN			0
+#define MAC_RX_FILTER_SERVICES		1
+#define MAC_RX_FILTER_STRICT		2
+#define MAC_RX_FILTER_PROFILE		MAC_RX_FILTER_SERVICES
+
+//
+// StackTask() receive scheduling
+//
+// Each call handles at most STACK_RX_BUDGET frames and then returns, so 
+// the application tasks keep running through a flood.  While fewer than 
+// STACK_RX_DRAIN_WATERMARK bytes of the RX ring are free the budget is 
+// ignored: the alternative is the hardware dropping frames.
+//
+#define STACK_RX_BUDGET				(4u)
+#define STACK_RX_DRAIN_WATERMARK	(MAC_RX_BUFFER_SIZE/2)
+
 // 
 // HTTP2 Server options
 //
 
 // Maximum numbers of simultaneous HTTP connections allowed.
-// Each connection consumes 2 bytes of RAM and a TCP socket
-#define MAX_HTTP_CONNECTIONS	(1ul)
+// Each connection takes a TCP_PURPOSE_HTTP_SERVER socket from
+// TCPSocketInitializer[] above and sizeof(HTTP_CONN) of Ethernet RAM
+// (RESERVED_HTTP_MEMORY); keep the two in step.
+// A kept-alive connection holds its socket between requests, so
+// leave a second one for the browser's parallel fetches.
+#define MAX_HTTP_CONNECTIONS	(2ul)
+
+// File served for a directory, and the length of the longer of the 
+// two names (buffer overrun protection)
+#define HTTP_DEFAULT_FILE		"index.htm"
+#define HTTPS_DEFAULT_FILE		"index.htm"
+#define HTTP_DEFAULT_LEN		(10u)
+
+// Optional HTTP server features
+#define HTTP_USE_POST					// POSTed forms, protect/config.htm
+#define HTTP_USE_COOKIES
+#define HTTP_USE_AUTHENTICATION			// Pages under protect/ ask for a password
+#define HTTP_MPFS_UPLOAD		"mpfsupload"	// Web page upload, needs MPFS_USE_EEPROM
+//#define MPFS_WRITE_WHOLE_AREA			// Upload images larger than a slot, losing the old site meanwhile (MPFS2.h)
 
 
 #endif
@@ -0,0 +1 @@
+~reboot~
\ No newline at end of file